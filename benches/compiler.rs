@@ -0,0 +1,226 @@
+//! # Compiler benchmarks
+//!
+//! `cargo bench` times each front-end phase and the code generators on
+//! synthetic programs of 10k, 100k and 1M lines and on `examples/*.yaf`.
+//!
+//! Before timing, every input is compiled once with pass timing enabled and
+//! the per-phase breakdown (the same table as `yaf compile --time-passes`)
+//! is printed. Allocation counts are deterministic, so they gate regressions:
+//!
+//! - `YAF_BENCH_SAVE_BASELINE=<file>` writes the counts as JSON.
+//! - `YAF_BENCH_BASELINE=<file>` fails the run when a phase allocates more
+//!   than `ALLOCATION_TOLERANCE` above the saved count.
+//!
+//! Time regressions use criterion's own baselines
+//! (`cargo bench -- --save-baseline main`, then `--baseline main`).
+
+use criterion::{BenchmarkId, Criterion, Throughput};
+use std::collections::BTreeMap;
+use std::hint::black_box;
+use std::path::Path;
+use yaf_language::backend::c::CodeGenerator;
+use yaf_language::core::{Lexer, Optimizer, Parser, Program, TokenInfo, TypeChecker};
+use yaf_language::timing::{CountingAllocator, PassTimings};
+
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
+
+/// Allowed growth of the allocation count of a phase over the baseline
+const ALLOCATION_TOLERANCE: f64 = 0.10;
+
+/// Sizes of the synthetic programs, in lines
+const SYNTHETIC_LINES: &[usize] = &[10_000, 100_000, 1_000_000];
+
+struct Input {
+    name: String,
+    source: String,
+}
+
+impl Input {
+    fn lines(&self) -> u64 {
+        self.source.lines().count() as u64
+    }
+}
+
+fn main() {
+    let inputs = inputs();
+
+    let mut counts = BTreeMap::new();
+    for input in &inputs {
+        let timings = profile(input);
+        println!("{} ({} lines)\n{}\n", input.name, input.lines(), timings.report());
+        for pass in timings.passes() {
+            counts.insert(format!("{}/{}", input.name, pass.name), pass.allocations);
+        }
+    }
+    check_allocations(&counts);
+
+    let mut criterion = Criterion::default().configure_from_args();
+    bench_phases(&mut criterion, &inputs);
+    criterion.final_summary();
+}
+
+fn inputs() -> Vec<Input> {
+    let mut inputs: Vec<Input> = SYNTHETIC_LINES.iter()
+        .map(|&lines| Input { name: format!("synthetic_{}k", lines / 1000), source: synthetic_program(lines) })
+        .collect();
+
+    let examples = Path::new(env!("CARGO_MANIFEST_DIR")).join("examples");
+    let mut paths: Vec<_> = std::fs::read_dir(&examples)
+        .expect("examples directory")
+        .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+        .filter(|path| path.extension().is_some_and(|extension| extension == "yaf"))
+        .collect();
+    paths.sort();
+    for path in paths {
+        let name = path.file_stem().unwrap().to_string_lossy().into_owned();
+        let source = std::fs::read_to_string(&path).expect("readable example");
+        inputs.push(Input { name, source });
+    }
+    inputs
+}
+
+// A program of about `lines` lines: blocks of functions with loops,
+// conditionals, integer arithmetic and string concatenation, all called
+// from main so the whole program is reachable.
+fn synthetic_program(lines: usize) -> String {
+    const BLOCK: &str = "\
+func sum_{n}(limit: int) -> int {
+    total = 0
+    i = 0
+    while i < limit {
+        if i % 3 == 0 {
+            total = total + i * {n}
+        } else {
+            total = total - 1
+        }
+        i = i + 1
+    }
+    return total
+}
+
+func label_{n}(name: string) -> string {
+    return \"item {n}: \" + name + \"!\"
+}
+
+";
+    let block_lines = BLOCK.lines().count() + 2;
+    let blocks = (lines / block_lines).max(1);
+
+    let mut source = String::with_capacity(lines * 24);
+    for n in 0..blocks {
+        source.push_str(&BLOCK.replace("{n}", &n.to_string()));
+    }
+    source.push_str("func main() {\n");
+    for n in 0..blocks {
+        source.push_str(&format!("    print(sum_{n}(10))\n    print(label_{n}(\"x\"))\n"));
+    }
+    source.push_str("}\n");
+    source
+}
+
+fn lex(source: &str) -> Vec<TokenInfo> {
+    Lexer::new(source).tokenize().expect("lexes")
+}
+
+fn parse(tokens: Vec<TokenInfo>) -> Program {
+    Parser::new(tokens).parse().expect("parses")
+}
+
+fn typecheck(ast: &Program) {
+    TypeChecker::new().check(ast).expect("typechecks")
+}
+
+fn fold(ast: Program) -> Program {
+    Optimizer::new().optimize(ast)
+}
+
+fn generate_c(ast: &Program) -> String {
+    CodeGenerator::new().generate(ast).expect("generates C")
+}
+
+#[cfg(feature = "llvm-backend")]
+fn generate_llvm(ast: &Program) {
+    use inkwell::context::Context;
+    use inkwell::OptimizationLevel;
+    use yaf_language::backend::llvm::LLVMCodeGenerator;
+
+    let context = Context::create();
+    let mut codegen = LLVMCodeGenerator::new(&context, "bench", OptimizationLevel::None);
+    codegen.generate(ast).expect("generates LLVM IR");
+}
+
+// One measured run of every phase
+fn profile(input: &Input) -> PassTimings {
+    let mut timings = PassTimings::new(true);
+    let tokens = timings.time("lex", || lex(&input.source));
+    let ast = timings.time("parse", || parse(tokens));
+    timings.time("typecheck", || typecheck(&ast));
+    let ast = timings.time("fold", || fold(ast));
+    timings.time("codegen-c", || drop(generate_c(&ast)));
+    #[cfg(feature = "llvm-backend")]
+    timings.time("codegen-llvm", || generate_llvm(&ast));
+    timings
+}
+
+fn check_allocations(counts: &BTreeMap<String, u64>) {
+    if let Ok(path) = std::env::var("YAF_BENCH_SAVE_BASELINE") {
+        let json = serde_json::to_string_pretty(counts).expect("serializable counts");
+        std::fs::write(&path, json).unwrap_or_else(|err| panic!("cannot write {}: {}", path, err));
+        println!("Saved allocation baseline to {}", path);
+    }
+
+    let Ok(path) = std::env::var("YAF_BENCH_BASELINE") else {
+        return;
+    };
+    let json = std::fs::read_to_string(&path).unwrap_or_else(|err| panic!("cannot read {}: {}", path, err));
+    let baseline: BTreeMap<String, u64> = serde_json::from_str(&json).expect("valid baseline");
+
+    let mut regressions = Vec::new();
+    for (phase, &count) in counts {
+        if let Some(&before) = baseline.get(phase) {
+            if count as f64 > before as f64 * (1.0 + ALLOCATION_TOLERANCE) {
+                regressions.push(format!("  {}: {} -> {} allocations", phase, before, count));
+            }
+        }
+    }
+    if !regressions.is_empty() {
+        eprintln!("Allocation regressions against {}:\n{}", path, regressions.join("\n"));
+        std::process::exit(1);
+    }
+    println!("No allocation regressions against {}", path);
+}
+
+fn bench_phases(criterion: &mut Criterion, inputs: &[Input]) {
+    let mut group = criterion.benchmark_group("compiler");
+    for input in inputs {
+        let lines = input.lines();
+        // The large programs take seconds per iteration
+        group.sample_size(if lines >= 100_000 { 10 } else { 50 });
+        group.throughput(Throughput::Elements(lines));
+
+        let tokens = lex(&input.source);
+        let ast = parse(tokens.clone());
+
+        group.bench_with_input(BenchmarkId::new("lex", &input.name), &input.source, |b, source| {
+            b.iter(|| lex(black_box(source)))
+        });
+        group.bench_with_input(BenchmarkId::new("parse", &input.name), &tokens, |b, tokens| {
+            b.iter_batched(|| tokens.clone(), parse, criterion::BatchSize::LargeInput)
+        });
+        group.bench_with_input(BenchmarkId::new("typecheck", &input.name), &ast, |b, ast| {
+            b.iter(|| typecheck(black_box(ast)))
+        });
+        group.bench_with_input(BenchmarkId::new("fold", &input.name), &ast, |b, ast| {
+            b.iter_batched(|| ast.clone(), fold, criterion::BatchSize::LargeInput)
+        });
+        group.bench_with_input(BenchmarkId::new("codegen-c", &input.name), &ast, |b, ast| {
+            b.iter(|| generate_c(black_box(ast)))
+        });
+        #[cfg(feature = "llvm-backend")]
+        group.bench_with_input(BenchmarkId::new("codegen-llvm", &input.name), &ast, |b, ast| {
+            b.iter(|| generate_llvm(black_box(ast)))
+        });
+    }
+    group.finish();
+}
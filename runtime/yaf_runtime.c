@@ -5,348 +5,4483 @@
 #include <math.h>
 #include <unistd.h>
 #include <time.h>
-#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+
+// Ends the program after a runtime error was reported (see yaf_run_guarded)
+static __attribute__((noreturn, cold)) void runtime_error_exit(void);
 
 // Helper function to check value types
-static void validate_type(YafValue val, uint8_t expected_type, const char* func_name) {
-    if (val.tag != expected_type) {
+static void validate_type(YafValue val, int32_t expected_type, const char* func_name) {
+    // Either string representation satisfies YAF_STRING
+    if (val.tag != expected_type && !(expected_type == YAF_STRING && val.tag == YAF_SMALL_STRING)) {
+        yaf_flush();
         fprintf(stderr, "Runtime error in %s: expected type %d, got %d\n", 
                 func_name, expected_type, val.tag);
-        exit(1);
+        runtime_error_exit();
     }
 }
 
-// Value construction functions
-YafValue yaf_make_int(int64_t value) {
-    YafValue val;
-    val.tag = YAF_INT;
-    val.value.int_val = value;
-    return val;
+// Strings are either heap objects (YAF_STRING) or, up to
+// YAF_SMALL_STRING_MAX bytes, stored inline in the value (YAF_SMALL_STRING).
+// These take the value by pointer because inline data lives inside it.
+static inline bool is_string(const YafValue* val) {
+    return val->tag == YAF_STRING || val->tag == YAF_SMALL_STRING;
 }
 
-YafValue yaf_make_float(double value) {
-    YafValue val;
-    val.tag = YAF_FLOAT;
-    val.value.float_val = value;
-    return val;
+static const char* string_data(const YafValue* val) {
+    if (val->tag == YAF_SMALL_STRING) {
+        return val->value.small_val;
+    }
+    return val->value.string_val ? val->value.string_val : "";
 }
 
-YafValue yaf_make_string(const char* value) {
-    YafValue val;
-    val.tag = YAF_STRING;
-    val.value.string_val = strdup(value ? value : "");
-    return val;
+static int64_t string_length(const YafValue* val) {
+    if (val->tag == YAF_SMALL_STRING) {
+        return (int64_t)strlen(val->value.small_val);
+    }
+    return yaf_string_len(val->value.string_val);
 }
 
-YafValue yaf_make_bool(int value) {
-    YafValue val;
-    val.tag = YAF_BOOL;
-    val.value.bool_val = value != 0;
-    return val;
+// Memory management
+//
+// Small objects come from a bump-pointer nursery carved out of large chunks
+// (like StackAllocator in src/runtime/memory.rs); freed blocks go to a free
+// list per size class (like MemoryPool) and are reused before bumping again.
+// Objects larger than the biggest size class go straight to malloc.
+//
+// The nursery, the free lists, the accounting and the root stack are per
+// thread (YafTlab), so allocating never synchronizes; only taking a fresh
+// chunk locks, and only while a parallel loop runs. Freed blocks go to the
+// free list of whichever thread frees them.
+#define YAF_CHUNK_SIZE        (256 * 1024)
+#define YAF_MIN_BLOCK_SHIFT   4                     // 16 bytes
+#define YAF_SIZE_CLASS_COUNT  8                     // 16 .. 2048 bytes
+#define YAF_MAX_SMALL_SIZE    ((size_t)1 << (YAF_MIN_BLOCK_SHIFT + YAF_SIZE_CLASS_COUNT - 1))
+#define YAF_DEFAULT_GC_THRESHOLD (8 * 1024 * 1024)
+
+typedef struct YafFreeBlock {
+    struct YafFreeBlock* next;
+} YafFreeBlock;
+
+typedef struct YafChunk {
+    struct YafChunk* next;
+    size_t size;
+} YafChunk;
+
+// Every collectable object is preceded by this header. The intrusive list
+// lets the sweep walk all objects and lets a refcount drop unlink in O(1).
+typedef struct YafGcHeader {
+    struct YafGcHeader* next;
+    struct YafGcHeader* prev;
+    size_t size;        // whole allocation, header included
+    uint32_t kind;      // YAF_STRING, YAF_ARRAY, YAF_MAP, YAF_GC_CELL
+    uint16_t marked;
+    uint16_t owner;     // list it is on: 0 for yaf_heap.objects, else a YafTlab's
+} YafGcHeader;
+
+#define GC_HEADER(p) ((YafGcHeader*)(p) - 1)
+
+// `marked` of a frame object (see Frame objects): not on any object list
+#define GC_FRAME_OBJECT 2
+
+// Thread-local allocation buffer and the rest of a thread's heap state
+typedef struct {
+    // Nursery
+    char* bump;
+    char* limit;
+    YafFreeBlock* free_lists[YAF_SIZE_CLASS_COUNT];
+    
+    // Accounting, summed over threads by yaf_memory_stats
+    int64_t bytes_since_collect;
+    int64_t bytes_in_use;
+    int64_t total_allocated;
+    int64_t allocation_count;
+    
+    // Roots: addresses of YafValue slots, pushed and popped in LIFO order
+    int64_t* roots;
+    int64_t root_count;
+    int64_t root_capacity;
+    
+    // Objects allocated while running a parallel loop, moved to
+    // yaf_heap.objects when the loop ends
+    YafGcHeader* objects;
+    int64_t object_count;
+    uint16_t owner;     // worker index + 1 inside a parallel loop, else 0
+    
+    // Output of the thread in a parallel loop, handed to the shared buffer
+    // a line at a time
+    char* out;
+    size_t out_length;
+    size_t out_capacity;
+} YafTlab;
+
+static _Thread_local YafTlab yaf_tlab;
+
+typedef struct {
+    pthread_mutex_t lock;   // chunk list, while a parallel loop runs
+    YafChunk* chunks;
+    int64_t chunk_count;
+    int64_t collections;
+    int64_t threshold;
+    
+    // Collectable objects
+    YafGcHeader* objects;
+    int64_t object_count;
+    int64_t bytes_freed;
+} YafHeap;
+
+static YafHeap yaf_heap = { .lock = PTHREAD_MUTEX_INITIALIZER, .threshold = YAF_DEFAULT_GC_THRESHOLD };
+
+// Set while worker threads run a parallel loop (see yaf_parallel_for), and
+// only changed when they are idle. Until then the runtime is single-threaded
+// and skips every atomic operation and lock.
+static bool yaf_parallel;
+
+// Heap state of every thread (see Parallel loops)
+static int tlab_count(void);
+static YafTlab* tlab_at(int index);
+static int64_t gc_collect_parallel(void);
+static int64_t gc_collect_parallel_if_needed(void);
+
+// Caches of @memo functions are roots too (see Memoization)
+static void gc_mark_memos(void);
+
+// A --profile build charges each allocation to the running function (see
+// Profiling). NULL in other builds and on worker threads.
+typedef struct ProfFunction ProfFunction;
+static _Thread_local ProfFunction* prof_current;
+static void prof_count_allocation(size_t size);
+
+static void out_of_memory(size_t size) {
+    fprintf(stderr, "Runtime error: out of memory allocating %zu bytes\n", size);
+    exit(1);
 }
 
-YafValue yaf_make_void(void) {
-    YafValue val;
-    val.tag = YAF_INT;  // Use INT with value 0 for void
-    val.value.int_val = 0;
-    return val;
+// The REPL runs its entries in its own process under yaf_run_guarded: a
+// runtime error there returns from it instead of exiting. Errors on worker
+// threads, or while they run a parallel loop, still exit.
+static _Thread_local jmp_buf* runtime_guard;
+
+static void runtime_error_exit(void) {
+    if (runtime_guard && !yaf_parallel) {
+        longjmp(*runtime_guard, 1);
+    }
+    exit(1);
 }
 
-// Type conversion functions
-YafValue yaf_value_to_string(YafValue value) {
-    char buffer[64];
-    switch (value.tag) {
-        case YAF_INT:
-            snprintf(buffer, sizeof(buffer), "%lld", value.value.int_val);
-            return yaf_make_string(buffer);
-        case YAF_FLOAT:
-            snprintf(buffer, sizeof(buffer), "%g", value.value.float_val);
-            return yaf_make_string(buffer);
-        case YAF_STRING:
-            return yaf_make_string(value.value.string_val);
-        case YAF_BOOL:
-            return yaf_make_string(value.value.bool_val ? "true" : "false");
-        default:
-            return yaf_make_string("unknown");
+// Runs `entry` and returns its result, or 1 after a runtime error. The roots
+// it pushed are popped either way.
+int32_t yaf_run_guarded(int32_t (*entry)(void)) {
+    jmp_buf guard;
+    jmp_buf* outer = runtime_guard;
+    int64_t depth = yaf_gc_root_depth();
+    volatile int32_t status = 1;
+    if (setjmp(guard) == 0) {
+        runtime_guard = &guard;
+        status = entry();
     }
+    runtime_guard = outer;
+    yaf_gc_unwind_roots(depth);
+    return status;
 }
 
-YafValue yaf_value_to_int(YafValue value) {
-    switch (value.tag) {
-        case YAF_INT:
-            return value;
-        case YAF_FLOAT:
-            return yaf_make_int((int64_t)value.value.float_val);
-        case YAF_STRING:
-            return yaf_make_int(strtoll(value.value.string_val, NULL, 10));
-        case YAF_BOOL:
-            return yaf_make_int(value.value.bool_val ? 1 : 0);
-        default:
-            return yaf_make_int(0);
+static inline int size_class_of(size_t size) {
+    size_t block = (size_t)1 << YAF_MIN_BLOCK_SHIFT;
+    int index = 0;
+    while (block < size) {
+        block <<= 1;
+        index++;
     }
+    return index;
 }
 
-YafValue yaf_value_to_float(YafValue value) {
-    switch (value.tag) {
-        case YAF_INT:
-            return yaf_make_float((double)value.value.int_val);
-        case YAF_FLOAT:
-            return value;
-        case YAF_STRING:
-            return yaf_make_float(strtod(value.value.string_val, NULL));
-        case YAF_BOOL:
-            return yaf_make_float(value.value.bool_val ? 1.0 : 0.0);
-        default:
-            return yaf_make_float(0.0);
+static char* nursery_refill(YafTlab* tlab, size_t size) {
+    YafChunk* chunk = malloc(YAF_CHUNK_SIZE);
+    if (!chunk) {
+        out_of_memory(size);
+    }
+    chunk->size = YAF_CHUNK_SIZE;
+    bool locked = yaf_parallel;
+    if (locked) {
+        pthread_mutex_lock(&yaf_heap.lock);
     }
+    chunk->next = yaf_heap.chunks;
+    yaf_heap.chunks = chunk;
+    yaf_heap.chunk_count++;
+    if (locked) {
+        pthread_mutex_unlock(&yaf_heap.lock);
+    }
+    // The chunk header is kept 16-byte aligned so every block is too
+    tlab->bump = (char*)chunk + ((sizeof(YafChunk) + 15) & ~(size_t)15);
+    tlab->limit = (char*)chunk + YAF_CHUNK_SIZE;
+    
+    char* block = tlab->bump;
+    tlab->bump += size;
+    return block;
 }
 
-void yaf_free_value(YafValue* value) {
-    if (value->tag == YAF_STRING && value->value.string_val) {
-        free(value->value.string_val);
-        value->value.string_val = NULL;
+void* yaf_alloc(size_t size) {
+    YafTlab* tlab = &yaf_tlab;
+    tlab->allocation_count++;
+    if (prof_current) {
+        prof_count_allocation(size);
+    }
+    
+    if (size > YAF_MAX_SMALL_SIZE) {
+        void* ptr = malloc(size);
+        if (!ptr) {
+            out_of_memory(size);
+        }
+        tlab->bytes_since_collect += size;
+        tlab->bytes_in_use += size;
+        tlab->total_allocated += size;
+        return ptr;
+    }
+    
+    int index = size_class_of(size);
+    size_t block_size = (size_t)1 << (YAF_MIN_BLOCK_SHIFT + index);
+    tlab->bytes_since_collect += block_size;
+    tlab->bytes_in_use += block_size;
+    tlab->total_allocated += block_size;
+    
+    // Reuse a freed block of the same class first
+    YafFreeBlock* free_block = tlab->free_lists[index];
+    if (free_block) {
+        tlab->free_lists[index] = free_block->next;
+        return free_block;
     }
+    
+    // Otherwise it is just a pointer bump
+    if ((size_t)(tlab->limit - tlab->bump) >= block_size) {
+        char* block = tlab->bump;
+        tlab->bump += block_size;
+        return block;
+    }
+    return nursery_refill(tlab, block_size);
 }
 
-void yaf_print_value(YafValue value) {
-    yaf_print_value_no_newline(value);
-    printf("\n");
+void yaf_dealloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return;
+    }
+    YafTlab* tlab = &yaf_tlab;
+    if (size > YAF_MAX_SMALL_SIZE) {
+        tlab->bytes_in_use -= size;
+        free(ptr);
+        return;
+    }
+    int index = size_class_of(size);
+    tlab->bytes_in_use -= (int64_t)1 << (YAF_MIN_BLOCK_SHIFT + index);
+    YafFreeBlock* block = ptr;
+    block->next = tlab->free_lists[index];
+    tlab->free_lists[index] = block;
 }
 
-void yaf_print_value_no_newline(YafValue value) {
+// Inside a parallel loop each thread links its new objects into its own list
+static void gc_link(YafGcHeader* header, size_t size, uint32_t kind) {
+    YafGcHeader** objects = yaf_tlab.owner ? &yaf_tlab.objects : &yaf_heap.objects;
+    header->size = size;
+    header->kind = kind;
+    header->marked = 0;
+    header->owner = yaf_tlab.owner;
+    header->prev = NULL;
+    header->next = *objects;
+    if (*objects) {
+        (*objects)->prev = header;
+    }
+    *objects = header;
+    if (yaf_tlab.owner) {
+        yaf_tlab.object_count++;
+    } else {
+        yaf_heap.object_count++;
+    }
+}
+
+void* yaf_gc_alloc(size_t size, uint32_t kind) {
+    YafGcHeader* header = yaf_alloc(sizeof(YafGcHeader) + size);
+    gc_link(header, sizeof(YafGcHeader) + size, kind);
+    return header + 1;
+}
+
+static void gc_unlink(YafGcHeader* header) {
+    YafTlab* list_owner = header->owner ? tlab_at(header->owner - 1) : NULL;
+    if (header->prev) {
+        header->prev->next = header->next;
+    } else if (list_owner) {
+        list_owner->objects = header->next;
+    } else {
+        yaf_heap.objects = header->next;
+    }
+    if (header->next) {
+        header->next->prev = header->prev;
+    }
+    if (list_owner) {
+        list_owner->object_count--;
+    } else {
+        yaf_heap.object_count--;
+    }
+}
+
+// Memory-mapped strings (see yaf_io_read_file) carry their header at the
+// end of the page right before the file data; the whole mapping goes at once.
+static size_t page_size(void) {
+    static size_t size;     // threads may race to set it, to the same value
+    size_t cached = __atomic_load_n(&size, __ATOMIC_RELAXED);
+    if (!cached) {
+        cached = (size_t)sysconf(_SC_PAGESIZE);
+        __atomic_store_n(&size, cached, __ATOMIC_RELAXED);
+    }
+    return cached;
+}
+
+static bool gc_is_mapped(const YafGcHeader* header) {
+    return header->kind == YAF_STRING &&
+           (((const YafString*)(header + 1))->flags & YAF_STR_MAPPED);
+}
+
+static void gc_unmap(YafGcHeader* header) {
+    char* base = ((YafString*)(header + 1))->data - page_size();
+    yaf_tlab.bytes_in_use -= (int64_t)header->size;
+    munmap(base, header->size);
+}
+
+static void gc_release(YafGcHeader* header) {
+    if (gc_is_mapped(header)) {
+        gc_unmap(header);
+    } else {
+        yaf_dealloc(header, header->size);
+    }
+}
+
+void yaf_gc_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    YafGcHeader* header = GC_HEADER(ptr);
+    // In a parallel loop a thread only unlinks from its own list; anything
+    // else that dies there is left to the next collection
+    if (yaf_parallel && header->owner != yaf_tlab.owner) {
+        return;
+    }
+    gc_unlink(header);
+    gc_release(header);
+}
+
+// Memory obtained outside yaf_alloc (e.g. by generated code) is only
+// accounted for, so it still counts towards the collection threshold
+void yaf_gc_register_allocation(int64_t address, int64_t size, int32_t type) {
+    (void)address;
+    (void)type;
+    yaf_tlab.allocation_count++;
+    yaf_tlab.bytes_since_collect += size;
+    yaf_tlab.total_allocated += size;
+}
+
+// Each thread has its own root stack; the collector scans all of them
+void yaf_gc_add_root(int64_t address) {
+    YafTlab* tlab = &yaf_tlab;
+    if (tlab->root_count == tlab->root_capacity) {
+        int64_t capacity = tlab->root_capacity ? tlab->root_capacity * 2 : 256;
+        int64_t* roots = realloc(tlab->roots, (size_t)capacity * sizeof(int64_t));
+        if (!roots) {
+            out_of_memory((size_t)capacity * sizeof(int64_t));
+        }
+        tlab->roots = roots;
+        tlab->root_capacity = capacity;
+    }
+    tlab->roots[tlab->root_count++] = address;
+}
+
+void yaf_gc_remove_root(int64_t address) {
+    YafTlab* tlab = &yaf_tlab;
+    // Roots are almost always removed in reverse order, so search from the top
+    for (int64_t i = tlab->root_count - 1; i >= 0; i--) {
+        if (tlab->roots[i] == address) {
+            tlab->roots[i] = tlab->roots[--tlab->root_count];
+            return;
+        }
+    }
+}
+
+int64_t yaf_gc_root_depth(void) {
+    return yaf_tlab.root_count;
+}
+
+// Pops every root pushed since yaf_gc_root_depth returned `depth`
+// (both backends call this before each return of a function)
+void yaf_gc_unwind_roots(int64_t depth) {
+    if (depth >= 0 && depth < yaf_tlab.root_count) {
+        yaf_tlab.root_count = depth;
+    }
+}
+
+// Boxed array elements: a YafValue each, or a NaN-boxed word
+#ifdef YAF_NAN_BOXING
+typedef YafPacked YafElement;
+
+_Static_assert(sizeof(void*) == 8, "YAF_NAN_BOXING needs 64-bit pointers");
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "YAF_NAN_BOXING packs inline strings little-endian");
+
+// A value too wide for 48 bits, boxed on its own (GC kind of such cells)
+#define YAF_GC_CELL 16
+
+#define PACKED_INT_MIN (-((int64_t)1 << 47))
+#define PACKED_INT_MAX (((int64_t)1 << 47) - 1)
+
+static inline YafPacked pack_pointer(uint64_t tag, const void* ptr) {
+    return tag | (uint64_t)(uintptr_t)ptr;
+}
+
+static inline void* packed_pointer(YafPacked packed) {
+    return (void*)(uintptr_t)(packed & YAF_PACKED_PAYLOAD);
+}
+
+YafPacked yaf_pack_value(YafValue value) {
     switch (value.tag) {
+        case YAF_FLOAT: {
+            YafPacked bits;
+            double d = value.value.float_val;
+            if (d != d) {
+                return 0x7FF8000000000000ULL;
+            }
+            memcpy(&bits, &d, sizeof(bits));
+            return bits;
+        }
         case YAF_INT:
-            printf("%lld", value.value.int_val);
-            break;
-        case YAF_FLOAT:
-            printf("%g", value.value.float_val);
-            break;
-        case YAF_STRING:
-            printf("%s", value.value.string_val ? value.value.string_val : "");
+            if (value.value.int_val >= PACKED_INT_MIN && value.value.int_val <= PACKED_INT_MAX) {
+                return YAF_PACKED_INT | ((uint64_t)value.value.int_val & YAF_PACKED_PAYLOAD);
+            }
             break;
         case YAF_BOOL:
-            printf("%s", value.value.bool_val ? "true" : "false");
+            return YAF_PACKED_BOOL | (value.value.bool_val ? 1 : 0);
+        case YAF_STRING:
+            return pack_pointer(YAF_PACKED_STRING, value.value.string_val);
+        case YAF_ARRAY:
+            return pack_pointer(YAF_PACKED_ARRAY, value.value.array_val);
+        case YAF_MAP:
+            return pack_pointer(YAF_PACKED_MAP, value.value.map_val);
+        case YAF_SMALL_STRING:
+            // Zero-filled past the end, so the low 6 bytes are the whole string
+            if (value.value.small_val[YAF_PACKED_SMALL_STRING_MAX] == '\0') {
+                return YAF_PACKED_SMALL_STRING | ((uint64_t)value.value.int_val & YAF_PACKED_PAYLOAD);
+            }
             break;
         default:
-            printf("unknown");
             break;
     }
+    YafValue* cell = yaf_gc_alloc(sizeof(YafValue), YAF_GC_CELL);
+    *cell = value;
+    return pack_pointer(YAF_PACKED_CELL, cell);
 }
 
-// Math functions
-YafValue yaf_math_abs(YafValue value) {
-    switch (value.tag) {
-        case YAF_INT:
-            return yaf_make_int(llabs(value.value.int_val));
-        case YAF_FLOAT:
-            return yaf_make_float(fabs(value.value.float_val));
-        default:
-            return yaf_make_int(0);
+YafValue yaf_unpack_value(YafPacked packed) {
+    YafValue val;
+    val.value.int_val = 0;
+    switch (packed & YAF_PACKED_TAG_MASK) {
+        case YAF_PACKED_INT:
+            // Sign-extend the 48-bit payload
+            val.tag = YAF_INT;
+            val.value.int_val = (int64_t)(packed << 16) >> 16;
+            return val;
+        case YAF_PACKED_BOOL:
+            return yaf_make_bool((int)(packed & 1));
+        case YAF_PACKED_STRING:
+            val.tag = YAF_STRING;
+            val.value.string_val = packed_pointer(packed);
+            return val;
+        case YAF_PACKED_ARRAY:
+            val.tag = YAF_ARRAY;
+            val.value.array_val = packed_pointer(packed);
+            return val;
+        case YAF_PACKED_MAP:
+            val.tag = YAF_MAP;
+            val.value.map_val = packed_pointer(packed);
+            return val;
+        case YAF_PACKED_SMALL_STRING:
+            val.tag = YAF_SMALL_STRING;
+            val.value.int_val = (int64_t)(packed & YAF_PACKED_PAYLOAD);
+            return val;
+        case YAF_PACKED_CELL:
+            return *(YafValue*)packed_pointer(packed);
+        default: {
+            double d;
+            memcpy(&d, &packed, sizeof(d));
+            return yaf_make_float(d);
+        }
     }
 }
 
-YafValue yaf_math_max(YafValue a, YafValue b) {
-    if (a.tag == YAF_INT && b.tag == YAF_INT) {
-        return yaf_make_int(a.value.int_val > b.value.int_val ? a.value.int_val : b.value.int_val);
-    } else if (a.tag == YAF_FLOAT || b.tag == YAF_FLOAT) {
-        double a_val = (a.tag == YAF_FLOAT) ? a.value.float_val : (double)a.value.int_val;
-        double b_val = (b.tag == YAF_FLOAT) ? b.value.float_val : (double)b.value.int_val;
-        return yaf_make_float(a_val > b_val ? a_val : b_val);
-    }
-    return yaf_make_int(0);
+static inline YafValue element_load(const YafElement* element) {
+    return yaf_unpack_value(*element);
 }
 
-YafValue yaf_math_min(YafValue a, YafValue b) {
-    if (a.tag == YAF_INT && b.tag == YAF_INT) {
-        return yaf_make_int(a.value.int_val < b.value.int_val ? a.value.int_val : b.value.int_val);
-    } else if (a.tag == YAF_FLOAT || b.tag == YAF_FLOAT) {
-        double a_val = (a.tag == YAF_FLOAT) ? a.value.float_val : (double)a.value.int_val;
-        double b_val = (b.tag == YAF_FLOAT) ? b.value.float_val : (double)b.value.int_val;
-        return yaf_make_float(a_val < b_val ? a_val : b_val);
+static inline void element_store(YafElement* element, YafValue value) {
+    *element = yaf_pack_value(value);
+}
+#else
+typedef YafValue YafElement;
+
+static inline YafValue element_load(const YafElement* element) {
+    return *element;
+}
+
+static inline void element_store(YafElement* element, YafValue value) {
+    *element = value;
+}
+#endif
+
+static void gc_mark_value(const YafValue* value);
+
+static void gc_mark_element(const YafElement* element) {
+#ifdef YAF_NAN_BOXING
+    if ((*element & YAF_PACKED_TAG_MASK) == YAF_PACKED_CELL) {
+        YafValue* cell = packed_pointer(*element);
+        GC_HEADER(cell)->marked = 1;
+        gc_mark_value(cell);
+        return;
     }
-    return yaf_make_int(0);
+#endif
+    YafValue value = element_load(element);
+    gc_mark_value(&value);
 }
 
-YafValue yaf_math_pow(YafValue base, YafValue exp) {
-    double base_val = (base.tag == YAF_FLOAT) ? base.value.float_val : (double)base.value.int_val;
-    double exp_val = (exp.tag == YAF_FLOAT) ? exp.value.float_val : (double)exp.value.int_val;
-    return yaf_make_float(pow(base_val, exp_val));
+// Mark phase. Only heap tags are followed: static strings live in
+// read-only memory and carry no GC header.
+static void gc_mark_value(const YafValue* value) {
+    switch (value->tag) {
+        case YAF_STRING: {
+            char* data = value->value.string_val;
+            if (!data || (YAF_STRING_HEADER(data)->flags & YAF_STR_STATIC)) {
+                return;
+            }
+            GC_HEADER(YAF_STRING_HEADER(data))->marked = 1;
+            break;
+        }
+        case YAF_ARRAY: {
+            YafArray* array = value->value.array_val;
+            if (!array) {
+                return;
+            }
+            YafGcHeader* header = GC_HEADER(array);
+            if (header->marked == 1) {
+                return;
+            }
+            // Frame arrays keep GC_FRAME_OBJECT and are walked every time;
+            // nothing else references them, so they are never in a cycle
+            if (!header->marked) {
+                header->marked = 1;
+            }
+            // Unboxed numeric elements hold no references
+            if (array->elem_kind == YAF_ELEM_VALUE) {
+                YafElement* elements = array->data;
+                for (int64_t i = 0; i < array->length; i++) {
+                    gc_mark_element(&elements[i]);
+                }
+            }
+            break;
+        }
+        case YAF_MAP: {
+            YafMap* map = value->value.map_val;
+            if (!map) {
+                return;
+            }
+            YafGcHeader* header = GC_HEADER(map);
+            if (header->marked) {
+                return;
+            }
+            header->marked = 1;
+            for (int64_t i = 0; i < map->capacity; i++) {
+                if (map->entries[i].hash) {
+                    gc_mark_value(&map->entries[i].key);
+                    gc_mark_value(&map->entries[i].value);
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
 }
 
-// String functions
-YafValue yaf_string_length(YafValue s) {
-    validate_type(s, YAF_STRING, "string_length");
-    return yaf_make_int(strlen(s.value.string_val ? s.value.string_val : ""));
+static size_t array_element_size(uint32_t elem_kind) {
+    return elem_kind == YAF_ELEM_VALUE ? sizeof(YafElement) : sizeof(int64_t);
 }
 
-YafValue yaf_string_upper(YafValue s) {
-    validate_type(s, YAF_STRING, "string_upper");
-    const char* input = s.value.string_val ? s.value.string_val : "";
-    char* result = malloc(strlen(input) + 1);
-    for (size_t i = 0; input[i]; i++) {
-        result[i] = toupper(input[i]);
-    }
-    result[strlen(input)] = '\0';
-    YafValue val = yaf_make_string(result);
-    free(result);
-    return val;
+// Objects owning memory outside their own block release it here
+static void gc_finalize(YafGcHeader* header) {
+    if (header->kind == YAF_ARRAY) {
+        YafArray* array = (YafArray*)(header + 1);
+        yaf_dealloc(array->data, (size_t)array->capacity * array_element_size(array->elem_kind));
+    } else if (header->kind == YAF_MAP) {
+        YafMap* map = (YafMap*)(header + 1);
+        yaf_dealloc(map->entries, (size_t)map->capacity * sizeof(YafMapEntry));
+    }
 }
 
-YafValue yaf_string_lower(YafValue s) {
-    validate_type(s, YAF_STRING, "string_lower");
-    const char* input = s.value.string_val ? s.value.string_val : "";
-    char* result = malloc(strlen(input) + 1);
-    for (size_t i = 0; input[i]; i++) {
-        result[i] = tolower(input[i]);
-    }
-    result[strlen(input)] = '\0';
-    YafValue val = yaf_make_string(result);
-    free(result);
-    return val;
+static int64_t gc_sweep(YafGcHeader* header) {
+    int64_t freed = 0;
+    while (header) {
+        YafGcHeader* next = header->next;
+        if (header->marked) {
+            header->marked = 0;
+        } else {
+            freed += (int64_t)header->size;
+            gc_finalize(header);
+            gc_unlink(header);
+            gc_release(header);
+        }
+        header = next;
+    }
+    return freed;
 }
 
-YafValue yaf_string_concat(YafValue a, YafValue b) {
-    const char* a_str = (a.tag == YAF_STRING && a.value.string_val) ? a.value.string_val : "";
-    const char* b_str = (b.tag == YAF_STRING && b.value.string_val) ? b.value.string_val : "";
+// Mark and sweep over the roots and objects of every thread. The others
+// must be stopped: idle, or parked by gc_collect_parallel.
+static int64_t gc_collect_stopped(void) {
+    int threads = tlab_count();
+    for (int t = 0; t < threads; t++) {
+        YafTlab* tlab = tlab_at(t);
+        for (int64_t i = 0; tlab && i < tlab->root_count; i++) {
+            gc_mark_value((const YafValue*)(intptr_t)tlab->roots[i]);
+        }
+    }
+    gc_mark_memos();
     
-    size_t total_len = strlen(a_str) + strlen(b_str) + 1;
-    char* result = malloc(total_len);
-    strcpy(result, a_str);
-    strcat(result, b_str);
+    // Sweep phase: everything not reached from a root is garbage
+    int64_t freed = gc_sweep(yaf_heap.objects);
+    for (int t = 0; t < threads; t++) {
+        YafTlab* tlab = tlab_at(t);
+        if (tlab) {
+            freed += gc_sweep(tlab->objects);
+            tlab->bytes_since_collect = 0;
+        }
+    }
     
-    YafValue val = yaf_make_string(result);
-    free(result);
-    return val;
+    yaf_heap.collections++;
+    yaf_heap.bytes_freed += freed;
+    return freed;
 }
 
-// I/O functions
-YafValue yaf_io_read_file(YafValue path) {
-    validate_type(path, YAF_STRING, "read_file");
-    const char* filepath = path.value.string_val ? path.value.string_val : "";
-    
-    FILE* file = fopen(filepath, "r");
-    if (!file) {
-        return yaf_make_string("");
+int64_t yaf_gc_collect(void) {
+    if (yaf_parallel) {
+        return gc_collect_parallel();
     }
-    
-    fseek(file, 0, SEEK_END);
-    long length = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    
-    char* content = malloc(length + 1);
-    fread(content, 1, length, file);
-    content[length] = '\0';
-    fclose(file);
-    
-    YafValue val = yaf_make_string(content);
-    free(content);
-    return val;
+    return gc_collect_stopped();
 }
 
-YafValue yaf_io_write_file(YafValue path, YafValue content) {
-    validate_type(path, YAF_STRING, "write_file");
-    validate_type(content, YAF_STRING, "write_file");
-    
-    const char* filepath = path.value.string_val ? path.value.string_val : "";
-    const char* data = content.value.string_val ? content.value.string_val : "";
-    
-    FILE* file = fopen(filepath, "w");
-    if (!file) {
-        return yaf_make_bool(0);
+// Threads in a parallel loop share the threshold, and stop here whenever
+// another one is collecting
+int64_t yaf_gc_collect_if_needed(void) {
+    if (yaf_parallel) {
+        return gc_collect_parallel_if_needed();
     }
-    
-    fputs(data, file);
-    fclose(file);
-    return yaf_make_bool(1);
+    if (yaf_tlab.bytes_since_collect < yaf_heap.threshold) {
+        return 0;
+    }
+    return gc_collect_stopped();
 }
 
-YafValue yaf_io_file_exists(YafValue path) {
-    validate_type(path, YAF_STRING, "file_exists");
-    const char* filepath = path.value.string_val ? path.value.string_val : "";
-    return yaf_make_bool(access(filepath, F_OK) == 0);
+void yaf_set_gc_threshold(int64_t threshold) {
+    yaf_heap.threshold = threshold > 0 ? threshold : YAF_DEFAULT_GC_THRESHOLD;
 }
 
-YafValue yaf_io_input(void) {
-    char buffer[1024];  // Buffer fijo de 1024 caracteres
+void yaf_gc_final_cleanup(void) {
+    // Large objects were malloc'ed individually and mapped strings have their
+    // own mapping; small ones die with their chunk
+    YafGcHeader* header = yaf_heap.objects;
+    while (header) {
+        YafGcHeader* next = header->next;
+        if (header->kind == YAF_ARRAY) {
+            YafArray* array = (YafArray*)(header + 1);
+            if ((size_t)array->capacity * array_element_size(array->elem_kind) > YAF_MAX_SMALL_SIZE) {
+                free(array->data);
+            }
+        } else if (header->kind == YAF_MAP) {
+            YafMap* map = (YafMap*)(header + 1);
+            if ((size_t)map->capacity * sizeof(YafMapEntry) > YAF_MAX_SMALL_SIZE) {
+                free(map->entries);
+            }
+        }
+        if (gc_is_mapped(header)) {
+            gc_unmap(header);
+        } else if (header->size > YAF_MAX_SMALL_SIZE) {
+            free(header);
+        }
+        header = next;
+    }
     
-    if (fgets(buffer, sizeof(buffer), stdin) == NULL) {
-        return yaf_make_string("");
+    YafChunk* chunk = yaf_heap.chunks;
+    while (chunk) {
+        YafChunk* next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
+    yaf_heap.chunks = NULL;
+    yaf_heap.chunk_count = 0;
+    yaf_heap.objects = NULL;
+    yaf_heap.object_count = 0;
     
-    // Remove trailing newline if present
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len-1] == '\n') {
-        buffer[len-1] = '\0';
-        len--;
+    // Worker threads are idle; their nurseries pointed into the chunks
+    int threads = tlab_count();
+    for (int t = 0; t < threads; t++) {
+        YafTlab* tlab = tlab_at(t);
+        if (tlab) {
+            free(tlab->roots);
+            free(tlab->out);
+            memset(tlab, 0, sizeof(*tlab));
+        }
     }
-    // Remove trailing carriage return if present (Windows compatibility)
-    if (len > 0 && buffer[len-1] == '\r') {
-        buffer[len-1] = '\0';
+}
+
+typedef struct {
+    int64_t allocations;
+    int64_t total;
+    int64_t in_use;
+    int64_t roots;
+    int64_t resident;       // bytes, 0 if unknown
+    int64_t peak_resident;
+} MemoryStats;
+
+// Resident set size from /proc on Linux; the peak from getrusage, which
+// reports kilobytes on Linux and bytes on macOS
+static void memory_stats_collect(MemoryStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    int threads = tlab_count();
+    for (int t = 0; t < threads; t++) {
+        YafTlab* tlab = tlab_at(t);
+        if (tlab) {
+            stats->allocations += tlab->allocation_count;
+            stats->total += tlab->total_allocated;
+            stats->in_use += tlab->bytes_in_use;
+            stats->roots += tlab->root_count;
+        }
     }
     
-    return yaf_make_string(buffer);
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        stats->peak_resident = (int64_t)usage.ru_maxrss;
+#else
+        stats->peak_resident = (int64_t)usage.ru_maxrss * 1024;
+#endif
+    }
+    FILE* statm = fopen("/proc/self/statm", "r");
+    long long pages = 0, resident = 0;
+    if (statm) {
+        if (fscanf(statm, "%lld %lld", &pages, &resident) == 2) {
+            stats->resident = (int64_t)resident * sysconf(_SC_PAGESIZE);
+        }
+        fclose(statm);
+    }
+    if (stats->resident == 0) {
+        stats->resident = stats->peak_resident;
+    }
 }
 
-YafValue yaf_io_input_prompt(YafValue prompt) {
-    validate_type(prompt, YAF_STRING, "input_prompt");
-    const char* prompt_str = prompt.value.string_val ? prompt.value.string_val : "";
-    
-    // Print prompt without newline
-    printf("%s", prompt_str);
-    fflush(stdout);
-    
-    return yaf_io_input();
+void yaf_memory_stats(void) {
+    MemoryStats stats;
+    memory_stats_collect(&stats);
+    fprintf(stderr, "[yaf memory] allocations: %lld, total: %lld bytes, in use: %lld bytes\n",
+            (long long)stats.allocations, (long long)stats.total, (long long)stats.in_use);
+    fprintf(stderr, "[yaf memory] nursery chunks: %lld (%d KB each), live objects: %lld, roots: %lld\n",
+            (long long)yaf_heap.chunk_count, YAF_CHUNK_SIZE / 1024,
+            (long long)yaf_heap.object_count,
+            (long long)stats.roots);
+    fprintf(stderr, "[yaf memory] collections: %lld, freed by collector: %lld bytes\n",
+            (long long)yaf_heap.collections,
+            (long long)yaf_heap.bytes_freed);
+    fprintf(stderr, "[yaf memory] resident: %lld KB, peak: %lld KB\n",
+            (long long)stats.resident / 1024, (long long)stats.peak_resident / 1024);
 }
 
-// Time functions  
-YafValue yaf_time_now(void) {
-    return yaf_make_int(time(NULL));
+static void memory_stats_entry(YafValue map, const char* key, int64_t value) {
+    yaf_map_set(map, yaf_make_string(key), yaf_make_int(value));
 }
 
-YafValue yaf_time_now_millis(void) {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return yaf_make_int(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+// memory_stats(): the same numbers as a map[string, int], in bytes
+YafValue yaf_memory_stats_map(void) {
+    MemoryStats stats;
+    memory_stats_collect(&stats);
+    YafValue map = yaf_make_map(16);
+    memory_stats_entry(map, "allocations", stats.allocations);
+    memory_stats_entry(map, "allocated_bytes", stats.total);
+    memory_stats_entry(map, "bytes_in_use", stats.in_use);
+    memory_stats_entry(map, "live_objects", yaf_heap.object_count);
+    memory_stats_entry(map, "chunks", yaf_heap.chunk_count);
+    memory_stats_entry(map, "roots", stats.roots);
+    memory_stats_entry(map, "collections", yaf_heap.collections);
+    memory_stats_entry(map, "freed_bytes", yaf_heap.bytes_freed);
+    memory_stats_entry(map, "rss_bytes", stats.resident);
+    memory_stats_entry(map, "peak_rss_bytes", stats.peak_resident);
+    return map;
 }
 
-YafValue yaf_time_sleep(YafValue seconds) {
-    int sec = (seconds.tag == YAF_INT) ? seconds.value.int_val : 
-              (int)seconds.value.float_val;
-    sleep(sec);
-    return yaf_make_bool(1);
+// String objects
+static size_t string_allocation_size(int64_t capacity) {
+    return sizeof(YafString) + (size_t)capacity + 1;
 }
 
-// Type conversion functions (enhanced)
-YafValue yaf_string_to_int(YafValue s) {
-    validate_type(s, YAF_STRING, "string_to_int");
-    const char* str = s.value.string_val ? s.value.string_val : "";
-    
-    // Parse integer from string
-    char* endptr;
-    long long result = strtoll(str, &endptr, 10);
+char* yaf_string_alloc(int64_t capacity) {
+    if (capacity < 0) {
+        capacity = 0;
+    }
+    YafString* str = yaf_gc_alloc(string_allocation_size(capacity), YAF_STRING);
+    str->refcount = 1;
+    str->flags = 0;
+    str->length = 0;
+    str->capacity = capacity;
+    str->hash = 0;
+    str->data[0] = '\0';
+    return str->data;
+}
+
+char* yaf_string_new(const char* data, int64_t length) {
+    char* s = yaf_string_alloc(length);
+    if (length > 0) {
+        memcpy(s, data, (size_t)length);
+    }
+    s[length] = '\0';
+    YAF_STRING_HEADER(s)->length = length;
+    return s;
+}
+
+int64_t yaf_string_len(const char* s) {
+    return s ? YAF_STRING_HEADER(s)->length : 0;
+}
+
+// FNV-1a, never 0 so that 0 can mean "not computed yet". The LLVM backend
+// computes the same function for string literals.
+static uint64_t hash_bytes(const char* data, int64_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int64_t i = 0; i < length; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+// Strings are immutable once published, so the hash is cached in the header.
+// Threads racing to cache it store the same value.
+uint64_t yaf_string_hash(const char* s) {
+    if (!s) {
+        return hash_bytes("", 0);
+    }
+    YafString* str = YAF_STRING_HEADER(s);
+    uint64_t hash = __atomic_load_n(&str->hash, __ATOMIC_RELAXED);
+    if (!hash) {
+        hash = hash_bytes(s, str->length);
+        __atomic_store_n(&str->hash, hash, __ATOMIC_RELAXED);
+    }
+    return hash;
+}
+
+// Refcounts only need atomics while other threads run; single-threaded
+// programs never pay for them
+char* yaf_string_retain(char* s) {
+    if (s && !(YAF_STRING_HEADER(s)->flags & YAF_STR_STATIC)) {
+        YafString* str = YAF_STRING_HEADER(s);
+        if (yaf_parallel) {
+            __atomic_fetch_add(&str->refcount, 1, __ATOMIC_RELAXED);
+        } else {
+            str->refcount++;
+        }
+    }
+    return s;
+}
+
+void yaf_string_release(char* s) {
+    if (!s) {
+        return;
+    }
+    YafString* str = YAF_STRING_HEADER(s);
+    if (str->flags & YAF_STR_STATIC) {
+        return;
+    }
+    int32_t refcount = yaf_parallel ? __atomic_sub_fetch(&str->refcount, 1, __ATOMIC_ACQ_REL) : --str->refcount;
+    if (refcount <= 0) {
+        yaf_gc_free(str);
+    }
+}
+
+// Array objects
+YafArray* yaf_array_new(uint32_t elem_kind, int64_t capacity) {
+    YafArray* array = yaf_gc_alloc(sizeof(YafArray), YAF_ARRAY);
+    array->length = 0;
+    array->capacity = 0;
+    array->elem_kind = elem_kind;
+    array->reserved = 0;
+    array->data = NULL;
+    if (capacity > 0) {
+        yaf_array_reserve(array, capacity);
+    }
+    return array;
+}
+
+// Grows the storage to at least `capacity` elements, doubling so that a
+// sequence of pushes is amortized O(1)
+void yaf_array_reserve(YafArray* array, int64_t capacity) {
+    if (capacity <= array->capacity) {
+        return;
+    }
+    int64_t new_capacity = array->capacity ? array->capacity * 2 : 4;
+    if (new_capacity < capacity) {
+        new_capacity = capacity;
+    }
+    
+    size_t element_size = array_element_size(array->elem_kind);
+    void* data = yaf_alloc((size_t)new_capacity * element_size);
+    if (array->length > 0) {
+        memcpy(data, array->data, (size_t)array->length * element_size);
+    }
+    yaf_dealloc(array->data, (size_t)array->capacity * element_size);
+    array->data = data;
+    array->capacity = new_capacity;
+}
+
+void yaf_array_bounds_error(int64_t index, int64_t length) {
+    yaf_flush();
+    fprintf(stderr, "Runtime error: array index %lld out of bounds (length %lld)\n",
+            (long long)index, (long long)length);
+    runtime_error_exit();
+}
+
+static YafArray* array_object(YafValue array, const char* func_name) {
+    validate_type(array, YAF_ARRAY, func_name);
+    return array.value.array_val;
+}
+
+// Generic element access on boxed values. The LLVM backend inlines the
+// typed fast paths and only calls these when the layout is not the one it
+// expected or the index is out of bounds.
+YafValue yaf_array_get(YafValue array, YafValue index) {
+    YafArray* arr = array_object(array, "array_get");
+    validate_type(index, YAF_INT, "array_get");
+    int64_t i = index.value.int_val;
+    if ((uint64_t)i >= (uint64_t)arr->length) {
+        yaf_array_bounds_error(i, arr->length);
+    }
+    switch (arr->elem_kind) {
+        case YAF_ELEM_INT:
+            return yaf_make_int(((int64_t*)arr->data)[i]);
+        case YAF_ELEM_FLOAT:
+            return yaf_make_float(((double*)arr->data)[i]);
+        default:
+            return element_load((YafElement*)arr->data + i);
+    }
+}
+
+static void array_store(YafArray* arr, int64_t i, YafValue value) {
+    switch (arr->elem_kind) {
+        case YAF_ELEM_INT:
+            validate_type(value, YAF_INT, "array_store");
+            ((int64_t*)arr->data)[i] = value.value.int_val;
+            break;
+        case YAF_ELEM_FLOAT:
+            ((double*)arr->data)[i] = value.tag == YAF_INT
+                ? (double)value.value.int_val
+                : (validate_type(value, YAF_FLOAT, "array_store"), value.value.float_val);
+            break;
+        default:
+            element_store((YafElement*)arr->data + i, value);
+            break;
+    }
+}
+
+void yaf_array_set(YafValue array, YafValue index, YafValue value) {
+    YafArray* arr = array_object(array, "array_set");
+    validate_type(index, YAF_INT, "array_set");
+    int64_t i = index.value.int_val;
+    if ((uint64_t)i >= (uint64_t)arr->length) {
+        yaf_array_bounds_error(i, arr->length);
+    }
+    array_store(arr, i, value);
+}
+
+void yaf_array_push(YafValue array, YafValue value) {
+    YafArray* arr = array_object(array, "push");
+    if (arr->length == arr->capacity) {
+        yaf_array_reserve(arr, arr->length + 1);
+    }
+    array_store(arr, arr->length, value);
+    arr->length++;
+}
+
+YafValue yaf_array_pop(YafValue array) {
+    YafArray* arr = array_object(array, "pop");
+    if (arr->length == 0) {
+        yaf_flush();
+        fprintf(stderr, "Runtime error: pop from empty array\n");
+        runtime_error_exit();
+    }
+    YafValue element = yaf_array_get(array, yaf_make_int(arr->length - 1));
+    arr->length--;
+    return element;
+}
+
+YafValue yaf_array_length(YafValue array) {
+    return yaf_make_int(array_object(array, "length")->length);
+}
+
+// Map objects
+#define YAF_MAP_MIN_CAPACITY 8
+
+static uint64_t mix_hash(uint64_t x) {
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x ? x : 1;
+}
+
+static uint64_t map_key_hash(YafValue key) {
+    switch (key.tag) {
+        case YAF_STRING:
+            return yaf_string_hash(key.value.string_val);
+        case YAF_SMALL_STRING:
+            // Same hash as the heap form, so both compare equal as keys
+            return hash_bytes(key.value.small_val, string_length(&key));
+        case YAF_BOOL:
+            return mix_hash(key.value.bool_val ? 1 : 0);
+        default:
+            return mix_hash((uint64_t)key.value.int_val);
+    }
+}
+
+static bool map_key_equal(YafValue a, uint64_t hash_a, const YafMapEntry* entry) {
+    if (entry->hash != hash_a) {
+        return false;
+    }
+    if (is_string(&a)) {
+        return is_string(&entry->key) && yaf_string_equal(a, entry->key);
+    }
+    if (entry->key.tag != a.tag) {
+        return false;
+    }
+    switch (a.tag) {
+        case YAF_BOOL:
+            return a.value.bool_val == entry->key.value.bool_val;
+        default:
+            return a.value.int_val == entry->key.value.int_val;
+    }
+}
+
+static YafMapEntry* map_alloc_entries(int64_t capacity) {
+    size_t size = (size_t)capacity * sizeof(YafMapEntry);
+    YafMapEntry* entries = yaf_alloc(size);
+    memset(entries, 0, size);
+    return entries;
+}
+
+// Robin Hood insertion of a key known not to be present: an entry that is
+// closer to its home slot than the one being placed gives up its slot
+static void map_insert_new(YafMap* map, YafMapEntry entry) {
+    uint64_t mask = (uint64_t)map->capacity - 1;
+    uint64_t slot = entry.hash & mask;
+    uint64_t distance = 0;
+    for (;;) {
+        YafMapEntry* current = &map->entries[slot];
+        if (!current->hash) {
+            *current = entry;
+            map->count++;
+            return;
+        }
+        uint64_t current_distance = (slot - (current->hash & mask)) & mask;
+        if (current_distance < distance) {
+            YafMapEntry displaced = *current;
+            *current = entry;
+            entry = displaced;
+            distance = current_distance;
+        }
+        slot = (slot + 1) & mask;
+        distance++;
+    }
+}
+
+static void map_resize(YafMap* map, int64_t capacity) {
+    YafMapEntry* old_entries = map->entries;
+    int64_t old_capacity = map->capacity;
+    map->entries = map_alloc_entries(capacity);
+    map->capacity = capacity;
+    map->count = 0;
+    for (int64_t i = 0; i < old_capacity; i++) {
+        if (old_entries[i].hash) {
+            map_insert_new(map, old_entries[i]);
+        }
+    }
+    yaf_dealloc(old_entries, (size_t)old_capacity * sizeof(YafMapEntry));
+}
+
+// Slot holding the key, or -1. Robin Hood ordering lets a miss stop as
+// soon as it reaches an entry closer to home than the probe distance.
+static int64_t map_find(const YafMap* map, YafValue key, uint64_t hash) {
+    uint64_t mask = (uint64_t)map->capacity - 1;
+    uint64_t slot = hash & mask;
+    for (uint64_t distance = 0;; distance++) {
+        const YafMapEntry* entry = &map->entries[slot];
+        if (!entry->hash || ((slot - (entry->hash & mask)) & mask) < distance) {
+            return -1;
+        }
+        if (map_key_equal(key, hash, entry)) {
+            return (int64_t)slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+static YafMap* map_object(YafValue map, const char* func_name) {
+    validate_type(map, YAF_MAP, func_name);
+    return map.value.map_val;
+}
+
+YafValue yaf_make_map(int64_t capacity) {
+    // Keep the load factor at most 7/8 for the requested entries
+    int64_t table_capacity = YAF_MAP_MIN_CAPACITY;
+    while (table_capacity * 7 / 8 < capacity) {
+        table_capacity *= 2;
+    }
+    
+    YafMap* map = yaf_gc_alloc(sizeof(YafMap), YAF_MAP);
+    map->count = 0;
+    map->capacity = table_capacity;
+    map->entries = map_alloc_entries(table_capacity);
+    
+    YafValue val;
+    val.tag = YAF_MAP;
+    val.value.map_val = map;
+    return val;
+}
+
+YafValue yaf_map_get(YafValue map, YafValue key) {
+    YafMap* m = map_object(map, "map_get");
+    int64_t slot = map_find(m, key, map_key_hash(key));
+    if (slot < 0) {
+        yaf_flush();
+        fprintf(stderr, "Runtime error: key not found in map_get\n");
+        runtime_error_exit();
+    }
+    return m->entries[slot].value;
+}
+
+void yaf_map_set(YafValue map, YafValue key, YafValue value) {
+    YafMap* m = map_object(map, "map_set");
+    uint64_t hash = map_key_hash(key);
+    int64_t slot = map_find(m, key, hash);
+    if (slot >= 0) {
+        m->entries[slot].value = value;
+        return;
+    }
+    if ((m->count + 1) * 8 > m->capacity * 7) {
+        map_resize(m, m->capacity * 2);
+    }
+    YafMapEntry entry = { .hash = hash, .key = key, .value = value };
+    map_insert_new(m, entry);
+}
+
+YafValue yaf_map_has(YafValue map, YafValue key) {
+    YafMap* m = map_object(map, "map_has");
+    return yaf_make_bool(map_find(m, key, map_key_hash(key)) >= 0);
+}
+
+// Backward shift deletion: no tombstones, probe sequences stay short
+YafValue yaf_map_delete(YafValue map, YafValue key) {
+    YafMap* m = map_object(map, "map_delete");
+    int64_t found = map_find(m, key, map_key_hash(key));
+    if (found < 0) {
+        return yaf_make_bool(0);
+    }
+    
+    uint64_t mask = (uint64_t)m->capacity - 1;
+    uint64_t slot = (uint64_t)found;
+    for (;;) {
+        uint64_t next = (slot + 1) & mask;
+        YafMapEntry* entry = &m->entries[next];
+        if (!entry->hash || (entry->hash & mask) == next) {
+            break;
+        }
+        m->entries[slot] = *entry;
+        slot = next;
+    }
+    memset(&m->entries[slot], 0, sizeof(YafMapEntry));
+    m->count--;
+    return yaf_make_bool(1);
+}
+
+YafValue yaf_map_length(YafValue map) {
+    return yaf_make_int(map_object(map, "length")->count);
+}
+
+
+// Value construction functions
+YafValue yaf_make_int(int64_t value) {
+    YafValue val;
+    val.tag = YAF_INT;
+    val.value.int_val = value;
+    return val;
+}
+
+YafValue yaf_make_float(double value) {
+    YafValue val;
+    val.tag = YAF_FLOAT;
+    val.value.float_val = value;
+    return val;
+}
+
+YafValue yaf_make_string(const char* value) {
+    return yaf_make_string_len(value, value ? (int64_t)strlen(value) : 0);
+}
+
+YafValue yaf_make_string_len(const char* value, int64_t length) {
+    YafValue val;
+    // Short strings without embedded NULs are stored inline
+    if (length <= YAF_SMALL_STRING_MAX && (length == 0 || !memchr(value, '\0', (size_t)length))) {
+        val.tag = YAF_SMALL_STRING;
+        val.value.int_val = 0;
+        if (length > 0) {
+            memcpy(val.value.small_val, value, (size_t)length);
+        }
+        return val;
+    }
+    val.tag = YAF_STRING;
+    val.value.string_val = yaf_string_new(value, length);
+    return val;
+}
+
+// Wraps a freshly built heap string, moving it inline if it is short
+static YafValue string_result(char* s) {
+    int64_t length = yaf_string_len(s);
+    if (length <= YAF_SMALL_STRING_MAX && !memchr(s, '\0', (size_t)length)) {
+        YafValue val = yaf_make_string_len(s, length);
+        yaf_gc_free(YAF_STRING_HEADER(s));
+        return val;
+    }
+    YafValue val;
+    val.tag = YAF_STRING;
+    val.value.string_val = s;
+    return val;
+}
+
+YafValue yaf_make_bool(int value) {
+    YafValue val;
+    val.tag = YAF_BOOL;
+    val.value.int_val = value != 0;    // whole payload: LLVM tests the i64
+    return val;
+}
+
+YafValue yaf_make_void(void) {
+    YafValue val;
+    val.tag = YAF_INT;  // Use INT with value 0 for void
+    val.value.int_val = 0;
+    return val;
+}
+
+// Number formatting, shared by print and the string conversions
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes the decimal form of value (needs 20 bytes of room), returns its length
+static int format_int(char* out, int64_t value) {
+    char digits[20];
+    int start = sizeof(digits);
+    uint64_t n = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    
+    // Two digits per division
+    while (n >= 100) {
+        unsigned pair = (unsigned)(n % 100) * 2;
+        n /= 100;
+        digits[--start] = digit_pairs[pair + 1];
+        digits[--start] = digit_pairs[pair];
+    }
+    if (n >= 10) {
+        unsigned pair = (unsigned)n * 2;
+        digits[--start] = digit_pairs[pair + 1];
+        digits[--start] = digit_pairs[pair];
+    } else {
+        digits[--start] = (char)('0' + n);
+    }
+    
+    int length = 0;
+    if (value < 0) {
+        out[length++] = '-';
+    }
+    memcpy(out + length, digits + start, sizeof(digits) - start);
+    return length + (int)sizeof(digits) - start;
+}
+
+// Same text as printf("%g"). Integral values below 10^6, which %g prints
+// without exponent or decimals, take the integer path; the rest use snprintf.
+static int format_float(char* out, size_t size, double value) {
+    if (value > -1e6 && value < 1e6 && value == (double)(int64_t)value && !(value == 0 && signbit(value))) {
+        return format_int(out, (int64_t)value);
+    }
+    return snprintf(out, size, "%g", value);
+}
+
+// Type conversion functions
+YafValue yaf_value_to_string(YafValue value) {
+    char buffer[64];
+    int len;
+    switch (value.tag) {
+        case YAF_INT:
+            len = format_int(buffer, value.value.int_val);
+            return yaf_make_string_len(buffer, len);
+        case YAF_FLOAT:
+            len = format_float(buffer, sizeof(buffer), value.value.float_val);
+            return yaf_make_string_len(buffer, len);
+        case YAF_STRING:
+        case YAF_SMALL_STRING:
+            // Strings are immutable: a conversion is just another reference
+            return yaf_retain_value(value);
+        case YAF_BOOL:
+            return yaf_make_string(value.value.bool_val ? "true" : "false");
+        default:
+            return yaf_make_string("unknown");
+    }
+}
+
+YafValue yaf_value_to_int(YafValue value) {
+    switch (value.tag) {
+        case YAF_INT:
+            return value;
+        case YAF_FLOAT:
+            return yaf_make_int((int64_t)value.value.float_val);
+        case YAF_STRING:
+        case YAF_SMALL_STRING:
+            return yaf_make_int(strtoll(string_data(&value), NULL, 10));
+        case YAF_BOOL:
+            return yaf_make_int(value.value.bool_val ? 1 : 0);
+        default:
+            return yaf_make_int(0);
+    }
+}
+
+YafValue yaf_value_to_float(YafValue value) {
+    switch (value.tag) {
+        case YAF_INT:
+            return yaf_make_float((double)value.value.int_val);
+        case YAF_FLOAT:
+            return value;
+        case YAF_STRING:
+        case YAF_SMALL_STRING:
+            return yaf_make_float(strtod(string_data(&value), NULL));
+        case YAF_BOOL:
+            return yaf_make_float(value.value.bool_val ? 1.0 : 0.0);
+        default:
+            return yaf_make_float(0.0);
+    }
+}
+
+YafValue yaf_retain_value(YafValue value) {
+    if (value.tag == YAF_STRING) {
+        yaf_string_retain(value.value.string_val);
+    }
+    return value;
+}
+
+void yaf_free_value(YafValue* value) {
+    if (value->tag == YAF_STRING && value->value.string_val) {
+        yaf_string_release(value->value.string_val);
+        value->value.string_val = NULL;
+    }
+}
+
+// Output buffer
+#define YAF_OUT_BUFFER_SIZE (64 * 1024)
+
+static struct {
+    char data[YAF_OUT_BUFFER_SIZE];
+    size_t length;
+    int is_tty;         // -1 until the first write
+} yaf_out = { .is_tty = -1 };
+
+// Writes every buffer in order, resuming after short writes
+static bool writev_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        ssize_t n = writev(fd, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t done = (size_t)n;
+        while (count > 0 && done >= iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+    return true;
+}
+
+static bool write_all(int fd, const char* data, size_t size) {
+    struct iovec iov = { (void*)data, size };
+    return writev_all(fd, &iov, 1);
+}
+
+// Pending bytes plus data too large to buffer, in a single system call
+static bool write_through(int fd, const char* pending, size_t pending_size, const char* data, size_t size) {
+    struct iovec iov[2] = { { (void*)pending, pending_size }, { (void*)data, size } };
+    return writev_all(fd, iov, 2);
+}
+
+// Threads running a parallel loop take this to reach the shared buffer
+static pthread_mutex_t yaf_out_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void out_flush(void) {
+    // On error there is nowhere to report it; drop the output like stdio would
+    write_all(STDOUT_FILENO, yaf_out.data, yaf_out.length);
+    yaf_out.length = 0;
+}
+
+static void out_write(const char* data, size_t size) {
+    if (yaf_out.is_tty < 0) {
+        yaf_out.is_tty = isatty(STDOUT_FILENO);
+        fflush(stdout);     // keep anything printed through stdio in order
+        atexit(yaf_flush);
+    }
+    if (size > YAF_OUT_BUFFER_SIZE - yaf_out.length) {
+        if (size >= YAF_OUT_BUFFER_SIZE) {
+            write_through(STDOUT_FILENO, yaf_out.data, yaf_out.length, data, size);
+            yaf_out.length = 0;
+            return;
+        }
+        out_flush();
+    }
+    memcpy(yaf_out.data + yaf_out.length, data, size);
+    yaf_out.length += size;
+}
+
+// Parallel loop output collects per thread, so lines are never interleaved
+static void thread_write(YafTlab* tlab, const char* data, size_t size) {
+    if (size > tlab->out_capacity - tlab->out_length) {
+        size_t capacity = tlab->out_capacity ? tlab->out_capacity * 2 : 256;
+        while (capacity - tlab->out_length < size) {
+            capacity *= 2;
+        }
+        char* out = realloc(tlab->out, capacity);
+        if (!out) {
+            out_of_memory(capacity);
+        }
+        tlab->out = out;
+        tlab->out_capacity = capacity;
+    }
+    memcpy(tlab->out + tlab->out_length, data, size);
+    tlab->out_length += size;
+}
+
+static void thread_flush_output(YafTlab* tlab, bool to_fd) {
+    pthread_mutex_lock(&yaf_out_lock);
+    out_write(tlab->out, tlab->out_length);
+    if (to_fd || yaf_out.is_tty) {
+        out_flush();
+    }
+    pthread_mutex_unlock(&yaf_out_lock);
+    tlab->out_length = 0;
+}
+
+void yaf_flush(void) {
+    if (yaf_tlab.owner) {
+        thread_flush_output(&yaf_tlab, true);
+        return;
+    }
+    out_flush();
+}
+
+void yaf_write(const char* data, int64_t length) {
+    if (yaf_tlab.owner) {
+        thread_write(&yaf_tlab, data, (size_t)length);
+        return;
+    }
+    out_write(data, (size_t)length);
+}
+
+void yaf_print_int(int64_t value) {
+    char buffer[24];
+    yaf_write(buffer, format_int(buffer, value));
+}
+
+void yaf_print_float(double value) {
+    char buffer[64];
+    yaf_write(buffer, format_float(buffer, sizeof(buffer), value));
+}
+
+void yaf_print_newline(void) {
+    yaf_write("\n", 1);
+    if (yaf_tlab.owner) {
+        thread_flush_output(&yaf_tlab, false);
+    } else if (yaf_out.is_tty) {
+        yaf_flush();
+    }
+}
+
+static void out_cstring(const char* s) {
+    yaf_write(s, (int64_t)strlen(s));
+}
+
+void yaf_print_value(YafValue value) {
+    yaf_print_value_no_newline(value);
+    yaf_print_newline();
+}
+
+void yaf_print_value_no_newline(YafValue value) {
+    switch (value.tag) {
+        case YAF_INT:
+            yaf_print_int(value.value.int_val);
+            break;
+        case YAF_FLOAT:
+            yaf_print_float(value.value.float_val);
+            break;
+        case YAF_STRING:
+        case YAF_SMALL_STRING:
+            yaf_write(string_data(&value), string_length(&value));
+            break;
+        case YAF_BOOL:
+            out_cstring(value.value.bool_val ? "true" : "false");
+            break;
+        case YAF_ARRAY: {
+            YafArray* array = value.value.array_val;
+            out_cstring("[");
+            for (int64_t i = 0; i < array->length; i++) {
+                if (i > 0) {
+                    out_cstring(", ");
+                }
+                yaf_print_value_no_newline(yaf_array_get(value, yaf_make_int(i)));
+            }
+            out_cstring("]");
+            break;
+        }
+        case YAF_MAP: {
+            YafMap* map = value.value.map_val;
+            int64_t printed = 0;
+            out_cstring("{");
+            for (int64_t i = 0; i < map->capacity; i++) {
+                if (map->entries[i].hash) {
+                    if (printed++) {
+                        out_cstring(", ");
+                    }
+                    yaf_print_value_no_newline(map->entries[i].key);
+                    out_cstring(": ");
+                    yaf_print_value_no_newline(map->entries[i].value);
+                }
+            }
+            out_cstring("}");
+            break;
+        }
+        default:
+            out_cstring("unknown");
+            break;
+    }
+}
+
+// Generic operators
+
+static double number_value(const YafValue* val, const char* func_name) {
+    if (val->tag == YAF_FLOAT) {
+        return val->value.float_val;
+    }
+    validate_type(*val, YAF_INT, func_name);
+    return (double)val->value.int_val;
+}
+
+// Also called by the LLVM backend's inline integer division
+void yaf_division_by_zero(void) {
+    yaf_flush();
+    fprintf(stderr, "Runtime error: division by zero\n");
+    runtime_error_exit();
+}
+
+YafValue yaf_add(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        return yaf_make_int((int64_t)((uint64_t)a.value.int_val + (uint64_t)b.value.int_val));
+    }
+    if (is_string(&a) || is_string(&b)) {
+        return yaf_string_concat(a, b);
+    }
+    return yaf_make_float(number_value(&a, "add") + number_value(&b, "add"));
+}
+
+YafValue yaf_sub(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        return yaf_make_int((int64_t)((uint64_t)a.value.int_val - (uint64_t)b.value.int_val));
+    }
+    return yaf_make_float(number_value(&a, "sub") - number_value(&b, "sub"));
+}
+
+YafValue yaf_mul(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        return yaf_make_int((int64_t)((uint64_t)a.value.int_val * (uint64_t)b.value.int_val));
+    }
+    return yaf_make_float(number_value(&a, "mul") * number_value(&b, "mul"));
+}
+
+YafValue yaf_div(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        if (b.value.int_val == 0) {
+            yaf_division_by_zero();
+        }
+        if (b.value.int_val == -1) {
+            return yaf_sub(yaf_make_int(0), a);     // INT64_MIN / -1 wraps
+        }
+        return yaf_make_int(a.value.int_val / b.value.int_val);
+    }
+    return yaf_make_float(number_value(&a, "div") / number_value(&b, "div"));
+}
+
+YafValue yaf_mod(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        if (b.value.int_val == 0) {
+            yaf_division_by_zero();
+        }
+        if (b.value.int_val == -1) {
+            return yaf_make_int(0);
+        }
+        return yaf_make_int(a.value.int_val % b.value.int_val);
+    }
+    return yaf_make_float(fmod(number_value(&a, "mod"), number_value(&b, "mod")));
+}
+
+// Strings by content, numbers by value, everything else by payload
+static bool values_equal(const YafValue* a, const YafValue* b) {
+    if (is_string(a) && is_string(b)) {
+        return yaf_string_equal(*a, *b);
+    }
+    if ((a->tag == YAF_FLOAT || b->tag == YAF_FLOAT) &&
+        (a->tag == YAF_FLOAT || a->tag == YAF_INT) && (b->tag == YAF_FLOAT || b->tag == YAF_INT)) {
+        return number_value(a, "eq") == number_value(b, "eq");
+    }
+    return a->tag == b->tag && a->value.int_val == b->value.int_val;
+}
+
+// Sign of a - b: strings compare bytewise, the rest as numbers. NaN is
+// unordered with everything, so every comparison with it is false.
+#define YAF_UNORDERED 2
+
+static int compare_values(const YafValue* a, const YafValue* b, const char* func_name) {
+    if (is_string(a) && is_string(b)) {
+        int64_t a_len = string_length(a);
+        int64_t b_len = string_length(b);
+        int order = memcmp(string_data(a), string_data(b), (size_t)(a_len < b_len ? a_len : b_len));
+        if (order != 0) {
+            return order < 0 ? -1 : 1;
+        }
+        return (a_len > b_len) - (a_len < b_len);
+    }
+    if (a->tag == YAF_INT && b->tag == YAF_INT) {
+        return (a->value.int_val > b->value.int_val) - (a->value.int_val < b->value.int_val);
+    }
+    double x = number_value(a, func_name);
+    double y = number_value(b, func_name);
+    if (x != x || y != y) {
+        return YAF_UNORDERED;
+    }
+    return (x > y) - (x < y);
+}
+
+YafValue yaf_eq(YafValue a, YafValue b) {
+    return yaf_make_bool(values_equal(&a, &b));
+}
+
+YafValue yaf_ne(YafValue a, YafValue b) {
+    return yaf_make_bool(!values_equal(&a, &b));
+}
+
+YafValue yaf_lt(YafValue a, YafValue b) {
+    return yaf_make_bool(compare_values(&a, &b, "lt") == -1);
+}
+
+YafValue yaf_le(YafValue a, YafValue b) {
+    int order = compare_values(&a, &b, "le");
+    return yaf_make_bool(order == -1 || order == 0);
+}
+
+YafValue yaf_gt(YafValue a, YafValue b) {
+    return yaf_make_bool(compare_values(&a, &b, "gt") == 1);
+}
+
+YafValue yaf_ge(YafValue a, YafValue b) {
+    int order = compare_values(&a, &b, "ge");
+    return yaf_make_bool(order == 1 || order == 0);
+}
+
+bool yaf_to_bool(YafValue value) {
+    switch (value.tag) {
+        case YAF_FLOAT:
+            return value.value.float_val != 0.0;
+        case YAF_STRING:
+        case YAF_SMALL_STRING:
+            return string_length(&value) > 0;
+        default:
+            return value.value.int_val != 0;
+    }
+}
+
+// Math functions
+YafValue yaf_math_abs(YafValue value) {
+    switch (value.tag) {
+        case YAF_INT:
+            return yaf_make_int(llabs(value.value.int_val));
+        case YAF_FLOAT:
+            return yaf_make_float(fabs(value.value.float_val));
+        default:
+            return yaf_make_int(0);
+    }
+}
+
+YafValue yaf_math_max(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        return yaf_make_int(a.value.int_val > b.value.int_val ? a.value.int_val : b.value.int_val);
+    } else if (a.tag == YAF_FLOAT || b.tag == YAF_FLOAT) {
+        double a_val = (a.tag == YAF_FLOAT) ? a.value.float_val : (double)a.value.int_val;
+        double b_val = (b.tag == YAF_FLOAT) ? b.value.float_val : (double)b.value.int_val;
+        return yaf_make_float(a_val > b_val ? a_val : b_val);
+    }
+    return yaf_make_int(0);
+}
+
+YafValue yaf_math_min(YafValue a, YafValue b) {
+    if (a.tag == YAF_INT && b.tag == YAF_INT) {
+        return yaf_make_int(a.value.int_val < b.value.int_val ? a.value.int_val : b.value.int_val);
+    } else if (a.tag == YAF_FLOAT || b.tag == YAF_FLOAT) {
+        double a_val = (a.tag == YAF_FLOAT) ? a.value.float_val : (double)a.value.int_val;
+        double b_val = (b.tag == YAF_FLOAT) ? b.value.float_val : (double)b.value.int_val;
+        return yaf_make_float(a_val < b_val ? a_val : b_val);
+    }
+    return yaf_make_int(0);
+}
+
+YafValue yaf_math_pow(YafValue base, YafValue exp) {
+    double base_val = (base.tag == YAF_FLOAT) ? base.value.float_val : (double)base.value.int_val;
+    double exp_val = (exp.tag == YAF_FLOAT) ? exp.value.float_val : (double)exp.value.int_val;
+    return yaf_make_float(pow(base_val, exp_val));
+}
+
+// String functions
+YafValue yaf_string_length(YafValue s) {
+    // length() is shared with arrays when the type is only known at runtime
+    if (s.tag == YAF_ARRAY) {
+        return yaf_array_length(s);
+    }
+    if (s.tag == YAF_MAP) {
+        return yaf_map_length(s);
+    }
+    validate_type(s, YAF_STRING, "string_length");
+    return yaf_make_int(string_length(&s));
+}
+
+// SIMD string kernels
+//
+// ASCII case conversion and substring search have vector versions (SSE2 or
+// AVX2 on x86, picked at runtime from the CPU, and NEON on AArch64) behind
+// function pointers resolved on first use. A block holding any non-ASCII
+// byte is handed to the scalar code, so results never depend on the path.
+// Equality needs no kernel of its own: lengths and cached hashes rule out
+// most mismatches and libc's memcmp is already vectorized per CPU.
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define YAF_SIMD_X86 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YAF_SIMD_NEON 1
+#endif
+
+typedef void (*CaseKernel)(char* dst, const char* src, size_t length, bool upper);
+typedef int64_t (*FindKernel)(const char* haystack, size_t length, const char* needle, size_t needle_length);
+
+static void case_convert_scalar(char* dst, const char* src, size_t length, bool upper) {
+    for (size_t i = 0; i < length; i++) {
+        dst[i] = (char)(upper ? toupper((unsigned char)src[i]) : tolower((unsigned char)src[i]));
+    }
+}
+
+// Index of the first occurrence, or -1; needle_length >= 1
+static int64_t find_scalar(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    const char* p = haystack;
+    const char* end = haystack + length;
+    while ((size_t)(end - p) >= needle_length) {
+        p = memchr(p, needle[0], (size_t)(end - p) - needle_length + 1);
+        if (!p) {
+            return -1;
+        }
+        if (memcmp(p + 1, needle + 1, needle_length - 1) == 0) {
+            return p - haystack;
+        }
+        p++;
+    }
+    return -1;
+}
+
+// Candidates are the positions where both the first and the last byte of
+// the needle match; only those are compared in full
+static int64_t find_candidates(const char* haystack, size_t i, uint64_t mask, const char* needle, size_t needle_length) {
+    while (mask) {
+        size_t pos = i + (size_t)__builtin_ctzll(mask);
+        if (memcmp(haystack + pos + 1, needle + 1, needle_length - 2) == 0) {
+            return (int64_t)pos;
+        }
+        mask &= mask - 1;
+    }
+    return -1;
+}
+
+static int64_t find_tail(const char* haystack, size_t length, size_t i, const char* needle, size_t needle_length) {
+    int64_t found = find_scalar(haystack + i, length - i, needle, needle_length);
+    return found < 0 ? -1 : (int64_t)i + found;
+}
+
+#if YAF_SIMD_X86
+static void case_convert_sse2(char* dst, const char* src, size_t length, bool upper) {
+    const __m128i lo = _mm_set1_epi8(upper ? 'a' - 1 : 'A' - 1);
+    const __m128i hi = _mm_set1_epi8(upper ? 'z' + 1 : 'Z' + 1);
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i c = _mm_loadu_si128((const __m128i*)(src + i));
+        if (_mm_movemask_epi8(c)) {
+            case_convert_scalar(dst + i, src + i, 16, upper);
+            continue;
+        }
+        __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(c, lo), _mm_cmplt_epi8(c, hi));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(c, _mm_and_si128(letter, flip)));
+    }
+    case_convert_scalar(dst + i, src + i, length - i, upper);
+}
+
+__attribute__((target("avx2")))
+static void case_convert_avx2(char* dst, const char* src, size_t length, bool upper) {
+    const __m256i lo = _mm256_set1_epi8(upper ? 'a' - 1 : 'A' - 1);
+    const __m256i hi = _mm256_set1_epi8(upper ? 'z' + 1 : 'Z' + 1);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i c = _mm256_loadu_si256((const __m256i*)(src + i));
+        if (_mm256_movemask_epi8(c)) {
+            case_convert_scalar(dst + i, src + i, 32, upper);
+            continue;
+        }
+        __m256i letter = _mm256_and_si256(_mm256_cmpgt_epi8(c, lo), _mm256_cmpgt_epi8(hi, c));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(c, _mm256_and_si256(letter, flip)));
+    }
+    case_convert_sse2(dst + i, src + i, length - i, upper);
+}
+
+static int64_t find_sse2(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length + 15 <= length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i*)(haystack + i + needle_length - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        int64_t found = find_candidates(haystack, i, mask, needle, needle_length);
+        if (found >= 0) {
+            return found;
+        }
+    }
+    return find_tail(haystack, length, i, needle, needle_length);
+}
+
+__attribute__((target("avx2")))
+static int64_t find_avx2(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length + 31 <= length; i += 32) {
+        __m256i block_first = _mm256_loadu_si256((const __m256i*)(haystack + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i*)(haystack + i + needle_length - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        int64_t found = find_candidates(haystack, i, mask, needle, needle_length);
+        if (found >= 0) {
+            return found;
+        }
+    }
+    return find_tail(haystack, length, i, needle, needle_length);
+}
+#endif
+
+#if YAF_SIMD_NEON
+static void case_convert_neon(char* dst, const char* src, size_t length, bool upper) {
+    const uint8x16_t lo = vdupq_n_u8(upper ? 'a' : 'A');
+    const uint8x16_t hi = vdupq_n_u8(upper ? 'z' : 'Z');
+    const uint8x16_t flip = vdupq_n_u8(0x20);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t c = vld1q_u8((const uint8_t*)(src + i));
+        if (vmaxvq_u8(c) >= 0x80) {
+            case_convert_scalar(dst + i, src + i, 16, upper);
+            continue;
+        }
+        uint8x16_t letter = vandq_u8(vcgeq_u8(c, lo), vcleq_u8(c, hi));
+        vst1q_u8((uint8_t*)(dst + i), veorq_u8(c, vandq_u8(letter, flip)));
+    }
+    case_convert_scalar(dst + i, src + i, length - i, upper);
+}
+
+static int64_t find_neon(const char* haystack, size_t length, const char* needle, size_t needle_length) {
+    const uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)needle[needle_length - 1]);
+    size_t i = 0;
+    for (; i + needle_length + 15 <= length; i += 16) {
+        uint8x16_t block_first = vld1q_u8((const uint8_t*)(haystack + i));
+        uint8x16_t block_last = vld1q_u8((const uint8_t*)(haystack + i + needle_length - 1));
+        uint8x16_t eq = vandq_u8(vceqq_u8(first, block_first), vceqq_u8(last, block_last));
+        // Narrow to one nibble per byte, then keep one bit per nibble
+        uint64_t nibbles = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        nibbles &= 0x1111111111111111ULL;
+        while (nibbles) {
+            size_t pos = i + (size_t)(__builtin_ctzll(nibbles) / 4);
+            if (memcmp(haystack + pos + 1, needle + 1, needle_length - 2) == 0) {
+                return (int64_t)pos;
+            }
+            nibbles &= nibbles - 1;
+        }
+    }
+    return find_tail(haystack, length, i, needle, needle_length);
+}
+#endif
+
+static struct {
+    CaseKernel case_convert;
+    FindKernel find;
+} string_kernels;
+
+static void string_kernels_init(void) {
+#if YAF_SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        string_kernels.case_convert = case_convert_avx2;
+        string_kernels.find = find_avx2;
+    } else {
+        string_kernels.case_convert = case_convert_sse2;
+        string_kernels.find = find_sse2;
+    }
+#elif YAF_SIMD_NEON
+    string_kernels.case_convert = case_convert_neon;
+    string_kernels.find = find_neon;
+#else
+    string_kernels.case_convert = case_convert_scalar;
+    string_kernels.find = find_scalar;
+#endif
+}
+
+static YafValue string_case_convert(YafValue s, bool upper, const char* func_name) {
+    validate_type(s, YAF_STRING, func_name);
+    int64_t len = string_length(&s);
+    if (s.tag == YAF_SMALL_STRING) {
+        // Inline in, inline out: case conversion keeps the length
+        case_convert_scalar(s.value.small_val, s.value.small_val, (size_t)len, upper);
+        return s;
+    }
+    char* result = yaf_string_alloc(len);
+    if (!string_kernels.case_convert) {
+        string_kernels_init();
+    }
+    string_kernels.case_convert(result, string_data(&s), (size_t)len, upper);
+    result[len] = '\0';
+    YAF_STRING_HEADER(result)->length = len;
+    return string_result(result);
+}
+
+YafValue yaf_string_upper(YafValue s) {
+    return string_case_convert(s, true, "string_upper");
+}
+
+YafValue yaf_string_lower(YafValue s) {
+    return string_case_convert(s, false, "string_lower");
+}
+
+static int64_t string_find(const char* haystack, int64_t length, const char* needle, int64_t needle_length) {
+    if (needle_length == 0) {
+        return 0;
+    }
+    if (needle_length > length) {
+        return -1;
+    }
+    if (needle_length == 1) {
+        const char* p = memchr(haystack, needle[0], (size_t)length);
+        return p ? p - haystack : -1;
+    }
+    if (!string_kernels.find) {
+        string_kernels_init();
+    }
+    return string_kernels.find(haystack, (size_t)length, needle, (size_t)needle_length);
+}
+
+YafValue yaf_string_find(YafValue s, YafValue needle) {
+    validate_type(s, YAF_STRING, "find");
+    validate_type(needle, YAF_STRING, "find");
+    return yaf_make_int(string_find(string_data(&s), string_length(&s),
+                                    string_data(&needle), string_length(&needle)));
+}
+
+YafValue yaf_string_contains(YafValue s, YafValue needle) {
+    validate_type(s, YAF_STRING, "contains");
+    validate_type(needle, YAF_STRING, "contains");
+    return yaf_make_bool(string_find(string_data(&s), string_length(&s),
+                                     string_data(&needle), string_length(&needle)) >= 0);
+}
+
+int32_t yaf_string_equal(YafValue a, YafValue b) {
+    if (a.tag == YAF_SMALL_STRING && b.tag == YAF_SMALL_STRING) {
+        return a.value.int_val == b.value.int_val;
+    }
+    const char* x = string_data(&a);
+    const char* y = string_data(&b);
+    if (x == y) {
+        return 1;
+    }
+    int64_t length = string_length(&a);
+    if (length != string_length(&b)) {
+        return 0;
+    }
+    if (length == 0) {
+        return 1;
+    }
+    // Both hashes already known (literals, map keys): a cheap early out
+    if (a.tag == YAF_STRING && b.tag == YAF_STRING) {
+        uint64_t hash_a = YAF_STRING_HEADER(x)->hash;
+        uint64_t hash_b = YAF_STRING_HEADER(y)->hash;
+        if (hash_a && hash_b && hash_a != hash_b) {
+            return 0;
+        }
+    }
+    return memcmp(x, y, (size_t)length) == 0;
+}
+
+YafValue yaf_string_concat(YafValue a, YafValue b) {
+    const char* a_str = is_string(&a) ? string_data(&a) : "";
+    const char* b_str = is_string(&b) ? string_data(&b) : "";
+    int64_t a_len = is_string(&a) ? string_length(&a) : 0;
+    int64_t b_len = is_string(&b) ? string_length(&b) : 0;
+    
+    // Si cabe en el valor no se reserva nada
+    if (a_len + b_len <= YAF_SMALL_STRING_MAX) {
+        char small[YAF_SMALL_STRING_MAX];
+        memcpy(small, a_str, (size_t)a_len);
+        memcpy(small + a_len, b_str, (size_t)b_len);
+        return yaf_make_string_len(small, a_len + b_len);
+    }
+    
+    // Una sola reserva con el tamaño exacto; no hace falta recorrer con strlen
+    char* result = yaf_string_alloc(a_len + b_len);
+    memcpy(result, a_str, (size_t)a_len);
+    memcpy(result + a_len, b_str, (size_t)b_len);
+    result[a_len + b_len] = '\0';
+    YAF_STRING_HEADER(result)->length = a_len + b_len;
+    
+    YafValue val;
+    val.tag = YAF_STRING;
+    val.value.string_val = result;
+    return val;
+}
+
+// String builders
+//
+// A builder is a heap string with spare capacity that nothing else
+// references, so appends can write in place; it grows geometrically and
+// becomes an ordinary string again by clearing its flag.
+#define YAF_BUILDER_MIN_CAPACITY 64
+
+static char* builder_new(const char* data, int64_t length, int64_t capacity) {
+    if (capacity < YAF_BUILDER_MIN_CAPACITY) {
+        capacity = YAF_BUILDER_MIN_CAPACITY;
+    }
+    char* builder = yaf_string_alloc(capacity);
+    memcpy(builder, data, (size_t)length);
+    builder[length] = '\0';
+    YafString* str = YAF_STRING_HEADER(builder);
+    str->length = length;
+    str->flags = YAF_STR_BUILDER;
+    return builder;
+}
+
+YafValue yaf_builder_from(YafValue s) {
+    validate_type(s, YAF_STRING, "string builder");
+    int64_t length = string_length(&s);
+    YafValue val;
+    val.tag = YAF_STRING;
+    val.value.string_val = builder_new(string_data(&s), length, length * 2);
+    return val;
+}
+
+YafValue yaf_builder_append(YafValue builder, YafValue s) {
+    validate_type(builder, YAF_STRING, "string builder");
+    validate_type(s, YAF_STRING, "string builder");
+    if (builder.tag != YAF_STRING || !builder.value.string_val ||
+        !(YAF_STRING_HEADER(builder.value.string_val)->flags & YAF_STR_BUILDER)) {
+        builder = yaf_builder_from(builder);
+    }
+    
+    char* data = builder.value.string_val;
+    YafString* str = YAF_STRING_HEADER(data);
+    int64_t add = string_length(&s);
+    int64_t length = str->length + add;
+    if (length > str->capacity) {
+        int64_t capacity = str->capacity * 2;
+        data = builder_new(data, str->length, capacity > length ? capacity : length);
+        yaf_gc_free(str);
+        str = YAF_STRING_HEADER(data);
+    }
+    memcpy(data + str->length, string_data(&s), (size_t)add);
+    data[length] = '\0';
+    str->length = length;
+    
+    builder.value.string_val = data;
+    return builder;
+}
+
+// Hands the buffer over as a regular immutable string, without copying
+// (short results move inline like any other new string)
+YafValue yaf_builder_to_string(YafValue builder) {
+    validate_type(builder, YAF_STRING, "string builder");
+    if (builder.tag != YAF_STRING || !builder.value.string_val) {
+        return builder;
+    }
+    YAF_STRING_HEADER(builder.value.string_val)->flags &= ~(uint32_t)YAF_STR_BUILDER;
+    return string_result(builder.value.string_val);
+}
+
+// I/O functions
+//
+// Files at least this large are mapped instead of read: the string is a
+// read-only view of the page cache and costs no copy and no heap memory.
+#define YAF_MMAP_THRESHOLD (64 * 1024)
+
+// Maps the file right after an anonymous page holding the GC and string
+// headers, so data is page aligned and the zero fill past EOF supplies the
+// NUL terminator (an extra page is reserved when the size is page aligned).
+static char* map_file_string(int fd, size_t length) {
+    size_t page = page_size();
+    size_t total = page + ((length + 1 + page - 1) & ~(page - 1));
+    char* base = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (mmap(base + page, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, total);
+        return NULL;
+    }
+    
+    YafString* str = (YafString*)(base + page - sizeof(YafString));
+    str->refcount = 1;
+    str->flags = YAF_STR_MAPPED;
+    str->length = (int64_t)length;
+    str->capacity = (int64_t)length;
+    str->hash = 0;
+    gc_link(GC_HEADER(str), total, YAF_STRING);
+    yaf_tlab.bytes_since_collect += (int64_t)total;
+    yaf_tlab.bytes_in_use += (int64_t)total;
+    yaf_tlab.total_allocated += (int64_t)total;
+    return str->data;
+}
+
+// Reads until EOF, for pipes and files whose size is not known upfront
+static char* read_fd_string(int fd, size_t size_hint) {
+    size_t capacity = size_hint > 0 ? size_hint : 4096;
+    size_t length = 0;
+    char* buffer = malloc(capacity);
+    if (!buffer) {
+        out_of_memory(capacity);
+    }
+    for (;;) {
+        if (length == capacity) {
+            capacity *= 2;
+            char* grown = realloc(buffer, capacity);
+            if (!grown) {
+                out_of_memory(capacity);
+            }
+            buffer = grown;
+        }
+        ssize_t n = read(fd, buffer + length, capacity - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        length += (size_t)n;
+    }
+    char* content = yaf_string_new(buffer, (int64_t)length);
+    free(buffer);
+    return content;
+}
+
+YafValue yaf_io_read_file(YafValue path) {
+    validate_type(path, YAF_STRING, "read_file");
+    const char* filepath = string_data(&path);
+    
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) {
+        return yaf_make_string("");
+    }
+    
+    struct stat st;
+    char* content = NULL;
+    // Pseudo-files such as /proc report a size of 0 and are read like pipes
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        if (st.st_size >= YAF_MMAP_THRESHOLD) {
+            content = map_file_string(fd, (size_t)st.st_size);
+        }
+        if (!content) {
+            // Small file (or mmap refused): read straight into the string
+            content = yaf_string_alloc((int64_t)st.st_size);
+            size_t length = 0;
+            while (length < (size_t)st.st_size) {
+                ssize_t n = read(fd, content + length, (size_t)st.st_size - length);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                length += (size_t)n;
+            }
+            content[length] = '\0';
+            YAF_STRING_HEADER(content)->length = (int64_t)length;
+        }
+    } else {
+        content = read_fd_string(fd, 0);
+    }
+    close(fd);
+    return string_result(content);
+}
+
+YafValue yaf_io_write_file(YafValue path, YafValue content) {
+    validate_type(path, YAF_STRING, "write_file");
+    validate_type(content, YAF_STRING, "write_file");
+    
+    int fd = open(string_data(&path), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        return yaf_make_bool(0);
+    }
+    
+    // The length comes from the header, so embedded NULs are written too
+    bool ok = write_all(fd, string_data(&content), (size_t)string_length(&content));
+    ok = close(fd) == 0 && ok;
+    return yaf_make_bool(ok);
+}
+
+YafValue yaf_io_file_exists(YafValue path) {
+    validate_type(path, YAF_STRING, "file_exists");
+    return yaf_make_bool(access(string_data(&path), F_OK) == 0);
+}
+
+// File handles
+//
+// Readers find lines with memchr in a large buffer that is refilled in
+// place and only grows when a single line does not fit, so memory stays
+// bounded by the longest line rather than the file size. Writers collect
+// output in a buffer of the same size; writes too large for it go out
+// together with the pending bytes in one writev.
+#define YAF_FILE_BUFFER_SIZE (256 * 1024)
+
+typedef struct {
+    int fd;
+    bool writable;
+    bool eof;
+    char* buffer;
+    size_t capacity;
+    size_t start;       // first unread byte (readers only)
+    size_t end;         // one past the last buffered byte
+} YafFile;
+
+// Handles returned by open() and file_open() index this table; closed
+// slots are reused
+static struct {
+    YafFile** handles;
+    int64_t count;
+} yaf_files;
+
+static YafFile stdin_reader = { .fd = STDIN_FILENO };
+
+static void file_alloc_buffer(YafFile* f) {
+    f->capacity = YAF_FILE_BUFFER_SIZE;
+    f->buffer = malloc(f->capacity);
+    if (!f->buffer) {
+        out_of_memory(f->capacity);
+    }
+}
+
+// Appends more input after the unread bytes; false once nothing was added
+static bool reader_fill(YafFile* r) {
+    if (r->eof) {
+        return false;
+    }
+    if (!r->buffer) {
+        file_alloc_buffer(r);
+    }
+    if (r->start > 0) {
+        memmove(r->buffer, r->buffer + r->start, r->end - r->start);
+        r->end -= r->start;
+        r->start = 0;
+    }
+    if (r->end == r->capacity) {
+        size_t capacity = r->capacity * 2;
+        char* grown = realloc(r->buffer, capacity);
+        if (!grown) {
+            out_of_memory(capacity);
+        }
+        r->buffer = grown;
+        r->capacity = capacity;
+    }
+    for (;;) {
+        ssize_t n = read(r->fd, r->buffer + r->end, r->capacity - r->end);
+        if (n > 0) {
+            r->end += (size_t)n;
+            return true;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        r->eof = true;
+        return false;
+    }
+}
+
+// Next line without its terminator ("\n" or "\r\n"); empty at end of input
+static YafValue reader_read_line(YafFile* r) {
+    size_t scanned = 0;     // bytes after start already known to hold no '\n'
+    if (!r->buffer) {
+        reader_fill(r);
+    }
+    for (;;) {
+        char* line = r->buffer + r->start;
+        char* newline = memchr(line + scanned, '\n', r->end - r->start - scanned);
+        if (newline || (r->eof && r->start < r->end)) {
+            size_t length = newline ? (size_t)(newline - line) : r->end - r->start;
+            r->start += newline ? length + 1 : length;
+            if (length > 0 && line[length - 1] == '\r') {
+                length--;
+            }
+            return yaf_make_string_len(line, (int64_t)length);
+        }
+        scanned = r->end - r->start;
+        if (!reader_fill(r)) {
+            if (r->start == r->end) {
+                return yaf_make_string("");
+            }
+        }
+    }
+}
+
+static bool reader_at_eof(YafFile* r) {
+    if (r->start == r->end) {
+        reader_fill(r);
+    }
+    return r->start == r->end && r->eof;
+}
+
+static bool writer_flush(YafFile* w) {
+    bool ok = write_all(w->fd, w->buffer, w->end);
+    w->end = 0;
+    return ok;
+}
+
+static bool writer_write(YafFile* w, const char* data, size_t size) {
+    if (size <= w->capacity - w->end) {
+        memcpy(w->buffer + w->end, data, size);
+        w->end += size;
+        return true;
+    }
+    if (size >= w->capacity) {
+        bool ok = write_through(w->fd, w->buffer, w->end, data, size);
+        w->end = 0;
+        return ok;
+    }
+    bool ok = writer_flush(w);
+    memcpy(w->buffer, data, size);
+    w->end = size;
+    return ok;
+}
+
+// Writers left open are flushed when the program exits
+static void flush_open_files(void) {
+    for (int64_t i = 0; i < yaf_files.count; i++) {
+        if (yaf_files.handles[i] && yaf_files.handles[i]->writable) {
+            writer_flush(yaf_files.handles[i]);
+        }
+    }
+}
+
+static int64_t file_register(int fd, bool writable) {
+    int64_t index = 0;
+    while (index < yaf_files.count && yaf_files.handles[index]) {
+        index++;
+    }
+    if (index == yaf_files.count) {
+        int64_t count = yaf_files.count ? yaf_files.count * 2 : 8;
+        YafFile** handles = realloc(yaf_files.handles, (size_t)count * sizeof(YafFile*));
+        if (!handles) {
+            out_of_memory((size_t)count * sizeof(YafFile*));
+        }
+        memset(handles + yaf_files.count, 0, (size_t)(count - yaf_files.count) * sizeof(YafFile*));
+        yaf_files.handles = handles;
+        yaf_files.count = count;
+    }
+    
+    YafFile* f = calloc(1, sizeof(YafFile));
+    if (!f) {
+        out_of_memory(sizeof(YafFile));
+    }
+    f->fd = fd;
+    f->writable = writable;
+    if (writable) {
+        static bool flush_registered;
+        if (!flush_registered) {
+            atexit(flush_open_files);
+            flush_registered = true;
+        }
+        file_alloc_buffer(f);
+    }
+    yaf_files.handles[index] = f;
+    return index;
+}
+
+static YafFile* file_for(YafValue handle, const char* func_name) {
+    validate_type(handle, YAF_INT, func_name);
+    int64_t index = handle.value.int_val;
+    if (index < 0 || index >= yaf_files.count || !yaf_files.handles[index]) {
+        yaf_flush();
+        fprintf(stderr, "Runtime error in %s: invalid file handle %lld\n",
+                func_name, (long long)index);
+        runtime_error_exit();
+    }
+    return yaf_files.handles[index];
+}
+
+static YafFile* file_for_mode(YafValue handle, const char* func_name, bool writable) {
+    YafFile* f = file_for(handle, func_name);
+    if (f->writable != writable) {
+        yaf_flush();
+        fprintf(stderr, "Runtime error in %s: file handle %lld is not open for %s\n",
+                func_name, (long long)handle.value.int_val, writable ? "writing" : "reading");
+        runtime_error_exit();
+    }
+    return f;
+}
+
+YafValue yaf_io_open(YafValue path) {
+    validate_type(path, YAF_STRING, "open");
+    int fd = open(string_data(&path), O_RDONLY);
+    return yaf_make_int(fd < 0 ? -1 : file_register(fd, false));
+}
+
+// Modes: "r" read, "w" truncate and write, "a" append
+YafValue yaf_io_file_open(YafValue path, YafValue mode) {
+    validate_type(path, YAF_STRING, "file_open");
+    validate_type(mode, YAF_STRING, "file_open");
+    const char* m = string_data(&mode);
+    int flags;
+    if (strcmp(m, "r") == 0) {
+        flags = O_RDONLY;
+    } else if (strcmp(m, "w") == 0) {
+        flags = O_WRONLY | O_CREAT | O_TRUNC;
+    } else if (strcmp(m, "a") == 0) {
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+    } else {
+        yaf_flush();
+        fprintf(stderr, "Runtime error in file_open: invalid mode \"%s\" (expected \"r\", \"w\" or \"a\")\n", m);
+        runtime_error_exit();
+    }
+    int fd = open(string_data(&path), flags, 0666);
+    return yaf_make_int(fd < 0 ? -1 : file_register(fd, flags != O_RDONLY));
+}
+
+YafValue yaf_io_read_line(YafValue handle) {
+    return reader_read_line(file_for_mode(handle, "read_line", false));
+}
+
+YafValue yaf_io_eof(YafValue handle) {
+    return yaf_make_bool(reader_at_eof(file_for_mode(handle, "eof", false)));
+}
+
+YafValue yaf_io_file_write(YafValue handle, YafValue content) {
+    YafFile* w = file_for_mode(handle, "file_write", true);
+    validate_type(content, YAF_STRING, "file_write");
+    size_t size = (size_t)string_length(&content);
+    return yaf_make_bool(writer_write(w, string_data(&content), size));
+}
+
+YafValue yaf_io_close(YafValue handle) {
+    YafFile* f = file_for(handle, "close");
+    bool ok = !f->writable || writer_flush(f);
+    ok = close(f->fd) == 0 && ok;
+    free(f->buffer);
+    free(f);
+    yaf_files.handles[handle.value.int_val] = NULL;
+    return yaf_make_bool(ok);
+}
+
+YafValue yaf_io_input(void) {
+    // Pending output (e.g. a question printed with print) must be visible first
+    yaf_flush();
+    return reader_read_line(&stdin_reader);
+}
+
+YafValue yaf_io_input_prompt(YafValue prompt) {
+    validate_type(prompt, YAF_STRING, "input_prompt");
+    const char* prompt_str = string_data(&prompt);
+    
+    // Print prompt without newline
+    out_cstring(prompt_str);
+    yaf_flush();
+    
+    return yaf_io_input();
+}
+
+// Time functions. now() is wall-clock seconds since the epoch; the finer
+// clocks are monotonic, for measuring intervals.
+YafValue yaf_time_now(void) {
+    return yaf_make_int(time(NULL));
+}
+
+static int64_t monotonic_nanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+YafValue yaf_time_now_nanos(void) {
+    return yaf_make_int(monotonic_nanos());
+}
+
+YafValue yaf_time_now_millis(void) {
+    return yaf_make_int(monotonic_nanos() / 1000000);
+}
+
+// Sleeps the whole duration even if a signal interrupts it
+static void sleep_nanos(double nanos) {
+    if (!(nanos > 0)) {
+        return;
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t)(nanos / 1e9);
+    ts.tv_nsec = (long)(nanos - (double)ts.tv_sec * 1e9);
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_nsec = 999999999;
+    }
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+static double number_or_zero(YafValue value) {
+    if (value.tag == YAF_FLOAT) {
+        return value.value.float_val;
+    }
+    return value.tag == YAF_INT ? (double)value.value.int_val : 0.0;
+}
+
+YafValue yaf_time_sleep(YafValue seconds) {
+    sleep_nanos(number_or_zero(seconds) * 1e9);
+    return yaf_make_bool(1);
+}
+
+YafValue yaf_time_sleep_ms(YafValue millis) {
+    sleep_nanos(number_or_zero(millis) * 1e6);
+    return yaf_make_bool(1);
+}
+
+// Returns its argument through a barrier the optimizer can't see across,
+// so benchmarked calls whose result is unused are not deleted
+__attribute__((noinline)) YafValue yaf_black_box(YafValue value) {
+    __asm__ volatile("" : : "r"(&value) : "memory");
+    return value;
+}
+
+// Type conversion functions (enhanced)
+YafValue yaf_string_to_int(YafValue s) {
+    validate_type(s, YAF_STRING, "string_to_int");
+    const char* str = string_data(&s);
+    
+    // Parse integer from string
+    char* endptr;
+    long long result = strtoll(str, &endptr, 10);
+    
+    // Check if conversion was successful
+    if (endptr == str || *endptr != '\0') {
+        return yaf_make_int(0);  // Return 0 for invalid strings
+    }
+    
+    return yaf_make_int(result);
+}
+
+YafValue yaf_int_to_string(YafValue i) {
+    validate_type(i, YAF_INT, "int_to_string");
+    
+    char buffer[32];
+    int len = format_int(buffer, i.value.int_val);
+    return yaf_make_string_len(buffer, len);
+}
+
+// Frame objects
+//
+// The compiler's escape analysis (src/core/escape.rs) gives arrays and
+// string conversions that never leave the current function storage in its
+// stack frame. A frame array has a GC header so marking can walk its
+// elements, but it is on no object list: the sweep never sees it. A frame
+// string is flagged static, which already keeps it out of marking,
+// refcounting and freeing.
+_Static_assert(sizeof(YafGcHeader) + sizeof(YafArray) <= 64, "YAF_FRAME_ARRAY_SIZE reserves 64 bytes of headers");
+_Static_assert(sizeof(YafElement) <= sizeof(YafValue), "YAF_FRAME_ARRAY_SIZE reserves a YafValue per element");
+_Static_assert(sizeof(YafString) + 32 <= YAF_FRAME_STRING_SIZE, "frame strings hold any formatted number");
+
+YafArray* yaf_array_init_frame(void* frame, uint32_t elem_kind, int64_t capacity) {
+    YafGcHeader* header = frame;
+    header->next = NULL;
+    header->prev = NULL;
+    header->size = YAF_FRAME_ARRAY_SIZE(capacity);
+    header->kind = YAF_ARRAY;
+    header->marked = GC_FRAME_OBJECT;
+    header->owner = 0;
+    
+    YafArray* array = (YafArray*)(header + 1);
+    array->length = 0;
+    array->capacity = capacity;
+    array->elem_kind = elem_kind;
+    array->reserved = 0;
+    array->data = (char*)frame + 64;
+    return array;
+}
+
+static YafValue frame_string(void* frame, const char* text, int length) {
+    if (length <= YAF_SMALL_STRING_MAX) {
+        return yaf_make_string_len(text, length);
+    }
+    YafString* str = frame;
+    str->refcount = 1;
+    str->flags = YAF_STR_STATIC;
+    str->length = length;
+    str->capacity = length;
+    str->hash = 0;
+    memcpy(str->data, text, (size_t)length);
+    str->data[length] = '\0';
+    
+    YafValue val;
+    val.tag = YAF_STRING;
+    val.value.string_val = str->data;
+    return val;
+}
+
+// Numbers are formatted in place; anything else converts as usual
+YafValue yaf_value_to_string_frame(YafValue value, void* frame) {
+    char buffer[64];
+    int len;
+    switch (value.tag) {
+        case YAF_INT:
+            len = format_int(buffer, value.value.int_val);
+            break;
+        case YAF_FLOAT:
+            len = format_float(buffer, sizeof(buffer), value.value.float_val);
+            break;
+        default:
+            return yaf_value_to_string(value);
+    }
+    if (len < 0 || (size_t)len >= YAF_FRAME_STRING_SIZE - sizeof(YafString)) {
+        return yaf_value_to_string(value);
+    }
+    return frame_string(frame, buffer, len);
+}
+
+YafValue yaf_int_to_string_frame(YafValue i, void* frame) {
+    validate_type(i, YAF_INT, "int_to_string");
+    
+    char buffer[32];
+    int len = format_int(buffer, i.value.int_val);
+    return frame_string(frame, buffer, len);
+}
+
+// Memoization
+//
+// Each @memo function has a cache of its results by argument values,
+// created by the first store and kept for the whole run. A single int
+// argument in [0, YAF_MEMO_DENSE_LIMIT) indexes a dense table, grown to the
+// largest index seen. Other argument tuples go to a hash table with
+// YAF_MEMO_WAYS slots per bucket, doubled while it stays within the limit;
+// once it can't grow, a new tuple replaces a slot of its bucket. The limit
+// is YAF_MEMO_LIMIT entries per table (environment variable, read when the
+// first cache is created).
+//
+// Cached strings are retained, so no explicit release frees them, and the
+// collector marks every cache. The function body runs without the lock:
+// two threads may compute the same result, and the second store is dropped.
+#define YAF_MEMO_WAYS 4
+#define YAF_MEMO_MIN_BUCKETS 16
+#define YAF_MEMO_DENSE_LIMIT ((int64_t)1 << 20)
+#define YAF_MEMO_DEFAULT_LIMIT ((int64_t)1 << 20)
+#define MEMO_EMPTY (-1)     // tag of a dense slot not computed yet
+
+struct YafMemo {
+    struct YafMemo* next;   // every cache, for the collector
+    int32_t arity;
+    bool has_strings;       // anything for the collector to mark
+    
+    YafValue* dense;
+    int64_t dense_capacity;
+    
+    // Slot i of the hash table: hashes[i] (0 when empty), then arity
+    // arguments and the result at entries[i * (arity + 1)]
+    uint64_t* hashes;
+    YafValue* entries;
+    int64_t bucket_count;
+    uint64_t evictions;
+};
+
+static YafMemo* memo_caches;
+static int64_t memo_limit;
+static pthread_mutex_t memo_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static YafMemo* memo_new(int32_t arity) {
+    if (!memo_limit) {
+        const char* env = getenv("YAF_MEMO_LIMIT");
+        long long limit = env ? strtoll(env, NULL, 10) : YAF_MEMO_DEFAULT_LIMIT;
+        memo_limit = limit > 0 ? limit : YAF_MEMO_DEFAULT_LIMIT;
+    }
+    YafMemo* memo = calloc(1, sizeof(YafMemo));
+    if (!memo) {
+        out_of_memory(sizeof(YafMemo));
+    }
+    memo->arity = arity;
+    memo->next = memo_caches;
+    memo_caches = memo;
+    return memo;
+}
+
+static bool memo_dense_index(const YafMemo* memo, const YafValue* args, int64_t* index) {
+    if (memo->arity != 1 || args[0].tag != YAF_INT) {
+        return false;
+    }
+    int64_t n = args[0].value.int_val;
+    if (n < 0 || n >= YAF_MEMO_DENSE_LIMIT || n >= memo_limit) {
+        return false;
+    }
+    *index = n;
+    return true;
+}
+
+static void memo_dense_grow(YafMemo* memo, int64_t index) {
+    int64_t capacity = memo->dense_capacity ? memo->dense_capacity : 64;
+    while (capacity <= index) {
+        capacity *= 2;
+    }
+    YafValue* dense = realloc(memo->dense, (size_t)capacity * sizeof(YafValue));
+    if (!dense) {
+        out_of_memory((size_t)capacity * sizeof(YafValue));
+    }
+    for (int64_t i = memo->dense_capacity; i < capacity; i++) {
+        dense[i].tag = MEMO_EMPTY;
+    }
+    memo->dense = dense;
+    memo->dense_capacity = capacity;
+}
+
+static uint64_t memo_hash(const YafValue* args, int32_t arity) {
+    uint64_t hash = (uint64_t)arity;
+    for (int32_t i = 0; i < arity; i++) {
+        hash = mix_hash(hash * 31 + map_key_hash(args[i]));
+    }
+    return mix_hash(hash);
+}
+
+// Floats compare by bits: a cache only needs the same key to mean the same call
+static bool memo_value_equal(YafValue a, YafValue b) {
+    if (is_string(&a)) {
+        return is_string(&b) && yaf_string_equal(a, b);
+    }
+    if (a.tag != b.tag) {
+        return false;
+    }
+    if (a.tag == YAF_BOOL) {
+        return a.value.bool_val == b.value.bool_val;
+    }
+    return a.value.int_val == b.value.int_val;
+}
+
+static int64_t memo_find(const YafMemo* memo, const YafValue* args, uint64_t hash) {
+    if (!memo->bucket_count) {
+        return -1;
+    }
+    int64_t first = (int64_t)(hash & (uint64_t)(memo->bucket_count - 1)) * YAF_MEMO_WAYS;
+    for (int64_t slot = first; slot < first + YAF_MEMO_WAYS; slot++) {
+        if (memo->hashes[slot] != hash) {
+            continue;
+        }
+        const YafValue* key = &memo->entries[slot * (memo->arity + 1)];
+        int32_t i = 0;
+        while (i < memo->arity && memo_value_equal(key[i], args[i])) {
+            i++;
+        }
+        if (i == memo->arity) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+// Free slot of the bucket for `hash`, or the one to evict when it is full
+static int64_t memo_slot_for(YafMemo* memo, uint64_t hash) {
+    int64_t first = (int64_t)(hash & (uint64_t)(memo->bucket_count - 1)) * YAF_MEMO_WAYS;
+    for (int64_t slot = first; slot < first + YAF_MEMO_WAYS; slot++) {
+        if (!memo->hashes[slot]) {
+            return slot;
+        }
+    }
+    return first + (int64_t)(memo->evictions++ % YAF_MEMO_WAYS);
+}
+
+static void memo_resize(YafMemo* memo, int64_t bucket_count) {
+    size_t slots = (size_t)bucket_count * YAF_MEMO_WAYS;
+    size_t width = (size_t)memo->arity + 1;
+    uint64_t* hashes = calloc(slots, sizeof(uint64_t));
+    YafValue* entries = malloc(slots * width * sizeof(YafValue));
+    if (!hashes || !entries) {
+        out_of_memory(slots * (sizeof(uint64_t) + width * sizeof(YafValue)));
+    }
+    
+    uint64_t* old_hashes = memo->hashes;
+    YafValue* old_entries = memo->entries;
+    int64_t old_slots = memo->bucket_count * YAF_MEMO_WAYS;
+    memo->hashes = hashes;
+    memo->entries = entries;
+    memo->bucket_count = bucket_count;
+    for (int64_t slot = 0; slot < old_slots; slot++) {
+        if (old_hashes[slot]) {
+            int64_t target = memo_slot_for(memo, old_hashes[slot]);
+            hashes[target] = old_hashes[slot];
+            memcpy(&entries[(size_t)target * width], &old_entries[(size_t)slot * width], width * sizeof(YafValue));
+        }
+    }
+    free(old_hashes);
+    free(old_entries);
+}
+
+static void memo_store(YafMemo* memo, const YafValue* args, uint64_t hash, YafValue result) {
+    if (memo_find(memo, args, hash) >= 0) {
+        return;
+    }
+    int64_t slots = memo->bucket_count * YAF_MEMO_WAYS;
+    if (!slots) {
+        memo_resize(memo, YAF_MEMO_MIN_BUCKETS);
+    } else if (slots * 2 <= memo_limit) {
+        // Grow before the buckets start to overflow
+        int64_t first = (int64_t)(hash & (uint64_t)(memo->bucket_count - 1)) * YAF_MEMO_WAYS;
+        if (memo->hashes[first + YAF_MEMO_WAYS - 1]) {
+            memo_resize(memo, memo->bucket_count * 2);
+        }
+    }
+    
+    int64_t slot = memo_slot_for(memo, hash);
+    YafValue* entry = &memo->entries[slot * (memo->arity + 1)];
+    memo->hashes[slot] = hash;
+    for (int32_t i = 0; i < memo->arity; i++) {
+        entry[i] = yaf_retain_value(args[i]);
+    }
+    entry[memo->arity] = result;
+}
+
+int32_t yaf_memo_get(YafMemo** cache, const YafValue* args, int32_t arity, YafValue* result) {
+    bool locked = yaf_parallel;
+    if (locked) {
+        pthread_mutex_lock(&memo_lock);
+    }
+    YafMemo* memo = *cache;
+    int32_t found = 0;
+    int64_t index;
+    if (!memo) {
+        // Nothing stored yet
+    } else if (memo_dense_index(memo, args, &index)) {
+        if (index < memo->dense_capacity && memo->dense[index].tag != MEMO_EMPTY) {
+            *result = memo->dense[index];
+            found = 1;
+        }
+    } else {
+        int64_t slot = memo_find(memo, args, memo_hash(args, arity));
+        if (slot >= 0) {
+            *result = memo->entries[slot * (arity + 1) + arity];
+            found = 1;
+        }
+    }
+    if (locked) {
+        pthread_mutex_unlock(&memo_lock);
+    }
+    return found;
+}
+
+void yaf_memo_put(YafMemo** cache, const YafValue* args, int32_t arity, YafValue result) {
+    bool locked = yaf_parallel;
+    if (locked) {
+        pthread_mutex_lock(&memo_lock);
+    }
+    YafMemo* memo = *cache;
+    if (!memo) {
+        memo = memo_new(arity);
+        *cache = memo;
+    }
+    for (int32_t i = 0; i < arity; i++) {
+        memo->has_strings |= is_string(&args[i]);
+    }
+    memo->has_strings |= is_string(&result);
+    
+    int64_t index;
+    if (memo_dense_index(memo, args, &index)) {
+        if (index >= memo->dense_capacity) {
+            memo_dense_grow(memo, index);
+        }
+        if (memo->dense[index].tag == MEMO_EMPTY) {
+            memo->dense[index] = yaf_retain_value(result);
+        }
+    } else {
+        memo_store(memo, args, memo_hash(args, arity), yaf_retain_value(result));
+    }
+    if (locked) {
+        pthread_mutex_unlock(&memo_lock);
+    }
+}
+
+static void gc_mark_memos(void) {
+    for (YafMemo* memo = memo_caches; memo; memo = memo->next) {
+        if (!memo->has_strings) {
+            continue;
+        }
+        for (int64_t i = 0; i < memo->dense_capacity; i++) {
+            if (memo->dense[i].tag != MEMO_EMPTY) {
+                gc_mark_value(&memo->dense[i]);
+            }
+        }
+        int64_t width = memo->arity + 1;
+        for (int64_t slot = 0; slot < memo->bucket_count * YAF_MEMO_WAYS; slot++) {
+            if (memo->hashes[slot]) {
+                for (int64_t i = 0; i < width; i++) {
+                    gc_mark_value(&memo->entries[slot * width + i]);
+                }
+            }
+        }
+    }
+}
+
+// Profiling
+//
+// `yaf compile --profile` makes every function call yaf_prof_enter(id) on
+// entry and yaf_prof_exit() before it returns; main registers the names
+// first. Times are CPU timestamp counter ticks (the virtual counter on
+// AArch64), converted to nanoseconds at exit against the monotonic clock.
+// Each function gets its calls, self time, total time (outermost
+// activations only, so recursion is not counted twice) and the allocations
+// made while it was the running function. The body of a @memo function is
+// what gets profiled, so its calls are the cache misses.
+//
+// Activations also form a call tree for the collapsed stacks: the children
+// of a node are a linked list of the functions it called. Direct recursion
+// stays in its node, and callees deeper than YAF_PROF_MAX_DEPTH or past
+// YAF_PROF_MAX_NODES are folded into their caller, so deep or mutual
+// recursion doesn't grow the tree (or the file) without bound.
+//
+// Only the main thread is profiled: calls made on pfor worker threads are
+// not recorded, and the time the main thread spends in a parallel loop
+// belongs to the function that runs it. At exit the flat profile goes to
+// stderr and the collapsed stacks ("main;f;g <nanoseconds>", the input of
+// flamegraph.pl and speedscope) to $YAF_PROFILE, or yaf-profile.folded.
+#define YAF_PROF_MAX_NODES (1 << 20)
+#define YAF_PROF_MAX_DEPTH 128
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct ProfFunction {
+    const char* name;
+    int64_t calls;
+    uint64_t self_ticks;
+    uint64_t total_ticks;
+    int64_t active;         // activations on the stack
+    int64_t allocations;
+    int64_t allocated;      // bytes
+};
+
+typedef struct {
+    int32_t function;
+    int32_t parent;
+    int32_t first_child;
+    int32_t next_sibling;
+    int32_t depth;
+    uint64_t self_ticks;
+} ProfNode;
+
+typedef struct {
+    ProfFunction* function;
+    int32_t node;
+    uint64_t start;
+    uint64_t callees;       // ticks spent in the functions it called
+} ProfFrame;
+
+static struct {
+    ProfFunction* functions;    // `count` user functions, then main
+    int32_t count;
+    ProfNode* nodes;
+    int32_t node_count;
+    int32_t node_capacity;
+    ProfFrame* frames;          // frames[0] is main
+    int64_t depth;
+    int64_t capacity;
+    uint64_t start_ticks;
+    int64_t start_nanos;
+} yaf_prof;
+
+static inline uint64_t prof_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return (uint64_t)monotonic_nanos();
+#endif
+}
+
+static void prof_count_allocation(size_t size) {
+    prof_current->allocations++;
+    prof_current->allocated += (int64_t)size;
+}
+
+static int32_t prof_add_node(int32_t function, int32_t parent) {
+    if (yaf_prof.node_count == yaf_prof.node_capacity) {
+        int32_t capacity = yaf_prof.node_capacity ? yaf_prof.node_capacity * 2 : 256;
+        ProfNode* nodes = realloc(yaf_prof.nodes, (size_t)capacity * sizeof(ProfNode));
+        if (!nodes) {
+            out_of_memory((size_t)capacity * sizeof(ProfNode));
+        }
+        yaf_prof.nodes = nodes;
+        yaf_prof.node_capacity = capacity;
+    }
+    int32_t index = yaf_prof.node_count++;
+    ProfNode* node = &yaf_prof.nodes[index];
+    node->function = function;
+    node->parent = parent;
+    node->first_child = -1;
+    node->next_sibling = -1;
+    node->depth = parent >= 0 ? yaf_prof.nodes[parent].depth + 1 : 0;
+    node->self_ticks = 0;
+    if (parent >= 0) {
+        node->next_sibling = yaf_prof.nodes[parent].first_child;
+        yaf_prof.nodes[parent].first_child = index;
+    }
+    return index;
+}
+
+static int32_t prof_callee_node(int32_t caller, int32_t function) {
+    if (yaf_prof.nodes[caller].function == function || yaf_prof.nodes[caller].depth >= YAF_PROF_MAX_DEPTH) {
+        return caller;
+    }
+    for (int32_t child = yaf_prof.nodes[caller].first_child; child >= 0; child = yaf_prof.nodes[child].next_sibling) {
+        if (yaf_prof.nodes[child].function == function) {
+            return child;
+        }
+    }
+    if (yaf_prof.node_count >= YAF_PROF_MAX_NODES) {
+        return caller;
+    }
+    return prof_add_node(function, caller);
+}
+
+static void prof_report(void);
+
+void yaf_prof_start(const char* const* names, int32_t count) {
+    if (yaf_prof.functions) {
+        return;
+    }
+    yaf_prof.functions = calloc((size_t)count + 1, sizeof(ProfFunction));
+    yaf_prof.capacity = 1024;
+    yaf_prof.frames = malloc((size_t)yaf_prof.capacity * sizeof(ProfFrame));
+    if (!yaf_prof.functions || !yaf_prof.frames) {
+        out_of_memory((size_t)yaf_prof.capacity * sizeof(ProfFrame));
+    }
+    for (int32_t i = 0; i < count; i++) {
+        yaf_prof.functions[i].name = names[i];
+    }
+    yaf_prof.functions[count].name = "main";
+    yaf_prof.functions[count].calls = 1;
+    yaf_prof.functions[count].active = 1;
+    yaf_prof.count = count;
+    
+    yaf_prof.frames[0].function = &yaf_prof.functions[count];
+    yaf_prof.frames[0].node = prof_add_node(count, -1);
+    yaf_prof.frames[0].callees = 0;
+    yaf_prof.depth = 1;
+    prof_current = &yaf_prof.functions[count];
+    atexit(prof_report);
+    
+    yaf_prof.start_nanos = monotonic_nanos();
+    yaf_prof.start_ticks = prof_ticks();
+    yaf_prof.frames[0].start = yaf_prof.start_ticks;
+}
+
+void yaf_prof_enter(int32_t function) {
+    if (!prof_current) {
+        return;
+    }
+    if (yaf_prof.depth == yaf_prof.capacity) {
+        int64_t capacity = yaf_prof.capacity * 2;
+        ProfFrame* frames = realloc(yaf_prof.frames, (size_t)capacity * sizeof(ProfFrame));
+        if (!frames) {
+            out_of_memory((size_t)capacity * sizeof(ProfFrame));
+        }
+        yaf_prof.frames = frames;
+        yaf_prof.capacity = capacity;
+    }
+    ProfFunction* callee = &yaf_prof.functions[function];
+    callee->calls++;
+    callee->active++;
+    prof_current = callee;
     
-    // Check if conversion was successful
-    if (endptr == str || *endptr != '\0') {
-        return yaf_make_int(0);  // Return 0 for invalid strings
+    ProfFrame* frame = &yaf_prof.frames[yaf_prof.depth];
+    frame->function = callee;
+    frame->node = prof_callee_node(yaf_prof.frames[yaf_prof.depth - 1].node, function);
+    frame->callees = 0;
+    yaf_prof.depth++;
+    frame->start = prof_ticks();
+}
+
+void yaf_prof_exit(void) {
+    if (!prof_current || yaf_prof.depth <= 1) {
+        return;
+    }
+    uint64_t now = prof_ticks();
+    ProfFrame* frame = &yaf_prof.frames[--yaf_prof.depth];
+    uint64_t elapsed = now - frame->start;
+    uint64_t self = elapsed > frame->callees ? elapsed - frame->callees : 0;
+    ProfNode* node = &yaf_prof.nodes[frame->node];
+    ProfFunction* function = frame->function;
+    function->self_ticks += self;
+    node->self_ticks += self;
+    if (--function->active == 0) {
+        function->total_ticks += elapsed;
     }
     
-    return yaf_make_int(result);
+    ProfFrame* caller = &yaf_prof.frames[yaf_prof.depth - 1];
+    caller->callees += elapsed;
+    prof_current = caller->function;
 }
 
-YafValue yaf_int_to_string(YafValue i) {
-    validate_type(i, YAF_INT, "int_to_string");
+static double prof_nanos_per_tick;
+
+static double prof_ms(uint64_t ticks) {
+    return (double)ticks * prof_nanos_per_tick / 1e6;
+}
+
+static int prof_by_self_time(const void* a, const void* b) {
+    const ProfFunction* x = *(ProfFunction* const*)a;
+    const ProfFunction* y = *(ProfFunction* const*)b;
+    return x->self_ticks < y->self_ticks ? 1 : x->self_ticks > y->self_ticks ? -1 : 0;
+}
+
+static void prof_write_folded(const char* path) {
+    FILE* out = fopen(path, "w");
+    // Functions of the path from a node up to the root
+    int32_t* path_functions = malloc((size_t)yaf_prof.node_count * sizeof(int32_t));
+    if (!out || !path_functions) {
+        fprintf(stderr, "[yaf profile] could not write %s: %s\n", path, strerror(errno));
+        if (out) {
+            fclose(out);
+        }
+        free(path_functions);
+        return;
+    }
+    for (int32_t i = 0; i < yaf_prof.node_count; i++) {
+        uint64_t nanos = (uint64_t)((double)yaf_prof.nodes[i].self_ticks * prof_nanos_per_tick);
+        if (nanos == 0) {
+            continue;
+        }
+        int32_t length = 0;
+        for (int32_t node = i; node >= 0; node = yaf_prof.nodes[node].parent) {
+            path_functions[length++] = yaf_prof.nodes[node].function;
+        }
+        while (length > 0) {
+            fputs(yaf_prof.functions[path_functions[--length]].name, out);
+            fputc(length > 0 ? ';' : ' ', out);
+        }
+        fprintf(out, "%llu\n", (unsigned long long)nanos);
+    }
+    free(path_functions);
+    fclose(out);
+    fprintf(stderr, "[yaf profile] collapsed stacks written to %s\n", path);
+}
+
+static void prof_report(void) {
+    if (!yaf_prof.functions) {
+        return;
+    }
+    // A runtime error exits from inside functions: close their frames
+    while (yaf_prof.depth > 1) {
+        yaf_prof_exit();
+    }
+    uint64_t now = prof_ticks();
+    int64_t nanos = monotonic_nanos() - yaf_prof.start_nanos;
+    ProfFrame* root = &yaf_prof.frames[0];
+    uint64_t elapsed = now - root->start;
+    ProfFunction* main_function = &yaf_prof.functions[yaf_prof.count];
+    main_function->self_ticks = elapsed > root->callees ? elapsed - root->callees : 0;
+    main_function->total_ticks = elapsed;
+    yaf_prof.nodes[root->node].self_ticks = main_function->self_ticks;
+    prof_current = NULL;
+    prof_nanos_per_tick = now > yaf_prof.start_ticks ? (double)nanos / (double)(now - yaf_prof.start_ticks) : 0.0;
     
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%lld", i.value.int_val);
-    return yaf_make_string(buffer);
+    ProfFunction** order = malloc(((size_t)yaf_prof.count + 1) * sizeof(ProfFunction*));
+    if (!order) {
+        return;
+    }
+    int32_t listed = 0;
+    for (int32_t i = 0; i <= yaf_prof.count; i++) {
+        if (yaf_prof.functions[i].calls > 0) {
+            order[listed++] = &yaf_prof.functions[i];
+        }
+    }
+    qsort(order, (size_t)listed, sizeof(ProfFunction*), prof_by_self_time);
+    
+    yaf_flush();
+    fprintf(stderr, "[yaf profile] %.3f ms\n", (double)nanos / 1e6);
+    fprintf(stderr, "%-24s %12s %12s %7s %12s %12s %14s\n",
+            "function", "calls", "self ms", "self %", "total ms", "allocations", "allocated");
+    for (int32_t i = 0; i < listed; i++) {
+        ProfFunction* function = order[i];
+        fprintf(stderr, "%-24s %12lld %12.3f %6.1f%% %12.3f %12lld %14lld\n",
+                function->name, (long long)function->calls,
+                prof_ms(function->self_ticks),
+                elapsed ? 100.0 * (double)function->self_ticks / (double)elapsed : 0.0,
+                prof_ms(function->total_ticks),
+                (long long)function->allocations, (long long)function->allocated);
+    }
+    free(order);
+    
+    const char* path = getenv("YAF_PROFILE");
+    prof_write_folded(path && *path ? path : "yaf-profile.folded");
+}
+
+// Networking
+//
+// Requests are state machines driven by one event loop: epoll on Linux,
+// kqueue on macOS and the BSDs, poll() elsewhere. Sockets are non-blocking
+// and armed one-shot for the single event their state waits for, so a batch
+// of thousands of requests runs on the calling thread with no stack per
+// request. At most YAF_NET_MAX_ACTIVE are in flight; the rest wait their turn.
+//
+// HTTP/1.1 connections are kept alive when the response framing allows it
+// (Content-Length or chunked, no "Connection: close") and parked in a small
+// pool keyed by host and port. A request whose pooled connection turns out
+// to be closed by the server retries once on a fresh one. Host names are
+// resolved with getaddrinfo, which blocks, once per host and batch. There is
+// no TLS: https URLs fail like unreachable hosts.
+#include <sys/socket.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define YAF_NET_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+#include <sys/event.h>
+#define YAF_NET_KQUEUE 1
+#else
+#include <poll.h>
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define YAF_NET_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define YAF_NET_SEND_FLAGS 0    // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+#define YAF_NET_MAX_ACTIVE         128
+#define YAF_NET_POOL_SIZE          YAF_NET_MAX_ACTIVE     // every connection of a batch can be parked
+#define YAF_NET_DEFAULT_TIMEOUT_MS 30000
+#define YAF_NET_READ_SIZE          (16 * 1024)
+#define YAF_NET_HOST_MAX           256
+#define YAF_NET_PORT_MAX           6
+
+typedef enum {
+    NET_HTTP,       // HTTP/1.1 request, the response is framed by its headers
+    NET_CONNECT,    // TCP connect only
+    NET_EXCHANGE,   // TCP: send the data, then read until the peer closes
+} YafNetKind;
+
+typedef enum {
+    NET_PENDING,
+    NET_CONNECTING,
+    NET_WRITING,
+    NET_READING,
+    NET_DONE,
+} YafNetState;
+
+// A host of the current batch. Resolved when the first connection to it is
+// opened, so requests served from the pool never resolve.
+typedef struct {
+    char host[YAF_NET_HOST_MAX];
+    char port[YAF_NET_PORT_MAX];
+    bool resolved;
+    struct addrinfo* addresses;
+} YafNetHost;
+
+typedef struct {
+    int fd;
+    char host[YAF_NET_HOST_MAX];
+    char port[YAF_NET_PORT_MAX];
+} YafNetIdle;
+
+typedef struct {
+    YafNetKind kind;
+    YafNetState state;
+    bool ok;
+    bool reused;        // the connection came from the pool
+    bool retried;
+    bool want_write;    // event the socket is armed for
+    int fd;
+    int host;           // index into yaf_net.hosts
+    struct addrinfo* next_address;  // tried if connecting fails
+    int64_t deadline;   // monotonic nanoseconds
+
+    char* out;
+    size_t out_length;
+    size_t written;
+
+    char* in;           // NUL-terminated
+    size_t in_length;
+    size_t in_capacity;
+
+    // HTTP response framing, known once the headers are in
+    size_t header_scan;
+    size_t body_start;  // 0 until then
+    int64_t content_length;     // -1 if not given
+    bool chunked;
+    bool keep_alive;
+    size_t chunk_scan;  // next chunk header to check
+    int status;
+} YafNetRequest;
+
+// The event loop and the connection pool outlive a batch; the host table is
+// cleared after each one
+static struct {
+    int poller;
+    bool poller_open;
+    YafNetIdle idle[YAF_NET_POOL_SIZE];
+    int idle_count;
+    YafNetHost* hosts;
+    int host_count;
+    int host_capacity;
+} yaf_net;
+
+static bool net_poller_open(void) {
+    if (!yaf_net.poller_open) {
+#if YAF_NET_EPOLL
+        yaf_net.poller = epoll_create1(EPOLL_CLOEXEC);
+#elif YAF_NET_KQUEUE
+        yaf_net.poller = kqueue();
+#else
+        yaf_net.poller = 0;
+#endif
+        yaf_net.poller_open = yaf_net.poller >= 0;
+    }
+    return yaf_net.poller_open;
 }
 
-// GC functions - simple implementations
-void yaf_gc_collect(void) {
-    // Simple no-op for now
+static void net_fail(YafNetRequest* r) {
+    if (r->fd >= 0) {
+        close(r->fd);
+        r->fd = -1;
+    }
+    r->ok = false;
+    r->state = NET_DONE;
 }
 
-void yaf_gc_final_cleanup(void) {
-    // Simple no-op for now  
-}
\ No newline at end of file
+// Waits for one event on the socket. A pooled socket stays registered with
+// its last event disarmed, so it is modified before it is added.
+static void net_arm(YafNetRequest* r, bool writable) {
+    r->want_write = writable;
+#if YAF_NET_EPOLL
+    struct epoll_event event = { .events = (writable ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT, .data.ptr = r };
+    if (epoll_ctl(yaf_net.poller, EPOLL_CTL_MOD, r->fd, &event) != 0 &&
+        (errno != ENOENT || epoll_ctl(yaf_net.poller, EPOLL_CTL_ADD, r->fd, &event) != 0)) {
+        net_fail(r);
+    }
+#elif YAF_NET_KQUEUE
+    struct kevent event;
+    EV_SET(&event, r->fd, writable ? EVFILT_WRITE : EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, r);
+    if (kevent(yaf_net.poller, &event, 1, NULL, 0, NULL) != 0) {
+        net_fail(r);
+    }
+#endif
+}
+
+// Fills `ready` with the requests whose socket is ready; every active
+// request is armed
+static int net_wait(YafNetRequest** active, int active_count, YafNetRequest** ready, int timeout_ms) {
+#if YAF_NET_EPOLL
+    (void)active;
+    struct epoll_event events[YAF_NET_MAX_ACTIVE];
+    int n = epoll_wait(yaf_net.poller, events, active_count, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        ready[i] = events[i].data.ptr;
+    }
+#elif YAF_NET_KQUEUE
+    (void)active;
+    struct kevent events[YAF_NET_MAX_ACTIVE];
+    struct timespec timeout = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long)(timeout_ms % 1000) * 1000000 };
+    int n = kevent(yaf_net.poller, NULL, 0, events, active_count, &timeout);
+    for (int i = 0; i < n; i++) {
+        ready[i] = events[i].udata;
+    }
+#else
+    struct pollfd fds[YAF_NET_MAX_ACTIVE];
+    for (int i = 0; i < active_count; i++) {
+        fds[i].fd = active[i]->fd;
+        fds[i].events = active[i]->want_write ? POLLOUT : POLLIN;
+        fds[i].revents = 0;
+    }
+    int n = poll(fds, (nfds_t)active_count, timeout_ms);
+    int count = 0;
+    for (int i = 0; i < active_count && n > 0; i++) {
+        if (fds[i].revents) {
+            ready[count++] = active[i];
+        }
+    }
+    n = count;
+#endif
+    return n < 0 ? 0 : n;     // EINTR: the caller checks deadlines and waits again
+}
+
+static int net_host(const char* host, const char* port) {
+    for (int i = 0; i < yaf_net.host_count; i++) {
+        if (strcmp(yaf_net.hosts[i].host, host) == 0 && strcmp(yaf_net.hosts[i].port, port) == 0) {
+            return i;
+        }
+    }
+    if (yaf_net.host_count == yaf_net.host_capacity) {
+        int capacity = yaf_net.host_capacity ? yaf_net.host_capacity * 2 : 16;
+        YafNetHost* hosts = realloc(yaf_net.hosts, (size_t)capacity * sizeof(YafNetHost));
+        if (!hosts) {
+            out_of_memory((size_t)capacity * sizeof(YafNetHost));
+        }
+        yaf_net.hosts = hosts;
+        yaf_net.host_capacity = capacity;
+    }
+    YafNetHost* entry = &yaf_net.hosts[yaf_net.host_count];
+    strcpy(entry->host, host);
+    strcpy(entry->port, port);
+    entry->resolved = false;
+    entry->addresses = NULL;
+    return yaf_net.host_count++;
+}
+
+static void net_hosts_reset(void) {
+    for (int i = 0; i < yaf_net.host_count; i++) {
+        if (yaf_net.hosts[i].addresses) {
+            freeaddrinfo(yaf_net.hosts[i].addresses);
+        }
+    }
+    yaf_net.host_count = 0;
+}
+
+// A parked connection is still usable if the server has neither closed it
+// nor sent anything
+static bool net_idle_alive(int fd) {
+    char byte;
+    ssize_t n = recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+static void net_idle_remove(int index) {
+    yaf_net.idle_count--;
+    memmove(&yaf_net.idle[index], &yaf_net.idle[index + 1], (size_t)(yaf_net.idle_count - index) * sizeof(YafNetIdle));
+}
+
+// Most recently parked first; dead connections found on the way are closed
+static int net_pool_take(const YafNetHost* host) {
+    for (int i = yaf_net.idle_count - 1; i >= 0; i--) {
+        YafNetIdle* idle = &yaf_net.idle[i];
+        if (strcmp(idle->host, host->host) != 0 || strcmp(idle->port, host->port) != 0) {
+            continue;
+        }
+        int fd = idle->fd;
+        net_idle_remove(i);
+        if (net_idle_alive(fd)) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+// A full pool closes its oldest connection
+static void net_pool_put(const YafNetHost* host, int fd) {
+    if (yaf_net.idle_count == YAF_NET_POOL_SIZE) {
+        close(yaf_net.idle[0].fd);
+        net_idle_remove(0);
+    }
+    YafNetIdle* idle = &yaf_net.idle[yaf_net.idle_count++];
+    idle->fd = fd;
+    strcpy(idle->host, host->host);
+    strcpy(idle->port, host->port);
+}
+
+static void net_finish(YafNetRequest* r) {
+    if (r->kind == NET_HTTP && r->keep_alive) {
+        net_pool_put(&yaf_net.hosts[r->host], r->fd);
+    } else {
+        close(r->fd);
+    }
+    r->fd = -1;
+    r->ok = true;
+    r->state = NET_DONE;
+}
+
+static void net_configure_socket(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof one);
+#endif
+}
+
+// Starts connecting to the next address of the host; fails once none is left
+static void net_connect(YafNetRequest* r) {
+    while (r->next_address) {
+        struct addrinfo* address = r->next_address;
+        r->next_address = address->ai_next;
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        net_configure_socket(fd);
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            // Even an immediate connection reports through the event loop
+            r->fd = fd;
+            r->state = NET_CONNECTING;
+            net_arm(r, true);
+            return;
+        }
+        close(fd);
+    }
+    net_fail(r);
+}
+
+static void net_open(YafNetRequest* r) {
+    YafNetHost* host = &yaf_net.hosts[r->host];
+    if (!host->resolved) {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host->host, host->port, &hints, &host->addresses) != 0) {
+            host->addresses = NULL;
+        }
+        host->resolved = true;
+    }
+    r->next_address = host->addresses;
+    net_connect(r);
+}
+
+static void net_step(YafNetRequest* r);
+
+// The connection broke before the response was complete. A pooled one may
+// simply have timed out on the server side, so the request goes again.
+static void net_broken(YafNetRequest* r) {
+    if (!r->reused || r->retried || r->in_length > 0) {
+        net_fail(r);
+        return;
+    }
+    close(r->fd);
+    r->fd = -1;
+    r->reused = false;
+    r->retried = true;
+    r->written = 0;
+    net_open(r);
+}
+
+static void net_start(YafNetRequest* r) {
+    if (r->kind == NET_HTTP) {
+        int fd = net_pool_take(&yaf_net.hosts[r->host]);
+        if (fd >= 0) {
+            r->fd = fd;
+            r->reused = true;
+            r->state = NET_WRITING;
+            net_step(r);
+            return;
+        }
+    }
+    net_open(r);
+}
+
+// `name: value` header line with the given name (case-insensitive)
+static bool net_header_value(const char* line, size_t length, const char* name, const char** value, size_t* value_length) {
+    size_t name_length = strlen(name);
+    if (length <= name_length || line[name_length] != ':' || strncasecmp(line, name, name_length) != 0) {
+        return false;
+    }
+    size_t i = name_length + 1;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) {
+        i++;
+    }
+    *value = line + i;
+    *value_length = length - i;
+    return true;
+}
+
+static bool net_value_has(const char* value, size_t length, const char* token) {
+    size_t token_length = strlen(token);
+    for (size_t i = 0; i + token_length <= length; i++) {
+        if (strncasecmp(value + i, token, token_length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Status line and the headers that frame the body; false if this is not
+// an HTTP/1.x response
+static bool net_parse_headers(YafNetRequest* r, size_t header_end) {
+    const char* p = r->in;
+    if (header_end < 12 || strncmp(p, "HTTP/1.", 7) != 0 || p[8] != ' ' ||
+        !isdigit((unsigned char)p[9]) || !isdigit((unsigned char)p[10]) || !isdigit((unsigned char)p[11])) {
+        return false;
+    }
+    r->status = (p[9] - '0') * 100 + (p[10] - '0') * 10 + (p[11] - '0');
+    r->keep_alive = p[7] != '0';    // HTTP/1.0 closes unless asked not to
+    r->content_length = -1;
+    r->chunked = false;
+
+    const char* line = memchr(p, '\n', header_end);
+    while (line && (size_t)(line - p) < header_end) {
+        line++;
+        const char* end = memchr(line, '\r', header_end - (size_t)(line - p));
+        if (!end) {
+            break;
+        }
+        const char* value;
+        size_t value_length;
+        size_t length = (size_t)(end - line);
+        if (net_header_value(line, length, "content-length", &value, &value_length)) {
+            r->content_length = strtoll(value, NULL, 10);
+        } else if (net_header_value(line, length, "transfer-encoding", &value, &value_length)) {
+            r->chunked = net_value_has(value, value_length, "chunked");
+        } else if (net_header_value(line, length, "connection", &value, &value_length)) {
+            if (net_value_has(value, value_length, "close")) {
+                r->keep_alive = false;
+            } else if (net_value_has(value, value_length, "keep-alive")) {
+                r->keep_alive = true;
+            }
+        }
+        line = memchr(end, '\n', header_end - (size_t)(end - p));
+    }
+    if (r->status < 200 || r->status == 204 || r->status == 304) {
+        r->content_length = 0;
+        r->chunked = false;
+    }
+    return true;
+}
+
+// Walks the chunk headers received so far: 1 once the last chunk and the
+// trailers are in, -1 if the framing is broken
+static int net_chunks_progress(YafNetRequest* r) {
+    for (;;) {
+        const char* line = r->in + r->chunk_scan;
+        int64_t eol = string_find(line, (int64_t)(r->in_length - r->chunk_scan), "\r\n", 2);
+        if (eol < 0) {
+            return 0;
+        }
+        char* digits_end;
+        unsigned long long size = strtoull(line, &digits_end, 16);
+        if (digits_end == line) {
+            return -1;
+        }
+        size_t after = r->chunk_scan + (size_t)eol + 2;
+        if (size == 0) {
+            // Trailers end with an empty line, usually right away
+            if (r->in_length - after >= 2 && memcmp(r->in + after, "\r\n", 2) == 0) {
+                return 1;
+            }
+            return string_find(r->in + after, (int64_t)(r->in_length - after), "\r\n\r\n", 4) >= 0;
+        }
+        if (size > r->in_length || after + size + 2 > r->in_length) {
+            return 0;
+        }
+        r->chunk_scan = after + (size_t)size + 2;
+    }
+}
+
+// 1 once the response is complete, -1 if it is malformed. Responses with
+// neither a length nor chunks end when the server closes.
+static int net_response_progress(YafNetRequest* r) {
+    if (r->kind != NET_HTTP) {
+        return 0;
+    }
+    while (r->body_start == 0) {
+        size_t from = r->header_scan > 3 ? r->header_scan - 3 : 0;
+        int64_t end = string_find(r->in + from, (int64_t)(r->in_length - from), "\r\n\r\n", 4);
+        if (end < 0) {
+            r->header_scan = r->in_length;
+            return 0;
+        }
+        size_t header_end = from + (size_t)end + 2;
+        if (!net_parse_headers(r, header_end)) {
+            return -1;
+        }
+        if (r->status < 200) {
+            // Interim response (100 Continue, 103 Early Hints): the real one follows
+            size_t consumed = header_end + 2;
+            memmove(r->in, r->in + consumed, r->in_length - consumed + 1);
+            r->in_length -= consumed;
+            r->header_scan = 0;
+            continue;
+        }
+        r->body_start = header_end + 2;
+        r->chunk_scan = r->body_start;
+        if (!r->chunked && r->content_length < 0) {
+            r->keep_alive = false;
+        }
+    }
+    if (r->chunked) {
+        return net_chunks_progress(r);
+    }
+    if (r->content_length >= 0) {
+        return r->in_length - r->body_start >= (uint64_t)r->content_length;
+    }
+    return 0;
+}
+
+static bool net_ends_at_close(const YafNetRequest* r) {
+    return r->kind == NET_EXCHANGE || (r->body_start > 0 && !r->chunked && r->content_length < 0);
+}
+
+// Advances the request as far as its socket allows, then arms it for the
+// event it needs next
+static void net_step(YafNetRequest* r) {
+    if (r->state == NET_CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof error;
+        if (getsockopt(r->fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            close(r->fd);
+            r->fd = -1;
+            net_connect(r);
+            return;
+        }
+        if (r->kind == NET_CONNECT) {
+            net_finish(r);
+            return;
+        }
+        r->state = NET_WRITING;
+    }
+    if (r->state == NET_WRITING) {
+        while (r->written < r->out_length) {
+            ssize_t n = send(r->fd, r->out + r->written, r->out_length - r->written, YAF_NET_SEND_FLAGS);
+            if (n > 0) {
+                r->written += (size_t)n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                net_arm(r, true);
+                return;
+            } else {
+                net_broken(r);
+                return;
+            }
+        }
+        r->state = NET_READING;
+    }
+    for (;;) {
+        if (r->in_capacity - r->in_length < YAF_NET_READ_SIZE) {
+            size_t capacity = r->in_capacity ? r->in_capacity * 2 : 2 * YAF_NET_READ_SIZE;
+            char* in = realloc(r->in, capacity);
+            if (!in) {
+                out_of_memory(capacity);
+            }
+            r->in = in;
+            r->in_capacity = capacity;
+        }
+        ssize_t n = recv(r->fd, r->in + r->in_length, r->in_capacity - r->in_length - 1, 0);
+        if (n > 0) {
+            r->in_length += (size_t)n;
+            r->in[r->in_length] = '\0';
+            int progress = net_response_progress(r);
+            if (progress != 0) {
+                progress > 0 ? net_finish(r) : net_fail(r);
+                return;
+            }
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            net_arm(r, false);
+            return;
+        } else if (n == 0 && net_ends_at_close(r)) {
+            r->keep_alive = false;
+            net_finish(r);
+            return;
+        } else {
+            net_broken(r);
+            return;
+        }
+    }
+}
+
+// An exchange keeps whatever arrived before its deadline
+static void net_expire(YafNetRequest* r) {
+    if (r->kind == NET_EXCHANGE && r->in_length > 0) {
+        net_finish(r);
+    } else {
+        net_fail(r);
+    }
+}
+
+// Runs the requests to completion, at most YAF_NET_MAX_ACTIVE at a time,
+// each within timeout_ms of its start
+static void net_run(YafNetRequest* requests, int64_t count, int64_t timeout_ms) {
+    if (!net_poller_open()) {
+        for (int64_t i = 0; i < count; i++) {
+            net_fail(&requests[i]);
+        }
+        return;
+    }
+    YafNetRequest* active[YAF_NET_MAX_ACTIVE];
+    YafNetRequest* ready[YAF_NET_MAX_ACTIVE];
+    int active_count = 0;
+    int64_t next = 0;
+    for (;;) {
+        while (next < count && active_count < YAF_NET_MAX_ACTIVE) {
+            YafNetRequest* r = &requests[next++];
+            if (r->state != NET_PENDING) {
+                continue;   // rejected when it was prepared
+            }
+            r->deadline = monotonic_nanos() + timeout_ms * 1000000;
+            net_start(r);
+            if (r->state != NET_DONE) {
+                active[active_count++] = r;
+            }
+        }
+        if (active_count == 0) {
+            break;
+        }
+
+        int64_t now = monotonic_nanos();
+        int64_t first_deadline = active[0]->deadline;
+        for (int i = 1; i < active_count; i++) {
+            if (active[i]->deadline < first_deadline) {
+                first_deadline = active[i]->deadline;
+            }
+        }
+        int64_t wait_ms = first_deadline > now ? (first_deadline - now + 999999) / 1000000 : 0;
+        int ready_count = net_wait(active, active_count, ready, (int)(wait_ms < INT32_MAX ? wait_ms : INT32_MAX));
+        for (int i = 0; i < ready_count; i++) {
+            net_step(ready[i]);
+        }
+
+        now = monotonic_nanos();
+        int kept = 0;
+        for (int i = 0; i < active_count; i++) {
+            YafNetRequest* r = active[i];
+            if (r->state != NET_DONE && now >= r->deadline) {
+                net_expire(r);
+            }
+            if (r->state != NET_DONE) {
+                active[kept++] = r;
+            }
+        }
+        active_count = kept;
+    }
+    net_hosts_reset();
+}
+
+static YafNetRequest* net_requests_new(int64_t count, YafNetKind kind) {
+    YafNetRequest* requests = calloc(count > 0 ? (size_t)count : 1, sizeof(YafNetRequest));
+    if (!requests) {
+        out_of_memory((size_t)count * sizeof(YafNetRequest));
+    }
+    for (int64_t i = 0; i < count; i++) {
+        requests[i].kind = kind;
+        requests[i].fd = -1;
+        requests[i].content_length = -1;
+    }
+    return requests;
+}
+
+static void net_requests_free(YafNetRequest* requests, int64_t count) {
+    for (int64_t i = 0; i < count; i++) {
+        free(requests[i].out);
+        free(requests[i].in);
+    }
+    free(requests);
+}
+
+// host[:port] or [v6 address][:port]; without a port, default_port if given
+static bool net_parse_authority(const char* s, size_t length, const char* default_port, char* host, char* port) {
+    const char* host_start = s;
+    const char* rest;
+    size_t host_length;
+    if (length > 0 && s[0] == '[') {
+        const char* close_bracket = memchr(s, ']', length);
+        if (!close_bracket) {
+            return false;
+        }
+        host_start = s + 1;
+        host_length = (size_t)(close_bracket - host_start);
+        rest = close_bracket + 1;
+    } else {
+        const char* colon = memchr(s, ':', length);
+        rest = colon ? colon : s + length;
+        host_length = (size_t)(rest - s);
+    }
+    if (host_length == 0 || host_length >= YAF_NET_HOST_MAX) {
+        return false;
+    }
+
+    size_t rest_length = length - (size_t)(rest - s);
+    if (rest_length == 0) {
+        if (!default_port) {
+            return false;
+        }
+        strcpy(port, default_port);
+    } else {
+        size_t digits = rest_length - 1;
+        if (rest[0] != ':' || digits == 0 || digits >= YAF_NET_PORT_MAX) {
+            return false;
+        }
+        for (size_t i = 1; i < rest_length; i++) {
+            if (!isdigit((unsigned char)rest[i])) {
+                return false;
+            }
+        }
+        memcpy(port, rest + 1, digits);
+        port[digits] = '\0';
+        if (atoi(port) > 65535) {
+            return false;
+        }
+    }
+    memcpy(host, host_start, host_length);
+    host[host_length] = '\0';
+    return true;
+}
+
+// Builds the request for http://host[:port][/path] (the scheme may be
+// left out); other schemes and malformed URLs leave it failed
+static void net_prepare_http(YafNetRequest* r, const char* url, const char* method, const char* body, size_t body_length) {
+    r->state = NET_DONE;
+    if (strncasecmp(url, "http://", 7) == 0) {
+        url += 7;
+    } else if (strstr(url, "://")) {
+        return;
+    }
+    size_t authority_length = strcspn(url, "/?#");
+    const char* path = url + authority_length;
+    size_t path_length = strcspn(path, "#");
+
+    char host[YAF_NET_HOST_MAX];
+    char port[YAF_NET_PORT_MAX];
+    if (!net_parse_authority(url, authority_length, "80", host, port)) {
+        return;
+    }
+    r->host = net_host(host, port);
+
+    char content_length[48] = "";
+    if (body) {
+        snprintf(content_length, sizeof content_length, "Content-Length: %zu\r\n", body_length);
+    }
+    const char* format = "%s %s%.*s HTTP/1.1\r\nHost: %.*s\r\nUser-Agent: yaf\r\nAccept: */*\r\n%s\r\n";
+    const char* slash = path[0] == '/' ? "" : "/";
+    int header_length = snprintf(NULL, 0, format, method, slash, (int)path_length, path,
+                                 (int)authority_length, url, content_length);
+    r->out = malloc((size_t)header_length + body_length + 1);
+    if (!r->out) {
+        out_of_memory((size_t)header_length + body_length + 1);
+    }
+    snprintf(r->out, (size_t)header_length + 1, format, method, slash, (int)path_length, path,
+             (int)authority_length, url, content_length);
+    if (body_length > 0) {
+        memcpy(r->out + header_length, body, body_length);
+    }
+    r->out_length = (size_t)header_length + body_length;
+    r->state = NET_PENDING;
+}
+
+// Decodes a chunked body in place (the data only moves back) and returns
+// its start
+static const char* net_response_body(YafNetRequest* r, size_t* length) {
+    char* body = r->in + r->body_start;
+    if (!r->ok || r->body_start == 0) {
+        *length = 0;
+        return "";
+    }
+    if (!r->chunked) {
+        size_t available = r->in_length - r->body_start;
+        *length = r->content_length >= 0 && (uint64_t)r->content_length < available
+            ? (size_t)r->content_length : available;
+        return body;
+    }
+    size_t scan = r->body_start;
+    size_t out = 0;
+    for (;;) {
+        char* digits_end;
+        size_t size = (size_t)strtoull(r->in + scan, &digits_end, 16);
+        int64_t eol = string_find(r->in + scan, (int64_t)(r->in_length - scan), "\r\n", 2);
+        if (size == 0 || eol < 0) {
+            break;
+        }
+        scan += (size_t)eol + 2;
+        memmove(body + out, r->in + scan, size);
+        out += size;
+        scan += size + 2;
+    }
+    *length = out;
+    return body;
+}
+
+static YafValue net_result_array(uint32_t elem_kind, int64_t count) {
+    YafValue array;
+    array.tag = YAF_ARRAY;
+    array.value.array_val = yaf_array_new(elem_kind, count);
+    return array;
+}
+
+static int64_t net_timeout_ms(YafValue timeout_ms) {
+    int64_t timeout = (int64_t)number_or_zero(timeout_ms);
+    return timeout > 0 ? timeout : YAF_NET_DEFAULT_TIMEOUT_MS;
+}
+
+static YafValue net_string_element(YafValue array, int64_t i, const char* func_name) {
+    YafValue element = yaf_array_get(array, yaf_make_int(i));
+    validate_type(element, YAF_STRING, func_name);
+    return element;
+}
+
+// GETs of every URL, run concurrently
+static YafNetRequest* net_get_all(YafValue urls, int64_t timeout_ms, const char* func_name, int64_t* count) {
+    *count = array_object(urls, func_name)->length;
+    YafNetRequest* requests = net_requests_new(*count, NET_HTTP);
+    for (int64_t i = 0; i < *count; i++) {
+        YafValue url = net_string_element(urls, i, func_name);
+        net_prepare_http(&requests[i], string_data(&url), "GET", NULL, 0);
+    }
+    net_run(requests, *count, timeout_ms);
+    return requests;
+}
+
+static YafValue net_body_string(YafNetRequest* r) {
+    size_t length;
+    const char* body = net_response_body(r, &length);
+    return yaf_make_string_len(body, (int64_t)length);
+}
+
+YafValue yaf_net_http_get_all(YafValue urls) {
+    int64_t count;
+    YafNetRequest* requests = net_get_all(urls, YAF_NET_DEFAULT_TIMEOUT_MS, "http_get_all", &count);
+    YafValue bodies = net_result_array(YAF_ELEM_VALUE, count);
+    for (int64_t i = 0; i < count; i++) {
+        yaf_array_push(bodies, net_body_string(&requests[i]));
+    }
+    net_requests_free(requests, count);
+    return bodies;
+}
+
+YafValue yaf_net_http_status_all(YafValue urls, YafValue timeout_ms) {
+    int64_t count;
+    YafNetRequest* requests = net_get_all(urls, net_timeout_ms(timeout_ms), "http_status_all", &count);
+    YafValue statuses = net_result_array(YAF_ELEM_INT, count);
+    for (int64_t i = 0; i < count; i++) {
+        yaf_array_push(statuses, yaf_make_int(requests[i].ok ? requests[i].status : 0));
+    }
+    net_requests_free(requests, count);
+    return statuses;
+}
+
+static YafValue net_http_one(YafValue url, const char* method, const YafValue* body) {
+    YafNetRequest* r = net_requests_new(1, NET_HTTP);
+    net_prepare_http(r, string_data(&url), method,
+                     body ? string_data(body) : NULL, body ? (size_t)string_length(body) : 0);
+    net_run(r, 1, YAF_NET_DEFAULT_TIMEOUT_MS);
+    YafValue result = net_body_string(r);
+    net_requests_free(r, 1);
+    return result;
+}
+
+YafValue yaf_net_http_get(YafValue url) {
+    validate_type(url, YAF_STRING, "http_get");
+    return net_http_one(url, "GET", NULL);
+}
+
+YafValue yaf_net_http_post(YafValue url, YafValue body) {
+    validate_type(url, YAF_STRING, "http_post");
+    validate_type(body, YAF_STRING, "http_post");
+    return net_http_one(url, "POST", &body);
+}
+
+static void net_prepare_tcp(YafNetRequest* r, YafValue address) {
+    char host[YAF_NET_HOST_MAX];
+    char port[YAF_NET_PORT_MAX];
+    const char* text = string_data(&address);
+    if (net_parse_authority(text, strlen(text), NULL, host, port)) {
+        r->host = net_host(host, port);
+    } else {
+        r->state = NET_DONE;
+    }
+}
+
+// Opens a connection to every "host:port" concurrently; true where it succeeded
+YafValue yaf_net_tcp_connect_all(YafValue addresses, YafValue timeout_ms) {
+    int64_t count = array_object(addresses, "tcp_connect_all")->length;
+    YafNetRequest* requests = net_requests_new(count, NET_CONNECT);
+    for (int64_t i = 0; i < count; i++) {
+        net_prepare_tcp(&requests[i], net_string_element(addresses, i, "tcp_connect_all"));
+    }
+    net_run(requests, count, net_timeout_ms(timeout_ms));
+    YafValue connected = net_result_array(YAF_ELEM_VALUE, count);
+    for (int64_t i = 0; i < count; i++) {
+        yaf_array_push(connected, yaf_make_bool(requests[i].ok));
+    }
+    net_requests_free(requests, count);
+    return connected;
+}
+
+// Sends data to "host:port" and returns what comes back until the peer
+// closes or the timeout passes
+YafValue yaf_net_tcp_request(YafValue address, YafValue data, YafValue timeout_ms) {
+    validate_type(address, YAF_STRING, "tcp_request");
+    validate_type(data, YAF_STRING, "tcp_request");
+    YafNetRequest* r = net_requests_new(1, NET_EXCHANGE);
+    net_prepare_tcp(r, address);
+    r->out_length = (size_t)string_length(&data);
+    r->out = malloc(r->out_length + 1);
+    if (!r->out) {
+        out_of_memory(r->out_length + 1);
+    }
+    memcpy(r->out, string_data(&data), r->out_length);
+    net_run(r, 1, net_timeout_ms(timeout_ms));
+    YafValue result = r->ok ? yaf_make_string_len(r->in ? r->in : "", (int64_t)r->in_length) : yaf_make_string("");
+    net_requests_free(r, 1);
+    return result;
+}
+
+// Parallel loops
+//
+// A pfor range is split into a few chunks per thread. Each worker owns a run
+// of chunk numbers, packed as next << 32 | end in one atomic word: it takes
+// chunks from the front and, once its run is empty, steals single chunks
+// from the back of the others'. The calling thread works as worker 0, and
+// yaf_parallel_for returns when every worker has run out of chunks.
+//
+// The pool starts with the first loop, with YAF_THREADS threads or one per
+// online CPU. While it runs a loop, workers allocate from their own YafTlab
+// and link new objects into its list; yaf_parallel_for moves them to the
+// shared list when the loop ends.
+//
+// Collection stops the world: a thread that wants to collect raises
+// gc_requested and waits until every other thread running the loop has
+// parked at a safepoint (a loop back-edge in generated code, or between
+// chunks) or left the loop.
+#define YAF_MAX_THREADS       256
+#define YAF_CHUNKS_PER_THREAD 8
+
+typedef struct {
+    YafLoopBody body;
+    void* env;
+    int64_t begin;
+    int64_t count;
+    int64_t chunk_count;
+} YafLoop;
+
+typedef struct {
+    _Atomic uint64_t chunks;    // next << 32 | end
+    YafTlab* tlab;              // the thread's yaf_tlab
+} __attribute__((aligned(64))) YafWorker;
+
+static struct {
+    pthread_once_t once;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    int threads;
+    int started;                // worker threads actually running
+    int registered;             // of those, the ones that set their tlab
+    YafWorker* workers;
+    
+    // Current loop, published under the lock with a new generation
+    YafLoop loop;
+    uint64_t generation;
+    int busy;                   // workers that have not finished it yet
+    
+    // Stop-the-world collection
+    _Atomic bool gc_requested;
+    int running;                // threads inside run_chunks
+    int parked;                 // of those, the ones stopped for the collector
+    pthread_cond_t parked_changed;
+    pthread_cond_t resume;
+} yaf_pool = {
+    .once = PTHREAD_ONCE_INIT,
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .parked_changed = PTHREAD_COND_INITIALIZER,
+    .resume = PTHREAD_COND_INITIALIZER,
+};
+
+// Without a pool only the calling thread has heap state
+static int tlab_count(void) {
+    return yaf_pool.workers ? yaf_pool.threads : 1;
+}
+
+static YafTlab* tlab_at(int index) {
+    return yaf_pool.workers ? yaf_pool.workers[index].tlab : &yaf_tlab;
+}
+
+// Called with the lock held
+static void gc_park(void) {
+    yaf_pool.parked++;
+    pthread_cond_signal(&yaf_pool.parked_changed);
+    while (atomic_load(&yaf_pool.gc_requested)) {
+        pthread_cond_wait(&yaf_pool.resume, &yaf_pool.lock);
+    }
+    yaf_pool.parked--;
+}
+
+static int64_t gc_collect_parallel(void) {
+    pthread_mutex_lock(&yaf_pool.lock);
+    if (atomic_load(&yaf_pool.gc_requested)) {
+        // Someone else is collecting: that does for this thread too
+        gc_park();
+        pthread_mutex_unlock(&yaf_pool.lock);
+        return 0;
+    }
+    atomic_store(&yaf_pool.gc_requested, true);
+    while (yaf_pool.parked + 1 < yaf_pool.running) {
+        pthread_cond_wait(&yaf_pool.parked_changed, &yaf_pool.lock);
+    }
+    int64_t freed = gc_collect_stopped();
+    atomic_store(&yaf_pool.gc_requested, false);
+    pthread_cond_broadcast(&yaf_pool.resume);
+    pthread_mutex_unlock(&yaf_pool.lock);
+    return freed;
+}
+
+// Each thread gets an even share of the threshold
+static int64_t gc_collect_parallel_if_needed(void) {
+    if (atomic_load_explicit(&yaf_pool.gc_requested, memory_order_relaxed) ||
+        yaf_tlab.bytes_since_collect >= yaf_heap.threshold / yaf_pool.threads) {
+        return gc_collect_parallel();
+    }
+    return 0;
+}
+
+// First iteration of chunk k: the first count % chunk_count chunks get one extra
+static int64_t chunk_start(const YafLoop* loop, int64_t k) {
+    int64_t base = loop->count / loop->chunk_count;
+    int64_t extra = loop->count % loop->chunk_count;
+    return loop->begin + k * base + (k < extra ? k : extra);
+}
+
+static int64_t take_chunk(YafWorker* worker) {
+    uint64_t range = atomic_load_explicit(&worker->chunks, memory_order_relaxed);
+    while ((range >> 32) < (range & 0xFFFFFFFFu)) {
+        if (atomic_compare_exchange_weak_explicit(&worker->chunks, &range, range + ((uint64_t)1 << 32),
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return (int64_t)(range >> 32);
+        }
+    }
+    return -1;
+}
+
+static int64_t steal_chunk(YafWorker* victim) {
+    uint64_t range = atomic_load_explicit(&victim->chunks, memory_order_relaxed);
+    while ((range >> 32) < (range & 0xFFFFFFFFu)) {
+        if (atomic_compare_exchange_weak_explicit(&victim->chunks, &range, range - 1,
+                                                  memory_order_acquire, memory_order_relaxed)) {
+            return (int64_t)(range & 0xFFFFFFFFu) - 1;
+        }
+    }
+    return -1;
+}
+
+// Runs chunks until there are none left, then leaves the loop
+static void run_chunks(int index) {
+    YafWorker* self = &yaf_pool.workers[index];
+    const YafLoop* loop = &yaf_pool.loop;
+    yaf_tlab.owner = (uint16_t)(index + 1);
+    for (;;) {
+        // A safepoint: nothing of the previous chunk is alive any more
+        if (atomic_load_explicit(&yaf_pool.gc_requested, memory_order_relaxed)) {
+            gc_collect_parallel();
+        }
+        int64_t chunk = take_chunk(self);
+        for (int i = 1; chunk < 0 && i < yaf_pool.threads; i++) {
+            chunk = steal_chunk(&yaf_pool.workers[(index + i) % yaf_pool.threads]);
+        }
+        if (chunk < 0) {
+            break;
+        }
+        loop->body(loop->env, chunk_start(loop, chunk), chunk_start(loop, chunk + 1), chunk);
+    }
+    if (yaf_tlab.out_length > 0) {
+        thread_flush_output(&yaf_tlab, false);
+    }
+    yaf_tlab.owner = 0;
+    
+    pthread_mutex_lock(&yaf_pool.lock);
+    yaf_pool.running--;
+    pthread_cond_signal(&yaf_pool.parked_changed);
+    pthread_mutex_unlock(&yaf_pool.lock);
+}
+
+static void* worker_main(void* arg) {
+    int index = (int)(intptr_t)arg;
+    uint64_t seen = 0;
+    pthread_mutex_lock(&yaf_pool.lock);
+    yaf_pool.workers[index].tlab = &yaf_tlab;
+    yaf_pool.registered++;
+    pthread_cond_signal(&yaf_pool.done);
+    for (;;) {
+        while (yaf_pool.generation == seen) {
+            pthread_cond_wait(&yaf_pool.start, &yaf_pool.lock);
+        }
+        seen = yaf_pool.generation;
+        pthread_mutex_unlock(&yaf_pool.lock);
+        
+        run_chunks(index);
+        
+        pthread_mutex_lock(&yaf_pool.lock);
+        if (--yaf_pool.busy == 0) {
+            pthread_cond_signal(&yaf_pool.done);
+        }
+    }
+    return NULL;
+}
+
+static void pool_init(void) {
+    const char* env = getenv("YAF_THREADS");
+    long threads = env ? strtol(env, NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > YAF_MAX_THREADS) {
+        threads = YAF_MAX_THREADS;
+    }
+    yaf_pool.threads = (int)threads;
+    if (threads == 1) {
+        return;
+    }
+    
+    // Lazily chosen kernels would be picked by several threads at once
+    string_kernels_init();
+    
+    YafWorker* workers = aligned_alloc(64, sizeof(YafWorker) * (size_t)threads);
+    if (!workers) {
+        out_of_memory(sizeof(YafWorker) * (size_t)threads);
+    }
+    memset(workers, 0, sizeof(YafWorker) * (size_t)threads);
+    workers[0].tlab = &yaf_tlab;
+    
+    pthread_mutex_lock(&yaf_pool.lock);
+    yaf_pool.workers = workers;
+    for (int i = 1; i < threads; i++) {
+        pthread_t thread;
+        // Without some of the threads their chunks just get stolen
+        if (pthread_create(&thread, NULL, worker_main, (void*)(intptr_t)i) == 0) {
+            pthread_detach(thread);
+            yaf_pool.started++;
+        }
+    }
+    // The collector must know every thread's heap once a loop starts
+    while (yaf_pool.registered < yaf_pool.started) {
+        pthread_cond_wait(&yaf_pool.done, &yaf_pool.lock);
+    }
+    pthread_mutex_unlock(&yaf_pool.lock);
+}
+
+int64_t yaf_parallel_chunks(int64_t begin, int64_t end) {
+    if (end <= begin) {
+        return 0;
+    }
+    pthread_once(&yaf_pool.once, pool_init);
+    int64_t chunks = (int64_t)yaf_pool.threads * (yaf_pool.threads > 1 ? YAF_CHUNKS_PER_THREAD : 1);
+    return end - begin < chunks ? end - begin : chunks;
+}
+
+// Objects the workers allocated join the shared list
+static void adopt_thread_objects(YafTlab* tlab) {
+    YafGcHeader* header = tlab->objects;
+    while (header) {
+        YafGcHeader* next = header->next;
+        header->owner = 0;
+        header->prev = NULL;
+        header->next = yaf_heap.objects;
+        if (yaf_heap.objects) {
+            yaf_heap.objects->prev = header;
+        }
+        yaf_heap.objects = header;
+        header = next;
+    }
+    yaf_heap.object_count += tlab->object_count;
+    tlab->objects = NULL;
+    tlab->object_count = 0;
+}
+
+void yaf_parallel_for(int64_t begin, int64_t end, YafLoopBody body, void* env) {
+    int64_t chunk_count = yaf_parallel_chunks(begin, end);
+    if (chunk_count == 0) {
+        return;
+    }
+    YafLoop loop = { body, env, begin, end - begin, chunk_count };
+    
+    // Nested loops, and everything when there is a single thread, run their
+    // chunks in order on the calling thread
+    if (yaf_tlab.owner || yaf_pool.threads == 1) {
+        for (int64_t k = 0; k < chunk_count; k++) {
+            body(env, chunk_start(&loop, k), chunk_start(&loop, k + 1), k);
+        }
+        return;
+    }
+    
+    int threads = yaf_pool.threads;
+    for (int i = 0; i < threads; i++) {
+        uint64_t first = (uint64_t)(chunk_count * i / threads);
+        uint64_t last = (uint64_t)(chunk_count * (i + 1) / threads);
+        atomic_store_explicit(&yaf_pool.workers[i].chunks, first << 32 | last, memory_order_relaxed);
+    }
+    
+    pthread_mutex_lock(&yaf_pool.lock);
+    yaf_parallel = true;
+    yaf_pool.loop = loop;
+    yaf_pool.generation++;
+    yaf_pool.busy = yaf_pool.started;
+    yaf_pool.running = yaf_pool.started + 1;
+    pthread_cond_broadcast(&yaf_pool.start);
+    pthread_mutex_unlock(&yaf_pool.lock);
+    
+    run_chunks(0);
+    
+    pthread_mutex_lock(&yaf_pool.lock);
+    while (yaf_pool.busy > 0) {
+        pthread_cond_wait(&yaf_pool.done, &yaf_pool.lock);
+    }
+    yaf_parallel = false;
+    pthread_mutex_unlock(&yaf_pool.lock);
+    
+    for (int i = 0; i < threads; i++) {
+        if (yaf_pool.workers[i].tlab) {
+            adopt_thread_objects(yaf_pool.workers[i].tlab);
+        }
+    }
+}
@@ -3,30 +3,118 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
-// YafValue structure matching Rust implementation
+// YafValue structure matching Rust implementation. This is the ABI both
+// backends emit against: LLVM passes it as { i32, i64 }, so the tag is a
+// full 32-bit field and every constructor writes the whole 64-bit payload.
 typedef struct {
-    uint8_t tag;
+    int32_t tag;
     union {
         int64_t int_val;
         double float_val;
         char* string_val;
         bool bool_val;
         void* array_val;
+        void* map_val;
+        char small_val[8];  // YAF_SMALL_STRING: NUL-terminated, no header
     } value;
 } YafValue;
 
+// Heap string object. The header lives right before the character data, so
+// string_val still points at a NUL-terminated buffer usable as a char*.
+typedef struct {
+    int32_t refcount;
+    uint32_t flags;
+    int64_t length;
+    int64_t capacity;
+    uint64_t hash;      // 0 until first needed; literals get it from the compiler
+    char data[];
+} YafString;
+
+// Growable array object (the value of a YAF_ARRAY). Numeric arrays keep
+// their elements unboxed: data is an int64_t[] or double[] by elem_kind,
+// a YafValue[] otherwise. Storage is a separate block so it can grow.
+typedef struct {
+    int64_t length;
+    int64_t capacity;
+    uint32_t elem_kind;
+    uint32_t reserved;
+    void* data;
+} YafArray;
+
+// Array element kinds. YAF_ELEM_VALUE holds a YafValue per element, or a
+// YafPacked word when the runtime is built with YAF_NAN_BOXING.
+#define YAF_ELEM_VALUE 0
+#define YAF_ELEM_INT   1
+#define YAF_ELEM_FLOAT 2
+
+// Hash map object (the value of a YAF_MAP): open addressing with Robin
+// Hood probing over a power of two table. A slot with hash 0 is empty;
+// computed hashes are never 0.
+typedef struct {
+    uint64_t hash;
+    YafValue key;
+    YafValue value;
+} YafMapEntry;
+
+typedef struct {
+    int64_t count;
+    int64_t capacity;
+    YafMapEntry* entries;
+} YafMap;
+
+#define YAF_STRING_HEADER(s) ((YafString*)((char*)(s) - offsetof(YafString, data)))
+
+// String flags
+#define YAF_STR_STATIC 0x1  // literal emitted by the compiler, never freed
+#define YAF_STR_MAPPED 0x2  // read-only view of a memory-mapped file
+#define YAF_STR_BUILDER 0x4 // private to a string builder, appended in place
+
 // Value type tags
 #define YAF_INT    0
 #define YAF_FLOAT  1
 #define YAF_STRING 2 
 #define YAF_BOOL   3
 #define YAF_ARRAY  4
+#define YAF_MAP    5
+#define YAF_SMALL_STRING 6  // short string stored inline in the value
+
+#define YAF_SMALL_STRING_MAX 7
+
+#ifdef YAF_NAN_BOXING
+// 8-byte NaN-boxed encoding of a YafValue, used for the elements of boxed
+// arrays. A double is stored as itself (NaNs made positive and quiet); the
+// rest live in negative quiet NaN space as 0xFFF8 | tag << 48 | payload, so
+// testing a tag is one mask and compare. Payloads are 48 bits: ints in
+// range, bools, pointers and strings of up to 6 bytes inline. Anything else
+// (a wider int, a 7-byte string) goes to a heap cell holding the YafValue.
+typedef uint64_t YafPacked;
+
+#define YAF_PACKED_BOXED     0xFFF8000000000000ULL
+#define YAF_PACKED_TAG_MASK  0xFFFF000000000000ULL
+#define YAF_PACKED_PAYLOAD   0x0000FFFFFFFFFFFFULL
+#define YAF_PACKED_TAG(t)    (YAF_PACKED_BOXED | ((uint64_t)(t) << 48))
+
+#define YAF_PACKED_INT          YAF_PACKED_TAG(0)
+#define YAF_PACKED_BOOL         YAF_PACKED_TAG(1)
+#define YAF_PACKED_STRING       YAF_PACKED_TAG(2)
+#define YAF_PACKED_ARRAY        YAF_PACKED_TAG(3)
+#define YAF_PACKED_MAP          YAF_PACKED_TAG(4)
+#define YAF_PACKED_SMALL_STRING YAF_PACKED_TAG(5)
+#define YAF_PACKED_CELL         YAF_PACKED_TAG(6)
+
+#define YAF_PACKED_SMALL_STRING_MAX 6
+
+YafPacked yaf_pack_value(YafValue value);
+YafValue yaf_unpack_value(YafPacked packed);
+#endif
 
 // Runtime functions
 YafValue yaf_make_int(int64_t value);
 YafValue yaf_make_float(double value);
 YafValue yaf_make_string(const char* value);
+YafValue yaf_make_string_len(const char* value, int64_t length);
 YafValue yaf_make_bool(int value);
 YafValue yaf_make_void(void);
 
@@ -34,36 +122,166 @@ YafValue yaf_make_void(void);
 YafValue yaf_value_to_string(YafValue value);
 YafValue yaf_value_to_int(YafValue value);
 YafValue yaf_value_to_float(YafValue value);
+YafValue yaf_retain_value(YafValue value);
 void yaf_free_value(YafValue* value);
 void yaf_print_value(YafValue value);
 void yaf_print_value_no_newline(YafValue value);
 
+// Buffered standard output. Flushed when full, on each newline if stdout
+// is a terminal, before reading input and at exit.
+void yaf_write(const char* data, int64_t length);
+void yaf_print_int(int64_t value);
+void yaf_print_float(double value);
+void yaf_print_newline(void);
+void yaf_flush(void);
+
+// Runs a REPL entry; a runtime error returns 1 instead of exiting
+int32_t yaf_run_guarded(int32_t (*entry)(void));
+
+// Generic operators on boxed values, for code that has no static types.
+// The LLVM backend inlines its own copies; the C backend calls these.
+YafValue yaf_add(YafValue a, YafValue b);
+YafValue yaf_sub(YafValue a, YafValue b);
+YafValue yaf_mul(YafValue a, YafValue b);
+YafValue yaf_div(YafValue a, YafValue b);
+YafValue yaf_mod(YafValue a, YafValue b);
+__attribute__((noreturn, cold)) void yaf_division_by_zero(void);
+YafValue yaf_eq(YafValue a, YafValue b);
+YafValue yaf_ne(YafValue a, YafValue b);
+YafValue yaf_lt(YafValue a, YafValue b);
+YafValue yaf_le(YafValue a, YafValue b);
+YafValue yaf_gt(YafValue a, YafValue b);
+YafValue yaf_ge(YafValue a, YafValue b);
+bool yaf_to_bool(YafValue value);
+
 // Math functions
 YafValue yaf_math_abs(YafValue value);
 YafValue yaf_math_max(YafValue a, YafValue b);
 YafValue yaf_math_min(YafValue a, YafValue b);
 YafValue yaf_math_pow(YafValue base, YafValue exp);
 
+// Memory management (bump-pointer nursery + size-class free lists)
+void* yaf_alloc(size_t size);
+void yaf_dealloc(void* ptr, size_t size);
+void* yaf_gc_alloc(size_t size, uint32_t kind);
+void yaf_gc_free(void* ptr);
+void yaf_gc_register_allocation(int64_t address, int64_t size, int32_t type);
+void yaf_gc_add_root(int64_t address);
+void yaf_gc_remove_root(int64_t address);
+int64_t yaf_gc_root_depth(void);
+void yaf_gc_unwind_roots(int64_t depth);
+int64_t yaf_gc_collect(void);
+int64_t yaf_gc_collect_if_needed(void);
+void yaf_set_gc_threshold(int64_t threshold);
+void yaf_gc_final_cleanup(void);
+void yaf_memory_stats(void);
+YafValue yaf_memory_stats_map(void);
+
+// Array functions
+YafArray* yaf_array_new(uint32_t elem_kind, int64_t capacity);
+void yaf_array_reserve(YafArray* array, int64_t capacity);
+YafValue yaf_array_get(YafValue array, YafValue index);
+void yaf_array_set(YafValue array, YafValue index, YafValue value);
+void yaf_array_push(YafValue array, YafValue value);
+YafValue yaf_array_pop(YafValue array);
+YafValue yaf_array_length(YafValue array);
+__attribute__((noreturn, cold)) void yaf_array_bounds_error(int64_t index, int64_t length);
+
+// Frame objects: built in storage the generated code reserves in its own
+// stack frame, for values the compiler proved never outlive it. They are
+// never allocated, registered with the collector or freed. The storage
+// must be 16-byte aligned.
+#define YAF_FRAME_STRING_SIZE 64
+#define YAF_FRAME_ARRAY_SIZE(capacity) (64 + (size_t)(capacity) * sizeof(YafValue))
+YafArray* yaf_array_init_frame(void* frame, uint32_t elem_kind, int64_t capacity);
+YafValue yaf_value_to_string_frame(YafValue value, void* frame);
+YafValue yaf_int_to_string_frame(YafValue i, void* frame);
+
+// Memoization: the cache of a @memo function, created by the first
+// yaf_memo_put on a pointer that starts out NULL. yaf_memo_get returns 1
+// and stores the cached result when the arguments have one.
+typedef struct YafMemo YafMemo;
+int32_t yaf_memo_get(YafMemo** cache, const YafValue* args, int32_t arity, YafValue* result);
+void yaf_memo_put(YafMemo** cache, const YafValue* args, int32_t arity, YafValue result);
+
+// Profiling (yaf compile --profile): main registers the function names,
+// ids are their indexes. Every function calls yaf_prof_enter on entry and
+// yaf_prof_exit before it returns; the report is written at exit.
+void yaf_prof_start(const char* const* names, int32_t count);
+void yaf_prof_enter(int32_t function);
+void yaf_prof_exit(void);
+
+// Map functions
+YafValue yaf_make_map(int64_t capacity);
+YafValue yaf_map_get(YafValue map, YafValue key);
+void yaf_map_set(YafValue map, YafValue key, YafValue value);
+YafValue yaf_map_has(YafValue map, YafValue key);
+YafValue yaf_map_delete(YafValue map, YafValue key);
+YafValue yaf_map_length(YafValue map);
+
+// String object functions
+char* yaf_string_alloc(int64_t capacity);
+char* yaf_string_new(const char* data, int64_t length);
+int64_t yaf_string_len(const char* s);
+uint64_t yaf_string_hash(const char* s);
+char* yaf_string_retain(char* s);
+void yaf_string_release(char* s);
+
 // String functions
 YafValue yaf_string_length(YafValue s);
 YafValue yaf_string_upper(YafValue s);
 YafValue yaf_string_lower(YafValue s);
 YafValue yaf_string_concat(YafValue a, YafValue b);
+YafValue yaf_string_find(YafValue s, YafValue needle);
+YafValue yaf_string_contains(YafValue s, YafValue needle);
+int32_t yaf_string_equal(YafValue a, YafValue b);
+
+// String builders: the LLVM backend lowers `s = s + e` in loops to these
+YafValue yaf_builder_from(YafValue s);
+YafValue yaf_builder_append(YafValue builder, YafValue s);
+YafValue yaf_builder_to_string(YafValue builder);
 
 // I/O functions
 YafValue yaf_io_read_file(YafValue path);
 YafValue yaf_io_write_file(YafValue path, YafValue content);
 YafValue yaf_io_file_exists(YafValue path);
 YafValue yaf_io_input(void);
+
+// Buffered file handles: open() and file_open() return a handle (-1 on
+// failure); close() flushes and closes either kind
+YafValue yaf_io_open(YafValue path);
+YafValue yaf_io_file_open(YafValue path, YafValue mode);
+YafValue yaf_io_read_line(YafValue handle);
+YafValue yaf_io_eof(YafValue handle);
+YafValue yaf_io_file_write(YafValue handle, YafValue content);
+YafValue yaf_io_close(YafValue handle);
 YafValue yaf_io_input_prompt(YafValue prompt);
 
 // Time functions
 YafValue yaf_time_now(void);
 YafValue yaf_time_now_millis(void);
+YafValue yaf_time_now_nanos(void);
 YafValue yaf_time_sleep(YafValue seconds);
+YafValue yaf_time_sleep_ms(YafValue millis);
+YafValue yaf_black_box(YafValue value);
 
 // Type conversion functions (enhanced)
 YafValue yaf_string_to_int(YafValue s);
 YafValue yaf_int_to_string(YafValue i);
 
+// Networking. The *_all functions run their requests concurrently on the
+// runtime's event loop; a failed request gives "", status 0 or false.
+YafValue yaf_net_http_get(YafValue url);
+YafValue yaf_net_http_post(YafValue url, YafValue body);
+YafValue yaf_net_http_get_all(YafValue urls);
+YafValue yaf_net_http_status_all(YafValue urls, YafValue timeout_ms);
+YafValue yaf_net_tcp_connect_all(YafValue addresses, YafValue timeout_ms);
+YafValue yaf_net_tcp_request(YafValue address, YafValue data, YafValue timeout_ms);
+
+// Parallel loops (pfor). The range is split into chunks numbered from 0,
+// run on a pool of worker threads; each writes its own reduction slot.
+typedef void (*YafLoopBody)(void* env, int64_t begin, int64_t end, int64_t chunk);
+int64_t yaf_parallel_chunks(int64_t begin, int64_t end);
+void yaf_parallel_for(int64_t begin, int64_t end, YafLoopBody body, void* env);
+
 #endif // YAF_RUNTIME_H
\ No newline at end of file
@@ -1,14 +1,49 @@
 use crate::core::ast::*;
+use crate::core::escape;
+use crate::core::tailcall::{self, TailLoop, TailReturn};
 use crate::runtime::values::Value;
 use crate::error::{Result, YafError};
 use std::collections::{HashMap, HashSet};
 
+// Vacía la pila de raíces antes de cada return (ver end_gc_frame)
+const GC_UNWIND: &str = "yaf_gc_unwind_roots(yaf_gc_frame); ";
+
+// Raíces del frame de la función actual: variables y temporales que el
+// runtime escanea en cada recolección. Se registran donde empieza el cuerpo.
+struct GcFrame {
+    at: usize,
+    roots: Vec<String>,
+    temps: Vec<String>,
+}
+
 pub struct CodeGenerator {
     output: String,
     indent_level: usize,
-    functions: HashMap<String, Function>,
     in_function: bool,
     declared_vars: HashSet<String>,
+    // Cuerpos de pfor sacados a funciones propias
+    parallel_loops: usize,
+    parallel_bodies: String,
+    // Objetos en el frame (ver core::escape): arrays de cada variable que no
+    // escapa y storage que se declara al principio de la función actual
+    frame_arrays: HashSet<String>,
+    frame_storage: Vec<String>,
+    frame_at: usize,
+    frame_slots: usize,
+    // Bucle de las llamadas de cola a sí misma de la función actual (ver
+    // core::tailcall) y sus parámetros
+    tail_loop: Option<(TailLoop, Vec<String>)>,
+    tail_temps: usize,
+    // --profile: id de la función actual (su índice en el programa), ver
+    // Profiling en el runtime
+    profiling: bool,
+    profile_id: Option<usize>,
+    // GC: el frame actual, las variables que nunca apuntan al heap y el
+    // tipo de retorno de cada función de usuario
+    gc_frame: Option<GcFrame>,
+    gc_temps: usize,
+    scalar_vars: HashSet<String>,
+    function_returns: HashMap<String, Type>,
 }
 
 impl CodeGenerator {
@@ -16,575 +51,119 @@ impl CodeGenerator {
         CodeGenerator {
             output: String::new(),
             indent_level: 0,
-            functions: HashMap::new(),
             in_function: false,
             declared_vars: HashSet::new(),
+            parallel_loops: 0,
+            parallel_bodies: String::new(),
+            frame_arrays: HashSet::new(),
+            frame_storage: Vec::new(),
+            frame_at: 0,
+            frame_slots: 0,
+            tail_loop: None,
+            tail_temps: 0,
+            profiling: false,
+            profile_id: None,
+            gc_frame: None,
+            gc_temps: 0,
+            scalar_vars: HashSet::new(),
+            function_returns: HashMap::new(),
         }
     }
     
-    pub fn generate(&mut self, program: Program) -> Result<String> {
-        // Registrar funciones
-        for function in &program.functions {
-            self.functions.insert(function.name.clone(), function.clone());
-        }
-        
-        // Generar includes y usar el runtime YAF existente  
-        self.emit_line("#include <stdio.h>");
-        self.emit_line("#include <stdlib.h>");
-        self.emit_line("#include <stdint.h>");
-        self.emit_line("#include <stdbool.h>");
-        self.emit_line("#include <ctype.h>");
-        self.emit_line("#include <string.h>");
-        
-        // Incluir declaraciones del runtime directamente
-        self.emit_line("// YAF Runtime declarations");
-        self.emit_line("typedef enum {");
-        self.emit_line("    YAF_INT,");
-        self.emit_line("    YAF_BOOL,");
-        self.emit_line("    YAF_STRING,");
-        self.emit_line("    YAF_VOID");
-        self.emit_line("} yaf_type_t;");
-        self.emit_line("");
-        self.emit_line("typedef struct {");
-        self.emit_line("    yaf_type_t type;");
-        self.emit_line("    union {");
-        self.emit_line("        int int_val;");
-        self.emit_line("        bool bool_val;");
-        self.emit_line("        char* string_val;");
-        self.emit_line("    } data;");
-        self.emit_line("} yaf_value_t;");
-        self.emit_line("");
-        
-        self.emit_line("#define YAF_INT    0");
-        self.emit_line("#define YAF_BOOL   1");
-        self.emit_line("#define YAF_STRING 2");
-        self.emit_line("#define YAF_VOID   3");
-        self.emit_line("");
-        
-        self.emit_line("void yaf_print_value(yaf_value_t value);");
-        self.emit_line("yaf_value_t yaf_make_int(int val);");
-        self.emit_line("yaf_value_t yaf_make_bool(bool val);");
-        self.emit_line("yaf_value_t yaf_make_string(char* val);");
-        self.emit_line("yaf_value_t yaf_make_void();");
-        self.emit_line("yaf_value_t yaf_make_array(void);");
-        self.emit_line("void yaf_print_value(yaf_value_t value);");
-        self.emit_line("bool yaf_to_bool(yaf_value_t val);");
-        self.emit_line("yaf_value_t yaf_eq(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_lt(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_gt(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_le(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_ge(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_add(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_sub(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_mul(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_div(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_mod(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_math_abs(yaf_value_t value);");
-        self.emit_line("yaf_value_t yaf_math_max(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_math_min(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("yaf_value_t yaf_math_pow(yaf_value_t base, yaf_value_t exp);");
-        self.emit_line("yaf_value_t yaf_string_length(yaf_value_t str);");
-        self.emit_line("yaf_value_t yaf_string_upper(yaf_value_t str);");
-        self.emit_line("yaf_value_t yaf_string_lower(yaf_value_t str);");
-        self.emit_line("yaf_value_t yaf_string_concat(yaf_value_t a, yaf_value_t b);");
-        self.emit_line("");
-        self.emit_line("bool yaf_to_bool(yaf_value_t val) {");
-        self.emit_line("    switch (val.type) {");
-        self.emit_line("        case YAF_BOOL: return val.data.bool_val;");
-        self.emit_line("        case YAF_INT: return val.data.int_val != 0;");
-        self.emit_line("        default: return false;");
-        self.emit_line("    }");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_eq(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type != b.type) return yaf_make_bool(0);");
-        self.emit_line("    switch (a.type) {");
-        self.emit_line("        case YAF_INT: return yaf_make_bool(a.data.int_val == b.data.int_val);");
-        self.emit_line("        case YAF_BOOL: return yaf_make_bool(a.data.bool_val == b.data.bool_val);");
-        self.emit_line("        default: return yaf_make_bool(0);");
-        self.emit_line("    }");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_lt(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_bool(a.data.int_val < b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_bool(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_gt(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_bool(a.data.int_val > b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_bool(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_le(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_bool(a.data.int_val <= b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_bool(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_ge(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_bool(a.data.int_val >= b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_bool(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_add(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_int(a.data.int_val + b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    if (a.type == YAF_STRING || b.type == YAF_STRING) {");
-        self.emit_line("        // String concatenation - simplified");
-        self.emit_line("        return a; // Return first for now");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_int(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_sub(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_int(a.data.int_val - b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_int(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_mul(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.emit_line("        return yaf_make_int(a.data.int_val * b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_int(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_div(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT && b.data.int_val != 0) {");
-        self.emit_line("        return yaf_make_int(a.data.int_val / b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_int(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_mod(yaf_value_t a, yaf_value_t b) {");
-        self.emit_line("    if (a.type == YAF_INT && b.type == YAF_INT && b.data.int_val != 0) {");
-        self.emit_line("        return yaf_make_int(a.data.int_val % b.data.int_val);");
-        self.emit_line("    }");
-        self.emit_line("    return yaf_make_int(0);");
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_make_array(void) {");
-        self.emit_line("    yaf_value_t val;");
-        self.emit_line("    val.type = YAF_INT; // Simplified - arrays return int 0");
-        self.emit_line("    val.data.int_val = 0;");
-        self.emit_line("    return val;");
-        self.emit_line("}");
+    /// Instrumenta la entrada y salida de las funciones (`yaf compile --profile`)
+    pub fn set_profiling(&mut self, enabled: bool) {
+        self.profiling = enabled;
+    }
+    
+    pub fn generate(&mut self, program: &Program) -> Result<String> {
+        // Mismo ABI que el backend LLVM: valores, helpers y operadores
+        // genéricos vienen todos del runtime YAF, que se enlaza aparte
+        self.emit_line("#include \"yaf_runtime.h\"");
         self.emit_line("");
         
-        // Las funciones auxiliares están en el runtime YAF
-        
         // Declaraciones de funciones de usuario
         for function in &program.functions {
+            self.function_returns.insert(function.name.clone(), function.return_type.clone());
             self.generate_function_declaration(function)?;
         }
         self.emit_line("");
-        
-        // Generar funciones helper
-        self.generate_helper_functions();
+        let prototypes_at = self.output.len();
         
         // Implementaciones de funciones de usuario
-        for function in &program.functions {
+        for (id, function) in program.functions.iter().enumerate() {
+            self.profile_id = self.profiling.then_some(id);
             self.generate_function(function)?;
         }
+        self.profile_id = None;
         
-        // Función main
-        self.emit_line("int main() {");
+        if self.profiling && !program.functions.is_empty() {
+            let names: Vec<String> = program.functions.iter().map(|function| Self::c_string_literal(&function.name)).collect();
+            self.emit_line(&format!("static const char* const yaf_prof_names[] = {{ {} }};", names.join(", ")));
+            self.emit_line("");
+        }
+        
+        // Función main: sus variables pueden ser las globales de alguna función
+        let mut shared = HashSet::new();
+        for function in &program.functions {
+            escape::collect_names(&function.body, &mut shared);
+        }
+        self.emit_line("int main(void) {");
         self.indent();
+        if self.profiling {
+            if program.functions.is_empty() {
+                self.emit_line("yaf_prof_start(NULL, 0);");
+            } else {
+                self.emit_line(&format!("yaf_prof_start(yaf_prof_names, {});", program.functions.len()));
+            }
+        }
+        self.declared_vars.clear();
+        self.scalar_vars.clear();
+        let locals = self.declare_locals(&program.main);
+        self.begin_gc_frame(&program.main, locals);
+        self.begin_frame(escape::frame_arrays(&program.main, &shared));
         self.generate_block(&program.main)?;
+        self.end_frame();
+        self.end_gc_frame();
         self.emit_line("return 0;");
         self.dedent();
         self.emit_line("}");
         
+        // Los cuerpos de pfor se usan antes de estar definidos
+        if self.parallel_loops > 0 {
+            let prototypes: String = (0..self.parallel_loops)
+                .map(|n| format!("static void yaf_pfor_{}(void* yaf_env_ptr, int64_t yaf_begin, int64_t yaf_end, int64_t yaf_chunk);\n", n))
+                .collect();
+            self.output.insert_str(prototypes_at, &format!("{}\n", prototypes));
+            let bodies = std::mem::take(&mut self.parallel_bodies);
+            self.emit_line("");
+            self.output.push_str(&bodies);
+        }
+        
         Ok(self.output.clone())
     }
     
-    #[allow(dead_code)]
-    fn generate_helper_functions(&mut self) {
-        // Función para imprimir
-        self.emit_line("void yaf_print_value(yaf_value_t val) {");
-        self.indent();
-        self.emit_line("switch (val.type) {");
-        self.indent();
-        self.emit_line("case YAF_INT:");
-        self.indent();
-        self.emit_line("printf(\"%d\", val.data.int_val);");
-        self.emit_line("break;");
-        self.dedent();
-        self.emit_line("case YAF_STRING:");
-        self.indent();
-        self.emit_line("printf(\"%s\", val.data.string_val);");
-        self.emit_line("break;");
-        self.dedent();
-        self.emit_line("case YAF_BOOL:");
-        self.indent();
-        self.emit_line("printf(\"%s\", val.data.bool_val ? \"true\" : \"false\");");
-        self.emit_line("break;");
-        self.dedent();
-        self.emit_line("case YAF_VOID:");
-        self.indent();
-        self.emit_line("printf(\"void\");");
-        self.emit_line("break;");
-        self.dedent();
-        self.dedent();
-        self.emit_line("}");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Función para crear valores
-        self.emit_line("yaf_value_t yaf_make_int(int val) {");
-        self.indent();
-        self.emit_line("yaf_value_t result;");
-        self.emit_line("result.type = YAF_INT;");
-        self.emit_line("result.data.int_val = val;");
-        self.emit_line("return result;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_make_bool(bool val) {");
-        self.indent();
-        self.emit_line("yaf_value_t result;");
-        self.emit_line("result.type = YAF_BOOL;");
-        self.emit_line("result.data.bool_val = val;");
-        self.emit_line("return result;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_make_string(const char* val) {");
-        self.indent();
-        self.emit_line("yaf_value_t result;");
-        self.emit_line("result.type = YAF_STRING;");
-        self.emit_line("result.data.string_val = strdup(val);");
-        self.emit_line("return result;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_make_void() {");
-        self.indent();
-        self.emit_line("yaf_value_t result;");
-        self.emit_line("result.type = YAF_VOID;");
-        self.emit_line("return result;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Operaciones aritméticas
-        self.emit_line("yaf_value_t yaf_add(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_int(a.data.int_val + b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Operación de suma inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_sub(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_int(a.data.int_val - b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Operación de resta inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_mul(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_int(a.data.int_val * b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Operación de multiplicación inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_div(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("if (b.data.int_val == 0) {");
-        self.indent();
-        self.emit_line("fprintf(stderr, \"Error: División por cero\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(a.data.int_val / b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Operación de división inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_mod(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("if (b.data.int_val == 0) {");
-        self.indent();
-        self.emit_line("fprintf(stderr, \"Error: Módulo por cero\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(a.data.int_val % b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Operación de módulo inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Operaciones de comparación
-        self.emit_line("yaf_value_t yaf_eq(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type != b.type) return yaf_make_bool(false);");
-        self.emit_line("switch (a.type) {");
-        self.indent();
-        self.emit_line("case YAF_INT: return yaf_make_bool(a.data.int_val == b.data.int_val);");
-        self.emit_line("case YAF_BOOL: return yaf_make_bool(a.data.bool_val == b.data.bool_val);");
-        self.emit_line("case YAF_STRING: return yaf_make_bool(strcmp(a.data.string_val, b.data.string_val) == 0);");
-        self.emit_line("default: return yaf_make_bool(false);");
-        self.dedent();
-        self.emit_line("}");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_lt(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_bool(a.data.int_val < b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Comparación inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_le(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_bool(a.data.int_val <= b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Comparación inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_gt(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_bool(a.data.int_val > b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Comparación inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_ge(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return yaf_make_bool(a.data.int_val >= b.data.int_val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("fprintf(stderr, \"Error: Comparación inválida\\n\");");
-        self.emit_line("exit(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Función para convertir a bool
-        self.emit_line("bool yaf_to_bool(yaf_value_t val) {");
-        self.indent();
-        self.emit_line("switch (val.type) {");
-        self.indent();
-        self.emit_line("case YAF_BOOL: return val.data.bool_val;");
-        self.emit_line("case YAF_INT: return val.data.int_val != 0;");
-        self.emit_line("case YAF_STRING: return strlen(val.data.string_val) > 0;");
-        self.emit_line("default: return false;");
-        self.dedent();
-        self.emit_line("}");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Funciones matemáticas
-        self.emit_line("yaf_value_t yaf_math_abs(yaf_value_t value) {");
-        self.indent();
-        self.emit_line("if (value.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("int val = value.data.int_val;");
-        self.emit_line("return yaf_make_int(val < 0 ? -val : val);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(0);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_math_max(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return a.data.int_val > b.data.int_val ? a : b;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(0);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_math_min(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_INT && b.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("return a.data.int_val < b.data.int_val ? a : b;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(0);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_math_pow(yaf_value_t base, yaf_value_t exp) {");
-        self.indent();
-        self.emit_line("if (base.type == YAF_INT && exp.type == YAF_INT) {");
-        self.indent();
-        self.emit_line("int result = 1;");
-        self.emit_line("int b = base.data.int_val;");
-        self.emit_line("int e = exp.data.int_val;");
-        self.emit_line("for (int i = 0; i < e; i++) {");
-        self.indent();
-        self.emit_line("result *= b;");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(result);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(1);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        // Funciones de strings
-        self.emit_line("yaf_value_t yaf_string_length(yaf_value_t str) {");
-        self.indent();
-        self.emit_line("if (str.type == YAF_STRING) {");
-        self.indent();
-        self.emit_line("return yaf_make_int(strlen(str.data.string_val));");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_int(0);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_string_upper(yaf_value_t str) {");
-        self.indent();
-        self.emit_line("if (str.type == YAF_STRING) {");
-        self.indent();
-        self.emit_line("int len = strlen(str.data.string_val);");
-        self.emit_line("char* result = malloc(len + 1);");
-        self.emit_line("for (int i = 0; i < len; i++) {");
-        self.indent();
-        self.emit_line("result[i] = toupper(str.data.string_val[i]);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("result[len] = '\\0';");
-        self.emit_line("return yaf_make_string(result);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_string(\"\");");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_string_lower(yaf_value_t str) {");
-        self.indent();
-        self.emit_line("if (str.type == YAF_STRING) {");
-        self.indent();
-        self.emit_line("int len = strlen(str.data.string_val);");
-        self.emit_line("char* result = malloc(len + 1);");
-        self.emit_line("for (int i = 0; i < len; i++) {");
-        self.indent();
-        self.emit_line("result[i] = tolower(str.data.string_val[i]);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("result[len] = '\\0';");
-        self.emit_line("return yaf_make_string(result);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_string(\"\");");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-        self.emit_line("yaf_value_t yaf_string_concat(yaf_value_t a, yaf_value_t b) {");
-        self.indent();
-        self.emit_line("if (a.type == YAF_STRING && b.type == YAF_STRING) {");
-        self.indent();
-        self.emit_line("int len_a = strlen(a.data.string_val);");
-        self.emit_line("int len_b = strlen(b.data.string_val);");
-        self.emit_line("char* result = malloc(len_a + len_b + 1);");
-        self.emit_line("strcpy(result, a.data.string_val);");
-        self.emit_line("strcat(result, b.data.string_val);");
-        self.emit_line("return yaf_make_string(result);");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("return yaf_make_string(\"\");");
-        self.dedent();
-        self.emit_line("}");
-        self.emit_line("");
-        
-
+    // Literal de C equivalente a los bytes del string: los no imprimibles van
+    // en octal, así los NUL intermedios también sobreviven
+    fn c_string_literal(s: &str) -> String {
+        let mut literal = String::with_capacity(s.len() + 2);
+        literal.push('"');
+        for &byte in s.as_bytes() {
+            match byte {
+                b'\\' => literal.push_str("\\\\"),
+                b'"' => literal.push_str("\\\""),
+                b'\n' => literal.push_str("\\n"),
+                b'\t' => literal.push_str("\\t"),
+                b'?' => literal.push_str("\\?"), // evita trigrafos
+                0x20..=0x7e => literal.push(byte as char),
+                _ => literal.push_str(&format!("\\{:03o}", byte)),
+            }
+        }
+        literal.push('"');
+        literal
     }
     
     fn generate_function_declaration(&mut self, function: &Function) -> Result<()> {
-        let return_type = "yaf_value_t"; // Siempre usar yaf_value_t para consistencia
+        let return_type = "YafValue"; // Siempre YafValue, como en el runtime
         
         let mut decl = format!("{} yaf_func_{}(", return_type, function.name);
         
@@ -592,7 +171,7 @@ impl CodeGenerator {
             if i > 0 {
                 decl.push_str(", ");
             }
-            decl.push_str("yaf_value_t ");
+            decl.push_str("YafValue ");
             decl.push_str(&param.name);
         }
         
@@ -606,15 +185,22 @@ impl CodeGenerator {
         self.in_function = true;
         self.declared_vars.clear(); // Nueva función, limpiar variables
         
-        let return_type = "yaf_value_t"; // Siempre usar yaf_value_t para consistencia
+        let return_type = "YafValue"; // Siempre YafValue, como en el runtime
         
-        let mut def = format!("{} yaf_func_{}(", return_type, function.name);
+        // El cuerpo de una función @memo queda detrás de la caché: las
+        // llamadas, también las recursivas, van a yaf_func_<nombre>
+        let memo = function.has_attribute("memo");
+        let mut def = if memo {
+            format!("static {} yaf_memo_body_{}(", return_type, function.name)
+        } else {
+            format!("{} yaf_func_{}(", return_type, function.name)
+        };
         
         for (i, param) in function.parameters.iter().enumerate() {
             if i > 0 {
                 def.push_str(", ");
             }
-            def.push_str("yaf_value_t ");
+            def.push_str("YafValue ");
             def.push_str(&param.name);
         }
         
@@ -622,19 +208,695 @@ impl CodeGenerator {
         self.emit_line(&def);
         self.indent();
         
+        // Los parámetros ya existen: asignarlos no debe redeclararlos
+        self.scalar_vars.clear();
+        let mut roots = Vec::new();
+        for param in &function.parameters {
+            self.declared_vars.insert(param.name.clone());
+            if Self::is_scalar_type(&param.param_type) {
+                self.scalar_vars.insert(param.name.clone());
+            } else {
+                roots.push(param.name.clone());
+            }
+        }
+        roots.extend(self.declare_locals(&function.body));
+        self.begin_gc_frame(&function.body, roots);
+        let parameters = function.parameters.iter().map(|param| param.name.clone()).collect();
+        self.begin_frame(escape::frame_arrays(&function.body, &parameters));
+        // Antes del bucle de cola: una llamada de cola a sí misma sigue en la misma activación
+        if let Some(id) = self.profile_id {
+            self.emit_line(&format!("yaf_prof_enter({});", id));
+        }
+        self.begin_tail_loop(function);
+        // Con los parámetros ya en raíces es el primer punto seguro para
+        // recolectar (también en cada vuelta del bucle de cola)
+        if self.block_may_allocate(&function.body) {
+            self.emit_line("yaf_gc_collect_if_needed();");
+        }
         self.generate_block(&function.body)?;
+        self.tail_loop = None;
+        self.end_frame();
         
         // Si no hay return explícito, agregar return void
-        self.emit_line("return yaf_make_void();");
+        self.emit_return("yaf_make_void()");
+        self.end_gc_frame();
         
         self.dedent();
         self.emit_line("}");
         self.emit_line("");
         
+        if memo {
+            self.generate_memo_wrapper(function);
+        }
+        
         self.in_function = false;
         Ok(())
     }
     
+    // Busca los argumentos en la caché de la función y solo ejecuta el
+    // cuerpo cuando no están (ver Memoization en el runtime)
+    fn generate_memo_wrapper(&mut self, function: &Function) {
+        let parameters: Vec<&str> = function.parameters.iter().map(|param| param.name.as_str()).collect();
+        let signature: Vec<String> = parameters.iter().map(|name| format!("YafValue {}", name)).collect();
+        let arity = parameters.len();
+        // C no admite arrays vacíos
+        let key = if arity == 0 { "yaf_make_int(0)".to_string() } else { parameters.join(", ") };
+        
+        self.emit_line(&format!("static YafMemo* yaf_memo_{};", function.name));
+        self.emit_line(&format!("YafValue yaf_func_{}({}) {{", function.name, signature.join(", ")));
+        self.indent();
+        self.emit_line(&format!("YafValue yaf_memo_key[] = {{ {} }};", key));
+        self.emit_line("YafValue yaf_memo_result;");
+        self.emit_line(&format!("if (yaf_memo_get(&yaf_memo_{}, yaf_memo_key, {}, &yaf_memo_result)) {{", function.name, arity));
+        self.indent();
+        self.emit_line("return yaf_memo_result;");
+        self.dedent();
+        self.emit_line("}");
+        self.emit_line(&format!("yaf_memo_result = yaf_memo_body_{}({});", function.name, parameters.join(", ")));
+        self.emit_line(&format!("yaf_memo_put(&yaf_memo_{}, yaf_memo_key, {}, yaf_memo_result);", function.name, arity));
+        self.emit_line("return yaf_memo_result;");
+        self.dedent();
+        self.emit_line("}");
+        self.emit_line("");
+    }
+    
+    // El storage de los objetos del frame vive en toda la función, aunque el
+    // literal esté dentro de un bucle: se declara donde empieza el cuerpo
+    fn begin_frame(&mut self, frame_arrays: HashSet<String>) {
+        self.frame_arrays = frame_arrays;
+        self.frame_storage.clear();
+        self.frame_at = self.output.len();
+    }
+    
+    fn end_frame(&mut self) {
+        let indent = "    ".repeat(self.indent_level);
+        let declarations: String = self.frame_storage.drain(..)
+            .map(|declaration| format!("{}{}\n", indent, declaration))
+            .collect();
+        self.output.insert_str(self.frame_at, &declarations);
+        self.frame_arrays.clear();
+    }
+    
+    // Solo se recolecta en los puntos seguros, dentro de las funciones de
+    // usuario y entre trozos de un pfor: si el bloque no llega a ninguno, sus
+    // variables no necesitan raíces
+    fn begin_gc_frame(&mut self, block: &Block, mut roots: Vec<String>) {
+        let calls = self.block_any(block, &|expr| self.contains_user_call(expr));
+        if !calls && !self.block_may_allocate(block) {
+            roots.clear();
+        }
+        // Los temporales en raíces solo hacen falta alrededor de una llamada
+        self.gc_frame = (calls || !roots.is_empty()).then(|| GcFrame { at: self.output.len(), roots, temps: Vec::new() });
+    }
+    
+    // La profundidad de la pila de raíces y las raíces se registran donde
+    // empezó el frame; sin ninguna raíz se quitan también los unwind
+    fn end_gc_frame(&mut self) {
+        let Some(frame) = self.gc_frame.take() else {
+            return;
+        };
+        if !Self::gc_frame_used(&frame) {
+            let body = self.output.split_off(frame.at);
+            self.output.push_str(&body.replace(GC_UNWIND, ""));
+            return;
+        }
+        let indent = "    ".repeat(self.indent_level);
+        let mut prologue = format!("{}int64_t yaf_gc_frame = yaf_gc_root_depth();\n", indent);
+        for temp in &frame.temps {
+            prologue.push_str(&format!("{}YafValue {} = yaf_make_void();\n", indent, temp));
+        }
+        for root in frame.roots.iter().chain(&frame.temps) {
+            prologue.push_str(&format!("{}yaf_gc_add_root((int64_t)&{});\n", indent, root));
+        }
+        self.output.insert_str(frame.at, &prologue);
+    }
+    
+    fn gc_frame_used(frame: &GcFrame) -> bool {
+        !frame.roots.is_empty() || !frame.temps.is_empty()
+    }
+    
+    // Variable de C en una raíz del frame, para un valor que tiene que
+    // sobrevivir a una llamada de usuario
+    fn gc_temp(&mut self) -> String {
+        let temp = format!("yaf_gc_tmp_{}", self.gc_temps);
+        self.gc_temps += 1;
+        // Solo se piden con una llamada de usuario, y entonces hay frame
+        self.gc_frame.as_mut().unwrap().temps.push(temp.clone());
+        temp
+    }
+    
+    // Un operando ya evaluado solo vive en un temporal de C, y C no fija el
+    // orden de evaluación de los argumentos: si otro operando puede llamar a
+    // una función de usuario (y recolectar), el valor se guarda antes en una
+    // raíz. Devuelve esas asignaciones, en orden.
+    fn spill_operands(&mut self, operands: &[&Expression], results: &mut [String], consumed: bool) -> String {
+        let mut spills = String::new();
+        for (i, operand) in operands.iter().enumerate() {
+            let pending_call = operands.iter().enumerate()
+                .any(|(j, other)| j != i && self.contains_user_call(other));
+            // Los strings del frame no están en el heap
+            let in_frame = consumed && escape::is_frame_string(operand);
+            if pending_call && !in_frame && self.may_point_to_heap(operand) {
+                let temp = self.gc_temp();
+                spills.push_str(&format!("{} = {}; ", temp, results[i]));
+                results[i] = temp;
+            }
+        }
+        spills
+    }
+    
+    fn sequenced(spills: String, code: String) -> String {
+        if spills.is_empty() {
+            code
+        } else {
+            format!("({{ {}{}; }})", spills, code)
+        }
+    }
+    
+    fn contains_user_call(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(_) | Expression::Variable(_) => false,
+            Expression::FunctionCall { name, arguments } => {
+                self.function_returns.contains_key(name) ||
+                    arguments.iter().any(|arg| self.contains_user_call(arg))
+            },
+            Expression::BuiltinCall { arguments, .. } | Expression::ArrayLiteral { elements: arguments } => {
+                arguments.iter().any(|arg| self.contains_user_call(arg))
+            },
+            Expression::BinaryOp { left, right, .. } | Expression::ArrayAccess { array: left, index: right } => {
+                self.contains_user_call(left) || self.contains_user_call(right)
+            },
+            Expression::UnaryOp { operand, .. } => self.contains_user_call(operand),
+            Expression::MapLiteral { entries, .. } => {
+                entries.iter().any(|(key, value)| self.contains_user_call(key) || self.contains_user_call(value))
+            },
+        }
+    }
+    
+    // Las variables ya están en raíces y una llamada no puede reasignarlas
+    fn may_point_to_heap(&self, expr: &Expression) -> bool {
+        !matches!(expr, Expression::Variable(_)) && !self.is_scalar(expr)
+    }
+    
+    fn is_scalar_type(ty: &Type) -> bool {
+        matches!(ty, Type::Int | Type::Float | Type::Bool | Type::Void)
+    }
+    
+    // Builtins que devuelven int, float, bool o void
+    fn is_scalar_builtin(name: &str) -> bool {
+        matches!(name,
+            "abs" | "max" | "min" | "pow" | "length" | "string_length" | "now" | "now_millis" | "now_nanos" |
+            "clock_monotonic" | "string_to_int" | "int" | "float" | "open" | "file_open" | "find" |
+            "write_file" | "file_exists" | "contains" | "eof" | "close" | "file_write" | "file_close" |
+            "sleep" | "sleep_ms" | "map_has" | "map_delete" | "print" | "push" | "map_set" | "flush")
+    }
+    
+    // Si el valor es seguro un int, float o bool, que nunca apuntan al heap
+    fn is_scalar(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(value) => !matches!(value, Value::String(_)),
+            Expression::Variable(name) => self.scalar_vars.contains(name),
+            Expression::FunctionCall { name, .. } => match self.function_returns.get(name) {
+                Some(return_type) => Self::is_scalar_type(return_type),
+                None => Self::is_scalar_builtin(name),
+            },
+            Expression::BuiltinCall { name, .. } => Self::is_scalar_builtin(name),
+            // + también concatena; el resto son aritmética y comparaciones
+            Expression::BinaryOp { left, operator: BinaryOperator::Add, right } => {
+                self.is_scalar(left) && self.is_scalar(right)
+            },
+            Expression::BinaryOp { .. } | Expression::UnaryOp { .. } => true,
+            Expression::ArrayLiteral { .. } | Expression::ArrayAccess { .. } | Expression::MapLiteral { .. } => false,
+        }
+    }
+    
+    // Si evaluar la expresión puede reservar en el heap del GC, sin contar las
+    // llamadas de usuario (esas tienen su propio punto seguro)
+    fn expression_may_allocate(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(value) => matches!(value, Value::String(_)),
+            Expression::Variable(_) => false,
+            Expression::FunctionCall { arguments, .. } | Expression::BuiltinCall { arguments, .. } => {
+                // push y map_set pueden hacer crecer el contenedor
+                let allocates = match expr {
+                    Expression::BuiltinCall { name, .. } => name == "push" || name == "map_set" || !Self::is_scalar_builtin(name),
+                    _ => false,
+                };
+                allocates || arguments.iter().any(|arg| self.expression_may_allocate(arg))
+            },
+            Expression::BinaryOp { left, operator, right } => {
+                let concatenates = matches!(operator, BinaryOperator::Add) && !self.is_scalar(expr);
+                concatenates || self.expression_may_allocate(left) || self.expression_may_allocate(right)
+            },
+            Expression::UnaryOp { operand, .. } => self.expression_may_allocate(operand),
+            Expression::ArrayLiteral { .. } | Expression::MapLiteral { .. } => true,
+            Expression::ArrayAccess { array, index } => {
+                self.expression_may_allocate(array) || self.expression_may_allocate(index)
+            },
+        }
+    }
+    
+    fn block_may_allocate(&self, block: &Block) -> bool {
+        self.block_any(block, &|expr| self.expression_may_allocate(expr))
+    }
+    
+    // Si alguna expresión del bloque cumple `test`. Un pfor cuenta siempre:
+    // puede recolectar entre trozos.
+    fn block_any(&self, block: &Block, test: &dyn Fn(&Expression) -> bool) -> bool {
+        block.statements.iter().any(|statement| self.statement_any(statement, test))
+    }
+    
+    fn statement_any(&self, statement: &Statement, test: &dyn Fn(&Expression) -> bool) -> bool {
+        match statement {
+            Statement::Declaration { value, .. } | Statement::Assignment { value, .. } => test(value),
+            Statement::ArrayAssignment { index, value, .. } => test(index) || test(value),
+            Statement::If { condition, then_block, else_block } => {
+                test(condition) || self.block_any(then_block, test) ||
+                    else_block.as_ref().map_or(false, |else_block| self.block_any(else_block, test))
+            },
+            Statement::While { condition, body } => test(condition) || self.block_any(body, test),
+            Statement::For { init, condition, increment, body } => {
+                self.statement_any(init, test) || test(condition) ||
+                    self.statement_any(increment, test) || self.block_any(body, test)
+            },
+            Statement::ParallelFor { .. } => true,
+            Statement::Return { value } => value.as_ref().map_or(false, |value| test(value)),
+            Statement::Expression(expr) => test(expr),
+        }
+    }
+    
+    // Las llamadas de cola a sí misma vuelven aquí con goto, después de
+    // asignar los argumentos a los parámetros
+    fn begin_tail_loop(&mut self, function: &Function) {
+        let Some(tail) = tailcall::tail_loop(function) else {
+            return;
+        };
+        if tail.accumulator.is_some() {
+            self.emit_line(&format!("YafValue yaf_acc = yaf_make_int(INT64_C({}));", tail.identity()));
+        }
+        self.emit_line("yaf_tail: ;");
+        let parameters = function.parameters.iter().map(|param| param.name.clone()).collect();
+        self.tail_loop = Some((tail, parameters));
+    }
+    
+    fn generate_tail_return(&mut self, expr: &Expression) -> Result<()> {
+        let (tail, parameters) = self.tail_loop.clone().unwrap();
+        let accumulate = match tail.accumulator {
+            Some(BinaryOperator::Multiply) => Some("yaf_mul"),
+            Some(_) => Some("yaf_add"),
+            None => None,
+        };
+        match tail.classify(expr) {
+            TailReturn::Jump { arguments, operand } => {
+                if let (Some(operand), Some(accumulate)) = (operand, accumulate) {
+                    let operand_result = self.generate_expression(operand)?;
+                    self.emit_line(&format!("yaf_acc = {}(yaf_acc, {});", accumulate, operand_result));
+                }
+                // Todos los argumentos se evalúan antes de tocar los parámetros;
+                // los que esperan a una llamada de usuario, en raíces
+                let mut temps = Vec::new();
+                for (i, argument) in arguments.iter().enumerate() {
+                    let argument_result = self.generate_expression(argument)?;
+                    if self.may_point_to_heap(argument) && arguments[i + 1..].iter().any(|arg| self.contains_user_call(arg)) {
+                        let temp = self.gc_temp();
+                        self.emit_line(&format!("{} = {};", temp, argument_result));
+                        temps.push(temp);
+                        continue;
+                    }
+                    let temp = format!("yaf_tail_{}", self.tail_temps);
+                    self.tail_temps += 1;
+                    self.emit_line(&format!("YafValue {} = {};", temp, argument_result));
+                    temps.push(temp);
+                }
+                for (parameter, temp) in parameters.iter().zip(&temps) {
+                    self.emit_line(&format!("{} = {};", parameter, temp));
+                }
+                self.emit_line("goto yaf_tail;");
+            },
+            TailReturn::Value => {
+                let expr_result = self.generate_expression(expr)?;
+                match accumulate {
+                    Some(accumulate) => self.emit_return(&format!("{}(yaf_acc, {})", accumulate, expr_result)),
+                    None => self.emit_return(&expr_result),
+                }
+            },
+        }
+        Ok(())
+    }
+    
+    // El valor se calcula antes de salir de la función en el perfil (--profile)
+    // y de quitar las raíces del frame
+    fn emit_return(&mut self, value: &str) {
+        if self.profile_id.is_none() && self.gc_frame.is_none() {
+            self.emit_line(&format!("return {};", value));
+            return;
+        }
+        let profile_exit = if self.profile_id.is_some() { "yaf_prof_exit(); " } else { "" };
+        let unwind = if self.gc_frame.is_some() { GC_UNWIND } else { "" };
+        self.emit_line(&format!("{{ YafValue yaf_result = {}; {}{}return yaf_result; }}", value, profile_exit, unwind));
+    }
+    
+    fn frame_slot(&mut self, size: &str) -> String {
+        let slot = format!("yaf_frame_{}", self.frame_slots);
+        self.frame_slots += 1;
+        self.frame_storage.push(format!("_Alignas(16) unsigned char {}[{}];", slot, size));
+        slot
+    }
+    
+    // Operando que se lee en el momento (print, concatenación): las
+    // conversiones a string se formatean en el frame
+    fn generate_consumed_expression(&mut self, expr: &Expression) -> Result<String> {
+        if !escape::is_frame_string(expr) {
+            return self.generate_expression(expr);
+        }
+        let (name, argument) = match expr {
+            Expression::BuiltinCall { name, arguments } | Expression::FunctionCall { name, arguments } => (name, &arguments[0]),
+            _ => unreachable!(),
+        };
+        let argument_result = self.generate_expression(argument)?;
+        let slot = self.frame_slot("YAF_FRAME_STRING_SIZE");
+        let function = if name == "str" { "yaf_value_to_string_frame" } else { "yaf_int_to_string_frame" };
+        Ok(format!("{}({}, {})", function, argument_result, slot))
+    }
+    
+    // Igual que los maps: crea el array del runtime y lo rellena. Los de una
+    // variable que no escapa se construyen en el frame.
+    fn generate_array_literal(&mut self, elements: &[Expression], in_frame: bool) -> Result<String> {
+        let array_new = if in_frame {
+            let slot = self.frame_slot(&format!("YAF_FRAME_ARRAY_SIZE({})", elements.len()));
+            format!("yaf_array_init_frame({}, YAF_ELEM_VALUE, {})", slot, elements.len())
+        } else {
+            format!("yaf_array_new(YAF_ELEM_VALUE, {})", elements.len())
+        };
+        // Si un elemento llama a una función de usuario, el array va en una raíz
+        let calls = elements.iter().any(|element| self.contains_user_call(element));
+        let array = if calls { self.gc_temp() } else { "__array".to_string() };
+        let mut code = if calls {
+            format!("({{ {} = (YafValue){{ .tag = YAF_ARRAY, .value.array_val = {} }}; ", array, array_new)
+        } else {
+            format!("({{ YafValue __array = {{ .tag = YAF_ARRAY, .value.array_val = {} }}; ", array_new)
+        };
+        for element in elements {
+            let element_result = self.generate_expression(element)?;
+            code.push_str(&format!("yaf_array_push({}, {}); ", array, element_result));
+        }
+        code.push_str(&format!("{}; }})", array));
+        Ok(code)
+    }
+    
+    // Las variables de YAF viven en toda la función, no en el bloque de C donde
+    // se asignan por primera vez: se declaran todas al principio. Devuelve las
+    // que declaró y pueden apuntar al heap, las que necesitan raíz.
+    fn declare_locals(&mut self, block: &Block) -> Vec<String> {
+        let mut names = Vec::new();
+        Self::collect_assigned(block, &mut names);
+        let mut typed = self.declared_vars.clone();
+        self.collect_scalar_locals(block, &mut typed);
+        names.retain(|name| self.declared_vars.insert(name.clone()));
+        for name in &names {
+            self.emit_line(&format!("YafValue {} = yaf_make_void();", name));
+        }
+        names.retain(|name| !self.scalar_vars.contains(name));
+        names
+    }
+    
+    // El tipo de una variable es el de su primera asignación (el typechecker
+    // no deja cambiarlo): int, float y bool nunca apuntan al heap
+    fn collect_scalar_locals(&mut self, block: &Block, typed: &mut HashSet<String>) {
+        for statement in &block.statements {
+            self.collect_scalar_statement(statement, typed);
+        }
+    }
+    
+    fn collect_scalar_statement(&mut self, statement: &Statement, typed: &mut HashSet<String>) {
+        match statement {
+            Statement::Declaration { name, var_type, .. } => {
+                if typed.insert(name.clone()) && Self::is_scalar_type(var_type) {
+                    self.scalar_vars.insert(name.clone());
+                }
+            },
+            Statement::Assignment { name, value } => {
+                if typed.insert(name.clone()) && self.is_scalar(value) {
+                    self.scalar_vars.insert(name.clone());
+                }
+            },
+            Statement::If { then_block, else_block, .. } => {
+                self.collect_scalar_locals(then_block, typed);
+                if let Some(else_block) = else_block {
+                    self.collect_scalar_locals(else_block, typed);
+                }
+            },
+            Statement::While { body, .. } => self.collect_scalar_locals(body, typed),
+            Statement::For { init, increment, body, .. } => {
+                self.collect_scalar_statement(init, typed);
+                self.collect_scalar_locals(body, typed);
+                self.collect_scalar_statement(increment, typed);
+            },
+            _ => {},
+        }
+    }
+    
+    fn collect_assigned(block: &Block, names: &mut Vec<String>) {
+        for statement in &block.statements {
+            Self::collect_assigned_statement(statement, names);
+        }
+    }
+    
+    fn collect_assigned_statement(statement: &Statement, names: &mut Vec<String>) {
+        match statement {
+            Statement::Declaration { name, .. } | Statement::Assignment { name, .. } => {
+                if !names.contains(name) {
+                    names.push(name.clone());
+                }
+            },
+            Statement::If { then_block, else_block, .. } => {
+                Self::collect_assigned(then_block, names);
+                if let Some(else_block) = else_block {
+                    Self::collect_assigned(else_block, names);
+                }
+            },
+            Statement::While { body, .. } => Self::collect_assigned(body, names),
+            Statement::For { init, increment, body, .. } => {
+                Self::collect_assigned_statement(init, names);
+                Self::collect_assigned(body, names);
+                Self::collect_assigned_statement(increment, names);
+            },
+            _ => {},
+        }
+    }
+    
+    // Nombres que un bloque lee o escribe, incluidos los de pfor anidados
+    fn collect_used(block: &Block, names: &mut HashSet<String>) {
+        for statement in &block.statements {
+            match statement {
+                Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                    names.insert(name.clone());
+                    Self::collect_used_expression(value, names);
+                },
+                Statement::ArrayAssignment { name, index, value } => {
+                    names.insert(name.clone());
+                    Self::collect_used_expression(index, names);
+                    Self::collect_used_expression(value, names);
+                },
+                Statement::If { condition, then_block, else_block } => {
+                    Self::collect_used_expression(condition, names);
+                    Self::collect_used(then_block, names);
+                    if let Some(else_block) = else_block {
+                        Self::collect_used(else_block, names);
+                    }
+                },
+                Statement::While { condition, body } => {
+                    Self::collect_used_expression(condition, names);
+                    Self::collect_used(body, names);
+                },
+                Statement::For { init, condition, increment, body } => {
+                    Self::collect_used(&Block { statements: vec![(**init).clone(), (**increment).clone()] }, names);
+                    Self::collect_used_expression(condition, names);
+                    Self::collect_used(body, names);
+                },
+                Statement::ParallelFor { start, end, reductions, body, .. } => {
+                    Self::collect_used_expression(start, names);
+                    Self::collect_used_expression(end, names);
+                    names.extend(reductions.iter().map(|r| r.variable.clone()));
+                    Self::collect_used(body, names);
+                },
+                Statement::Return { value } => {
+                    if let Some(value) = value {
+                        Self::collect_used_expression(value, names);
+                    }
+                },
+                Statement::Expression(expr) => Self::collect_used_expression(expr, names),
+            }
+        }
+    }
+    
+    fn collect_used_expression(expr: &Expression, names: &mut HashSet<String>) {
+        match expr {
+            Expression::Literal(_) => {},
+            Expression::Variable(name) => {
+                names.insert(name.clone());
+            },
+            Expression::FunctionCall { arguments, .. } | Expression::BuiltinCall { arguments, .. } |
+            Expression::ArrayLiteral { elements: arguments } => {
+                for argument in arguments {
+                    Self::collect_used_expression(argument, names);
+                }
+            },
+            Expression::BinaryOp { left, right, .. } => {
+                Self::collect_used_expression(left, names);
+                Self::collect_used_expression(right, names);
+            },
+            Expression::UnaryOp { operand, .. } => Self::collect_used_expression(operand, names),
+            Expression::ArrayAccess { array, index } => {
+                Self::collect_used_expression(array, names);
+                Self::collect_used_expression(index, names);
+            },
+            Expression::MapLiteral { entries, .. } => {
+                for (key, value) in entries {
+                    Self::collect_used_expression(key, names);
+                    Self::collect_used_expression(value, names);
+                }
+            },
+        }
+    }
+    
+    // El cuerpo va a una función yaf_pfor_N(env, begin, end, chunk) que el
+    // runtime llama por trozos del rango. env apunta a las variables de fuera
+    // que el cuerpo lee (se copian: el typechecker no deja escribirlas) y, por
+    // cada reducción, a su valor actual y al array de resultados por trozo,
+    // que se combinan en orden al terminar.
+    fn generate_parallel_for(&mut self, variable: &str, start: &Expression, end: &Expression,
+                             reductions: &[Reduction], body: &Block) -> Result<()> {
+        let index = self.parallel_loops;
+        self.parallel_loops += 1;
+        
+        let mut used = HashSet::new();
+        Self::collect_used(body, &mut used);
+        let mut assigned = Vec::new();
+        Self::collect_assigned(body, &mut assigned);
+        let mut captured: Vec<String> = used.into_iter()
+            .filter(|name| self.declared_vars.contains(name) && name != variable && !assigned.contains(name)
+                && !reductions.iter().any(|r| r.variable == *name))
+            .collect();
+        captured.sort();
+        
+        // Cuerpo en su propia función
+        let saved_output = std::mem::take(&mut self.output);
+        let saved_indent = std::mem::replace(&mut self.indent_level, 0);
+        let saved_vars = std::mem::take(&mut self.declared_vars);
+        let saved_frame = (
+            std::mem::take(&mut self.frame_arrays),
+            std::mem::take(&mut self.frame_storage),
+            self.frame_at,
+        );
+        let saved_gc = (self.gc_frame.take(), std::mem::take(&mut self.scalar_vars));
+        self.emit_line(&format!(
+            "static void yaf_pfor_{}(void* yaf_env_ptr, int64_t yaf_begin, int64_t yaf_end, int64_t yaf_chunk) {{", index
+        ));
+        self.indent();
+        self.emit_line("YafValue** yaf_env = (YafValue**)yaf_env_ptr;");
+        for (slot, name) in captured.iter().enumerate() {
+            self.emit_line(&format!("YafValue {} = *yaf_env[{}];", name, slot));
+            self.declared_vars.insert(name.clone());
+        }
+        for (i, reduction) in reductions.iter().enumerate() {
+            let current = format!("yaf_env[{}]", captured.len() + 2 * i);
+            // Cada trozo suma desde cero; min y max pueden partir del valor actual
+            let initial = match reduction.operator {
+                ReductionOperator::Add => format!("({}->tag == YAF_FLOAT ? yaf_make_float(0.0) : yaf_make_int(INT64_C(0)))", current),
+                ReductionOperator::Min | ReductionOperator::Max => format!("*{}", current),
+            };
+            self.emit_line(&format!("YafValue {} = {};", reduction.variable, initial));
+            self.declared_vars.insert(reduction.variable.clone());
+            self.scalar_vars.insert(reduction.variable.clone());
+        }
+        self.declared_vars.insert(variable.to_string());
+        self.scalar_vars.insert(variable.to_string());
+        // Cada hilo tiene su pila de raíces. Las copias de lo capturado no
+        // necesitan raíz: el frame de fuera mantiene vivos los originales.
+        let locals = self.declare_locals(body);
+        self.begin_gc_frame(body, locals);
+        self.begin_frame(HashSet::new());
+        self.emit_line("for (int64_t yaf_index = yaf_begin; yaf_index < yaf_end; yaf_index++) {");
+        self.indent();
+        self.emit_line(&format!("YafValue {} = yaf_make_int(yaf_index);", variable));
+        self.generate_block(body)?;
+        if self.block_may_allocate(body) {
+            self.emit_line("yaf_gc_collect_if_needed();");
+        }
+        self.dedent();
+        self.emit_line("}");
+        self.end_frame();
+        for (i, reduction) in reductions.iter().enumerate() {
+            self.emit_line(&format!("yaf_env[{}][yaf_chunk] = {};", captured.len() + 2 * i + 1, reduction.variable));
+        }
+        if self.gc_frame.as_ref().map_or(false, Self::gc_frame_used) {
+            self.emit_line(GC_UNWIND.trim_end());
+        }
+        self.end_gc_frame();
+        self.dedent();
+        self.emit_line("}");
+        self.emit_line("");
+        let function = std::mem::replace(&mut self.output, saved_output);
+        self.parallel_bodies.push_str(&function);
+        self.indent_level = saved_indent;
+        self.declared_vars = saved_vars;
+        (self.frame_arrays, self.frame_storage, self.frame_at) = saved_frame;
+        (self.gc_frame, self.scalar_vars) = saved_gc;
+        
+        // Llamada desde el bloque actual
+        let start_result = self.generate_expression(start)?;
+        let end_result = self.generate_expression(end)?;
+        self.emit_line("{");
+        self.indent();
+        self.emit_line(&format!("int64_t yaf_pfor_begin = ({}).value.int_val;", start_result));
+        self.emit_line(&format!("int64_t yaf_pfor_end = ({}).value.int_val;", end_result));
+        self.emit_line("int64_t yaf_pfor_chunks = yaf_parallel_chunks(yaf_pfor_begin, yaf_pfor_end);");
+        self.emit_line("if (yaf_pfor_chunks > 0) {");
+        self.indent();
+        let mut env: Vec<String> = captured.iter().map(|name| format!("&{}", name)).collect();
+        for reduction in reductions {
+            let partials = format!("yaf_partials_{}", reduction.variable);
+            self.emit_line(&format!(
+                "YafValue* {} = yaf_alloc(sizeof(YafValue) * (size_t)yaf_pfor_chunks);", partials
+            ));
+            env.push(format!("&{}", reduction.variable));
+            env.push(partials);
+        }
+        if env.is_empty() {
+            self.emit_line(&format!("yaf_parallel_for(yaf_pfor_begin, yaf_pfor_end, yaf_pfor_{}, NULL);", index));
+        } else {
+            self.emit_line(&format!("YafValue* yaf_pfor_env[] = {{ {} }};", env.join(", ")));
+            self.emit_line(&format!("yaf_parallel_for(yaf_pfor_begin, yaf_pfor_end, yaf_pfor_{}, yaf_pfor_env);", index));
+        }
+        for reduction in reductions {
+            let combine = match reduction.operator {
+                ReductionOperator::Add => "yaf_add",
+                ReductionOperator::Min => "yaf_math_min",
+                ReductionOperator::Max => "yaf_math_max",
+            };
+            let partials = format!("yaf_partials_{}", reduction.variable);
+            self.emit_line("for (int64_t yaf_k = 0; yaf_k < yaf_pfor_chunks; yaf_k++) {");
+            self.emit_line(&format!(
+                "    {} = {}({}, {}[yaf_k]);", reduction.variable, combine, reduction.variable, partials
+            ));
+            self.emit_line("}");
+            self.emit_line(&format!("yaf_dealloc({}, sizeof(YafValue) * (size_t)yaf_pfor_chunks);", partials));
+        }
+        self.dedent();
+        self.emit_line("}");
+        self.dedent();
+        self.emit_line("}");
+        Ok(())
+    }
+    
+    // Punto seguro al final de cada vuelta, si el bucle reserva memoria
+    fn emit_back_edge(&mut self, loop_statement: &Statement) {
+        if self.statement_any(loop_statement, &|expr| self.expression_may_allocate(expr)) {
+            self.emit_line("yaf_gc_collect_if_needed();");
+        }
+    }
+    
     fn generate_block(&mut self, block: &Block) -> Result<()> {
         for statement in &block.statements {
             self.generate_statement(statement)?;
@@ -644,28 +906,22 @@ impl CodeGenerator {
     
     fn generate_statement(&mut self, stmt: &Statement) -> Result<()> {
         match stmt {
-            Statement::Declaration { name, var_type: _, value } => {
-                let expr_result = self.generate_expression(value)?;
-                // Para declaración, siempre crear nueva variable
-                self.emit_line(&format!("yaf_value_t {} = {};", name, expr_result));
-                self.declared_vars.insert(name.clone());
-            },
-            Statement::Assignment { name, value } => {
-                let expr_result = self.generate_expression(value)?;
-                if self.declared_vars.contains(name) {
-                    // Variable ya declarada, hacer asignación
-                    self.emit_line(&format!("{} = {};", name, expr_result));
-                } else {
-                    // Variable nueva, hacer declaración
-                    self.emit_line(&format!("yaf_value_t {} = {};", name, expr_result));
-                    self.declared_vars.insert(name.clone());
-                }
+            Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                // declare_locals ya declaró la variable al principio de la función
+                let expr_result = match value {
+                    Expression::ArrayLiteral { elements } if self.frame_arrays.contains(name) => {
+                        self.generate_array_literal(elements, true)?
+                    },
+                    _ => self.generate_expression(value)?,
+                };
+                self.emit_line(&format!("{} = {};", name, expr_result));
             },
             
             Statement::ArrayAssignment { name, index, value } => {
-                let index_result = self.generate_expression(index)?;
-                let value_result = self.generate_expression(value)?;
-                self.emit_line(&format!("yaf_array_set({}, {}, {});", name, index_result, value_result));
+                let mut results = [self.generate_expression(index)?, self.generate_expression(value)?];
+                let spills = self.spill_operands(&[index, value], &mut results, false);
+                let [index_result, value_result] = results;
+                self.emit_line(&format!("{}yaf_array_set({}, {}, {});", spills, name, index_result, value_result));
             },
             
             Statement::If { condition, then_block, else_block } => {
@@ -691,6 +947,7 @@ impl CodeGenerator {
                 let cond_result = self.generate_expression(condition)?;
                 self.emit_line(&format!("if (!yaf_to_bool({})) break;", cond_result));
                 self.generate_block(body)?;
+                self.emit_back_edge(stmt);
                 self.dedent();
                 self.emit_line("}");
             },
@@ -711,17 +968,26 @@ impl CodeGenerator {
                 
                 // Generar el incremento
                 self.generate_statement(increment)?;
+                self.emit_back_edge(stmt);
                 
                 self.dedent();
                 self.emit_line("}");
             },
             
+            Statement::ParallelFor { variable, start, end, reductions, body } => {
+                self.generate_parallel_for(variable, start, end, reductions, body)?;
+            },
+            
+            Statement::Return { value: Some(expr) } if self.tail_loop.is_some() => {
+                self.generate_tail_return(expr)?;
+            },
+            
             Statement::Return { value } => {
                 if let Some(expr) = value {
                     let expr_result = self.generate_expression(expr)?;
-                    self.emit_line(&format!("return {};", expr_result));
+                    self.emit_return(&expr_result);
                 } else {
-                    self.emit_line("return yaf_make_void();");
+                    self.emit_return("yaf_make_void()");
                 }
             },
             
@@ -738,6 +1004,10 @@ impl CodeGenerator {
                             }
                         }
                     },
+                    Expression::BuiltinCall { .. } => {
+                        // push, map_set, write_file... se llaman por su efecto
+                        self.emit_line(&format!("{};", result));
+                    },
                     _ => {
                         // Otras expresiones como statements se descartan
                     }
@@ -751,17 +1021,13 @@ impl CodeGenerator {
         match expr {
             Expression::Literal(value) => {
                 match value {
-                    Value::Int(n) => Ok(format!("yaf_make_int({})", n)),
+                    Value::Int(n) => Ok(format!("yaf_make_int(INT64_C({}))", n)),
                     Value::String(s) => {
-                        // Escapar string para C
-                        let escaped = s.replace("\\", "\\\\")
-                                      .replace("\"", "\\\"")
-                                      .replace("\n", "\\n")
-                                      .replace("\t", "\\t");
-                        Ok(format!("yaf_make_string(\"{}\")", escaped))
+                        // Con la longitud explícita: los cortos quedan inline
+                        Ok(format!("yaf_make_string_len({}, {})", Self::c_string_literal(s), s.len()))
                     },
-                    Value::Float(f) => Ok(format!("yaf_make_int({})", *f as i64)), // Temporal: convertir a int
-                    Value::Bool(b) => Ok(format!("yaf_make_bool({})", if *b { "true" } else { "false" })),
+                    Value::Float(f) => Ok(format!("yaf_make_float({:?})", f)),
+                    Value::Bool(b) => Ok(format!("yaf_make_bool({})", if *b { 1 } else { 0 })),
                 }
             },
             
@@ -775,34 +1041,43 @@ impl CodeGenerator {
                     
                     for (i, arg) in arguments.iter().enumerate() {
                         if i > 0 {
-                            print_code.push_str("printf(\" \"); ");
+                            print_code.push_str("yaf_write(\" \", 1); ");
                         }
-                        let arg_result = self.generate_expression(arg)?;
-                        print_code.push_str(&format!("yaf_print_value({}); ", arg_result));
+                        let arg_result = self.generate_consumed_expression(arg)?;
+                        print_code.push_str(&format!("yaf_print_value_no_newline({}); ", arg_result));
                     }
-                    print_code.push_str("printf(\"\\n\");");
+                    print_code.push_str("yaf_print_newline();");
                     
                     // Emitir el código del print
                     self.emit_line(&print_code);
                     Ok("yaf_make_void()".to_string())
                 } else {
                     // Llamada a función de usuario
-                    let mut call = format!("yaf_func_{}(", name);
-                    for (i, arg) in arguments.iter().enumerate() {
-                        if i > 0 {
-                            call.push_str(", ");
-                        }
-                        let arg_result = self.generate_expression(arg)?;
-                        call.push_str(&arg_result);
+                    let mut arg_results = Vec::new();
+                    for arg in arguments {
+                        arg_results.push(self.generate_expression(arg)?);
                     }
-                    call.push(')');
-                    Ok(call)
+                    let operands: Vec<&Expression> = arguments.iter().collect();
+                    let spills = self.spill_operands(&operands, &mut arg_results, false);
+                    Ok(Self::sequenced(spills, format!("yaf_func_{}({})", name, arg_results.join(", "))))
                 }
             },
             
             Expression::BinaryOp { left, operator, right } => {
-                let left_result = self.generate_expression(left)?;
-                let right_result = self.generate_expression(right)?;
+                // La concatenación copia sus operandos
+                let concatenates = matches!(operator, BinaryOperator::Add);
+                let mut results = if concatenates {
+                    [self.generate_consumed_expression(left)?, self.generate_consumed_expression(right)?]
+                } else {
+                    [self.generate_expression(left)?, self.generate_expression(right)?]
+                };
+                // && y || convierten cada operando a bool antes de seguir
+                let spills = if matches!(operator, BinaryOperator::And | BinaryOperator::Or) {
+                    String::new()
+                } else {
+                    self.spill_operands(&[left, right], &mut results, concatenates)
+                };
+                let [left_result, right_result] = results;
                 
                 let op_func = match operator {
                     BinaryOperator::Add => "yaf_add",
@@ -811,9 +1086,7 @@ impl CodeGenerator {
                     BinaryOperator::Divide => "yaf_div",
                     BinaryOperator::Modulo => "yaf_mod",
                     BinaryOperator::Equal => "yaf_eq",
-                    BinaryOperator::NotEqual => {
-                        return Ok(format!("yaf_make_bool(!yaf_to_bool(yaf_eq({}, {})))", left_result, right_result));
-                    },
+                    BinaryOperator::NotEqual => "yaf_ne",
                     BinaryOperator::Less => "yaf_lt",
                     BinaryOperator::LessEqual => "yaf_le",
                     BinaryOperator::Greater => "yaf_gt",
@@ -826,7 +1099,7 @@ impl CodeGenerator {
                     },
                 };
                 
-                Ok(format!("{}({}, {})", op_func, left_result, right_result))
+                Ok(Self::sequenced(spills, format!("{}({}, {})", op_func, left_result, right_result)))
             },
             
             Expression::UnaryOp { operator, operand } => {
@@ -838,14 +1111,32 @@ impl CodeGenerator {
                 }
             },
             
-            Expression::ArrayLiteral { elements: _ } => {
-                // Por simplicidad, todos los arrays son vacíos por ahora
-                Ok("yaf_make_array()".to_string())
+            Expression::ArrayLiteral { elements } => self.generate_array_literal(elements, false),
+            
+            Expression::ArrayAccess { array, index } => {
+                let mut results = [self.generate_expression(array)?, self.generate_expression(index)?];
+                let spills = self.spill_operands(&[array, index], &mut results, false);
+                let [array_result, index_result] = results;
+                Ok(Self::sequenced(spills, format!("yaf_array_get({}, {})", array_result, index_result)))
             },
             
-            Expression::ArrayAccess { array: _, index: _ } => {
-                // Por simplicidad, retornamos int 0 por ahora
-                Ok("yaf_make_int(0)".to_string())
+            Expression::MapLiteral { entries, .. } => {
+                // Expresión-sentencia de GCC/Clang: crea el map y lo rellena. Si
+                // una entrada llama a una función de usuario, el map va en una raíz.
+                let calls = entries.iter().any(|(key, value)| self.contains_user_call(key) || self.contains_user_call(value));
+                let map = if calls { self.gc_temp() } else { "__map".to_string() };
+                let mut code = if calls {
+                    format!("({{ {} = yaf_make_map({}); ", map, entries.len())
+                } else {
+                    format!("({{ YafValue __map = yaf_make_map({}); ", entries.len())
+                };
+                for (key, value) in entries {
+                    let mut results = [self.generate_expression(key)?, self.generate_expression(value)?];
+                    let spills = self.spill_operands(&[key, value], &mut results, false);
+                    code.push_str(&format!("{}yaf_map_set({}, {}, {}); ", spills, map, results[0], results[1]));
+                }
+                code.push_str(&format!("{}; }})", map));
+                Ok(code)
             },
             
             Expression::BuiltinCall { name, arguments } => {
@@ -853,9 +1144,11 @@ impl CodeGenerator {
                 for arg in arguments {
                     c_args.push(self.generate_expression(arg)?);
                 }
+                let operands: Vec<&Expression> = arguments.iter().collect();
+                let spills = self.spill_operands(&operands, &mut c_args, false);
                 let args_str = c_args.join(", ");
                 
-                match name.as_str() {
+                let call = match name.as_str() {
                     // Math functions
                     "abs" => Ok(format!("yaf_math_abs({})", args_str)),
                     "max" => Ok(format!("yaf_math_max({})", args_str)),
@@ -867,24 +1160,56 @@ impl CodeGenerator {
                     "upper" => Ok(format!("yaf_string_upper({})", args_str)),
                     "lower" => Ok(format!("yaf_string_lower({})", args_str)),
                     "concat" => Ok(format!("yaf_string_concat({})", args_str)),
+                    "find" => Ok(format!("yaf_string_find({})", args_str)),
+                    "contains" => Ok(format!("yaf_string_contains({})", args_str)),
+                    
+                    // Map functions
+                    "map_get" => Ok(format!("yaf_map_get({})", args_str)),
+                    "map_set" => Ok(format!("({{ yaf_map_set({}); yaf_make_void(); }})", args_str)),
+                    "map_has" => Ok(format!("yaf_map_has({})", args_str)),
+                    "map_delete" => Ok(format!("yaf_map_delete({})", args_str)),
                     
                     // I/O functions
                     "read_file" => Ok(format!("yaf_io_read_file({})", args_str)),
                     "write_file" => Ok(format!("yaf_io_write_file({})", args_str)),
                     "file_exists" => Ok(format!("yaf_io_file_exists({})", args_str)),
+                    "open" => Ok(format!("yaf_io_open({})", args_str)),
+                    "read_line" => Ok(format!("yaf_io_read_line({})", args_str)),
+                    "eof" => Ok(format!("yaf_io_eof({})", args_str)),
+                    "close" | "file_close" => Ok(format!("yaf_io_close({})", args_str)),
+                    "file_open" => Ok(format!("yaf_io_file_open({})", args_str)),
+                    "file_write" => Ok(format!("yaf_io_file_write({})", args_str)),
+                    
+                    "input" => Ok("yaf_io_input()".to_string()),
+                    "input_prompt" => Ok(format!("yaf_io_input_prompt({})", args_str)),
+                    "flush" => Ok("({ yaf_flush(); yaf_make_void(); })".to_string()),
+                    
+                    // Array functions
+                    "push" => Ok(format!("({{ yaf_array_push({}); yaf_make_void(); }})", args_str)),
+                    "pop" => Ok(format!("yaf_array_pop({})", args_str)),
                     
                     // Time functions
                     "now" => Ok("yaf_time_now()".to_string()),
                     "now_millis" => Ok("yaf_time_now_millis()".to_string()),
+                    "now_nanos" | "clock_monotonic" => Ok("yaf_time_now_nanos()".to_string()),
                     "sleep" => Ok(format!("yaf_time_sleep({})", args_str)),
+                    "sleep_ms" => Ok(format!("yaf_time_sleep_ms({})", args_str)),
+                    "black_box" => Ok(format!("yaf_black_box({})", args_str)),
+                    "memory_stats" => Ok("yaf_memory_stats_map()".to_string()),
+                    
+                    // Network functions
+                    "http_get" | "http_post" | "http_get_all" | "http_status_all" | "tcp_connect_all" | "tcp_request" => Ok(format!("yaf_net_{}({})", name, args_str)),
                     
                     // Type conversion functions
                     "str" => Ok(format!("yaf_value_to_string({})", args_str)),
                     "int" => Ok(format!("yaf_value_to_int({})", args_str)),
                     "float" => Ok(format!("yaf_value_to_float({})", args_str)),
+                    "string_to_int" => Ok(format!("yaf_string_to_int({})", args_str)),
+                    "int_to_string" => Ok(format!("yaf_int_to_string({})", args_str)),
                     
                     _ => Err(YafError::TypeError(format!("Unknown builtin function: {}", name)))
-                }
+                }?;
+                Ok(Self::sequenced(spills, call))
             },
         }
     }
@@ -1,17 +1,161 @@
 use inkwell::context::Context;
 use inkwell::builder::Builder;
-use inkwell::module::Module;
-use inkwell::values::{FunctionValue, PointerValue, BasicValueEnum, BasicMetadataValueEnum};
-use inkwell::types::{BasicMetadataTypeEnum, StructType};
+use inkwell::basic_block::BasicBlock;
+use inkwell::module::{Module, Linkage};
+use inkwell::values::{FunctionValue, PointerValue, IntValue, FloatValue, InstructionValue, BasicValue, BasicValueEnum, BasicMetadataValueEnum, CallSiteValue};
+use inkwell::types::{BasicType, BasicMetadataTypeEnum, BasicTypeEnum, StructType};
+use inkwell::{IntPredicate, FloatPredicate};
 use inkwell::{OptimizationLevel, AddressSpace};
 use inkwell::targets::{Target, TargetMachine, RelocMode, CodeModel, FileType, InitializationConfig};
-use std::collections::HashMap;
+use inkwell::execution_engine::ExecutionEngine;
+use inkwell::attributes::{Attribute, AttributeLoc};
+use inkwell::passes::PassBuilderOptions;
+use inkwell::support::load_library_permanently;
+use std::collections::{HashMap, HashSet};
 use std::path::Path;
+use std::sync::Once;
 use anyhow::{Result, anyhow};
 
 use crate::core::ast::*;
+use crate::core::escape;
+use crate::core::tailcall::{self, TailLoop, TailReturn};
 use crate::runtime::values::Value;
 
+// Layout of YafString in runtime/yaf_runtime.h
+const YAF_STR_STATIC: u64 = 0x1;
+
+// YafValue tags (runtime/yaf_runtime.h)
+const YAF_INT: u64 = 0;
+const YAF_FLOAT: u64 = 1;
+const YAF_STRING: u64 = 2;
+const YAF_BOOL: u64 = 3;
+const YAF_ARRAY: u64 = 4;
+const YAF_SMALL_STRING: u64 = 6;
+
+// MemoryEffects encoding of the memory attribute in LLVM 18: two bits
+// (ref, mod) for each of argument, inaccessible and other memory
+const MEMORY_NONE: u64 = 0;
+const MEMORY_READ: u64 = 0b01_01_01;
+
+// Longest string stored inline in a YafValue (NUL-terminated in the payload)
+const YAF_SMALL_STRING_MAX: usize = 7;
+
+// YafArray element kinds and field indices (runtime/yaf_runtime.h)
+const YAF_ELEM_VALUE: u64 = 0;
+const YAF_ELEM_INT: u64 = 1;
+const YAF_ELEM_FLOAT: u64 = 2;
+const ARRAY_LENGTH_FIELD: u32 = 0;
+const ARRAY_CAPACITY_FIELD: u32 = 1;
+const ARRAY_KIND_FIELD: u32 = 2;
+const ARRAY_DATA_FIELD: u32 = 4;
+
+// Frame object storage (YAF_FRAME_STRING_SIZE, YAF_FRAME_ARRAY_SIZE)
+const FRAME_STRING_SIZE: u64 = 64;
+const FRAME_ARRAY_HEADERS: u64 = 64;
+const FRAME_ARRAY_ELEMENT_SIZE: u64 = 16;
+
+/// How a value is represented in generated code. Values whose type the
+/// typechecker rules prove to be `int`, `bool` or `float` live as raw
+/// `i64`/`i1`/`double`; everything else is a boxed `{i32 tag, i64 data}`.
+#[derive(Debug, Clone, Copy, PartialEq)]
+enum ValueKind {
+    Int,
+    Bool,
+    Float,
+    Boxed,
+}
+
+impl ValueKind {
+    fn of(ty: &Type) -> Self {
+        match ty {
+            Type::Int => ValueKind::Int,
+            Type::Bool => ValueKind::Bool,
+            Type::Float => ValueKind::Float,
+            _ => ValueKind::Boxed,
+        }
+    }
+    
+    fn of_inferred(ty: &Option<Type>) -> Self {
+        ty.as_ref().map(ValueKind::of).unwrap_or(ValueKind::Boxed)
+    }
+}
+
+#[derive(Debug, Clone, Copy)]
+enum TypedValue<'ctx> {
+    Int(IntValue<'ctx>),
+    Bool(IntValue<'ctx>),
+    Float(FloatValue<'ctx>),
+    Boxed(BasicValueEnum<'ctx>),
+}
+
+impl<'ctx> TypedValue<'ctx> {
+    fn kind(&self) -> ValueKind {
+        match self {
+            TypedValue::Int(_) => ValueKind::Int,
+            TypedValue::Bool(_) => ValueKind::Bool,
+            TypedValue::Float(_) => ValueKind::Float,
+            TypedValue::Boxed(_) => ValueKind::Boxed,
+        }
+    }
+    
+    fn as_basic_value(&self) -> BasicValueEnum<'ctx> {
+        match *self {
+            TypedValue::Int(v) | TypedValue::Bool(v) => v.into(),
+            TypedValue::Float(v) => v.into(),
+            TypedValue::Boxed(v) => v,
+        }
+    }
+}
+
+/// A variable slot. Boxed slots are GC roots; typed slots are plain allocas
+/// that mem2reg turns into SSA values.
+#[derive(Debug, Clone)]
+struct Variable<'ctx> {
+    ptr: PointerValue<'ctx>,
+    kind: ValueKind,
+    ty: Option<Type>,
+}
+
+/// Top-level variables of the REPL entries run so far. Each entry is a
+/// module of its own whose globals start from these values and update them
+/// when it finishes, so a definition runs once and later entries only see
+/// its value. The engines of earlier entries stay alive: values can point
+/// into their code and string literals.
+#[derive(Default)]
+pub struct JitSession {
+    globals: HashMap<String, SessionGlobal>,
+    engines: Vec<ExecutionEngine<'static>>,
+}
+
+// The bits of a global as yaf_repl_entry saves them: tag and payload of a
+// boxed value, or 0 and the raw bits of an int, bool or float
+#[derive(Clone)]
+struct SessionGlobal {
+    kind: ValueKind,
+    ty: Option<Type>,
+    bits: [u64; 2],
+}
+
+impl JitSession {
+    pub fn variables(&self) -> impl Iterator<Item = &str> {
+        self.globals.keys().map(String::as_str)
+    }
+    
+    /// Drops a variable; the next entry that assigns it starts over
+    pub fn forget(&mut self, name: &str) {
+        self.globals.remove(name);
+    }
+}
+
+/// Where the self tail calls of the function being generated jump to (see
+/// core::tailcall): the block right after the parameters are stored
+#[derive(Debug, Clone)]
+struct TailTarget<'ctx> {
+    tail: TailLoop,
+    block: BasicBlock<'ctx>,
+    parameters: Vec<Variable<'ctx>>,
+    accumulator: Option<PointerValue<'ctx>>,
+}
 
 pub struct LLVMCodeGenerator<'ctx> {
     context: &'ctx Context,
@@ -23,12 +167,42 @@ pub struct LLVMCodeGenerator<'ctx> {
     
     // Function and variable maps
     functions: HashMap<String, FunctionValue<'ctx>>,
-    global_variables: HashMap<String, PointerValue<'ctx>>,
-    local_variables: HashMap<String, PointerValue<'ctx>>,
+    global_variables: HashMap<String, Variable<'ctx>>,
+    local_variables: HashMap<String, Variable<'ctx>>,
+    
+    // Signatures as seen by the typechecker: (param_types, return_type)
+    function_types: HashMap<String, (Vec<Type>, Type)>,
     
     // Current function context
     current_function: Option<FunctionValue<'ctx>>,
     
+    // Root stack depth at entry of the current function (see yaf_gc_root_depth)
+    gc_frame: Option<IntValue<'ctx>>,
+    gc_frame_used: bool,
+    gc_unwinds: Vec<InstructionValue<'ctx>>,
+    return_kind: ValueKind,
+    
+    // String variables lowered to builders in the loops being generated
+    string_builders: Vec<String>,
+    
+    // Variables of the current function whose arrays live in its frame (see core::escape)
+    frame_arrays: HashSet<String>,
+    
+    // Self tail calls of the current function become jumps; other calls whose
+    // result is returned are marked `tail` if the function roots nothing
+    tail_loop: Option<TailTarget<'ctx>>,
+    return_position: bool,
+    tail_calls: Vec<CallSiteValue<'ctx>>,
+    
+    // --profile builds: the functions by id and the id of the current one
+    // (see Profiling in the runtime)
+    profiling: bool,
+    profiled_functions: Vec<String>,
+    profile_id: Option<u32>,
+    
+    // REPL entries: the variables of the earlier ones (see JitSession)
+    session: Option<HashMap<String, SessionGlobal>>,
+    
     // Optimization level
     optimization_level: OptimizationLevel,
     
@@ -57,14 +231,40 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
             functions: HashMap::new(),
             global_variables: HashMap::new(),
             local_variables: HashMap::new(),
+            function_types: HashMap::new(),
             current_function: None,
+            gc_frame: None,
+            gc_frame_used: false,
+            gc_unwinds: Vec::new(),
+            return_kind: ValueKind::Boxed,
+            string_builders: Vec::new(),
+            frame_arrays: HashSet::new(),
+            tail_loop: None,
+            return_position: false,
+            tail_calls: Vec::new(),
+            profiling: false,
+            profiled_functions: Vec::new(),
+            profile_id: None,
+            session: None,
             optimization_level: opt_level,
             variable_counter: 0,
         }
     }
     
+    /// Instrument function entry and exit for `yaf compile --profile`
+    pub fn set_profiling(&mut self, enabled: bool) {
+        self.profiling = enabled;
+    }
+    
+    /// Generate the program as the next entry of a REPL session: its main
+    /// starts from the session's variables, keeps the ones it creates in
+    /// globals and leaves the heap alive for the next entry
+    pub fn continue_session(&mut self, session: &JitSession) {
+        self.session = Some(session.globals.clone());
+    }
+    
     // Helper method to find variables (first local, then global)
-    fn get_variable(&self, name: &str) -> Option<&PointerValue<'ctx>> {
+    fn get_variable(&self, name: &str) -> Option<&Variable<'ctx>> {
         self.local_variables.get(name).or_else(|| self.global_variables.get(name))
     }
     
@@ -73,8 +273,988 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         self.variable_counter += 1;
         format!("{}_{}", base_name, self.variable_counter)
     }
+    
+    // Every function starts with an `entry` block that records the depth of the
+    // root stack and holds the rooted slots; code is generated from `body` on.
+    fn build_function_prologue(&mut self, function: FunctionValue<'ctx>) {
+        let entry_block = self.context.append_basic_block(function, "entry");
+        let body_block = self.context.append_basic_block(function, "body");
+        
+        self.builder.position_at_end(entry_block);
+        let root_depth_fn = self.module.get_function("yaf_gc_root_depth").unwrap();
+        let frame = self.builder.build_call(root_depth_fn, &[], "gc_frame")
+            .unwrap().try_as_basic_value().left().unwrap().into_int_value();
+        self.gc_frame = Some(frame);
+        self.gc_frame_used = false;
+        self.gc_unwinds.clear();
+        self.builder.build_unconditional_branch(body_block).unwrap();
+        
+        self.builder.position_at_end(body_block);
+    }
+    
+    // Reserve a YafValue slot in the entry block and register it as a GC root.
+    // Slots start zeroed (an INT) so the collector never scans garbage.
+    fn create_local_slot(&mut self, name: &str) -> PointerValue<'ctx> {
+        let function = self.current_function.unwrap();
+        let current_block = self.builder.get_insert_block().unwrap();
+        
+        let entry_block = function.get_first_basic_block().unwrap();
+        match entry_block.get_terminator() {
+            Some(terminator) => self.builder.position_before(&terminator),
+            None => self.builder.position_at_end(entry_block),
+        }
+        
+        let unique_name = self.get_unique_var_name(name);
+        let alloca = self.builder.build_alloca(self.yaf_value_type, &unique_name).unwrap();
+        self.builder.build_store(alloca, self.yaf_value_type.const_zero()).unwrap();
+        self.build_add_root(alloca);
+        self.gc_frame_used = true;
+        
+        self.builder.position_at_end(current_block);
+        alloca
+    }
+    
+    // Slot for a raw int/bool/float in the entry block; not a GC root
+    fn create_typed_slot(&mut self, name: &str, kind: ValueKind) -> PointerValue<'ctx> {
+        let function = self.current_function.unwrap();
+        let current_block = self.builder.get_insert_block().unwrap();
+        
+        let entry_block = function.get_first_basic_block().unwrap();
+        match entry_block.get_terminator() {
+            Some(terminator) => self.builder.position_before(&terminator),
+            None => self.builder.position_at_end(entry_block),
+        }
+        
+        let unique_name = self.get_unique_var_name(name);
+        let llvm_type = self.llvm_type_of(kind);
+        let alloca = self.builder.build_alloca(llvm_type, &unique_name).unwrap();
+        self.builder.build_store(alloca, self.zero_of(kind)).unwrap();
+        
+        self.builder.position_at_end(current_block);
+        alloca
+    }
+    
+    // Stack storage for a frame object, in the entry block so a loop reuses it.
+    // Not a root: whatever references the object roots it.
+    fn create_frame_storage(&mut self, size: u64, name: &str) -> PointerValue<'ctx> {
+        let function = self.current_function.unwrap();
+        let current_block = self.builder.get_insert_block().unwrap();
+        
+        let entry_block = function.get_first_basic_block().unwrap();
+        match entry_block.get_terminator() {
+            Some(terminator) => self.builder.position_before(&terminator),
+            None => self.builder.position_at_end(entry_block),
+        }
+        
+        let unique_name = self.get_unique_var_name(name);
+        let storage_type = self.context.i8_type().array_type(size as u32);
+        let alloca = self.builder.build_alloca(storage_type, &unique_name).unwrap();
+        alloca.as_instruction_value().unwrap().set_alignment(16).unwrap();
+        
+        self.builder.position_at_end(current_block);
+        alloca
+    }
+    
+    // New variable in the current scope: a local slot inside functions (main
+    // included, except in a REPL entry), a module global otherwise
+    fn create_variable(&mut self, name: &str, ty: Option<Type>) -> Variable<'ctx> {
+        let kind = ValueKind::of_inferred(&ty);
+        let local = self.current_function.is_some() && !self.in_session_main();
+        let variable = if self.in_session_main() {
+            self.create_session_variable(name, ty)
+        } else if local {
+            // A frame array of raw elements holds no references: no root needed
+            let unrooted = self.frame_arrays.contains(name) && matches!(
+                &ty, Some(Type::Array(element_type)) if Self::array_element_layout(element_type).1 != ValueKind::Boxed
+            );
+            let ptr = if kind == ValueKind::Boxed && !unrooted {
+                self.create_local_slot(name)
+            } else {
+                self.create_typed_slot(name, kind)
+            };
+            Variable { ptr, kind, ty }
+        } else {
+            self.create_global(name, ty)
+        };
+        
+        if local {
+            self.local_variables.insert(name.to_string(), variable.clone());
+        } else {
+            self.global_variables.insert(name.to_string(), variable.clone());
+        }
+        variable
+    }
+    
+    fn in_session_main(&self) -> bool {
+        self.session.is_some() && self.current_function.is_some() && self.current_function == self.module.get_function("main")
+    }
+    
+    // A variable main of a REPL entry creates: a global, so the session keeps
+    // it, rooted at main's entry like a local slot
+    fn create_session_variable(&mut self, name: &str, ty: Option<Type>) -> Variable<'ctx> {
+        let variable = self.create_global(name, ty);
+        if variable.kind == ValueKind::Boxed {
+            let function = self.current_function.unwrap();
+            let current_block = self.builder.get_insert_block().unwrap();
+            
+            let entry_block = function.get_first_basic_block().unwrap();
+            match entry_block.get_terminator() {
+                Some(terminator) => self.builder.position_before(&terminator),
+                None => self.builder.position_at_end(entry_block),
+            }
+            self.build_add_root(variable.ptr);
+            self.gc_frame_used = true;
+            
+            self.builder.position_at_end(current_block);
+        }
+        variable
+    }
+    
+    fn create_global(&mut self, name: &str, ty: Option<Type>) -> Variable<'ctx> {
+        let kind = ValueKind::of_inferred(&ty);
+        let unique_name = self.get_unique_var_name(name);
+        let llvm_type = self.llvm_type_of(kind);
+        let global = self.module.add_global(llvm_type, None, &unique_name);
+        global.set_initializer(&self.zero_of(kind));
+        Variable { ptr: global.as_pointer_value(), kind, ty }
+    }
+    
+    // A variable of an earlier REPL entry, with the value it was left with
+    fn create_session_global(&mut self, name: &str, session_global: &SessionGlobal) -> Variable<'ctx> {
+        let unique_name = self.get_unique_var_name(name);
+        let global = self.module.add_global(self.llvm_type_of(session_global.kind), None, &unique_name);
+        let [tag, bits] = session_global.bits;
+        let value: BasicValueEnum<'ctx> = match session_global.kind {
+            ValueKind::Int => self.context.i64_type().const_int(bits, false).into(),
+            ValueKind::Bool => self.context.bool_type().const_int(bits & 1, false).into(),
+            ValueKind::Float => self.context.f64_type().const_float(f64::from_bits(bits)).into(),
+            ValueKind::Boxed => self.yaf_value_type.const_named_struct(&[
+                self.context.i32_type().const_int(tag, false).into(),
+                self.context.i64_type().const_int(bits, false).into(),
+            ]).into(),
+        };
+        global.set_initializer(&value);
+        Variable { ptr: global.as_pointer_value(), kind: session_global.kind, ty: session_global.ty.clone() }
+    }
+    
+    // Removes the root-stack bookkeeping of a function that never rooted a slot.
+    // Calls returned from such a function can then reuse its stack frame:
+    // nothing the collector reads lives there.
+    fn finish_gc_frame(&mut self) {
+        let tail_calls = std::mem::take(&mut self.tail_calls);
+        if !self.gc_frame_used {
+            for call in tail_calls {
+                call.set_tail_call(true);
+            }
+            for unwind in self.gc_unwinds.drain(..) {
+                unwind.erase_from_basic_block();
+            }
+            if let Some(frame) = self.gc_frame.and_then(|frame| frame.as_instruction_value()) {
+                frame.erase_from_basic_block();
+            }
+        }
+        self.gc_frame = None;
+        self.gc_unwinds.clear();
+    }
+    
+    fn build_add_root(&mut self, slot: PointerValue<'ctx>) {
+        let add_root_fn = self.module.get_function("yaf_gc_add_root").unwrap();
+        let address = self.builder.build_ptr_to_int(slot, self.context.i64_type(), "root_addr").unwrap();
+        self.builder.build_call(add_root_fn, &[address.into()], "").unwrap();
+    }
+    
+    // Threshold check; emitted at function entry and loop back-edges, where no
+    // unrooted temporaries are alive
+    fn build_safepoint(&mut self) {
+        let collect_fn = self.module.get_function("yaf_gc_collect_if_needed").unwrap();
+        self.builder.build_call(collect_fn, &[], "safepoint").unwrap();
+    }
+    
+    // Pop the roots of the current frame and return
+    fn build_function_return(&mut self, value: BasicValueEnum<'ctx>) {
+        if self.profile_id.is_some() {
+            let exit_fn = self.module.get_function("yaf_prof_exit").unwrap();
+            self.builder.build_call(exit_fn, &[], "").unwrap();
+        }
+        if let Some(frame) = self.gc_frame {
+            let unwind_fn = self.module.get_function("yaf_gc_unwind_roots").unwrap();
+            let unwind = self.builder.build_call(unwind_fn, &[frame.into()], "").unwrap();
+            if let Some(instruction) = unwind.try_as_basic_value().right() {
+                self.gc_unwinds.push(instruction);
+            }
+        }
+        self.builder.build_return(Some(&value)).unwrap();
+    }
+    
+    // A collection can only happen inside user functions (safepoint on entry)
+    fn contains_user_call(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(_) | Expression::Variable(_) => false,
+            Expression::FunctionCall { name, arguments } => {
+                self.functions.contains_key(name) ||
+                    arguments.iter().any(|arg| self.contains_user_call(arg))
+            },
+            Expression::BuiltinCall { arguments, .. } => {
+                arguments.iter().any(|arg| self.contains_user_call(arg))
+            },
+            Expression::BinaryOp { left, right, .. } => {
+                self.contains_user_call(left) || self.contains_user_call(right)
+            },
+            Expression::UnaryOp { operand, .. } => self.contains_user_call(operand),
+            Expression::ArrayLiteral { elements } => {
+                elements.iter().any(|element| self.contains_user_call(element))
+            },
+            Expression::ArrayAccess { array, index } => {
+                self.contains_user_call(array) || self.contains_user_call(index)
+            },
+            Expression::MapLiteral { entries, .. } => {
+                entries.iter().any(|(key, value)| self.contains_user_call(key) || self.contains_user_call(value))
+            },
+        }
+    }
+    
+    // An already evaluated operand only lives in a register; if a user call is
+    // still to be evaluated, store it into a rooted slot so it survives a collection
+    fn root_temporary(&mut self, value: BasicValueEnum<'ctx>, pending: &[Expression]) {
+        if self.current_function.is_some() && pending.iter().any(|expr| self.contains_user_call(expr)) {
+            let slot = self.create_local_slot("gc_tmp");
+            self.builder.build_store(slot, value).unwrap();
+        }
+    }
+    
+    fn llvm_type_of(&self, kind: ValueKind) -> BasicTypeEnum<'ctx> {
+        match kind {
+            ValueKind::Int => self.context.i64_type().into(),
+            ValueKind::Bool => self.context.bool_type().into(),
+            ValueKind::Float => self.context.f64_type().into(),
+            ValueKind::Boxed => self.yaf_value_type.into(),
+        }
+    }
+    
+    fn zero_of(&self, kind: ValueKind) -> BasicValueEnum<'ctx> {
+        match kind {
+            ValueKind::Int => self.context.i64_type().const_zero().into(),
+            ValueKind::Bool => self.context.bool_type().const_zero().into(),
+            ValueKind::Float => self.context.f64_type().const_zero().into(),
+            ValueKind::Boxed => self.yaf_value_type.const_zero().into(),
+        }
+    }
+    
+    fn typed_from_basic(&self, value: BasicValueEnum<'ctx>, kind: ValueKind) -> TypedValue<'ctx> {
+        match kind {
+            ValueKind::Int => TypedValue::Int(value.into_int_value()),
+            ValueKind::Bool => TypedValue::Bool(value.into_int_value()),
+            ValueKind::Float => TypedValue::Float(value.into_float_value()),
+            ValueKind::Boxed => TypedValue::Boxed(value),
+        }
+    }
+    
+    // Box a raw value into a YafValue; only needed at dynamic boundaries
+    // (print, arrays, builtins, untyped variables)
+    fn box_value(&mut self, value: TypedValue<'ctx>) -> BasicValueEnum<'ctx> {
+        let i64_type = self.context.i64_type();
+        let (tag, data) = match value {
+            TypedValue::Boxed(v) => return v,
+            TypedValue::Int(v) => (YAF_INT, v),
+            TypedValue::Bool(v) => (YAF_BOOL, self.builder.build_int_z_extend(v, i64_type, "bool_data").unwrap()),
+            TypedValue::Float(v) => (YAF_FLOAT, self.builder.build_bit_cast(v, i64_type, "float_bits").unwrap().into_int_value()),
+        };
+        
+        let struct_val = self.yaf_value_type.get_undef();
+        let struct_val = self.builder.build_insert_value(
+            struct_val,
+            self.context.i32_type().const_int(tag, false),
+            0,
+            "type_field"
+        ).unwrap();
+        let struct_val = self.builder.build_insert_value(
+            struct_val,
+            data,
+            1,
+            "data_field"
+        ).unwrap();
+        struct_val.into_struct_value().into()
+    }
+    
+    // Inverse of box_value. Numbers coming back from the runtime may be tagged
+    // int or float (e.g. pow), so those conversions look at the tag.
+    fn unbox_value(&mut self, value: BasicValueEnum<'ctx>, kind: ValueKind) -> TypedValue<'ctx> {
+        let i64_type = self.context.i64_type();
+        let f64_type = self.context.f64_type();
+        let boxed = value.into_struct_value();
+        let data = self.builder.build_extract_value(boxed, 1, "unbox_data").unwrap().into_int_value();
+        
+        match kind {
+            ValueKind::Boxed => TypedValue::Boxed(value),
+            ValueKind::Bool => {
+                // The C runtime only writes the low byte of bool_val
+                let low = self.builder.build_int_truncate(data, self.context.i8_type(), "bool_byte").unwrap();
+                let result = self.builder.build_int_compare(
+                    IntPredicate::NE, low, self.context.i8_type().const_zero(), "unbox_bool"
+                ).unwrap();
+                TypedValue::Bool(result)
+            },
+            ValueKind::Int | ValueKind::Float => {
+                let tag = self.builder.build_extract_value(boxed, 0, "unbox_tag").unwrap().into_int_value();
+                let is_float = self.builder.build_int_compare(
+                    IntPredicate::EQ, tag, self.context.i32_type().const_int(YAF_FLOAT, false), "is_float"
+                ).unwrap();
+                let as_float = self.builder.build_bit_cast(data, f64_type, "as_float").unwrap().into_float_value();
+                if kind == ValueKind::Int {
+                    let converted = self.builder.build_float_to_signed_int(as_float, i64_type, "float_to_int").unwrap();
+                    let result = self.builder.build_select(is_float, converted, data, "unbox_int").unwrap();
+                    TypedValue::Int(result.into_int_value())
+                } else {
+                    let converted = self.builder.build_signed_int_to_float(data, f64_type, "int_to_float").unwrap();
+                    let result = self.builder.build_select(is_float, as_float, converted, "unbox_float").unwrap();
+                    TypedValue::Float(result.into_float_value())
+                }
+            },
+        }
+    }
+    
+    fn coerce(&mut self, value: TypedValue<'ctx>, kind: ValueKind) -> TypedValue<'ctx> {
+        match (value, kind) {
+            (_, ValueKind::Boxed) => TypedValue::Boxed(self.box_value(value)),
+            (TypedValue::Boxed(v), _) => self.unbox_value(v, kind),
+            (TypedValue::Int(v), ValueKind::Float) => {
+                TypedValue::Float(self.builder.build_signed_int_to_float(v, self.context.f64_type(), "int_to_float").unwrap())
+            },
+            (TypedValue::Bool(v), ValueKind::Int) => {
+                TypedValue::Int(self.builder.build_int_z_extend(v, self.context.i64_type(), "bool_to_int").unwrap())
+            },
+            (value, kind) if value.kind() == kind => value,
+            // No other mix passes the typechecker; go through the box
+            (value, kind) => {
+                let boxed = self.box_value(value);
+                self.unbox_value(boxed, kind)
+            },
+        }
+    }
+    
+    fn build_truthy(&mut self, value: TypedValue<'ctx>) -> IntValue<'ctx> {
+        match value {
+            TypedValue::Bool(v) => v,
+            TypedValue::Int(v) => self.builder.build_int_compare(
+                IntPredicate::NE, v, self.context.i64_type().const_zero(), "truthy"
+            ).unwrap(),
+            TypedValue::Float(v) => self.builder.build_float_compare(
+                FloatPredicate::UNE, v, self.context.f64_type().const_zero(), "truthy"
+            ).unwrap(),
+            TypedValue::Boxed(v) => self.builder.build_call(
+                self.module.get_function("yaf_to_bool").unwrap(),
+                &[v.into()],
+                "condition_bool"
+            ).unwrap().try_as_basic_value().left().unwrap().into_int_value(),
+        }
+    }
+    
+    // Arrays of int or float are stored unboxed; the element accessors below
+    // inline those layouts and call the runtime for everything else
+    fn array_element_layout(element_type: &Type) -> (u64, ValueKind) {
+        match element_type {
+            Type::Int => (YAF_ELEM_INT, ValueKind::Int),
+            Type::Float => (YAF_ELEM_FLOAT, ValueKind::Float),
+            _ => (YAF_ELEM_VALUE, ValueKind::Boxed),
+        }
+    }
+    
+    fn array_dense_kind(&self, array: &Expression) -> Option<(u64, ValueKind)> {
+        match self.static_type(array)? {
+            Type::Array(element_type) => match Self::array_element_layout(&element_type) {
+                (_, ValueKind::Boxed) => None,
+                layout => Some(layout),
+            },
+            _ => None,
+        }
+    }
+    
+    // The YafArray struct: length, capacity, elem_kind, reserved, data
+    fn array_object_type(&self) -> StructType<'ctx> {
+        let i64_type = self.context.i64_type();
+        let i32_type = self.context.i32_type();
+        self.context.struct_type(&[
+            i64_type.into(),
+            i64_type.into(),
+            i32_type.into(),
+            i32_type.into(),
+            self.context.ptr_type(AddressSpace::default()).into(),
+        ], false)
+    }
+    
+    fn array_object_ptr(&self, array_val: BasicValueEnum<'ctx>) -> PointerValue<'ctx> {
+        let data = self.builder.build_extract_value(array_val.into_struct_value(), 1, "array_data").unwrap().into_int_value();
+        self.builder.build_int_to_ptr(data, self.context.ptr_type(AddressSpace::default()), "array_obj").unwrap()
+    }
+    
+    fn load_array_field(&self, object: PointerValue<'ctx>, field: u32, name: &str) -> BasicValueEnum<'ctx> {
+        let array_type = self.array_object_type();
+        let field_type = array_type.get_field_type_at_index(field).unwrap();
+        let field_ptr = self.builder.build_struct_gep(array_type, object, field, &format!("{}_ptr", name)).unwrap();
+        self.builder.build_load(field_type, field_ptr, name).unwrap()
+    }
+    
+    fn array_element_ptr(&self, object: PointerValue<'ctx>, index: IntValue<'ctx>, kind: ValueKind) -> PointerValue<'ctx> {
+        let data = self.load_array_field(object, ARRAY_DATA_FIELD, "elements").into_pointer_value();
+        unsafe {
+            self.builder.build_in_bounds_gep(self.llvm_type_of(kind), data, &[index], "element_ptr").unwrap()
+        }
+    }
+    
+    // Fast path guard: the array has the layout the static type promised and
+    // `index < limit` (unsigned, so negative indices fail too). In counted
+    // loops over the length LLVM proves the comparison and drops it, and
+    // the layout test is loop invariant.
+    fn build_array_guard(&self, object: PointerValue<'ctx>, elem_kind: u64, index: IntValue<'ctx>, limit_field: u32) -> IntValue<'ctx> {
+        let limit = self.load_array_field(object, limit_field, "limit").into_int_value();
+        let in_bounds = self.builder.build_int_compare(IntPredicate::ULT, index, limit, "in_bounds").unwrap();
+        let layout = self.load_array_field(object, ARRAY_KIND_FIELD, "elem_kind").into_int_value();
+        let expected = self.context.i32_type().const_int(elem_kind, false);
+        let dense = self.builder.build_int_compare(IntPredicate::EQ, layout, expected, "dense").unwrap();
+        self.builder.build_and(in_bounds, dense, "fast_path").unwrap()
+    }
+    
+    // `a && b` / `a || b`: the right operand only runs when the left one does
+    // not decide the result, as in the C backend and the constant folder
+    fn build_short_circuit(&mut self, operator: &BinaryOperator, left: &Expression, right: &Expression) -> Result<TypedValue<'ctx>> {
+        let left_val = self.generate_typed_expression(left)?;
+        let left_bool = self.build_truthy(left_val);
+        let left_block = self.builder.get_insert_block().unwrap();
+        let function = left_block.get_parent().unwrap();
+        let right_block = self.context.append_basic_block(function, "logic_right");
+        let merge_block = self.context.append_basic_block(function, "logic_done");
+        let is_and = matches!(operator, BinaryOperator::And);
+        if is_and {
+            self.builder.build_conditional_branch(left_bool, right_block, merge_block).unwrap();
+        } else {
+            self.builder.build_conditional_branch(left_bool, merge_block, right_block).unwrap();
+        }
+        
+        self.builder.position_at_end(right_block);
+        let right_val = self.generate_typed_expression(right)?;
+        let right_bool = self.build_truthy(right_val);
+        let right_end = self.builder.get_insert_block().unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        
+        self.builder.position_at_end(merge_block);
+        let decided = self.context.bool_type().const_int(if is_and { 0 } else { 1 }, false);
+        let phi = self.builder.build_phi(self.context.bool_type(), if is_and { "and_result" } else { "or_result" }).unwrap();
+        phi.add_incoming(&[(&decided, left_block), (&right_bool, right_end)]);
+        Ok(TypedValue::Bool(phi.as_basic_value().into_int_value()))
+    }
+    
+    // Branches on the guard; returns (fast, slow, merge) with the builder at fast
+    fn build_array_branch(&self, guard: IntValue<'ctx>) -> (BasicBlock<'ctx>, BasicBlock<'ctx>, BasicBlock<'ctx>) {
+        let function = self.builder.get_insert_block().unwrap().get_parent().unwrap();
+        let fast_block = self.context.append_basic_block(function, "array_fast");
+        let slow_block = self.context.append_basic_block(function, "array_slow");
+        let merge_block = self.context.append_basic_block(function, "array_done");
+        self.builder.build_conditional_branch(guard, fast_block, slow_block).unwrap();
+        self.builder.position_at_end(fast_block);
+        (fast_block, slow_block, merge_block)
+    }
+    
+    fn build_array_merge(&self, kind: ValueKind, fast: (BasicValueEnum<'ctx>, BasicBlock<'ctx>), slow: (BasicValueEnum<'ctx>, BasicBlock<'ctx>)) -> TypedValue<'ctx> {
+        let phi = self.builder.build_phi(self.llvm_type_of(kind), "element").unwrap();
+        phi.add_incoming(&[(&fast.0, fast.1), (&slow.0, slow.1)]);
+        self.typed_from_basic(phi.as_basic_value(), kind)
+    }
+    
+    fn build_array_get(&mut self, array_val: BasicValueEnum<'ctx>, index: IntValue<'ctx>, (elem_kind, kind): (u64, ValueKind)) -> TypedValue<'ctx> {
+        let object = self.array_object_ptr(array_val);
+        let guard = self.build_array_guard(object, elem_kind, index, ARRAY_LENGTH_FIELD);
+        let (_, slow_block, merge_block) = self.build_array_branch(guard);
+        
+        let element_ptr = self.array_element_ptr(object, index, kind);
+        let fast_val = self.builder.build_load(self.llvm_type_of(kind), element_ptr, "element").unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        let fast_end = self.builder.get_insert_block().unwrap();
+        
+        self.builder.position_at_end(slow_block);
+        let boxed_index = self.box_value(TypedValue::Int(index));
+        let boxed = self.builder.build_call(
+            self.module.get_function("yaf_array_get").unwrap(),
+            &[array_val.into(), boxed_index.into()],
+            "array_get"
+        ).unwrap().try_as_basic_value().left().unwrap();
+        let slow_val = self.unbox_value(boxed, kind).as_basic_value();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        let slow_end = self.builder.get_insert_block().unwrap();
+        
+        self.builder.position_at_end(merge_block);
+        self.build_array_merge(kind, (fast_val, fast_end), (slow_val, slow_end))
+    }
+    
+    fn build_array_set(&mut self, array_val: BasicValueEnum<'ctx>, index: IntValue<'ctx>, value: TypedValue<'ctx>, (elem_kind, kind): (u64, ValueKind)) {
+        let object = self.array_object_ptr(array_val);
+        let guard = self.build_array_guard(object, elem_kind, index, ARRAY_LENGTH_FIELD);
+        let (_, slow_block, merge_block) = self.build_array_branch(guard);
+        
+        let element_ptr = self.array_element_ptr(object, index, kind);
+        self.builder.build_store(element_ptr, value.as_basic_value()).unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        
+        self.builder.position_at_end(slow_block);
+        let boxed_index = self.box_value(TypedValue::Int(index));
+        let boxed_value = self.box_value(value);
+        self.builder.build_call(
+            self.module.get_function("yaf_array_set").unwrap(),
+            &[array_val.into(), boxed_index.into(), boxed_value.into()],
+            "array_set"
+        ).unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        
+        self.builder.position_at_end(merge_block);
+    }
+    
+    // Appends in place while there is spare capacity; growing is left to the runtime
+    fn build_array_push(&mut self, array_val: BasicValueEnum<'ctx>, value: TypedValue<'ctx>, (elem_kind, kind): (u64, ValueKind)) {
+        let object = self.array_object_ptr(array_val);
+        let length = self.load_array_field(object, ARRAY_LENGTH_FIELD, "length").into_int_value();
+        let guard = self.build_array_guard(object, elem_kind, length, ARRAY_CAPACITY_FIELD);
+        let (_, slow_block, merge_block) = self.build_array_branch(guard);
+        
+        let element_ptr = self.array_element_ptr(object, length, kind);
+        self.builder.build_store(element_ptr, value.as_basic_value()).unwrap();
+        let new_length = self.builder.build_int_add(length, self.context.i64_type().const_int(1, false), "new_length").unwrap();
+        let length_ptr = self.builder.build_struct_gep(self.array_object_type(), object, ARRAY_LENGTH_FIELD, "length_ptr").unwrap();
+        self.builder.build_store(length_ptr, new_length).unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        
+        self.builder.position_at_end(slow_block);
+        let boxed_value = self.box_value(value);
+        self.builder.build_call(
+            self.module.get_function("yaf_array_push").unwrap(),
+            &[array_val.into(), boxed_value.into()],
+            "array_push"
+        ).unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        
+        self.builder.position_at_end(merge_block);
+    }
+    
+    fn build_array_pop(&mut self, array_val: BasicValueEnum<'ctx>, (elem_kind, kind): (u64, ValueKind)) -> TypedValue<'ctx> {
+        let object = self.array_object_ptr(array_val);
+        let length = self.load_array_field(object, ARRAY_LENGTH_FIELD, "length").into_int_value();
+        // length - 1 wraps to the maximum on an empty array, failing the guard
+        let last = self.builder.build_int_sub(length, self.context.i64_type().const_int(1, false), "last").unwrap();
+        let guard = self.build_array_guard(object, elem_kind, last, ARRAY_LENGTH_FIELD);
+        let (_, slow_block, merge_block) = self.build_array_branch(guard);
+        
+        let length_ptr = self.builder.build_struct_gep(self.array_object_type(), object, ARRAY_LENGTH_FIELD, "length_ptr").unwrap();
+        self.builder.build_store(length_ptr, last).unwrap();
+        let element_ptr = self.array_element_ptr(object, last, kind);
+        let fast_val = self.builder.build_load(self.llvm_type_of(kind), element_ptr, "element").unwrap();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        let fast_end = self.builder.get_insert_block().unwrap();
+        
+        self.builder.position_at_end(slow_block);
+        let boxed = self.builder.build_call(
+            self.module.get_function("yaf_array_pop").unwrap(),
+            &[array_val.into()],
+            "array_pop"
+        ).unwrap().try_as_basic_value().left().unwrap();
+        let slow_val = self.unbox_value(boxed, kind).as_basic_value();
+        self.builder.build_unconditional_branch(merge_block).unwrap();
+        let slow_end = self.builder.get_insert_block().unwrap();
+        
+        self.builder.position_at_end(merge_block);
+        self.build_array_merge(kind, (fast_val, fast_end), (slow_val, slow_end))
+    }
+    
+    fn builtin_return_type(name: &str) -> Option<Type> {
+        match name {
+            "abs" | "max" | "min" | "pow" | "length" | "string_length" |
+            "now" | "now_millis" | "now_nanos" | "clock_monotonic" |
+            "string_to_int" | "int" | "open" | "file_open" | "find" => Some(Type::Int),
+            "upper" | "lower" | "string_upper" | "string_lower" | "concat" | "substring" |
+            "read_file" | "read_line" | "input" | "input_prompt" | "int_to_string" | "str" |
+            "http_get" | "http_post" | "tcp_request" => Some(Type::String),
+            "http_get_all" => Some(Type::Array(Box::new(Type::String))),
+            "http_status_all" => Some(Type::Array(Box::new(Type::Int))),
+            "tcp_connect_all" => Some(Type::Array(Box::new(Type::Bool))),
+            "memory_stats" => Some(Type::Map(Box::new(Type::String), Box::new(Type::Int))),
+            "write_file" | "file_exists" | "contains" | "eof" | "close" | "file_write" | "file_close" | "sleep" | "sleep_ms" | "map_has" | "map_delete" => Some(Type::Bool),
+            "float" => Some(Type::Float),
+            "print" | "push" | "map_set" | "flush" => Some(Type::Void),
+            _ => None,
+        }
+    }
+    
+    // Static type of an expression following the typechecker rules. None when
+    // it is not known at this point; such values simply stay boxed.
+    fn static_type(&self, expr: &Expression) -> Option<Type> {
+        match expr {
+            Expression::Literal(value) => Some(match value {
+                Value::Int(_) => Type::Int,
+                Value::Float(_) => Type::Float,
+                Value::String(_) => Type::String,
+                Value::Bool(_) => Type::Bool,
+            }),
+            Expression::Variable(name) => self.get_variable(name).and_then(|var| var.ty.clone()),
+            Expression::FunctionCall { name, .. } => {
+                match self.function_types.get(name) {
+                    Some((_, return_type)) => Some(return_type.clone()),
+                    None => Self::builtin_return_type(name),
+                }
+            },
+            Expression::BuiltinCall { name, arguments } if name == "pop" => {
+                match self.static_type(arguments.first()?)? {
+                    Type::Array(element_type) => Some(*element_type),
+                    _ => None,
+                }
+            },
+            Expression::BuiltinCall { name, arguments } if name == "black_box" => {
+                self.static_type(arguments.first()?)
+            },
+            Expression::BuiltinCall { name, arguments } if name == "map_get" => {
+                match self.static_type(arguments.first()?)? {
+                    Type::Map(_, value_type) => Some(*value_type),
+                    _ => None,
+                }
+            },
+            Expression::BuiltinCall { name, .. } => Self::builtin_return_type(name),
+            Expression::BinaryOp { left, operator, right } => {
+                match operator {
+                    BinaryOperator::Add | BinaryOperator::Subtract | BinaryOperator::Multiply |
+                    BinaryOperator::Divide | BinaryOperator::Modulo => {
+                        match (self.static_type(left)?, self.static_type(right)?) {
+                            (Type::Int, Type::Int) => Some(Type::Int),
+                            (Type::Float, Type::Float) | (Type::Int, Type::Float) |
+                            (Type::Float, Type::Int) => Some(Type::Float),
+                            (Type::String, Type::String) if matches!(operator, BinaryOperator::Add) => Some(Type::String),
+                            _ => None,
+                        }
+                    },
+                    _ => Some(Type::Bool),
+                }
+            },
+            Expression::UnaryOp { operator, operand } => {
+                match operator {
+                    UnaryOperator::Not => Some(Type::Bool),
+                    UnaryOperator::Minus => self.static_type(operand),
+                }
+            },
+            Expression::ArrayLiteral { elements } => {
+                let element_type = match elements.first() {
+                    Some(first) => self.static_type(first)?,
+                    None => Type::Int,
+                };
+                Some(Type::Array(Box::new(element_type)))
+            },
+            Expression::ArrayAccess { array, .. } => {
+                match self.static_type(array)? {
+                    Type::Array(element_type) => Some(*element_type),
+                    _ => None,
+                }
+            },
+            Expression::MapLiteral { key_type, value_type, .. } => {
+                Some(Type::Map(Box::new(key_type.clone()), Box::new(value_type.clone())))
+            },
+        }
+    }
+    
+    fn kind_of(&self, expr: &Expression) -> ValueKind {
+        ValueKind::of_inferred(&self.static_type(expr))
+    }
+    
+    // Whether evaluating the expression can allocate on the GC heap, not
+    // counting user calls (those poll at their own entry)
+    fn expression_may_allocate(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(_) | Expression::Variable(_) => false,
+            Expression::FunctionCall { name, arguments } |
+            Expression::BuiltinCall { name, arguments } => {
+                // push and map_set may grow the container storage
+                let allocates = name == "push" || name == "map_set" || !self.function_types.contains_key(name) && !matches!(
+                    Self::builtin_return_type(name),
+                    Some(Type::Int) | Some(Type::Bool) | Some(Type::Float) | Some(Type::Void)
+                );
+                allocates || arguments.iter().any(|arg| self.expression_may_allocate(arg))
+            },
+            Expression::BinaryOp { left, operator, right } => {
+                let concatenates = matches!(operator, BinaryOperator::Add) &&
+                    self.kind_of(expr) == ValueKind::Boxed;
+                concatenates || self.expression_may_allocate(left) || self.expression_may_allocate(right)
+            },
+            Expression::UnaryOp { operand, .. } => self.expression_may_allocate(operand),
+            Expression::ArrayLiteral { .. } | Expression::MapLiteral { .. } => true,
+            Expression::ArrayAccess { array, index } => {
+                self.expression_may_allocate(array) || self.expression_may_allocate(index)
+            },
+        }
+    }
+    
+    fn block_may_allocate(&self, block: &Block) -> bool {
+        block.statements.iter().any(|stmt| self.statement_may_allocate(stmt))
+    }
+    
+    fn statement_may_allocate(&self, stmt: &Statement) -> bool {
+        match stmt {
+            Statement::Declaration { value, .. } | Statement::Assignment { value, .. } => {
+                self.expression_may_allocate(value)
+            },
+            Statement::ArrayAssignment { index, value, .. } => {
+                self.expression_may_allocate(index) || self.expression_may_allocate(value)
+            },
+            Statement::If { condition, then_block, else_block } => {
+                self.expression_may_allocate(condition) || self.block_may_allocate(then_block) ||
+                    else_block.as_ref().map_or(false, |block| self.block_may_allocate(block))
+            },
+            Statement::While { condition, body } => {
+                self.expression_may_allocate(condition) || self.block_may_allocate(body)
+            },
+            Statement::For { init, condition, increment, body } => {
+                self.statement_may_allocate(init) || self.expression_may_allocate(condition) ||
+                    self.statement_may_allocate(increment) || self.block_may_allocate(body)
+            },
+            // The body runs in its own function; here only the bounds and the partials
+            Statement::ParallelFor { start, end, reductions, .. } => {
+                !reductions.is_empty() || self.expression_may_allocate(start) || self.expression_may_allocate(end)
+            },
+            Statement::Return { value } => {
+                value.as_ref().map_or(false, |expr| self.expression_may_allocate(expr))
+            },
+            Statement::Expression(expr) => self.expression_may_allocate(expr),
+        }
+    }
+    
+    // The appended operand of `name = name + e`, if the statement has that shape
+    fn string_append_operand(stmt: &Statement) -> Option<(&str, &Expression)> {
+        if let Statement::Assignment { name, value: Expression::BinaryOp { left, operator: BinaryOperator::Add, right } } = stmt {
+            if matches!(left.as_ref(), Expression::Variable(var) if var == name) {
+                return Some((name, right));
+            }
+        }
+        None
+    }
+    
+    fn collect_string_appends(stmt: &Statement, names: &mut Vec<String>) {
+        let blocks: Vec<&Block> = match stmt {
+            Statement::If { then_block, else_block, .. } => {
+                std::iter::once(then_block).chain(else_block.as_ref()).collect()
+            },
+            Statement::While { body, .. } => vec![body],
+            Statement::For { init, increment, body, .. } => {
+                Self::collect_string_appends(init, names);
+                Self::collect_string_appends(increment, names);
+                vec![body]
+            },
+            _ => {
+                if let Some((name, _)) = Self::string_append_operand(stmt) {
+                    if !names.iter().any(|n| n == name) {
+                        names.push(name.to_string());
+                    }
+                }
+                Vec::new()
+            },
+        };
+        for block in blocks {
+            for stmt in &block.statements {
+                Self::collect_string_appends(stmt, names);
+            }
+        }
+    }
+    
+    // Whether the expression reads `name` or, with `calls`, calls a user
+    // function (which could read or replace a global)
+    fn expression_uses(expr: &Expression, name: &str, calls: bool) -> bool {
+        match expr {
+            Expression::Literal(_) => false,
+            Expression::Variable(var) => var == name,
+            Expression::FunctionCall { arguments, .. } => {
+                calls || arguments.iter().any(|arg| Self::expression_uses(arg, name, calls))
+            },
+            Expression::BuiltinCall { arguments, .. } => {
+                arguments.iter().any(|arg| Self::expression_uses(arg, name, calls))
+            },
+            Expression::BinaryOp { left, right, .. } => {
+                Self::expression_uses(left, name, calls) || Self::expression_uses(right, name, calls)
+            },
+            Expression::UnaryOp { operand, .. } => Self::expression_uses(operand, name, calls),
+            Expression::ArrayLiteral { elements } => {
+                elements.iter().any(|element| Self::expression_uses(element, name, calls))
+            },
+            Expression::ArrayAccess { array, index } => {
+                Self::expression_uses(array, name, calls) || Self::expression_uses(index, name, calls)
+            },
+            Expression::MapLiteral { entries, .. } => entries.iter().any(|(key, value)| {
+                Self::expression_uses(key, name, calls) || Self::expression_uses(value, name, calls)
+            }),
+        }
+    }
+    
+    // Whether the statement touches `name` other than through `name = name + e`
+    fn statement_uses(stmt: &Statement, name: &str, calls: bool) -> bool {
+        if let Some((target, operand)) = Self::string_append_operand(stmt) {
+            if target == name {
+                return Self::expression_uses(operand, name, calls);
+            }
+        }
+        let block_uses = |block: &Block| block.statements.iter().any(|stmt| Self::statement_uses(stmt, name, calls));
+        match stmt {
+            Statement::Declaration { name: target, value, .. } | Statement::Assignment { name: target, value } => {
+                target == name || Self::expression_uses(value, name, calls)
+            },
+            Statement::ArrayAssignment { name: target, index, value } => {
+                target == name || Self::expression_uses(index, name, calls) || Self::expression_uses(value, name, calls)
+            },
+            Statement::If { condition, then_block, else_block } => {
+                Self::expression_uses(condition, name, calls) || block_uses(then_block) ||
+                    else_block.as_ref().map_or(false, |block| block_uses(block))
+            },
+            Statement::While { condition, body } => {
+                Self::expression_uses(condition, name, calls) || block_uses(body)
+            },
+            Statement::For { init, condition, increment, body } => {
+                Self::statement_uses(init, name, calls) || Self::expression_uses(condition, name, calls) ||
+                    Self::statement_uses(increment, name, calls) || block_uses(body)
+            },
+            Statement::ParallelFor { start, end, reductions, body, .. } => {
+                reductions.iter().any(|reduction| reduction.variable == name) ||
+                    Self::expression_uses(start, name, calls) || Self::expression_uses(end, name, calls) ||
+                    block_uses(body)
+            },
+            Statement::Return { value } => {
+                value.as_ref().map_or(false, |expr| Self::expression_uses(expr, name, calls))
+            },
+            Statement::Expression(expr) => Self::expression_uses(expr, name, calls),
+        }
+    }
+    
+    // Names a block assigns, including loop headers (nested pfor bodies aside)
+    fn collect_assigned_names(block: &Block, names: &mut Vec<String>) {
+        for stmt in &block.statements {
+            match stmt {
+                Statement::Declaration { name, .. } | Statement::Assignment { name, .. } => {
+                    if !names.contains(name) {
+                        names.push(name.clone());
+                    }
+                },
+                Statement::If { then_block, else_block, .. } => {
+                    Self::collect_assigned_names(then_block, names);
+                    if let Some(else_block) = else_block {
+                        Self::collect_assigned_names(else_block, names);
+                    }
+                },
+                Statement::While { body, .. } => Self::collect_assigned_names(body, names),
+                Statement::For { init, increment, body, .. } => {
+                    let header = Block { statements: vec![(**init).clone(), (**increment).clone()] };
+                    Self::collect_assigned_names(&header, names);
+                    Self::collect_assigned_names(body, names);
+                },
+                _ => {},
+            }
+        }
+    }
+    
+    // A string variable that the loop only ever extends with `s = s + e` is
+    // turned into a builder around it: one copy before the loop, in-place
+    // appends with geometric growth inside, and the buffer handed back as a
+    // plain string afterwards. Nothing else may observe it meanwhile, so a
+    // global also requires the loop to make no user calls.
+    fn begin_string_builders(&mut self, loop_stmt: &Statement) -> Result<Vec<String>> {
+        let mut names = Vec::new();
+        Self::collect_string_appends(loop_stmt, &mut names);
+        names.retain(|name| {
+            let defined_string = matches!(self.get_variable(name), Some(variable) if variable.ty == Some(Type::String));
+            let global = !self.local_variables.contains_key(name);
+            defined_string && !self.string_builders.contains(name) && !Self::statement_uses(loop_stmt, name, global)
+        });
+        
+        for name in &names {
+            let variable = self.get_variable(name).cloned().unwrap();
+            let current = self.builder.build_load(self.yaf_value_type, variable.ptr, name).unwrap();
+            let builder = self.call_library_function("yaf_builder_from", &[current])?;
+            self.builder.build_store(variable.ptr, builder).unwrap();
+        }
+        self.string_builders.extend(names.iter().cloned());
+        Ok(names)
+    }
+    
+    fn end_string_builders(&mut self, names: Vec<String>) -> Result<()> {
+        for name in &names {
+            let variable = self.get_variable(name).cloned().unwrap();
+            let current = self.builder.build_load(self.yaf_value_type, variable.ptr, name).unwrap();
+            let string = self.call_library_function("yaf_builder_to_string", &[current])?;
+            self.builder.build_store(variable.ptr, string).unwrap();
+        }
+        self.string_builders.retain(|name| !names.contains(name));
+        Ok(())
+    }
+    
+    // Same hash as hash_bytes in runtime/yaf_runtime.c (FNV-1a, never 0)
+    fn string_hash(bytes: &[u8]) -> u64 {
+        let hash = bytes.iter().fold(0xcbf29ce484222325u64, |hash, &byte| {
+            (hash ^ byte as u64).wrapping_mul(0x100000001b3)
+        });
+        if hash == 0 { 1 } else { hash }
+    }
+    
+    // A YAF_SMALL_STRING constant: the bytes packed into the payload, zero
+    // padded, as they lie in memory on our little-endian targets
+    fn build_small_string(&self, s: &str) -> BasicValueEnum<'ctx> {
+        let mut bytes = [0u8; 8];
+        bytes[..s.len()].copy_from_slice(s.as_bytes());
+        self.yaf_value_type.const_named_struct(&[
+            self.context.i32_type().const_int(YAF_SMALL_STRING, false).into(),
+            self.context.i64_type().const_int(u64::from_le_bytes(bytes), false).into(),
+        ]).into()
+    }
+    
+    // Whether a tag is either string representation
+    fn build_is_string(&self, tag: IntValue<'ctx>, name: &str) -> IntValue<'ctx> {
+        let tag_type = tag.get_type();
+        let heap = self.builder.build_int_compare(IntPredicate::EQ, tag, tag_type.const_int(YAF_STRING, false), "is_heap_string").unwrap();
+        let small = self.builder.build_int_compare(IntPredicate::EQ, tag, tag_type.const_int(YAF_SMALL_STRING, false), "is_small_string").unwrap();
+        self.builder.build_or(heap, small, name).unwrap()
+    }
+    
+    // Emit a string literal as a constant YafString (see runtime/yaf_runtime.h):
+    // { i32 refcount, i32 flags, i64 length, i64 capacity, i64 hash, [N x i8] data }.
+    // The value points at the data field, right after the header.
+    fn build_static_string(&mut self, s: &str) -> BasicValueEnum<'ctx> {
+        let i32_type = self.context.i32_type();
+        let i64_type = self.context.i64_type();
+        let length = i64_type.const_int(s.len() as u64, false);
+        let data = self.context.const_string(s.as_bytes(), true);
+        
+        let literal = self.context.const_struct(&[
+            i32_type.const_zero().into(),                            // refcount (ignored)
+            i32_type.const_int(YAF_STR_STATIC, false).into(),        // flags
+            length.into(),                                           // length
+            length.into(),                                           // capacity
+            i64_type.const_int(Self::string_hash(s.as_bytes()), false).into(), // hash
+            data.into(),
+        ], false);
+        
+        let name = self.get_unique_var_name("str_literal");
+        let global = self.module.add_global(literal.get_type(), None, &name);
+        global.set_initializer(&literal);
+        global.set_constant(true);
+        global.set_linkage(Linkage::Private);
+        
+        let data_ptr = self.builder.build_struct_gep(literal.get_type(), global.as_pointer_value(), 5, "str_data").unwrap();
+        let data_as_int = self.builder.build_ptr_to_int(data_ptr, i64_type, "str_data_int").unwrap();
+        
+        let struct_val = self.yaf_value_type.get_undef();
+        let struct_val = self.builder.build_insert_value(
+            struct_val,
+            i32_type.const_int(2, false), // YAF_STRING = 2
+            0,
+            "type_field"
+        ).unwrap();
+        let struct_val = self.builder.build_insert_value(
+            struct_val,
+            data_as_int,
+            1,
+            "data_field"
+        ).unwrap();
+        
+        struct_val.into_struct_value().into()
+    }
 
-    pub fn generate(&mut self, program: Program) -> Result<()> {
+    pub fn generate(&mut self, program: &Program) -> Result<()> {
         // Generate runtime functions first
         self.generate_runtime_functions()?;
         
@@ -82,11 +1262,27 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         for function in &program.functions {
             self.declare_function(function)?;
         }
+        if self.profiling {
+            self.profiled_functions = program.functions.iter().map(|function| function.name.clone()).collect();
+        }
         
         // Extract and create global variables FIRST
+        for (name, session_global) in self.session.clone().unwrap_or_default() {
+            let global = self.create_session_global(&name, &session_global);
+            self.global_variables.insert(name, global);
+        }
         self.create_global_variables(&program.main)?;
         
-        // Generate main function
+        // Generate main function. Its variables may be globals of a function,
+        // which keeps them out of the frame; in a REPL entry they all outlive it.
+        let mut shared = HashSet::new();
+        for function in &program.functions {
+            escape::collect_names(&function.body, &mut shared);
+        }
+        if self.session.is_some() {
+            escape::collect_names(&program.main, &mut shared);
+        }
+        self.frame_arrays = escape::frame_arrays(&program.main, &shared);
         self.generate_main(&program.main)?;
         
         // Then implement all user functions (now they can access globals)
@@ -100,20 +1296,14 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
     fn create_global_variables(&mut self, main_block: &Block) -> Result<()> {
         // Solo procesar asignaciones en el nivel global para crear las variables
         for statement in &main_block.statements {
-            if let Statement::Assignment { name, .. } = statement {
+            if let Statement::Assignment { name, value } = statement {
                 if !self.global_variables.contains_key(name) {
-                    // Crear variable global real
-                    let unique_name = self.get_unique_var_name(name);
-                    let global = self.module.add_global(self.yaf_value_type, None, &unique_name);
-                    
-                    // Inicializar con valor por defecto
-                    let null_value = self.yaf_value_type.const_zero();
-                    global.set_initializer(&null_value);
-                    
-                    let global_ptr = global.as_pointer_value();
+                    // Crear variable global real, con el tipo que le daría el typechecker
+                    let ty = self.static_type(value);
+                    let global = self.create_global(name, ty);
                     
                     // Registrar como variable global
-                    self.global_variables.insert(name.clone(), global_ptr);
+                    self.global_variables.insert(name.clone(), global);
                 }
             }
         }
@@ -138,9 +1328,9 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let free_type = _void_type.fn_type(&[ptr_type.into()], false);
         self.module.add_function("free", free_type, None);
         
-        // strdup declaration
-        let strdup_type = ptr_type.fn_type(&[ptr_type.into()], false);
-        self.module.add_function("strdup", strdup_type, None);
+        // strlen declaration
+        let strlen_type = i64_type.fn_type(&[ptr_type.into()], false);
+        self.module.add_function("strlen", strlen_type, None);
         
         // Generate GC functions first (needed by other functions)
         self.generate_gc_functions()?;
@@ -165,14 +1355,57 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         // Don't generate implementation of yaf_free_value - use external
         self.generate_yaf_clone_value()?;
         
-        // Array functions
-        self.generate_yaf_make_array()?;
-        self.generate_yaf_array_get()?;
-        self.generate_yaf_array_set()?;
+        self.set_helper_attributes();
         
         Ok(())
     }
     
+    // The helpers generated above are private to the module and always
+    // inlined, so the pass pipeline can fold them into user loops. The ones
+    // that only compute on their payloads and can't trap are also marked
+    // memory(none); the equality helpers compare string contents through
+    // yaf_string_equal, so they only get memory(read) and can't be merged
+    // across a store. yaf_div and yaf_mod may report a zero divisor, so they
+    // must not be speculated past the code that guards them.
+    fn set_helper_attributes(&self) {
+        const PURE_HELPERS: &[&str] = &[
+            "yaf_sub", "yaf_mul",
+            "yaf_lt", "yaf_le", "yaf_gt", "yaf_ge", "yaf_to_bool",
+        ];
+        const READ_HELPERS: &[&str] = &[
+            "yaf_eq", "yaf_ne",
+        ];
+        const OTHER_HELPERS: &[&str] = &[
+            "yaf_add", "yaf_div", "yaf_mod", "yaf_clone_value",
+        ];
+        
+        let attribute = |name: &str, value: u64| {
+            self.context.create_enum_attribute(Attribute::get_named_enum_kind_id(name), value)
+        };
+        
+        for &name in PURE_HELPERS.iter().chain(READ_HELPERS).chain(OTHER_HELPERS) {
+            if let Some(function) = self.module.get_function(name) {
+                function.set_linkage(Linkage::Internal);
+                function.add_attribute(AttributeLoc::Function, attribute("alwaysinline", 0));
+                function.add_attribute(AttributeLoc::Function, attribute("nounwind", 0));
+                if PURE_HELPERS.contains(&name) {
+                    function.add_attribute(AttributeLoc::Function, attribute("memory", MEMORY_NONE));
+                    function.add_attribute(AttributeLoc::Function, attribute("willreturn", 0));
+                } else if READ_HELPERS.contains(&name) {
+                    function.add_attribute(AttributeLoc::Function, attribute("memory", MEMORY_READ));
+                    function.add_attribute(AttributeLoc::Function, attribute("willreturn", 0));
+                }
+            }
+        }
+        
+        // What the equality helpers call: reads both strings, writes nothing
+        if let Some(function) = self.module.get_function("yaf_string_equal") {
+            function.add_attribute(AttributeLoc::Function, attribute("nounwind", 0));
+            function.add_attribute(AttributeLoc::Function, attribute("memory", MEMORY_READ));
+            function.add_attribute(AttributeLoc::Function, attribute("willreturn", 0));
+        }
+    }
+    
     fn declare_yaf_runtime_functions(&mut self) -> Result<()> {
         let i32_type = self.context.i32_type();
         let i64_type = self.context.i64_type();
@@ -191,6 +1424,16 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let make_string_type = self.yaf_value_type.fn_type(&[ptr_type.into()], false);
         self.module.add_function("yaf_make_string", make_string_type, None);
         
+        // String object declarations (header with length, capacity and refcount)
+        let string_new_type = ptr_type.fn_type(&[ptr_type.into(), i64_type.into()], false);
+        self.module.add_function("yaf_string_new", string_new_type, None);
+        
+        let string_retain_type = ptr_type.fn_type(&[ptr_type.into()], false);
+        self.module.add_function("yaf_string_retain", string_retain_type, None);
+        
+        let string_release_type = void_type.fn_type(&[ptr_type.into()], false);
+        self.module.add_function("yaf_string_release", string_release_type, None);
+        
         // yaf_make_float declaration
         let f64_type = self.context.f64_type();
         let make_float_type = self.yaf_value_type.fn_type(&[f64_type.into()], false);
@@ -214,10 +1457,33 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let print_value_no_nl_type = void_type.fn_type(&[self.yaf_value_type.into()], false);
         self.module.add_function("yaf_print_value_no_newline", print_value_no_nl_type, None);
         
+        // Buffered output declarations
+        let print_int_type = void_type.fn_type(&[i64_type.into()], false);
+        self.module.add_function("yaf_print_int", print_int_type, None);
+        
+        let print_float_type = void_type.fn_type(&[self.context.f64_type().into()], false);
+        self.module.add_function("yaf_print_float", print_float_type, None);
+        
+        let print_newline_type = void_type.fn_type(&[], false);
+        self.module.add_function("yaf_print_newline", print_newline_type, None);
+        
+        let flush_type = void_type.fn_type(&[], false);
+        self.module.add_function("yaf_flush", flush_type, None);
+        
         // yaf_string_concat declaration
         let string_concat_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
         self.module.add_function("yaf_string_concat", string_concat_type, None);
         
+        // String function declarations (SIMD kernels in the runtime)
+        let string_unary_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_string_length", string_unary_type, None);
+        self.module.add_function("yaf_string_upper", string_unary_type, None);
+        self.module.add_function("yaf_string_lower", string_unary_type, None);
+        self.module.add_function("yaf_string_find", string_concat_type, None);
+        self.module.add_function("yaf_string_contains", string_concat_type, None);
+        let string_equal_type = i32_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_string_equal", string_equal_type, None);
+        
         // yaf_free_value declaration
         let free_value_type = void_type.fn_type(&[ptr_type.into()], false);
         self.module.add_function("yaf_free_value", free_value_type, None);
@@ -229,6 +1495,26 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let input_prompt_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
         self.module.add_function("yaf_io_input_prompt", input_prompt_type, None);
         
+        // String builder declarations
+        let builder_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
+        let builder_append_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_builder_from", builder_type, None);
+        self.module.add_function("yaf_builder_append", builder_append_type, None);
+        self.module.add_function("yaf_builder_to_string", builder_type, None);
+        
+        // File functions declarations
+        let value_fn_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
+        let value_pair_fn_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_io_read_file", value_fn_type, None);
+        self.module.add_function("yaf_io_write_file", value_pair_fn_type, None);
+        self.module.add_function("yaf_io_file_exists", value_fn_type, None);
+        self.module.add_function("yaf_io_open", value_fn_type, None);
+        self.module.add_function("yaf_io_read_line", value_fn_type, None);
+        self.module.add_function("yaf_io_eof", value_fn_type, None);
+        self.module.add_function("yaf_io_close", value_fn_type, None);
+        self.module.add_function("yaf_io_file_open", value_pair_fn_type, None);
+        self.module.add_function("yaf_io_file_write", value_pair_fn_type, None);
+        
         // String conversion functions declarations
         let string_to_int_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
         self.module.add_function("yaf_string_to_int", string_to_int_type, None);
@@ -243,8 +1529,93 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let time_now_millis_type = self.yaf_value_type.fn_type(&[], false);
         self.module.add_function("yaf_time_now_millis", time_now_millis_type, None);
         
-        let time_sleep_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
-        self.module.add_function("yaf_time_sleep", time_sleep_type, None);
+        let time_now_nanos_type = self.yaf_value_type.fn_type(&[], false);
+        self.module.add_function("yaf_time_now_nanos", time_now_nanos_type, None);
+        
+        let time_sleep_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_time_sleep", time_sleep_type, None);
+        self.module.add_function("yaf_time_sleep_ms", time_sleep_type, None);
+        self.module.add_function("yaf_black_box", time_sleep_type, None);
+        self.module.add_function("yaf_memory_stats_map", time_now_type, None);
+        
+        // Networking: every argument and result is a boxed value
+        for (name, arity) in [
+            ("yaf_net_http_get", 1), ("yaf_net_http_post", 2), ("yaf_net_http_get_all", 1),
+            ("yaf_net_http_status_all", 2), ("yaf_net_tcp_connect_all", 2), ("yaf_net_tcp_request", 3),
+        ] {
+            let parameters = vec![self.yaf_value_type.into(); arity];
+            self.module.add_function(name, self.yaf_value_type.fn_type(&parameters, false), None);
+        }
+        
+        // Memoization: caches of @memo functions
+        let memo_get_type = i32_type.fn_type(&[ptr_type.into(), ptr_type.into(), i32_type.into(), ptr_type.into()], false);
+        self.module.add_function("yaf_memo_get", memo_get_type, None);
+        let memo_put_type = void_type.fn_type(&[ptr_type.into(), ptr_type.into(), i32_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_memo_put", memo_put_type, None);
+        
+        // Profiling hooks of --profile builds
+        let prof_start_type = void_type.fn_type(&[ptr_type.into(), i32_type.into()], false);
+        self.module.add_function("yaf_prof_start", prof_start_type, None);
+        self.module.add_function("yaf_prof_enter", void_type.fn_type(&[i32_type.into()], false), None);
+        self.module.add_function("yaf_prof_exit", void_type.fn_type(&[], false), None);
+        
+        // Array object declarations. Typed element accesses are inlined;
+        // these handle boxed arrays and the out of line cases.
+        let array_new_type = ptr_type.fn_type(&[i32_type.into(), i64_type.into()], false);
+        self.module.add_function("yaf_array_new", array_new_type, None);
+        
+        // Frame objects: built in storage of the caller's frame
+        let array_init_frame_type = ptr_type.fn_type(&[ptr_type.into(), i32_type.into(), i64_type.into()], false);
+        self.module.add_function("yaf_array_init_frame", array_init_frame_type, None);
+        let to_string_frame_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), ptr_type.into()], false);
+        self.module.add_function("yaf_value_to_string_frame", to_string_frame_type, None);
+        self.module.add_function("yaf_int_to_string_frame", to_string_frame_type, None);
+        
+        let array_get_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_array_get", array_get_type, None);
+        
+        let array_set_type = void_type.fn_type(&[
+            self.yaf_value_type.into(),
+            self.yaf_value_type.into(),
+            self.yaf_value_type.into()
+        ], false);
+        self.module.add_function("yaf_array_set", array_set_type, None);
+        
+        let array_push_type = void_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_array_push", array_push_type, None);
+        
+        let array_pop_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into()], false);
+        self.module.add_function("yaf_array_pop", array_pop_type, None);
+        
+        // Map object declarations (open addressing table in the runtime)
+        let make_map_type = self.yaf_value_type.fn_type(&[i64_type.into()], false);
+        self.module.add_function("yaf_make_map", make_map_type, None);
+        
+        let map_set_type = void_type.fn_type(&[
+            self.yaf_value_type.into(),
+            self.yaf_value_type.into(),
+            self.yaf_value_type.into()
+        ], false);
+        self.module.add_function("yaf_map_set", map_set_type, None);
+        
+        let map_lookup_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
+        for name in ["yaf_map_get", "yaf_map_has", "yaf_map_delete"] {
+            self.module.add_function(name, map_lookup_type, None);
+        }
+        
+        // Parallel loops: yaf_parallel_for(begin, end, body, env) calls
+        // body(env, chunk_begin, chunk_end, chunk) for each of the
+        // yaf_parallel_chunks(begin, end) chunks of the range
+        let parallel_chunks_type = i64_type.fn_type(&[i64_type.into(), i64_type.into()], false);
+        self.module.add_function("yaf_parallel_chunks", parallel_chunks_type, None);
+        
+        let parallel_for_type = void_type.fn_type(&[
+            i64_type.into(),
+            i64_type.into(),
+            ptr_type.into(),
+            ptr_type.into()
+        ], false);
+        self.module.add_function("yaf_parallel_for", parallel_for_type, None);
         
         Ok(())
     }
@@ -320,11 +1691,18 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         
         let param = function.get_nth_param(0).unwrap().into_pointer_value();
         
-        // Duplicate string to ensure we own it
-        let strdup_fn = self.module.get_function("strdup").unwrap();
-        let copied_str = self.builder.build_call(
-            strdup_fn,
+        // Copy into a runtime string object so the length lives in the header
+        let strlen_fn = self.module.get_function("strlen").unwrap();
+        let length = self.builder.build_call(
+            strlen_fn,
             &[param.into()],
+            "length"
+        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+        
+        let string_new_fn = self.module.get_function("yaf_string_new").unwrap();
+        let copied_str = self.builder.build_call(
+            string_new_fn,
+            &[param.into(), length.into()],
             "copied_str"
         ).unwrap().try_as_basic_value().left().unwrap().into_pointer_value();
         
@@ -351,18 +1729,8 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
             "data_field"
         ).unwrap();
         
-        // Register with garbage collector 
-        // Calculate approximate string size (we don't have strlen here, so estimate)
-        let estimated_size = self.context.i64_type().const_int(64, false); // Rough estimate
-        let string_type = self.context.i32_type().const_int(2, false); // YAF_STRING = 2
-        
-        let gc_register_fn = self.module.get_function("yaf_gc_register_allocation").unwrap();
-        self.builder.build_call(
-            gc_register_fn,
-            &[ptr_as_int.into(), estimated_size.into(), string_type.into()],
-            "gc_register"
-        ).unwrap();
-        
+        // yaf_string_new allocates from the runtime heap, which already
+        // accounts for it; no yaf_gc_register_allocation needed
         self.builder.build_return(Some(&struct_val)).unwrap();
         Ok(())
     }
@@ -501,20 +1869,9 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let type1 = self.builder.build_extract_value(param1, 0, "type1").unwrap().into_int_value();
         let type2 = self.builder.build_extract_value(param2, 0, "type2").unwrap().into_int_value();
         
-        // Check if either is string (YAF_STRING = 2)
-        let string_type = type1.get_type().const_int(2, false);
-        let is_string1 = self.builder.build_int_compare(
-            inkwell::IntPredicate::EQ,
-            type1,
-            string_type,
-            "is_string1"
-        ).unwrap();
-        let is_string2 = self.builder.build_int_compare(
-            inkwell::IntPredicate::EQ,
-            type2,
-            string_type,
-            "is_string2"
-        ).unwrap();
+        // Check if either is string (heap or inline)
+        let is_string1 = self.build_is_string(type1, "is_string1");
+        let is_string2 = self.build_is_string(type2, "is_string2");
         let either_string = self.builder.build_or(is_string1, is_string2, "either_string").unwrap();
         
         let _not_string = self.builder.build_not(either_string, "not_string").unwrap();
@@ -554,13 +1911,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
         let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
         let int_result = self.builder.build_int_add(data1, data2, "add_result").unwrap();
-        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-        let int_result_val = self.builder.build_call(
-            make_int_fn,
-            &[int_result.into()],
-            "make_int_call"
-        ).unwrap();
-        let int_val = int_result_val.try_as_basic_value().left().unwrap();
+        let int_val = self.box_value(TypedValue::Int(int_result));
         self.builder.build_unconditional_branch(end_block).unwrap();
         
         // End block with phi
@@ -591,12 +1942,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         
         let result = self.builder.build_int_sub(data1, data2, "sub_result").unwrap();
         
-        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-        let result_val = self.builder.build_call(
-            make_int_fn,
-            &[result.into()],
-            "make_int_call"
-        ).unwrap().try_as_basic_value().left().unwrap();
+        let result_val = self.box_value(TypedValue::Int(result));
         
         self.builder.build_return(Some(&result_val)).unwrap();
         Ok(())
@@ -620,12 +1966,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         
         let result = self.builder.build_int_mul(data1, data2, "mul_result").unwrap();
         
-        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-        let result_val = self.builder.build_call(
-            make_int_fn,
-            &[result.into()],
-            "make_int_call"
-        ).unwrap().try_as_basic_value().left().unwrap();
+        let result_val = self.box_value(TypedValue::Int(result));
         
         self.builder.build_return(Some(&result_val)).unwrap();
         Ok(())
@@ -647,14 +1988,9 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
         let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
         
-        let result = self.builder.build_int_signed_div(data1, data2, "div_result").unwrap();
+        let result = self.build_int_division(data1, data2, false);
         
-        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-        let result_val = self.builder.build_call(
-            make_int_fn,
-            &[result.into()],
-            "make_int_call"
-        ).unwrap().try_as_basic_value().left().unwrap();
+        let result_val = self.box_value(TypedValue::Int(result));
         
         self.builder.build_return(Some(&result_val)).unwrap();
         Ok(())
@@ -676,33 +2012,52 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
         let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
         
-        let result = self.builder.build_int_signed_rem(data1, data2, "mod_result").unwrap();
+        let result = self.build_int_division(data1, data2, true);
         
-        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-        let result_val = self.builder.build_call(
-            make_int_fn,
-            &[result.into()],
-            "make_int_call"
-        ).unwrap().try_as_basic_value().left().unwrap();
+        let result_val = self.box_value(TypedValue::Int(result));
         
         self.builder.build_return(Some(&result_val)).unwrap();
         Ok(())
     }
     
     fn call_yaf_make_bool_from_i1(&mut self, bool_val: inkwell::values::IntValue<'ctx>) -> inkwell::values::BasicValueEnum<'ctx> {
-        // Convert i1 to i32 for C function call
-        let extended_result = self.builder.build_int_z_extend(
-            bool_val,
-            self.context.i32_type(),
-            "extend_bool"
-        ).unwrap();
+        // Built inline rather than calling the C yaf_make_bool, so the
+        // comparison helpers stay free of external calls
+        self.box_value(TypedValue::Bool(bool_val))
+    }
+    
+    // Equality of two boxed values: strings by content, the rest by payload
+    fn build_value_equality(&mut self, function: FunctionValue<'ctx>, param1: inkwell::values::StructValue<'ctx>, param2: inkwell::values::StructValue<'ctx>) -> IntValue<'ctx> {
+        let i32_type = self.context.i32_type();
         
-        let make_bool_fn = self.module.get_function("yaf_make_bool").unwrap();
-        self.builder.build_call(
-            make_bool_fn,
-            &[extended_result.into()],
-            "make_bool_call"
-        ).unwrap().try_as_basic_value().left().unwrap()
+        let type1 = self.builder.build_extract_value(param1, 0, "type1").unwrap().into_int_value();
+        let type2 = self.builder.build_extract_value(param2, 0, "type2").unwrap().into_int_value();
+        let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
+        let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
+        
+        let is_string1 = self.build_is_string(type1, "is_string1");
+        let is_string2 = self.build_is_string(type2, "is_string2");
+        let both_strings = self.builder.build_and(is_string1, is_string2, "both_strings").unwrap();
+        
+        let entry_bb = self.builder.get_insert_block().unwrap();
+        let string_bb = self.context.append_basic_block(function, "string_eq");
+        let merge_bb = self.context.append_basic_block(function, "eq_merge");
+        let same_payload = self.builder.build_int_compare(IntPredicate::EQ, data1, data2, "same_payload").unwrap();
+        self.builder.build_conditional_branch(both_strings, string_bb, merge_bb).unwrap();
+        
+        self.builder.position_at_end(string_bb);
+        let equal = self.builder.build_call(
+            self.module.get_function("yaf_string_equal").unwrap(),
+            &[param1.into(), param2.into()],
+            "string_equal"
+        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+        let same_content = self.builder.build_int_compare(IntPredicate::NE, equal, i32_type.const_zero(), "same_content").unwrap();
+        self.builder.build_unconditional_branch(merge_bb).unwrap();
+        
+        self.builder.position_at_end(merge_bb);
+        let phi = self.builder.build_phi(self.context.bool_type(), "eq_result").unwrap();
+        phi.add_incoming(&[(&same_payload, entry_bb), (&same_content, string_bb)]);
+        phi.as_basic_value().into_int_value()
     }
     
     fn generate_yaf_eq(&mut self) -> Result<()> {
@@ -718,15 +2073,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let param1 = function.get_nth_param(0).unwrap().into_struct_value();
         let param2 = function.get_nth_param(1).unwrap().into_struct_value();
         
-        let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
-        let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
-        
-        let result = self.builder.build_int_compare(
-            inkwell::IntPredicate::EQ,
-            data1,
-            data2,
-            "eq_result"
-        ).unwrap();
+        let result = self.build_value_equality(function, param1, param2);
         
         let result_val = self.call_yaf_make_bool_from_i1(result);
         
@@ -776,15 +2123,8 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let param1 = function.get_nth_param(0).unwrap().into_struct_value();
         let param2 = function.get_nth_param(1).unwrap().into_struct_value();
         
-        let data1 = self.builder.build_extract_value(param1, 1, "data1").unwrap().into_int_value();
-        let data2 = self.builder.build_extract_value(param2, 1, "data2").unwrap().into_int_value();
-        
-        let result = self.builder.build_int_compare(
-            inkwell::IntPredicate::NE,
-            data1,
-            data2,
-            "ne_result"
-        ).unwrap();
+        let equal = self.build_value_equality(function, param1, param2);
+        let result = self.builder.build_not(equal, "ne_result").unwrap();
         
         let result_val = self.call_yaf_make_bool_from_i1(result);
         
@@ -902,66 +2242,250 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
     }
     
     fn declare_function(&mut self, function: &Function) -> Result<()> {
+        // int/bool/float parameters and results use the raw LLVM types
         let param_types: Vec<BasicMetadataTypeEnum> = function.parameters
             .iter()
-            .map(|_| self.yaf_value_type.into())
+            .map(|param| self.llvm_type_of(ValueKind::of(&param.param_type)).into())
             .collect();
         
-        let fn_type = self.yaf_value_type.fn_type(&param_types, false);
+        let return_type = self.llvm_type_of(ValueKind::of(&function.return_type));
+        let fn_type = return_type.fn_type(&param_types, false);
         let llvm_function = self.module.add_function(
             &format!("yaf_func_{}", function.name),
             fn_type,
             None
         );
         
+        // Calls go to yaf_func_<name>; for @memo functions that is the cache
+        // lookup generate_memo_wrapper builds around the body
+        if function.has_attribute("memo") {
+            let body = self.module.add_function(&format!("yaf_memo_body_{}", function.name), fn_type, None);
+            body.set_linkage(Linkage::Internal);
+        }
+        
         self.functions.insert(function.name.clone(), llvm_function);
+        self.function_types.insert(
+            function.name.clone(),
+            (function.parameters.iter().map(|param| param.param_type.clone()).collect(), function.return_type.clone())
+        );
         Ok(())
     }
     
     fn generate_function(&mut self, function: &Function) -> Result<()> {
-        let llvm_function = self.functions[&function.name];
+        let llvm_function = match self.module.get_function(&format!("yaf_memo_body_{}", function.name)) {
+            Some(body) => body,
+            None => self.functions[&function.name],
+        };
         self.current_function = Some(llvm_function);
         
-        let entry_block = self.context.append_basic_block(llvm_function, "entry");
-        self.builder.position_at_end(entry_block);
+        self.return_kind = ValueKind::of(&function.return_type);
+        
+        self.build_function_prologue(llvm_function);
+        
+        // Before the tail loop: a self tail call stays in the same activation
+        self.profile_id = self.profiled_functions.iter().position(|name| *name == function.name).map(|id| id as u32);
+        if let Some(id) = self.profile_id {
+            let enter_fn = self.module.get_function("yaf_prof_enter").unwrap();
+            self.builder.build_call(enter_fn, &[self.context.i32_type().const_int(id as u64, false).into()], "").unwrap();
+        }
         
         // Clear local variables for new function scope (keep globals)
         self.local_variables.clear();
+        // Arrays stored into parameters or globals outlive the frame
+        let mut excluded: HashSet<String> = function.parameters.iter().map(|param| param.name.clone()).collect();
+        excluded.extend(self.global_variables.keys().cloned());
+        self.frame_arrays = escape::frame_arrays(&function.body, &excluded);
         
-        // Create alloca instructions for parameters
+        // Boxed parameters get rooted slots, typed ones plain allocas
+        let mut parameters = Vec::new();
         for (i, param) in function.parameters.iter().enumerate() {
             let param_value = llvm_function.get_nth_param(i as u32).unwrap();
-            let unique_name = self.get_unique_var_name(&param.name);
-            let alloca = self.builder.build_alloca(self.yaf_value_type, &unique_name).unwrap();
-            self.builder.build_store(alloca, param_value).unwrap();
-            self.local_variables.insert(param.name.clone(), alloca);
+            let variable = self.create_variable(&param.name, Some(param.param_type.clone()));
+            self.builder.build_store(variable.ptr, param_value).unwrap();
+            parameters.push(variable);
+        }
+        self.begin_tail_loop(function, parameters);
+        
+        // Arguments are rooted now, so this is the first safe point to collect.
+        // Functions that never allocate themselves don't need it.
+        if self.block_may_allocate(&function.body) {
+            self.build_safepoint();
         }
         
         // Generate function body
         self.generate_block(&function.body)?;
         
-        // Add default return if needed
+        // Add default return if needed (zero, not undef: the caller may root it)
         if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
-            let void_val = self.yaf_value_type.get_undef();
-            self.builder.build_return(Some(&void_val)).unwrap();
+            let void_val = self.zero_of(self.return_kind);
+            let void_val = self.accumulated(void_val);
+            self.build_function_return(void_val);
         }
         
+        self.tail_loop = None;
+        self.profile_id = None;
+        self.finish_gc_frame();
         self.current_function = None;
+        self.return_kind = ValueKind::Boxed;
+        
+        if llvm_function != self.functions[&function.name] {
+            self.generate_memo_wrapper(function, llvm_function);
+        }
+        Ok(())
+    }
+    
+    // Self tail calls store their arguments in the parameter slots and jump
+    // to a block after the entry, so the loop never grows the stack or the
+    // root stack. The safepoint that follows runs on every iteration.
+    fn begin_tail_loop(&mut self, function: &Function, parameters: Vec<Variable<'ctx>>) {
+        let Some(tail) = tailcall::tail_loop(function) else {
+            return;
+        };
+        let accumulator = tail.accumulator.as_ref().map(|_| {
+            let i64_type = self.context.i64_type();
+            let slot = self.create_entry_alloca(i64_type.into(), "tail_acc");
+            self.builder.build_store(slot, i64_type.const_int(tail.identity() as u64, true)).unwrap();
+            slot
+        });
+        let block = self.context.append_basic_block(self.current_function.unwrap(), "tail_loop");
+        self.builder.build_unconditional_branch(block).unwrap();
+        self.builder.position_at_end(block);
+        self.tail_loop = Some(TailTarget { tail, block, parameters, accumulator });
+    }
+    
+    fn is_tail_jump(&self, expr: &Expression) -> bool {
+        self.tail_loop.as_ref().is_some_and(|target| matches!(target.tail.classify(expr), TailReturn::Jump { .. }))
+    }
+    
+    fn generate_tail_jump(&mut self, expr: &Expression) -> Result<()> {
+        let target = self.tail_loop.clone().unwrap();
+        let TailReturn::Jump { arguments, operand } = target.tail.classify(expr) else {
+            unreachable!();
+        };
+        if let (Some(operand), Some(slot), Some(operator)) = (operand, target.accumulator, target.tail.accumulator.as_ref()) {
+            let value = self.generate_typed_expression(operand)?;
+            let value = self.coerce(value, ValueKind::Int);
+            let current = self.builder.build_load(self.context.i64_type(), slot, "tail_acc").unwrap().into_int_value();
+            let combined = self.build_typed_binary_op(operator, TypedValue::Int(current), value).unwrap();
+            self.builder.build_store(slot, combined.as_basic_value()).unwrap();
+        }
+        
+        // Every argument is evaluated before any parameter changes
+        let mut values = Vec::new();
+        for (i, (argument, parameter)) in arguments.iter().zip(&target.parameters).enumerate() {
+            let value = self.generate_typed_expression(argument)?;
+            let value = self.coerce(value, parameter.kind);
+            if let TypedValue::Boxed(boxed) = value {
+                self.root_temporary(boxed, &arguments[i + 1..]);
+            }
+            values.push(value);
+        }
+        for (value, parameter) in values.iter().zip(&target.parameters) {
+            self.builder.build_store(parameter.ptr, value.as_basic_value()).unwrap();
+        }
+        self.builder.build_unconditional_branch(target.block).unwrap();
         Ok(())
     }
     
+    // Result of a return of the current function, combined with its
+    // accumulator when its tail calls have one
+    fn accumulated(&mut self, value: BasicValueEnum<'ctx>) -> BasicValueEnum<'ctx> {
+        let Some(target) = &self.tail_loop else {
+            return value;
+        };
+        let (Some(slot), Some(operator)) = (target.accumulator, target.tail.accumulator.clone()) else {
+            return value;
+        };
+        let current = self.builder.build_load(self.context.i64_type(), slot, "tail_acc").unwrap().into_int_value();
+        let combined = self.build_typed_binary_op(&operator, TypedValue::Int(current), TypedValue::Int(value.into_int_value()));
+        combined.unwrap().as_basic_value()
+    }
+    
+    // Looks the arguments up in the function's cache (see Memoization in the
+    // runtime) and only runs the body on a miss. Nothing is allocated between
+    // the body returning and the store, so the result needs no root.
+    fn generate_memo_wrapper(&mut self, function: &Function, body: FunctionValue<'ctx>) {
+        let wrapper = self.functions[&function.name];
+        let i32_type = self.context.i32_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        
+        let cache = self.module.add_global(ptr_type, None, &format!("yaf_memo_{}", function.name));
+        cache.set_linkage(Linkage::Internal);
+        cache.set_initializer(&ptr_type.const_null());
+        
+        let entry = self.context.append_basic_block(wrapper, "entry");
+        let hit = self.context.append_basic_block(wrapper, "memo_hit");
+        let miss = self.context.append_basic_block(wrapper, "memo_miss");
+        self.builder.position_at_end(entry);
+        
+        let arity = function.parameters.len() as u32;
+        let key_type = self.yaf_value_type.array_type(arity.max(1));
+        let key = self.builder.build_alloca(key_type, "memo_key").unwrap();
+        let arguments = wrapper.get_params();
+        for (i, (argument, param)) in arguments.iter().zip(&function.parameters).enumerate() {
+            let typed = self.typed_from_basic(*argument, ValueKind::of(&param.param_type));
+            let boxed = self.box_value(typed);
+            let slot = unsafe {
+                self.builder.build_in_bounds_gep(
+                    key_type, key, &[i32_type.const_zero(), i32_type.const_int(i as u64, false)], "memo_arg"
+                ).unwrap()
+            };
+            self.builder.build_store(slot, boxed).unwrap();
+        }
+        let result = self.builder.build_alloca(self.yaf_value_type, "memo_result").unwrap();
+        let cache = cache.as_pointer_value();
+        let arity = i32_type.const_int(arity as u64, false);
+        
+        let found = self.builder.build_call(
+            self.module.get_function("yaf_memo_get").unwrap(),
+            &[cache.into(), key.into(), arity.into(), result.into()],
+            "memo_found"
+        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+        let found = self.builder.build_int_compare(IntPredicate::NE, found, i32_type.const_zero(), "memo_is_hit").unwrap();
+        self.builder.build_conditional_branch(found, hit, miss).unwrap();
+        
+        let return_kind = ValueKind::of(&function.return_type);
+        self.builder.position_at_end(hit);
+        let cached = self.builder.build_load(self.yaf_value_type, result, "memo_cached").unwrap();
+        let cached = self.unbox_value(cached, return_kind).as_basic_value();
+        self.builder.build_return(Some(&cached)).unwrap();
+        
+        self.builder.position_at_end(miss);
+        let arguments: Vec<BasicMetadataValueEnum<'ctx>> = arguments.into_iter().map(|argument| argument.into()).collect();
+        let value = self.builder.build_call(body, &arguments, "memo_value")
+            .unwrap().try_as_basic_value().left().unwrap();
+        let boxed = self.box_value(self.typed_from_basic(value, return_kind));
+        self.builder.build_call(
+            self.module.get_function("yaf_memo_put").unwrap(),
+            &[cache.into(), key.into(), arity.into(), boxed.into()],
+            ""
+        ).unwrap();
+        self.builder.build_return(Some(&value)).unwrap();
+    }
+    
     fn generate_main(&mut self, main_block: &Block) -> Result<()> {
         let i32_type = self.context.i32_type();
         let main_type = i32_type.fn_type(&[], false);
         let main_function = self.module.add_function("main", main_type, None);
         
-        let basic_block = self.context.append_basic_block(main_function, "entry");
-        self.builder.position_at_end(basic_block);
-        
         // Set current function for proper context (needed for if/while statements)
         self.current_function = Some(main_function);
         self.local_variables.clear();
         
+        self.build_function_prologue(main_function);
+        if self.profiling {
+            self.build_profile_start();
+        }
+        
+        // Boxed globals are roots for the whole run
+        let globals: Vec<PointerValue<'ctx>> = self.global_variables.values()
+            .filter(|global| global.kind == ValueKind::Boxed)
+            .map(|global| global.ptr)
+            .collect();
+        for global in globals {
+            self.build_add_root(global);
+        }
+        
         self.generate_block(main_block)?;
         
         // Trigger final garbage collection before exit
@@ -980,9 +2504,30 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         self.builder.build_return(Some(&i32_type.const_int(0, false))).unwrap();
         
         self.current_function = None;
+        self.gc_frame = None;
         Ok(())
     }
     
+    // Registers the names of the profiled functions, indexed by id
+    fn build_profile_start(&mut self) {
+        let i32_type = self.context.i32_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        let count = self.profiled_functions.len() as u32;
+        let names_type = ptr_type.array_type(count.max(1));
+        let names = self.create_entry_alloca(names_type.into(), "prof_names");
+        for (i, function) in self.profiled_functions.clone().iter().enumerate() {
+            let name = self.builder.build_global_string_ptr(function, &format!("prof_name_{}", i)).unwrap();
+            let slot = unsafe {
+                self.builder.build_in_bounds_gep(
+                    names_type, names, &[i32_type.const_zero(), i32_type.const_int(i as u64, false)], "prof_name"
+                ).unwrap()
+            };
+            self.builder.build_store(slot, name.as_pointer_value()).unwrap();
+        }
+        let start_fn = self.module.get_function("yaf_prof_start").unwrap();
+        self.builder.build_call(start_fn, &[names.into(), i32_type.const_int(count as u64, false).into()], "").unwrap();
+    }
+    
     fn generate_block(&mut self, block: &Block) -> Result<()> {
         for statement in &block.statements {
             self.generate_statement(statement)?;
@@ -993,131 +2538,98 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
     fn generate_statement(&mut self, stmt: &Statement) -> Result<()> {
         match stmt {
 
-            Statement::Declaration { name, var_type: _, value } => {
-                // Para declaraciones, funciona igual que asignación pero podríamos
-                // usar el tipo para optimizaciones futuras
-                let val = self.generate_expression(value)?;
+            Statement::Declaration { name, var_type, value } => {
+                // El tipo declarado decide la representación (cruda o YafValue)
+                let kind = ValueKind::of(var_type);
+                let val = self.generate_assigned_value(name, value)?;
+                let val = self.coerce(val, kind);
                 
                 // Variable no debería existir ya (nueva declaración)
-                let alloca = if let Some(function) = self.current_function {
-                    // Estamos en una función - crear variable local en entry block
-                    let current_block = self.builder.get_insert_block().unwrap();
-                    
-                    // Moverse al entry block para crear la alloca
-                    let entry_block = function.get_first_basic_block().unwrap();
-                    if let Some(first_instr) = entry_block.get_first_instruction() {
-                        self.builder.position_before(&first_instr);
-                    } else {
-                        self.builder.position_at_end(entry_block);
-                    }
-                    
-                    // Crear alloca con nombre único
-                    let unique_name = self.get_unique_var_name(name);
-                    let alloca = self.builder.build_alloca(self.yaf_value_type, &unique_name).unwrap();
-                    
-                    // Volver a la posición original
-                    self.builder.position_at_end(current_block);
-                    
-                    // Registrar como variable local
-                    self.local_variables.insert(name.clone(), alloca);
-                    alloca
-                } else {
-                    // Estamos a nivel global - crear variable global
-                    let unique_name = self.get_unique_var_name(name);
-                    let global = self.module.add_global(self.yaf_value_type, None, &unique_name);
-                    global.set_initializer(&self.yaf_value_type.const_zero());
-                    
-                    // Registrar como variable global
-                    let global_ptr = global.as_pointer_value();
-                    self.global_variables.insert(name.clone(), global_ptr);
-                    global_ptr
-                };
+                let variable = self.create_variable(name, Some(var_type.clone()));
                 
                 // Hacer store del valor inicial
-                self.builder.build_store(alloca, val).unwrap();
+                self.builder.build_store(variable.ptr, val.as_basic_value()).unwrap();
+            },
+            Statement::Assignment { name, .. } if self.string_builders.contains(name) => {
+                // `s = s + e` sobre un builder: se añade en el sitio
+                let (_, operand) = Self::string_append_operand(stmt).unwrap();
+                let operand = self.generate_consumed_expression(operand)?;
+                let operand = self.box_value(operand);
+                let variable = self.get_variable(name).cloned().unwrap();
+                let current = self.builder.build_load(self.yaf_value_type, variable.ptr, name).unwrap();
+                let appended = self.call_library_function("yaf_builder_append", &[current, operand])?;
+                self.builder.build_store(variable.ptr, appended).unwrap();
             },
             Statement::Assignment { name, value } => {
-                let val = self.generate_expression(value)?;
-                if let Some(&alloca) = self.get_variable(name) {
-                    // Variable ya existe, solo hacer store
-                    self.builder.build_store(alloca, val).unwrap();
-                } else {
-                    // Variable no existe, crearla
-                    let alloca = if let Some(function) = self.current_function {
-                        // Estamos en una función - crear variable local en entry block
-                        let current_block = self.builder.get_insert_block().unwrap();
-                        
-                        // Moverse al entry block para crear la alloca
-                        let entry_block = function.get_first_basic_block().unwrap();
-                        if let Some(first_instr) = entry_block.get_first_instruction() {
-                            self.builder.position_before(&first_instr);
-                        } else {
-                            self.builder.position_at_end(entry_block);
-                        }
-                        
-                        // Crear alloca con nombre único
-                        let unique_name = self.get_unique_var_name(name);
-                        let alloca = self.builder.build_alloca(self.yaf_value_type, &unique_name).unwrap();
-                        
-                        // Volver a la posición original
-                        self.builder.position_at_end(current_block);
-                        
-                        // Registrar como variable local
-                        self.local_variables.insert(name.clone(), alloca);
-                        alloca
-                    } else {
-                        // Estamos en contexto global - crear variable global real
-                        let unique_name = self.get_unique_var_name(name);
-                        let global = self.module.add_global(self.yaf_value_type, None, &unique_name);
-                        
-                        // Inicializar con un valor por defecto (null)
-                        let null_value = self.yaf_value_type.const_zero();
-                        global.set_initializer(&null_value);
-                        
-                        let global_ptr = global.as_pointer_value();
-                        
-                        // Registrar como variable global
-                        self.global_variables.insert(name.clone(), global_ptr);
-                        global_ptr
-                    };
-                    
-                    self.builder.build_store(alloca, val).unwrap();
+                let val = self.generate_assigned_value(name, value)?;
+                let existing = self.get_variable(name).cloned();
+                let value_type = self.static_type(value);
+                match existing {
+                    // Variable ya existe, solo hacer store (convirtiendo si hace falta)
+                    Some(variable) if variable.kind == ValueKind::Boxed || value_type.is_none() ||
+                                      variable.kind == val.kind() => {
+                        let val = self.coerce(val, variable.kind);
+                        self.builder.build_store(variable.ptr, val.as_basic_value()).unwrap();
+                    },
+                    // Variable no existe (o es otra del mismo nombre en otro scope), crearla
+                    _ => {
+                        let val = self.coerce(val, ValueKind::of_inferred(&value_type));
+                        let variable = self.create_variable(name, value_type);
+                        self.builder.build_store(variable.ptr, val.as_basic_value()).unwrap();
+                    },
                 }
             },
             Statement::ArrayAssignment { name, index, value } => {
-                let array_val = if let Some(&alloca) = self.get_variable(name) {
-                    self.builder.build_load(self.yaf_value_type, alloca, name).unwrap()
-                } else {
-                    return Err(anyhow!("Variable '{}' no encontrada", name));
+                let array_val = match self.get_variable(name) {
+                    Some(variable) if variable.kind == ValueKind::Boxed => {
+                        self.builder.build_load(self.yaf_value_type, variable.ptr, name).unwrap()
+                    },
+                    Some(_) => return Err(anyhow!("Variable '{}' no es un array", name)),
+                    None => return Err(anyhow!("Variable '{}' no encontrada", name)),
                 };
                 
-                let index_val = self.generate_expression(index)?;
-                let value_val = self.generate_expression(value)?;
+                self.root_temporary(array_val, std::slice::from_ref(index));
+                self.root_temporary(array_val, std::slice::from_ref(value));
                 
-                // Use yaf_array_set runtime function
-                let set_fn = self.module.get_function("yaf_array_set").unwrap();
-                self.builder.build_call(
-                    set_fn,
-                    &[array_val.into(), index_val.into(), value_val.into()],
-                    "array_set"
-                ).unwrap();
+                if let Some(layout) = self.array_dense_kind(&Expression::Variable(name.clone())) {
+                    let index_val = self.generate_typed_expression(index)?;
+                    let index_val = match self.coerce(index_val, ValueKind::Int) { TypedValue::Int(v) => v, _ => unreachable!() };
+                    let value_val = self.generate_typed_expression(value)?;
+                    let value_val = self.coerce(value_val, layout.1);
+                    self.build_array_set(array_val, index_val, value_val, layout);
+                } else {
+                    let index_val = self.generate_expression(index)?;
+                    self.root_temporary(index_val, std::slice::from_ref(value));
+                    let value_val = self.generate_expression(value)?;
+                    
+                    let set_fn = self.module.get_function("yaf_array_set").unwrap();
+                    self.builder.build_call(
+                        set_fn,
+                        &[array_val.into(), index_val.into(), value_val.into()],
+                        "array_set"
+                    ).unwrap();
+                }
+            },
+            Statement::Return { value: Some(expr) } if self.is_tail_jump(expr) => {
+                self.generate_tail_jump(expr)?;
             },
             Statement::Return { value } => {
                 if let Some(expr) = value {
-                    let val = self.generate_expression(expr)?;
-                    self.builder.build_return(Some(&val)).unwrap();
+                    self.return_position = matches!(expr, Expression::FunctionCall { .. });
+                    let val = self.generate_typed_expression(expr)?;
+                    self.return_position = false;
+                    let val = self.coerce(val, self.return_kind);
+                    let val = self.accumulated(val.as_basic_value());
+                    self.build_function_return(val);
                 } else {
-                    let void_val = self.yaf_value_type.get_undef();
-                    self.builder.build_return(Some(&void_val)).unwrap();
+                    let void_val = self.zero_of(self.return_kind);
+                    let void_val = self.accumulated(void_val);
+                    self.build_function_return(void_val);
                 }
             },
             Statement::If { condition, then_block, else_block } => {
-                let condition_val = self.generate_expression(condition)?;
-                let condition_bool = self.builder.build_call(
-                    self.module.get_function("yaf_to_bool").unwrap(),
-                    &[condition_val.into()],
-                    "condition_bool"
-                ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+                let condition_val = self.generate_typed_expression(condition)?;
+                let condition_bool = self.build_truthy(condition_val);
                 
                 let then_bb = self.context.append_basic_block(self.current_function.unwrap(), "then");
                 let else_bb = self.context.append_basic_block(self.current_function.unwrap(), "else");
@@ -1149,6 +2661,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 self.builder.position_at_end(merge_bb);
             },
             Statement::While { condition, body } => {
+                let builders = self.begin_string_builders(stmt)?;
                 let loop_bb = self.context.append_basic_block(self.current_function.unwrap(), "loop");
                 let body_bb = self.context.append_basic_block(self.current_function.unwrap(), "loop_body");
                 let after_bb = self.context.append_basic_block(self.current_function.unwrap(), "afterloop");
@@ -1157,12 +2670,8 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 
                 // Loop condition check
                 self.builder.position_at_end(loop_bb);
-                let condition_val = self.generate_expression(condition)?;
-                let condition_bool = self.builder.build_call(
-                    self.module.get_function("yaf_to_bool").unwrap(),
-                    &[condition_val.into()],
-                    "condition_bool"
-                ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+                let condition_val = self.generate_typed_expression(condition)?;
+                let condition_bool = self.build_truthy(condition_val);
                 
                 self.builder.build_conditional_branch(condition_bool, body_bb, after_bb).unwrap();
                 
@@ -1172,13 +2681,19 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 
                 // Only add branch if block doesn't end with return
                 if self.builder.get_insert_block().unwrap().get_terminator().is_none() {
+                    if self.statement_may_allocate(stmt) {
+                        self.build_safepoint();
+                    }
                     self.builder.build_unconditional_branch(loop_bb).unwrap();
                 }
                 
                 // Continue after loop
                 self.builder.position_at_end(after_bb);
+                self.end_string_builders(builders)?;
             },
             Statement::For { init, condition, increment, body } => {
+                let builders = self.begin_string_builders(stmt)?;
+                
                 // Generar la inicialización
                 self.generate_statement(init)?;
                 
@@ -1191,12 +2706,8 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 
                 // Loop condition check
                 self.builder.position_at_end(loop_bb);
-                let condition_val = self.generate_expression(condition)?;
-                let condition_bool = self.builder.build_call(
-                    self.module.get_function("yaf_to_bool").unwrap(),
-                    &[condition_val.into()],
-                    "condition_bool"
-                ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
+                let condition_val = self.generate_typed_expression(condition)?;
+                let condition_bool = self.build_truthy(condition_val);
                 
                 self.builder.build_conditional_branch(condition_bool, body_bb, after_bb).unwrap();
                 
@@ -1212,10 +2723,17 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 // Increment
                 self.builder.position_at_end(increment_bb);
                 self.generate_statement(increment)?;
+                if self.statement_may_allocate(stmt) {
+                    self.build_safepoint();
+                }
                 self.builder.build_unconditional_branch(loop_bb).unwrap();
                 
                 // Continue after loop
                 self.builder.position_at_end(after_bb);
+                self.end_string_builders(builders)?;
+            },
+            Statement::ParallelFor { variable, start, end, reductions, body } => {
+                self.generate_parallel_for(variable, start, end, reductions, body)?;
             },
             Statement::Expression(expr) => {
                 self.generate_expression(expr)?;
@@ -1224,97 +2742,379 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         Ok(())
     }
     
+    // The body becomes a private function yaf_pfor_N(env, begin, end, chunk)
+    // that the runtime calls once per chunk of the range. env holds pointers
+    // to the enclosing locals the body reads (copied on entry; the typechecker
+    // rejects writes to them) and, for each reduction, to the variable and to
+    // an array with one partial result per chunk. Each chunk reduces into a
+    // private slot starting at 0 for + and at the current value for min/max;
+    // afterwards the partials are folded in chunk order, so the result does
+    // not depend on how chunks were scheduled.
+    fn generate_parallel_for(&mut self, variable: &str, start: &Expression, end: &Expression,
+                             reductions: &[Reduction], body: &Block) -> Result<()> {
+        let i64_type = self.context.i64_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        
+        let begin = self.generate_typed_expression(start)?;
+        let begin = match self.coerce(begin, ValueKind::Int) { TypedValue::Int(v) => v, _ => unreachable!() };
+        let end = self.generate_typed_expression(end)?;
+        let end = match self.coerce(end, ValueKind::Int) { TypedValue::Int(v) => v, _ => unreachable!() };
+        
+        let mut assigned = Vec::new();
+        Self::collect_assigned_names(body, &mut assigned);
+        let mut captured: Vec<(String, Variable<'ctx>)> = self.local_variables.iter()
+            .filter(|(name, _)| {
+                name.as_str() != variable && !assigned.contains(name) &&
+                    !reductions.iter().any(|reduction| &reduction.variable == *name) &&
+                    body.statements.iter().any(|stmt| Self::statement_uses(stmt, name, false))
+            })
+            .map(|(name, var)| (name.clone(), var.clone()))
+            .collect();
+        captured.sort_by(|a, b| a.0.cmp(&b.0));
+        let mut outer = Vec::new();
+        for reduction in reductions {
+            let var = self.get_variable(&reduction.variable).cloned()
+                .ok_or_else(|| anyhow!("Variable '{}' no encontrada", reduction.variable))?;
+            outer.push(var);
+        }
+        let env_type = ptr_type.array_type((captured.len() + 2 * reductions.len()).max(1) as u32);
+        
+        // Body function
+        let body_type = self.context.void_type().fn_type(&[ptr_type.into(), i64_type.into(), i64_type.into(), i64_type.into()], false);
+        let body_name = self.get_unique_var_name("yaf_pfor");
+        let body_function = self.module.add_function(&body_name, body_type, Some(Linkage::Private));
+        
+        let parent_block = self.builder.get_insert_block().unwrap();
+        let parent_function = self.current_function.replace(body_function);
+        let parent_locals = std::mem::take(&mut self.local_variables);
+        let parent_frame = (self.gc_frame, self.gc_frame_used, std::mem::take(&mut self.gc_unwinds));
+        let parent_tail_calls = std::mem::take(&mut self.tail_calls);
+        let parent_builders = std::mem::take(&mut self.string_builders);
+        // Names the body assigns are its own locals, even if main assigns a
+        // global of the same name later on
+        let shadowed: Vec<(String, Variable<'ctx>)> = assigned.iter()
+            .filter_map(|name| self.global_variables.remove(name).map(|global| (name.clone(), global)))
+            .collect();
+        
+        self.build_function_prologue(body_function);
+        let env = body_function.get_nth_param(0).unwrap().into_pointer_value();
+        let chunk_begin = body_function.get_nth_param(1).unwrap().into_int_value();
+        let chunk_end = body_function.get_nth_param(2).unwrap().into_int_value();
+        let chunk = body_function.get_nth_param(3).unwrap().into_int_value();
+        
+        for (slot, (name, var)) in captured.iter().enumerate() {
+            let source = self.load_env_pointer(env, env_type, slot);
+            let value = self.builder.build_load(self.llvm_type_of(var.kind), source, name).unwrap();
+            let local = self.create_variable(name, var.ty.clone());
+            self.builder.build_store(local.ptr, value).unwrap();
+        }
+        for (i, (reduction, var)) in reductions.iter().zip(&outer).enumerate() {
+            let local = self.create_variable(&reduction.variable, var.ty.clone());
+            let initial = match (&reduction.operator, var.kind) {
+                (ReductionOperator::Add, ValueKind::Boxed) => {
+                    // 0 or 0.0, by the tag of the current value
+                    let source = self.load_env_pointer(env, env_type, captured.len() + 2 * i);
+                    let current = self.builder.build_load(self.yaf_value_type, source, "pfor_current").unwrap();
+                    let tag = self.builder.build_extract_value(current.into_struct_value(), 0, "pfor_tag").unwrap();
+                    let i32_type = self.context.i32_type();
+                    let is_float = self.builder.build_int_compare(
+                        IntPredicate::EQ, tag.into_int_value(), i32_type.const_int(YAF_FLOAT, false), "pfor_is_float"
+                    ).unwrap();
+                    let zero_tag = self.builder.build_select(
+                        is_float, i32_type.const_int(YAF_FLOAT, false), i32_type.const_int(YAF_INT, false), "pfor_zero_tag"
+                    ).unwrap();
+                    self.builder.build_insert_value(self.yaf_value_type.const_zero(), zero_tag, 0, "pfor_zero")
+                        .unwrap().into_struct_value().into()
+                },
+                (ReductionOperator::Add, kind) => self.zero_of(kind),
+                (_, kind) => {
+                    let source = self.load_env_pointer(env, env_type, captured.len() + 2 * i);
+                    self.builder.build_load(self.llvm_type_of(kind), source, "pfor_current").unwrap()
+                },
+            };
+            self.builder.build_store(local.ptr, initial).unwrap();
+        }
+        
+        let index = self.create_typed_slot(variable, ValueKind::Int);
+        self.builder.build_store(index, chunk_begin).unwrap();
+        self.local_variables.insert(variable.to_string(), Variable { ptr: index, kind: ValueKind::Int, ty: Some(Type::Int) });
+        
+        let loop_bb = self.context.append_basic_block(body_function, "pfor_loop");
+        let body_bb = self.context.append_basic_block(body_function, "pfor_body");
+        let after_bb = self.context.append_basic_block(body_function, "pfor_done");
+        self.builder.build_unconditional_branch(loop_bb).unwrap();
+        
+        self.builder.position_at_end(loop_bb);
+        let current = self.builder.build_load(i64_type, index, variable).unwrap().into_int_value();
+        let in_range = self.builder.build_int_compare(IntPredicate::SLT, current, chunk_end, "pfor_in_range").unwrap();
+        self.builder.build_conditional_branch(in_range, body_bb, after_bb).unwrap();
+        
+        self.builder.position_at_end(body_bb);
+        self.generate_block(body)?;
+        let current = self.builder.build_load(i64_type, index, variable).unwrap().into_int_value();
+        let next = self.builder.build_int_add(current, i64_type.const_int(1, false), "pfor_next").unwrap();
+        self.builder.build_store(index, next).unwrap();
+        if self.block_may_allocate(body) {
+            self.build_safepoint();
+        }
+        self.builder.build_unconditional_branch(loop_bb).unwrap();
+        
+        self.builder.position_at_end(after_bb);
+        for (i, (reduction, var)) in reductions.iter().zip(&outer).enumerate() {
+            let partials = self.load_env_pointer(env, env_type, captured.len() + 2 * i + 1);
+            let element_type = self.llvm_type_of(var.kind);
+            let slot = unsafe {
+                self.builder.build_in_bounds_gep(element_type, partials, &[chunk], "pfor_partial_slot").unwrap()
+            };
+            let local = self.local_variables[&reduction.variable].ptr;
+            let value = self.builder.build_load(element_type, local, &reduction.variable).unwrap();
+            self.builder.build_store(slot, value).unwrap();
+        }
+        if let Some(frame) = self.gc_frame {
+            let unwind_fn = self.module.get_function("yaf_gc_unwind_roots").unwrap();
+            let unwind = self.builder.build_call(unwind_fn, &[frame.into()], "").unwrap();
+            if let Some(instruction) = unwind.try_as_basic_value().right() {
+                self.gc_unwinds.push(instruction);
+            }
+        }
+        self.builder.build_return(None).unwrap();
+        self.finish_gc_frame();
+        
+        // Back to the enclosing function
+        self.builder.position_at_end(parent_block);
+        self.current_function = parent_function;
+        self.local_variables = parent_locals;
+        (self.gc_frame, self.gc_frame_used, self.gc_unwinds) = parent_frame;
+        self.tail_calls = parent_tail_calls;
+        self.string_builders = parent_builders;
+        self.global_variables.extend(shadowed);
+        let function = self.current_function.unwrap();
+        
+        let chunks = self.call_library_function("yaf_parallel_chunks", &[begin.into(), end.into()])?.into_int_value();
+        let run_bb = self.context.append_basic_block(function, "pfor_run");
+        let done_bb = self.context.append_basic_block(function, "pfor_after");
+        let has_chunks = self.builder.build_int_compare(IntPredicate::SGT, chunks, i64_type.const_zero(), "pfor_has_chunks").unwrap();
+        self.builder.build_conditional_branch(has_chunks, run_bb, done_bb).unwrap();
+        self.builder.position_at_end(run_bb);
+        
+        let env = self.create_entry_alloca(env_type.into(), "pfor_env");
+        for (slot, (_, var)) in captured.iter().enumerate() {
+            self.store_env_pointer(env, env_type, slot, var.ptr);
+        }
+        let mut partials = Vec::new();
+        for (i, var) in outer.iter().enumerate() {
+            let element_size = if var.kind == ValueKind::Boxed { 16 } else { 8 };
+            let bytes = self.builder.build_int_mul(chunks, i64_type.const_int(element_size, false), "pfor_partials_size").unwrap();
+            let array = self.call_library_function("yaf_alloc", &[bytes.into()])?.into_pointer_value();
+            self.store_env_pointer(env, env_type, captured.len() + 2 * i, var.ptr);
+            self.store_env_pointer(env, env_type, captured.len() + 2 * i + 1, array);
+            partials.push((array, bytes));
+        }
+        let parallel_for_fn = self.module.get_function("yaf_parallel_for").unwrap();
+        let body_pointer = body_function.as_global_value().as_pointer_value();
+        self.builder.build_call(
+            parallel_for_fn,
+            &[begin.into(), end.into(), body_pointer.into(), env.into()],
+            ""
+        ).unwrap();
+        
+        // r = r + partial (or min/max) for each chunk in order, through the
+        // usual assignment so typed and boxed reductions combine alike
+        for ((reduction, var), (array, bytes)) in reductions.iter().zip(&outer).zip(partials) {
+            const PARTIAL: &str = "__yaf_pfor_partial";
+            let partial = self.create_variable(PARTIAL, var.ty.clone());
+            let counter = self.create_typed_slot("pfor_k", ValueKind::Int);
+            self.builder.build_store(counter, i64_type.const_zero()).unwrap();
+            
+            let fold_bb = self.context.append_basic_block(function, "pfor_fold");
+            let fold_body_bb = self.context.append_basic_block(function, "pfor_fold_body");
+            let folded_bb = self.context.append_basic_block(function, "pfor_folded");
+            self.builder.build_unconditional_branch(fold_bb).unwrap();
+            
+            self.builder.position_at_end(fold_bb);
+            let k = self.builder.build_load(i64_type, counter, "pfor_k").unwrap().into_int_value();
+            let more = self.builder.build_int_compare(IntPredicate::SLT, k, chunks, "pfor_more").unwrap();
+            self.builder.build_conditional_branch(more, fold_body_bb, folded_bb).unwrap();
+            
+            self.builder.position_at_end(fold_body_bb);
+            let element_type = self.llvm_type_of(var.kind);
+            let slot = unsafe {
+                self.builder.build_in_bounds_gep(element_type, array, &[k], "pfor_partial_slot").unwrap()
+            };
+            let value = self.builder.build_load(element_type, slot, PARTIAL).unwrap();
+            self.builder.build_store(partial.ptr, value).unwrap();
+            let target = Box::new(Expression::Variable(reduction.variable.clone()));
+            let operand = Box::new(Expression::Variable(PARTIAL.to_string()));
+            let combined = match reduction.operator {
+                ReductionOperator::Add => Expression::BinaryOp { left: target, operator: BinaryOperator::Add, right: operand },
+                _ => Expression::BuiltinCall {
+                    name: reduction.operator.to_string().to_string(),
+                    arguments: vec![*target, *operand],
+                },
+            };
+            self.generate_statement(&Statement::Assignment { name: reduction.variable.clone(), value: combined })?;
+            let next = self.builder.build_int_add(k, i64_type.const_int(1, false), "pfor_k_next").unwrap();
+            self.builder.build_store(counter, next).unwrap();
+            self.builder.build_unconditional_branch(fold_bb).unwrap();
+            
+            self.builder.position_at_end(folded_bb);
+            let dealloc_fn = self.module.get_function("yaf_dealloc").unwrap();
+            self.builder.build_call(dealloc_fn, &[array.into(), bytes.into()], "").unwrap();
+            self.local_variables.remove(PARTIAL);
+        }
+        self.builder.build_unconditional_branch(done_bb).unwrap();
+        self.builder.position_at_end(done_bb);
+        Ok(())
+    }
+    
+    fn load_env_pointer(&self, env: PointerValue<'ctx>, env_type: inkwell::types::ArrayType<'ctx>, slot: usize) -> PointerValue<'ctx> {
+        let i64_type = self.context.i64_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        let address = unsafe {
+            self.builder.build_in_bounds_gep(env_type, env, &[i64_type.const_zero(), i64_type.const_int(slot as u64, false)], "env_slot").unwrap()
+        };
+        self.builder.build_load(ptr_type, address, "env_ptr").unwrap().into_pointer_value()
+    }
+    
+    fn store_env_pointer(&self, env: PointerValue<'ctx>, env_type: inkwell::types::ArrayType<'ctx>, slot: usize, value: PointerValue<'ctx>) {
+        let i64_type = self.context.i64_type();
+        let address = unsafe {
+            self.builder.build_in_bounds_gep(env_type, env, &[i64_type.const_zero(), i64_type.const_int(slot as u64, false)], "env_slot").unwrap()
+        };
+        self.builder.build_store(address, value).unwrap();
+    }
+    
+    // Alloca in the entry block of the current function, so loops reuse it
+    fn create_entry_alloca(&mut self, ty: BasicTypeEnum<'ctx>, name: &str) -> PointerValue<'ctx> {
+        let function = self.current_function.unwrap();
+        let current_block = self.builder.get_insert_block().unwrap();
+        
+        let entry_block = function.get_first_basic_block().unwrap();
+        match entry_block.get_terminator() {
+            Some(terminator) => self.builder.position_before(&terminator),
+            None => self.builder.position_at_end(entry_block),
+        }
+        let alloca = self.builder.build_alloca(ty, name).unwrap();
+        
+        self.builder.position_at_end(current_block);
+        alloca
+    }
+    
+    // Boxed value of an expression, for the dynamic boundaries (print, arrays,
+    // runtime calls) and untyped variables
     fn generate_expression(&mut self, expr: &Expression) -> Result<BasicValueEnum<'ctx>> {
+        let value = self.generate_typed_expression(expr)?;
+        Ok(self.box_value(value))
+    }
+    
+    // Value of an expression in the representation given by its static type
+    fn generate_typed_expression(&mut self, expr: &Expression) -> Result<TypedValue<'ctx>> {
+        let kind = self.kind_of(expr);
+        let value = self.generate_value(expr)?;
+        Ok(self.coerce(value, kind))
+    }
+    
+    fn generate_value(&mut self, expr: &Expression) -> Result<TypedValue<'ctx>> {
         match expr {
             Expression::Literal(value) => {
                 match value {
                     Value::Int(n) => {
-                        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-                        let int_val = self.context.i64_type().const_int(*n as u64, false);
-                        let result = self.builder.build_call(
-                            make_int_fn,
-                            &[int_val.into()],
-                            "make_int_literal"
-                        ).unwrap();
-                        Ok(result.try_as_basic_value().left().unwrap())
+                        Ok(TypedValue::Int(self.context.i64_type().const_int(*n as u64, true)))
                     },
                     Value::Bool(b) => {
-                        let bool_val = self.context.bool_type().const_int(*b as u64, false);
-                        let result = self.call_yaf_make_bool_from_i1(bool_val);
-                        Ok(result)
+                        Ok(TypedValue::Bool(self.context.bool_type().const_int(*b as u64, false)))
                     },
                     Value::Float(f) => {
-                        // Por ahora, convertimos floats a int para compatibilidad
-                        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-                        let int_val = self.context.i64_type().const_int(*f as i64 as u64, false);
-                        let result = self.builder.build_call(
-                            make_int_fn,
-                            &[int_val.into()],
-                            "make_float_as_int_literal"
-                        ).unwrap();
-                        Ok(result.try_as_basic_value().left().unwrap())
+                        Ok(TypedValue::Float(self.context.f64_type().const_float(*f)))
+                    },
+                    Value::String(s) if s.len() <= YAF_SMALL_STRING_MAX && !s.contains('\0') => {
+                        // Los literales cortos van dentro del propio valor
+                        Ok(TypedValue::Boxed(self.build_small_string(s)))
                     },
                     Value::String(s) => {
-                        // Para strings, necesitamos crear una función make_string
-                        let make_string_fn = self.module.get_function("yaf_make_string")
-                            .ok_or_else(|| anyhow!("yaf_make_string function not found"))?;
-                        let str_val = self.builder.build_global_string_ptr(s, "string_literal").unwrap();
-                        let result = self.builder.build_call(
-                            make_string_fn,
-                            &[str_val.as_pointer_value().into()],
-                            "make_string_literal"
-                        ).unwrap();
-                        Ok(result.try_as_basic_value().left().unwrap())
+                        // Los literales son objetos string estáticos: no se copian ni se liberan
+                        Ok(TypedValue::Boxed(self.build_static_string(s)))
                     },
                 }
             },
             Expression::Variable(name) => {
-                if let Some(&alloca) = self.get_variable(name) {
-                    let val = self.builder.build_load(self.yaf_value_type, alloca, name).unwrap();
-                    Ok(val)
+                if let Some(variable) = self.get_variable(name).cloned() {
+                    let llvm_type = self.llvm_type_of(variable.kind);
+                    let val = self.builder.build_load(llvm_type, variable.ptr, name).unwrap();
+                    Ok(self.typed_from_basic(val, variable.kind))
                 } else {
                     Err(anyhow!("Undefined variable: {}", name))
                 }
             },
             Expression::FunctionCall { name, arguments } => {
                 if name == "print" {
-                    // Handle print specially - concatenate without spaces
+                    // Handle print specially - concatenate without spaces. Everything
+                    // goes to the runtime output buffer; raw numbers skip the box.
                     for arg in arguments.iter() {
-                        let arg_val = self.generate_expression(arg)?;
-                        let print_fn = self.module.get_function("yaf_print_value_no_newline").unwrap();
+                        let (print_fn, arg_val) = match self.generate_consumed_expression(arg)? {
+                            TypedValue::Int(v) => ("yaf_print_int", v.into()),
+                            TypedValue::Float(v) => ("yaf_print_float", v.into()),
+                            other => ("yaf_print_value_no_newline", self.box_value(other)),
+                        };
+                        let print_fn = self.module.get_function(print_fn).unwrap();
                         self.builder.build_call(print_fn, &[arg_val.into()], "print").unwrap();
                     }
                     
                     // Print newline at the end
-                    let printf_fn = self.module.get_function("printf").unwrap();
-                    let newline_str = self.builder.build_global_string_ptr("\n", "newline").unwrap();
-                    self.builder.build_call(
-                        printf_fn,
-                        &[newline_str.as_pointer_value().into()],
-                        "print_newline"
-                    ).unwrap();
+                    let newline_fn = self.module.get_function("yaf_print_newline").unwrap();
+                    self.builder.build_call(newline_fn, &[], "print_newline").unwrap();
                     
-                    let void_val = self.yaf_value_type.get_undef();
-                    Ok(void_val.into())
+                    Ok(TypedValue::Boxed(self.yaf_value_type.const_zero().into()))
                 } else if name == "str" || name == "int" || name == "float" || 
                          name == "length" || name == "upper" || name == "lower" || name == "concat" {
                     // Handle built-in functions
-                    self.generate_builtin_call(name, arguments)
+                    Ok(TypedValue::Boxed(self.generate_builtin_call(name, arguments)?))
                 } else if let Some(&function) = self.functions.get(name) {
+                    let (param_types, return_type) = self.function_types[name].clone();
+                    let returned = std::mem::take(&mut self.return_position);
                     let mut args = Vec::new();
-                    for arg in arguments {
-                        args.push(self.generate_expression(arg)?.into());
+                    for (i, arg) in arguments.iter().enumerate() {
+                        let arg_val = self.generate_typed_expression(arg)?;
+                        let arg_val = self.coerce(arg_val, ValueKind::of(&param_types[i]));
+                        if let TypedValue::Boxed(boxed) = arg_val {
+                            self.root_temporary(boxed, &arguments[i + 1..]);
+                        }
+                        args.push(arg_val.as_basic_value().into());
                     }
                     let result = self.builder.build_call(function, &args, "func_call").unwrap();
-                    Ok(result.try_as_basic_value().left().unwrap())
+                    if returned {
+                        self.tail_calls.push(result);
+                    }
+                    let result = result.try_as_basic_value().left().unwrap();
+                    Ok(self.typed_from_basic(result, ValueKind::of(&return_type)))
                 } else {
                     Err(anyhow!("Undefined function: {}", name))
                 }
             },
+            Expression::BinaryOp { left, operator, right } if matches!(operator, BinaryOperator::And | BinaryOperator::Or) => {
+                self.build_short_circuit(operator, left, right)
+            },
             Expression::BinaryOp { left, operator, right } => {
-                let left_val = self.generate_expression(left)?;
-                let right_val = self.generate_expression(right)?;
+                let left_kind = self.kind_of(left);
+                let right_kind = self.kind_of(right);
+                // Concatenation copies its operands
+                let concatenates = matches!(operator, BinaryOperator::Add);
+                let left_val = if concatenates { self.generate_consumed_expression(left)? } else { self.generate_typed_expression(left)? };
+                if let TypedValue::Boxed(boxed) = left_val {
+                    self.root_temporary(boxed, std::slice::from_ref(right.as_ref()));
+                }
+                let right_val = if concatenates { self.generate_consumed_expression(right)? } else { self.generate_typed_expression(right)? };
+                
+                
+                // Fast path: both operands statically int/bool/float
+                if left_kind != ValueKind::Boxed && right_kind != ValueKind::Boxed {
+                    if let Some(result) = self.build_typed_binary_op(operator, left_val, right_val) {
+                        return Ok(result);
+                    }
+                }
                 
+                let left_val = self.box_value(left_val);
+                let right_val = self.box_value(right_val);
                 let op_fn_name = match operator {
                     BinaryOperator::Add => "yaf_add",
                     BinaryOperator::Subtract => "yaf_sub",
@@ -1327,41 +3127,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     BinaryOperator::LessEqual => "yaf_le",
                     BinaryOperator::Greater => "yaf_gt",
                     BinaryOperator::GreaterEqual => "yaf_ge",
-                    BinaryOperator::And => {
-                        let left_bool = self.builder.build_call(
-                            self.module.get_function("yaf_to_bool").unwrap(),
-                            &[left_val.into()],
-                            "left_bool"
-                        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
-                        
-                        let right_bool = self.builder.build_call(
-                            self.module.get_function("yaf_to_bool").unwrap(),
-                            &[right_val.into()],
-                            "right_bool"
-                        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
-                        
-                        let result = self.builder.build_and(left_bool, right_bool, "and_result").unwrap();
-                        // Usar la función helper que convierte i1 a yaf_value correctamente
-                        let result_val = self.call_yaf_make_bool_from_i1(result);
-                        return Ok(result_val);
-                    },
-                    BinaryOperator::Or => {
-                        let left_bool = self.builder.build_call(
-                            self.module.get_function("yaf_to_bool").unwrap(),
-                            &[left_val.into()],
-                            "left_bool"
-                        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
-                        
-                        let right_bool = self.builder.build_call(
-                            self.module.get_function("yaf_to_bool").unwrap(),
-                            &[right_val.into()],
-                            "right_bool"
-                        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
-                        
-                        let result = self.builder.build_or(left_bool, right_bool, "or_result").unwrap();
-                        let result_val = self.call_yaf_make_bool_from_i1(result);
-                        return Ok(result_val);
-                    },
+                    BinaryOperator::And | BinaryOperator::Or => unreachable!(),
                 };
                 
                 let op_fn = self.module.get_function(op_fn_name).unwrap();
@@ -1370,96 +3136,312 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     &[left_val.into(), right_val.into()],
                     "binop"
                 ).unwrap();
-                Ok(result.try_as_basic_value().left().unwrap())
+                Ok(TypedValue::Boxed(result.try_as_basic_value().left().unwrap()))
             },
             Expression::UnaryOp { operator, operand } => {
-                let operand_val = self.generate_expression(operand)?;
+                let operand_val = self.generate_typed_expression(operand)?;
                 
                 match operator {
                     UnaryOperator::Not => {
-                        let operand_bool = self.builder.build_call(
-                            self.module.get_function("yaf_to_bool").unwrap(),
-                            &[operand_val.into()],
-                            "operand_bool"
-                        ).unwrap().try_as_basic_value().left().unwrap().into_int_value();
-                        
+                        let operand_bool = self.build_truthy(operand_val);
                         let result = self.builder.build_not(operand_bool, "not_result").unwrap();
-                        let result_val = self.call_yaf_make_bool_from_i1(result);
-                        Ok(result_val)
+                        Ok(TypedValue::Bool(result))
                     },
                     UnaryOperator::Minus => {
-                        let data_val = self.builder.build_extract_value(
-                            operand_val.into_struct_value(), 
-                            1, 
-                            "data"
-                        ).unwrap().into_int_value();
-                        
-                        let zero = self.context.i64_type().const_int(0, false);
-                        let result = self.builder.build_int_sub(zero, data_val, "neg_result").unwrap();
-                        
-                        let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-                        let result_val = self.builder.build_call(
-                            make_int_fn,
-                            &[result.into()],
-                            "make_int_call"
-                        ).unwrap();
-                        Ok(result_val.try_as_basic_value().left().unwrap())
+                        match operand_val {
+                            TypedValue::Float(v) => {
+                                Ok(TypedValue::Float(self.builder.build_float_neg(v, "neg_result").unwrap()))
+                            },
+                            other => {
+                                let data_val = match self.coerce(other, ValueKind::Int) {
+                                    TypedValue::Int(v) => v,
+                                    _ => unreachable!(),
+                                };
+                                Ok(TypedValue::Int(self.builder.build_int_neg(data_val, "neg_result").unwrap()))
+                            },
+                        }
                     },
                 }
             },
-            
-            Expression::ArrayLiteral { elements } => {
-                let make_array_fn = self.module.get_function("yaf_make_array").unwrap();
-                let len = self.context.i64_type().const_int(elements.len() as u64, false);
-                
-                // Create array
-                let array_val = self.builder.build_call(
-                    make_array_fn,
-                    &[len.into()],
-                    "make_array"
-                ).unwrap().try_as_basic_value().left().unwrap();
-                
-                // Set elements
-                for (i, element) in elements.iter().enumerate() {
-                    let element_val = self.generate_expression(element)?;
-                    let index_raw = self.context.i64_type().const_int(i as u64, false);
-                    
-                    // Convert index to YafValue
-                    let make_int_fn = self.module.get_function("yaf_make_int").unwrap();
-                    let index_val = self.builder.build_call(
-                        make_int_fn,
-                        &[index_raw.into()],
-                        "index_val"
-                    ).unwrap().try_as_basic_value().left().unwrap();
-                    
-                    // Call yaf_array_set
-                    let set_fn = self.module.get_function("yaf_array_set").unwrap();
+            
+            Expression::ArrayLiteral { elements } => self.generate_array_literal(expr, elements, false),
+            
+            Expression::MapLiteral { entries, .. } => {
+                let capacity = self.context.i64_type().const_int(entries.len() as u64, false);
+                let map_val = self.call_library_function("yaf_make_map", &[capacity.into()])?;
+                let set_fn = self.module.get_function("yaf_map_set").unwrap();
+                
+                for (i, (key, value)) in entries.iter().enumerate() {
+                    let pending: Vec<Expression> = entries[i..].iter()
+                        .flat_map(|(key, value)| [key.clone(), value.clone()])
+                        .collect();
+                    self.root_temporary(map_val, &pending);
+                    let key_val = self.generate_expression(key)?;
+                    self.root_temporary(key_val, std::slice::from_ref(value));
+                    let value_val = self.generate_expression(value)?;
+                    self.builder.build_call(
+                        set_fn,
+                        &[map_val.into(), key_val.into(), value_val.into()],
+                        "map_set"
+                    ).unwrap();
+                }
+                
+                Ok(TypedValue::Boxed(map_val))
+            },
+            
+            Expression::ArrayAccess { array, index } => {
+                let array_val = self.generate_expression(array)?;
+                self.root_temporary(array_val, std::slice::from_ref(index.as_ref()));
+                
+                if let Some(layout) = self.array_dense_kind(array) {
+                    let index_val = self.generate_typed_expression(index)?;
+                    let index_val = match self.coerce(index_val, ValueKind::Int) { TypedValue::Int(v) => v, _ => unreachable!() };
+                    return Ok(self.build_array_get(array_val, index_val, layout));
+                }
+                
+                let index_val = self.generate_expression(index)?;
+                let get_fn = self.module.get_function("yaf_array_get").unwrap();
+                let result = self.builder.build_call(
+                    get_fn,
+                    &[array_val.into(), index_val.into()],
+                    "array_get"
+                ).unwrap();
+                Ok(TypedValue::Boxed(result.try_as_basic_value().left().unwrap()))
+            },
+            
+            Expression::BuiltinCall { name, arguments } => {
+                if let Some(value) = self.generate_array_builtin(name, arguments)? {
+                    return Ok(value);
+                }
+                Ok(TypedValue::Boxed(self.generate_builtin_call(name, arguments)?))
+            },
+        }
+    }
+    
+    // Array literal on the GC heap, or with `in_frame` in storage of the current
+    // frame (a variable core::escape proved never lets its array escape)
+    fn generate_array_literal(&mut self, expr: &Expression, elements: &[Expression], in_frame: bool) -> Result<TypedValue<'ctx>> {
+        let i64_type = self.context.i64_type();
+        let element_type = match self.static_type(expr) {
+            Some(Type::Array(element_type)) => *element_type,
+            _ => Type::Void,
+        };
+        let (elem_kind, kind) = Self::array_element_layout(&element_type);
+        let len = i64_type.const_int(elements.len() as u64, false);
+        
+        let elem_kind_val = self.context.i32_type().const_int(elem_kind, false);
+        let object = if in_frame {
+            let size = FRAME_ARRAY_HEADERS + FRAME_ARRAY_ELEMENT_SIZE * elements.len() as u64;
+            let storage = self.create_frame_storage(size, "frame_array");
+            self.builder.build_call(
+                self.module.get_function("yaf_array_init_frame").unwrap(),
+                &[storage.into(), elem_kind_val.into(), len.into()],
+                "array_frame"
+            )
+        } else {
+            self.builder.build_call(
+                self.module.get_function("yaf_array_new").unwrap(),
+                &[elem_kind_val.into(), len.into()],
+                "array_new"
+            )
+        }.unwrap().try_as_basic_value().left().unwrap().into_pointer_value();
+        let object_int = self.builder.build_ptr_to_int(object, i64_type, "array_int").unwrap();
+        let array_val = self.yaf_value_type.const_named_struct(&[
+            self.context.i32_type().const_int(YAF_ARRAY, false).into(),
+            i64_type.const_zero().into(),
+        ]);
+        let array_val = self.builder.build_insert_value(array_val, object_int, 1, "array").unwrap()
+            .into_struct_value().into();
+        // Nothing sweeps a frame array; it only needs a root to keep boxed elements alive
+        if !in_frame || kind == ValueKind::Boxed {
+            self.root_temporary(array_val, elements);
+        }
+        
+        if kind == ValueKind::Boxed {
+            for element in elements {
+                let element_val = self.generate_expression(element)?;
+                self.builder.build_call(
+                    self.module.get_function("yaf_array_push").unwrap(),
+                    &[array_val.into(), element_val.into()],
+                    "array_push"
+                ).unwrap();
+            }
+        } else {
+            // Raw elements hold no references, so the length can be set once at the end
+            for (i, element) in elements.iter().enumerate() {
+                let element_val = self.generate_typed_expression(element)?;
+                let element_val = self.coerce(element_val, kind);
+                let element_ptr = self.array_element_ptr(object, i64_type.const_int(i as u64, false), kind);
+                self.builder.build_store(element_ptr, element_val.as_basic_value()).unwrap();
+            }
+            let length_ptr = self.builder.build_struct_gep(self.array_object_type(), object, ARRAY_LENGTH_FIELD, "length_ptr").unwrap();
+            self.builder.build_store(length_ptr, len).unwrap();
+        }
+        
+        Ok(TypedValue::Boxed(array_val))
+    }
+    
+    // Value stored into `name`: the array literals of frame array variables
+    // are built in the frame
+    fn generate_assigned_value(&mut self, name: &str, value: &Expression) -> Result<TypedValue<'ctx>> {
+        match value {
+            Expression::ArrayLiteral { elements } if self.frame_arrays.contains(name) && self.current_function.is_some() => {
+                self.generate_array_literal(value, elements, true)
+            },
+            _ => self.generate_typed_expression(value),
+        }
+    }
+    
+    // Operand read right away by print or a concatenation, which copy it:
+    // string conversions are formatted into frame storage
+    fn generate_consumed_expression(&mut self, expr: &Expression) -> Result<TypedValue<'ctx>> {
+        let (name, argument) = match expr {
+            Expression::BuiltinCall { name, arguments } | Expression::FunctionCall { name, arguments }
+                if escape::is_frame_string(expr) && self.current_function.is_some() => (name, &arguments[0]),
+            _ => return self.generate_typed_expression(expr),
+        };
+        let argument = self.generate_expression(argument)?;
+        let storage = self.create_frame_storage(FRAME_STRING_SIZE, "frame_string");
+        let function = if name == "str" { "yaf_value_to_string_frame" } else { "yaf_int_to_string_frame" };
+        Ok(TypedValue::Boxed(self.call_library_function(function, &[argument, storage.into()])?))
+    }
+    
+    // Inline arithmetic and comparisons on raw values. Mixed int/float operands
+    // are promoted to double, like the typechecker allows. None if the operand
+    // kinds don't support the operator (the boxed helpers then handle it).
+    fn build_typed_binary_op(&mut self, operator: &BinaryOperator, left: TypedValue<'ctx>, right: TypedValue<'ctx>) -> Option<TypedValue<'ctx>> {
+        let b = &self.builder;
+        match (left, right) {
+            (TypedValue::Int(l), TypedValue::Int(r)) => Some(match operator {
+                BinaryOperator::Add => TypedValue::Int(b.build_int_add(l, r, "add").unwrap()),
+                BinaryOperator::Subtract => TypedValue::Int(b.build_int_sub(l, r, "sub").unwrap()),
+                BinaryOperator::Multiply => TypedValue::Int(b.build_int_mul(l, r, "mul").unwrap()),
+                BinaryOperator::Divide => TypedValue::Int(self.build_int_division(l, r, false)),
+                BinaryOperator::Modulo => TypedValue::Int(self.build_int_division(l, r, true)),
+                _ => TypedValue::Bool(b.build_int_compare(Self::int_predicate(operator)?, l, r, "cmp").unwrap()),
+            }),
+            (TypedValue::Bool(l), TypedValue::Bool(r)) => {
+                let predicate = match operator {
+                    BinaryOperator::Equal => IntPredicate::EQ,
+                    BinaryOperator::NotEqual => IntPredicate::NE,
+                    _ => return None,
+                };
+                Some(TypedValue::Bool(b.build_int_compare(predicate, l, r, "cmp").unwrap()))
+            },
+            (TypedValue::Float(_), TypedValue::Float(_) | TypedValue::Int(_)) |
+            (TypedValue::Int(_), TypedValue::Float(_)) => {
+                let l = match self.coerce(left, ValueKind::Float) { TypedValue::Float(v) => v, _ => unreachable!() };
+                let r = match self.coerce(right, ValueKind::Float) { TypedValue::Float(v) => v, _ => unreachable!() };
+                let b = &self.builder;
+                Some(match operator {
+                    BinaryOperator::Add => TypedValue::Float(b.build_float_add(l, r, "fadd").unwrap()),
+                    BinaryOperator::Subtract => TypedValue::Float(b.build_float_sub(l, r, "fsub").unwrap()),
+                    BinaryOperator::Multiply => TypedValue::Float(b.build_float_mul(l, r, "fmul").unwrap()),
+                    BinaryOperator::Divide => TypedValue::Float(b.build_float_div(l, r, "fdiv").unwrap()),
+                    BinaryOperator::Modulo => TypedValue::Float(b.build_float_rem(l, r, "frem").unwrap()),
+                    _ => TypedValue::Bool(b.build_float_compare(Self::float_predicate(operator)?, l, r, "fcmp").unwrap()),
+                })
+            },
+            _ => None,
+        }
+    }
+    
+    // Integer `/` and `%` with the runtime's semantics: a zero divisor reports
+    // the error on a cold path, and a -1 divisor gives the wrapping negation
+    // (resp. 0) instead of the sdiv overflow on INT64_MIN
+    fn build_int_division(&self, l: IntValue<'ctx>, r: IntValue<'ctx>, remainder: bool) -> IntValue<'ctx> {
+        let i64_type = self.context.i64_type();
+        let function = self.builder.get_insert_block().unwrap().get_parent().unwrap();
+        let zero_block = self.context.append_basic_block(function, "div_by_zero");
+        let divide_block = self.context.append_basic_block(function, "div");
+        let is_zero = self.builder.build_int_compare(IntPredicate::EQ, r, i64_type.const_zero(), "divisor_zero").unwrap();
+        self.builder.build_conditional_branch(is_zero, zero_block, divide_block).unwrap();
+        
+        self.builder.position_at_end(zero_block);
+        let error_fn = self.module.get_function("yaf_division_by_zero").unwrap();
+        self.builder.build_call(error_fn, &[], "").unwrap();
+        self.builder.build_unreachable().unwrap();
+        
+        self.builder.position_at_end(divide_block);
+        let minus_one = self.builder.build_int_compare(IntPredicate::EQ, r, i64_type.const_all_ones(), "divisor_minus_one").unwrap();
+        let divisor = self.builder.build_select(minus_one, i64_type.const_int(1, false), r, "divisor").unwrap().into_int_value();
+        let (result, special) = if remainder {
+            (self.builder.build_int_signed_rem(l, divisor, "rem").unwrap(), i64_type.const_zero())
+        } else {
+            (self.builder.build_int_signed_div(l, divisor, "div").unwrap(), self.builder.build_int_sub(i64_type.const_zero(), l, "negated").unwrap())
+        };
+        self.builder.build_select(minus_one, special, result, if remainder { "rem_result" } else { "div_result" }).unwrap().into_int_value()
+    }
+    
+    fn int_predicate(operator: &BinaryOperator) -> Option<IntPredicate> {
+        Some(match operator {
+            BinaryOperator::Equal => IntPredicate::EQ,
+            BinaryOperator::NotEqual => IntPredicate::NE,
+            BinaryOperator::Less => IntPredicate::SLT,
+            BinaryOperator::LessEqual => IntPredicate::SLE,
+            BinaryOperator::Greater => IntPredicate::SGT,
+            BinaryOperator::GreaterEqual => IntPredicate::SGE,
+            _ => return None,
+        })
+    }
+    
+    fn float_predicate(operator: &BinaryOperator) -> Option<FloatPredicate> {
+        Some(match operator {
+            BinaryOperator::Equal => FloatPredicate::OEQ,
+            BinaryOperator::NotEqual => FloatPredicate::UNE,
+            BinaryOperator::Less => FloatPredicate::OLT,
+            BinaryOperator::LessEqual => FloatPredicate::OLE,
+            BinaryOperator::Greater => FloatPredicate::OGT,
+            BinaryOperator::GreaterEqual => FloatPredicate::OGE,
+            _ => return None,
+        })
+    }
+    
+    // length/push/pop on arrays. None if the call is not one of them (or
+    // length of something that is not statically an array).
+    fn generate_array_builtin(&mut self, name: &str, arguments: &[Expression]) -> Result<Option<TypedValue<'ctx>>> {
+        match name {
+            "length" => {
+                if arguments.len() != 1 || !matches!(self.static_type(&arguments[0]), Some(Type::Array(_))) {
+                    return Ok(None);
+                }
+                let array_val = self.generate_expression(&arguments[0])?;
+                let object = self.array_object_ptr(array_val);
+                let length = self.load_array_field(object, ARRAY_LENGTH_FIELD, "length").into_int_value();
+                Ok(Some(TypedValue::Int(length)))
+            },
+            "push" => {
+                if arguments.len() != 2 {
+                    return Err(anyhow!("push() expects 2 arguments, got {}", arguments.len()));
+                }
+                let array_val = self.generate_expression(&arguments[0])?;
+                self.root_temporary(array_val, &arguments[1..]);
+                if let Some(layout) = self.array_dense_kind(&arguments[0]) {
+                    let value = self.generate_typed_expression(&arguments[1])?;
+                    let value = self.coerce(value, layout.1);
+                    self.build_array_push(array_val, value, layout);
+                } else {
+                    let value = self.generate_expression(&arguments[1])?;
                     self.builder.build_call(
-                        set_fn,
-                        &[array_val.into(), index_val.into(), element_val.into()],
-                        "array_set"
+                        self.module.get_function("yaf_array_push").unwrap(),
+                        &[array_val.into(), value.into()],
+                        "array_push"
                     ).unwrap();
                 }
-                
-                Ok(array_val)
-            },
-            
-            Expression::ArrayAccess { array, index } => {
-                let array_val = self.generate_expression(array)?;
-                let index_val = self.generate_expression(index)?;
-                
-                let get_fn = self.module.get_function("yaf_array_get").unwrap();
-                let result = self.builder.build_call(
-                    get_fn,
-                    &[array_val.into(), index_val.into()],
-                    "array_get"
-                ).unwrap();
-                Ok(result.try_as_basic_value().left().unwrap())
+                Ok(Some(TypedValue::Boxed(self.yaf_value_type.const_zero().into())))
             },
-            
-            Expression::BuiltinCall { name, arguments } => {
-                self.generate_builtin_call(name, arguments)
+            "pop" => {
+                if arguments.len() != 1 {
+                    return Err(anyhow!("pop() expects 1 argument, got {}", arguments.len()));
+                }
+                let array_val = self.generate_expression(&arguments[0])?;
+                if let Some(layout) = self.array_dense_kind(&arguments[0]) {
+                    return Ok(Some(self.build_array_pop(array_val, layout)));
+                }
+                let result = self.call_library_function("yaf_array_pop", &[array_val])?;
+                Ok(Some(TypedValue::Boxed(result)))
             },
+            _ => Ok(None),
         }
     }
     
@@ -1478,6 +3460,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     return Err(anyhow!("max() expects 2 arguments, got {}", arguments.len()));
                 }
                 let arg1 = self.generate_expression(&arguments[0])?;
+                self.root_temporary(arg1, &arguments[1..]);
                 let arg2 = self.generate_expression(&arguments[1])?;
                 self.call_library_function("yaf_math_max", &[arg1, arg2])
             },
@@ -1486,6 +3469,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     return Err(anyhow!("min() expects 2 arguments, got {}", arguments.len()));
                 }
                 let arg1 = self.generate_expression(&arguments[0])?;
+                self.root_temporary(arg1, &arguments[1..]);
                 let arg2 = self.generate_expression(&arguments[1])?;
                 self.call_library_function("yaf_math_min", &[arg1, arg2])
             },
@@ -1494,6 +3478,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     return Err(anyhow!("pow() expects 2 arguments, got {}", arguments.len()));
                 }
                 let base = self.generate_expression(&arguments[0])?;
+                self.root_temporary(base, &arguments[1..]);
                 let exp = self.generate_expression(&arguments[1])?;
                 self.call_library_function("yaf_math_pow", &[base, exp])
             },
@@ -1520,15 +3505,52 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 let arg = self.generate_expression(&arguments[0])?;
                 self.call_library_function("yaf_string_lower", &[arg])
             },
+            "find" | "contains" => {
+                if arguments.len() != 2 {
+                    return Err(anyhow!("{}() expects 2 arguments, got {}", name, arguments.len()));
+                }
+                let haystack = self.generate_expression(&arguments[0])?;
+                self.root_temporary(haystack, &arguments[1..]);
+                let needle = self.generate_expression(&arguments[1])?;
+                self.call_library_function(&format!("yaf_string_{}", name), &[haystack, needle])
+            },
             "concat" => {
                 if arguments.len() != 2 {
                     return Err(anyhow!("concat() expects 2 arguments, got {}", arguments.len()));
                 }
                 let arg1 = self.generate_expression(&arguments[0])?;
+                self.root_temporary(arg1, &arguments[1..]);
                 let arg2 = self.generate_expression(&arguments[1])?;
                 self.call_library_function("yaf_string_concat", &[arg1, arg2])
             },
             
+            // Map functions
+            "map_get" | "map_has" | "map_delete" => {
+                if arguments.len() != 2 {
+                    return Err(anyhow!("{}() expects 2 arguments, got {}", name, arguments.len()));
+                }
+                let map = self.generate_expression(&arguments[0])?;
+                self.root_temporary(map, &arguments[1..]);
+                let key = self.generate_expression(&arguments[1])?;
+                self.call_library_function(&format!("yaf_{}", name), &[map, key])
+            },
+            "map_set" => {
+                if arguments.len() != 3 {
+                    return Err(anyhow!("map_set() expects 3 arguments, got {}", arguments.len()));
+                }
+                let map = self.generate_expression(&arguments[0])?;
+                self.root_temporary(map, &arguments[1..]);
+                let key = self.generate_expression(&arguments[1])?;
+                self.root_temporary(key, &arguments[2..]);
+                let value = self.generate_expression(&arguments[2])?;
+                self.builder.build_call(
+                    self.module.get_function("yaf_map_set").unwrap(),
+                    &[map.into(), key.into(), value.into()],
+                    "map_set"
+                ).unwrap();
+                Ok(self.yaf_value_type.const_zero().into())
+            },
+            
             // I/O functions
             "read_file" => {
                 if arguments.len() != 1 {
@@ -1542,6 +3564,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                     return Err(anyhow!("write_file() expects 2 arguments, got {}", arguments.len()));
                 }
                 let path = self.generate_expression(&arguments[0])?;
+                self.root_temporary(path, &arguments[1..]);
                 let content = self.generate_expression(&arguments[1])?;
                 self.call_library_function("yaf_io_write_file", &[path, content])
             },
@@ -1552,6 +3575,29 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 let arg = self.generate_expression(&arguments[0])?;
                 self.call_library_function("yaf_io_file_exists", &[arg])
             },
+            "open" | "read_line" | "eof" | "close" => {
+                if arguments.len() != 1 {
+                    return Err(anyhow!("{}() expects 1 argument, got {}", name, arguments.len()));
+                }
+                let arg = self.generate_expression(&arguments[0])?;
+                self.call_library_function(&format!("yaf_io_{}", name), &[arg])
+            },
+            "file_close" => {
+                if arguments.len() != 1 {
+                    return Err(anyhow!("file_close() expects 1 argument, got {}", arguments.len()));
+                }
+                let handle = self.generate_expression(&arguments[0])?;
+                self.call_library_function("yaf_io_close", &[handle])
+            },
+            "file_open" | "file_write" => {
+                if arguments.len() != 2 {
+                    return Err(anyhow!("{}() expects 2 arguments, got {}", name, arguments.len()));
+                }
+                let first = self.generate_expression(&arguments[0])?;
+                self.root_temporary(first, &arguments[1..]);
+                let second = self.generate_expression(&arguments[1])?;
+                self.call_library_function(&format!("yaf_io_{}", name), &[first, second])
+            },
             "input" => {
                 if !arguments.is_empty() {
                     return Err(anyhow!("input() expects no arguments, got {}", arguments.len()));
@@ -1566,6 +3612,14 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 self.call_library_function("yaf_io_input_prompt", &[prompt])
             },
             
+            "flush" => {
+                if !arguments.is_empty() {
+                    return Err(anyhow!("flush() expects no arguments, got {}", arguments.len()));
+                }
+                self.builder.build_call(self.module.get_function("yaf_flush").unwrap(), &[], "flush").unwrap();
+                Ok(self.yaf_value_type.const_zero().into())
+            },
+            
             // Time functions
             "now" => {
                 if !arguments.is_empty() {
@@ -1579,12 +3633,52 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 }
                 self.call_library_function("yaf_time_now_millis", &[])
             },
-            "sleep" => {
+            "now_nanos" | "clock_monotonic" => {
+                if !arguments.is_empty() {
+                    return Err(anyhow!("{}() expects no arguments, got {}", name, arguments.len()));
+                }
+                self.call_library_function("yaf_time_now_nanos", &[])
+            },
+            "sleep" | "sleep_ms" => {
+                if arguments.len() != 1 {
+                    return Err(anyhow!("{}() expects 1 argument, got {}", name, arguments.len()));
+                }
+                let arg = self.generate_expression(&arguments[0])?;
+                self.call_library_function(&format!("yaf_time_{}", name), &[arg])
+            },
+            "black_box" => {
                 if arguments.len() != 1 {
-                    return Err(anyhow!("sleep() expects 1 argument, got {}", arguments.len()));
+                    return Err(anyhow!("black_box() expects 1 argument, got {}", arguments.len()));
                 }
                 let arg = self.generate_expression(&arguments[0])?;
-                self.call_library_function("yaf_time_sleep", &[arg])
+                self.call_library_function("yaf_black_box", &[arg])
+            },
+            "memory_stats" => {
+                if !arguments.is_empty() {
+                    return Err(anyhow!("memory_stats() expects no arguments, got {}", arguments.len()));
+                }
+                self.call_library_function("yaf_memory_stats_map", &[])
+            },
+            
+            // Network functions
+            "http_get" | "http_post" | "http_get_all" | "http_status_all" | "tcp_connect_all" | "tcp_request" => {
+                let arity = match name {
+                    "http_get" | "http_get_all" => 1,
+                    "tcp_request" => 3,
+                    _ => 2,
+                };
+                if arguments.len() != arity {
+                    return Err(anyhow!(
+                        "{}() expects {} argument{}, got {}", name, arity, if arity == 1 { "" } else { "s" }, arguments.len()
+                    ));
+                }
+                let mut args = Vec::with_capacity(arity);
+                for (index, argument) in arguments.iter().enumerate() {
+                    let arg = self.generate_expression(argument)?;
+                    self.root_temporary(arg, &arguments[index + 1..]);
+                    args.push(arg);
+                }
+                self.call_library_function(&format!("yaf_net_{}", name), &args)
             },
             
             // Type conversion functions
@@ -1659,7 +3753,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let param = function.get_nth_param(0).unwrap().into_struct_value();
         let type_val = self.builder.build_extract_value(param, 0, "type").unwrap().into_int_value();
         
-        // Only free strings, other types don't need it
+        // Only free heap strings; other types (inline strings included) own nothing
         let is_string = self.builder.build_int_compare(
             inkwell::IntPredicate::EQ,
             type_val,
@@ -1669,7 +3763,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         
         self.builder.build_conditional_branch(is_string, string_block, end_block).unwrap();
         
-        // String case - free the allocated memory
+        // String case - drop one reference, the runtime frees it at zero
         self.builder.position_at_end(string_block);
         let data_val = self.builder.build_extract_value(param, 1, "data").unwrap().into_int_value();
         let ptr_val = self.builder.build_int_to_ptr(
@@ -1678,8 +3772,8 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
             "int_to_ptr"
         ).unwrap();
         
-        let free_fn = self.module.get_function("free").unwrap();
-        self.builder.build_call(free_fn, &[ptr_val.into()], "free_call").unwrap();
+        let release_fn = self.module.get_function("yaf_string_release").unwrap();
+        self.builder.build_call(release_fn, &[ptr_val.into()], "release_call").unwrap();
         self.builder.build_unconditional_branch(end_block).unwrap();
         
         // End
@@ -1695,7 +3789,6 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         
         let entry_block = self.context.append_basic_block(function, "entry");
         let string_block = self.context.append_basic_block(function, "string_case");
-        let other_block = self.context.append_basic_block(function, "other_case");
         let end_block = self.context.append_basic_block(function, "end");
         
         self.builder.position_at_end(entry_block);
@@ -1703,7 +3796,7 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let param = function.get_nth_param(0).unwrap().into_struct_value();
         let type_val = self.builder.build_extract_value(param, 0, "type").unwrap().into_int_value();
         
-        // Check if it's a string
+        // Check if it's a heap string; inline strings are copied with the value
         let is_string = self.builder.build_int_compare(
             inkwell::IntPredicate::EQ,
             type_val,
@@ -1711,9 +3804,9 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
             "is_string"
         ).unwrap();
         
-        self.builder.build_conditional_branch(is_string, string_block, other_block).unwrap();
+        self.builder.build_conditional_branch(is_string, string_block, end_block).unwrap();
         
-        // String case - create a new copy
+        // String case - strings are immutable, so a copy is just a refcount bump
         self.builder.position_at_end(string_block);
         let data_val = self.builder.build_extract_value(param, 1, "data").unwrap().into_int_value();
         let ptr_val = self.builder.build_int_to_ptr(
@@ -1722,250 +3815,13 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
             "int_to_ptr"
         ).unwrap();
         
-        let strdup_fn = self.module.get_function("strdup").unwrap();
-        let copied_str = self.builder.build_call(
-            strdup_fn,
-            &[ptr_val.into()],
-            "copied_str"
-        ).unwrap().try_as_basic_value().left().unwrap().into_pointer_value();
-        
-        let new_ptr_as_int = self.builder.build_ptr_to_int(
-            copied_str, 
-            self.context.i64_type(), 
-            "new_ptr_to_int"
-        ).unwrap();
-        
-        let new_struct = self.builder.build_insert_value(
-            param,
-            new_ptr_as_int,
-            1,
-            "new_data"
-        ).unwrap();
-        
-        self.builder.build_unconditional_branch(end_block).unwrap();
-        
-        // Other types - just return as-is (no deep copying needed)
-        self.builder.position_at_end(other_block);
+        let retain_fn = self.module.get_function("yaf_string_retain").unwrap();
+        self.builder.build_call(retain_fn, &[ptr_val.into()], "retain_call").unwrap();
         self.builder.build_unconditional_branch(end_block).unwrap();
         
-        // End - phi node to select the right value
+        // End - the value itself is returned unchanged
         self.builder.position_at_end(end_block);
-        let phi = self.builder.build_phi(self.yaf_value_type, "result").unwrap();
-        phi.add_incoming(&[(&new_struct, string_block), (&param, other_block)]);
-        
-        self.builder.build_return(Some(&phi.as_basic_value())).unwrap();
-        
-        Ok(())
-    }
-    
-    fn generate_yaf_make_array(&mut self) -> Result<()> {
-        let i64_type = self.context.i64_type();
-        let fn_type = self.yaf_value_type.fn_type(&[i64_type.into()], false);
-        let function = self.module.add_function("yaf_make_array", fn_type, None);
-        
-        let basic_block = self.context.append_basic_block(function, "entry");
-        self.builder.position_at_end(basic_block);
-        
-        let length_param = function.get_nth_param(0).unwrap().into_int_value();
-        
-        // Allocate memory for array: sizeof(YafValue) * length + sizeof(i64) for length
-        let value_size = self.yaf_value_type.size_of().unwrap();
-        let total_size = self.builder.build_int_mul(
-            value_size, 
-            length_param, 
-            "total_size"
-        ).unwrap();
-        let length_size = i64_type.const_int(8, false); // sizeof(i64) = 8 bytes
-        let final_size = self.builder.build_int_add(
-            total_size, 
-            length_size, 
-            "final_size"
-        ).unwrap();
-        
-        // Allocate memory
-        let malloc_fn = self.module.get_function("malloc").unwrap();
-        let ptr = self.builder.build_call(
-            malloc_fn,
-            &[final_size.into()],
-            "array_ptr"
-        ).unwrap().try_as_basic_value().left().unwrap().into_pointer_value();
-        
-        // Store length at the beginning
-        let length_ptr = self.builder.build_pointer_cast(
-            ptr,
-            self.context.ptr_type(AddressSpace::default()),
-            "length_ptr"
-        ).unwrap();
-        self.builder.build_store(length_ptr, length_param).unwrap();
-        
-        // Register with GC (if available)
-        if let Some(gc_register) = self.module.get_function("yaf_gc_register") {
-            self.builder.build_call(
-                gc_register,
-                &[ptr.into()],
-                "gc_register"
-            ).unwrap();
-        }
-        
-        // Convert pointer to int for YafValue
-        let ptr_as_int = self.builder.build_ptr_to_int(
-            ptr,
-            i64_type,
-            "ptr_as_int"
-        ).unwrap();
-        
-        // Create YafValue struct
-        let struct_val = self.yaf_value_type.get_undef();
-        let struct_val = self.builder.build_insert_value(
-            struct_val,
-            self.context.i32_type().const_int(3, false), // YAF_ARRAY = 3
-            0,
-            "type_field"
-        ).unwrap();
-        let struct_val = self.builder.build_insert_value(
-            struct_val,
-            ptr_as_int,
-            1,
-            "data_field"
-        ).unwrap();
-        
-        self.builder.build_return(Some(&struct_val)).unwrap();
-        Ok(())
-    }
-    
-    fn generate_yaf_array_get(&mut self) -> Result<()> {
-        let i64_type = self.context.i64_type();
-        let fn_type = self.yaf_value_type.fn_type(&[self.yaf_value_type.into(), self.yaf_value_type.into()], false);
-        let function = self.module.add_function("yaf_array_get", fn_type, None);
-        
-        let basic_block = self.context.append_basic_block(function, "entry");
-        self.builder.position_at_end(basic_block);
-        
-        let array_param = function.get_nth_param(0).unwrap().into_struct_value();
-        let index_param = function.get_nth_param(1).unwrap().into_struct_value();
-        
-        // Extract array pointer
-        let array_data = self.builder.build_extract_value(array_param, 1, "array_data").unwrap().into_int_value();
-        let array_ptr = self.builder.build_int_to_ptr(
-            array_data,
-            self.context.ptr_type(AddressSpace::default()),
-            "array_ptr"
-        ).unwrap();
-        
-        // Extract index (assume it's an int)
-        let index_data = self.builder.build_extract_value(index_param, 1, "index_data").unwrap().into_int_value();
-        
-        // Get pointer to length (first i64)
-        let _length_ptr = self.builder.build_pointer_cast(
-            array_ptr,
-            self.context.ptr_type(AddressSpace::default()),
-            "length_ptr"
-        ).unwrap();
-        
-        // Calculate offset to data: ptr + sizeof(i64) + index * sizeof(YafValue)
-        let data_start_offset = i64_type.const_int(8, false); // sizeof(i64) = 8 bytes
-        let value_size = self.yaf_value_type.size_of().unwrap();
-        let index_offset = self.builder.build_int_mul(
-            index_data,
-            value_size,
-            "index_offset"
-        ).unwrap();
-        let total_offset = self.builder.build_int_add(
-            data_start_offset,
-            index_offset,
-            "total_offset"
-        ).unwrap();
-        
-        // Calculate final address
-        let base_as_int = self.builder.build_ptr_to_int(
-            array_ptr,
-            i64_type,
-            "base_as_int"
-        ).unwrap();
-        let final_addr = self.builder.build_int_add(
-            base_as_int,
-            total_offset,
-            "final_addr"
-        ).unwrap();
-        let element_ptr = self.builder.build_int_to_ptr(
-            final_addr,
-            self.context.ptr_type(AddressSpace::default()),
-            "element_ptr"
-        ).unwrap();
-        
-        // Load and return the element
-        let element = self.builder.build_load(
-            self.yaf_value_type,
-            element_ptr,
-            "element"
-        ).unwrap();
-        
-        self.builder.build_return(Some(&element)).unwrap();
-        Ok(())
-    }
-    
-    fn generate_yaf_array_set(&mut self) -> Result<()> {
-        let i64_type = self.context.i64_type();
-        let void_type = self.context.void_type();
-        let fn_type = void_type.fn_type(&[
-            self.yaf_value_type.into(),
-            self.yaf_value_type.into(),
-            self.yaf_value_type.into()
-        ], false);
-        let function = self.module.add_function("yaf_array_set", fn_type, None);
-        
-        let basic_block = self.context.append_basic_block(function, "entry");
-        self.builder.position_at_end(basic_block);
-        
-        let array_param = function.get_nth_param(0).unwrap().into_struct_value();
-        let index_param = function.get_nth_param(1).unwrap().into_struct_value();
-        let value_param = function.get_nth_param(2).unwrap().into_struct_value();
-        
-        // Extract array pointer
-        let array_data = self.builder.build_extract_value(array_param, 1, "array_data").unwrap().into_int_value();
-        let array_ptr = self.builder.build_int_to_ptr(
-            array_data,
-            self.context.ptr_type(AddressSpace::default()),
-            "array_ptr"
-        ).unwrap();
-        
-        // Extract index
-        let index_data = self.builder.build_extract_value(index_param, 1, "index_data").unwrap().into_int_value();
-        
-        // Calculate offset to element: ptr + sizeof(i64) + index * sizeof(YafValue)
-        let data_start_offset = i64_type.const_int(8, false); // sizeof(i64) = 8 bytes
-        let value_size = self.yaf_value_type.size_of().unwrap();
-        let index_offset = self.builder.build_int_mul(
-            index_data,
-            value_size,
-            "index_offset"
-        ).unwrap();
-        let total_offset = self.builder.build_int_add(
-            data_start_offset,
-            index_offset,
-            "total_offset"
-        ).unwrap();
-        
-        // Calculate final address
-        let base_as_int = self.builder.build_ptr_to_int(
-            array_ptr,
-            i64_type,
-            "base_as_int"
-        ).unwrap();
-        let final_addr = self.builder.build_int_add(
-            base_as_int,
-            total_offset,
-            "final_addr"
-        ).unwrap();
-        let element_ptr = self.builder.build_int_to_ptr(
-            final_addr,
-            self.context.ptr_type(AddressSpace::default()),
-            "element_ptr"
-        ).unwrap();
-        
-        // Store the value
-        self.builder.build_store(element_ptr, value_param).unwrap();
-        self.builder.build_return(None).unwrap();
+        self.builder.build_return(Some(&param)).unwrap();
         
         Ok(())
     }
@@ -1974,7 +3830,16 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         // Generate cleanup code to free any remaining allocated memory
         // This helps prevent memory leaks on program exit
         
-        // Add a call to cleanup all remaining GC roots
+        // Buffered output must be written before main returns: under the JIT
+        // the process keeps running, so the runtime's atexit hook is not enough
+        let flush_fn = self.module.get_function("yaf_flush").unwrap();
+        self.builder.build_call(flush_fn, &[], "flush_output").unwrap();
+        
+        // Add a call to cleanup all remaining GC roots; the heap of a REPL
+        // entry holds the session's values
+        if self.session.is_some() {
+            return Ok(());
+        }
         if let Some(gc_final_cleanup) = self.module.get_function("yaf_gc_final_cleanup") {
             self.builder.build_call(
                 gc_final_cleanup,
@@ -1989,6 +3854,19 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
     fn generate_memory_pool_functions(&mut self) -> Result<()> {
         let void_type = self.context.void_type();
         let i64_type = self.context.i64_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        
+        // yaf_alloc(size: i64) -> ptr - bump-pointer nursery allocation
+        let alloc_type = ptr_type.fn_type(&[i64_type.into()], false);
+        self.module.add_function("yaf_alloc", alloc_type, None);
+        
+        // yaf_dealloc(ptr, size: i64) - return a block to its size-class free list
+        let dealloc_type = void_type.fn_type(&[ptr_type.into(), i64_type.into()], false);
+        self.module.add_function("yaf_dealloc", dealloc_type, None);
+        
+        // yaf_gc_alloc(size: i64, kind: i32) -> ptr - object tracked by the collector
+        let gc_alloc_type = ptr_type.fn_type(&[i64_type.into(), self.context.i32_type().into()], false);
+        self.module.add_function("yaf_gc_alloc", gc_alloc_type, None);
         
         // yaf_gc_final_cleanup() - cleanup all memory before exit
         let final_cleanup_type = void_type.fn_type(&[], false);
@@ -2025,6 +3903,14 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let gc_remove_root_type = void_type.fn_type(&[i64_type.into()], false);
         self.module.add_function("yaf_gc_remove_root", gc_remove_root_type, None);
         
+        // yaf_gc_root_depth() -> i64 - root stack depth, saved at function entry
+        let gc_root_depth_type = i64_type.fn_type(&[], false);
+        self.module.add_function("yaf_gc_root_depth", gc_root_depth_type, None);
+        
+        // yaf_gc_unwind_roots(depth: i64) - pop the roots of a returning frame
+        let gc_unwind_roots_type = void_type.fn_type(&[i64_type.into()], false);
+        self.module.add_function("yaf_gc_unwind_roots", gc_unwind_roots_type, None);
+        
         // yaf_gc_collect() -> i64 (returns bytes freed)
         let gc_collect_type = i64_type.fn_type(&[], false);
         self.module.add_function("yaf_gc_collect", gc_collect_type, None);
@@ -2033,70 +3919,130 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         let gc_collect_if_needed_type = i64_type.fn_type(&[], false);
         self.module.add_function("yaf_gc_collect_if_needed", gc_collect_if_needed_type, None);
         
+        // yaf_division_by_zero(): reports the error and exits, see build_int_division
+        let division_error = self.module.add_function("yaf_division_by_zero", self.context.void_type().fn_type(&[], false), None);
+        for name in ["noreturn", "cold", "nounwind"] {
+            let attribute = self.context.create_enum_attribute(Attribute::get_named_enum_kind_id(name), 0);
+            division_error.add_attribute(AttributeLoc::Function, attribute);
+        }
+        
         Ok(())
     }
     
-    pub fn optimize_module(&self) -> Result<()> {
-        // For now, we implement basic optimizations manually
-        // Future versions can use LLVM's pass infrastructure when available
-        
-        match self.optimization_level {
-            OptimizationLevel::None => {
-                // No optimizations for debug builds
-                println!("LLVM Optimization: None (debug mode)");
-            },
-            OptimizationLevel::Less => {
-                println!("LLVM Optimization: Basic optimizations enabled");
-                // Basic optimizations would be implemented here
-                self.perform_constant_folding()?;
-            },
-            OptimizationLevel::Default => {
-                println!("LLVM Optimization: Standard optimizations enabled");  
-                // Standard optimizations
-                self.perform_constant_folding()?;
-                self.perform_dead_code_elimination()?;
-            },
-            OptimizationLevel::Aggressive => {
-                println!("LLVM Optimization: Aggressive optimizations enabled");
-                // All optimizations
-                self.perform_constant_folding()?;
-                self.perform_dead_code_elimination()?;
-                self.perform_function_inlining()?;
-            },
+    /// Merges the runtime bitcode (runtime/yaf_runtime.c built with
+    /// `clang -emit-llvm`) into the module for --lto. Everything except `main`
+    /// becomes internal, so the optimizer can inline runtime code into the
+    /// program and drop whatever is unused.
+    pub fn link_runtime_bitcode(&self, bitcode_path: &Path) -> Result<()> {
+        let runtime = Module::parse_bitcode_from_path(bitcode_path, self.context)
+            .map_err(|e| anyhow!("Could not load runtime bitcode {}: {}", bitcode_path.display(), e))?;
+        
+        // Same target as the runtime, so the linker doesn't mix layouts
+        let target_machine = self.create_target_machine()?;
+        self.module.set_triple(&target_machine.get_triple());
+        self.module.set_data_layout(&target_machine.get_target_data().get_data_layout());
+        
+        self.module
+            .link_in_module(runtime)
+            .map_err(|e| anyhow!("Could not link runtime bitcode: {}", e))?;
+        
+        for function in self.module.get_functions() {
+            if function.count_basic_blocks() > 0 && function.get_name().to_bytes() != b"main" {
+                function.set_linkage(Linkage::Internal);
+            }
+        }
+        for global in self.module.get_globals() {
+            let is_intrinsic = global.get_name().to_bytes().starts_with(b"llvm.");
+            if !global.is_declaration() && !is_intrinsic && global.get_linkage() != Linkage::Private {
+                global.set_linkage(Linkage::Internal);
+            }
         }
         
         Ok(())
     }
     
-    fn perform_constant_folding(&self) -> Result<()> {
-        // Simple constant folding - in a real implementation this would
-        // traverse the IR and fold constant expressions
-        println!("  - Constant folding applied");
-        Ok(())
+    /// Runs `main` in this process with LLVM's JIT. `runtime_library` is
+    /// runtime/yaf_runtime.c built as a shared library; once loaded, the
+    /// engine resolves the runtime symbols from the process.
+    pub fn run_jit(&self, runtime_library: &Path, args: &[String]) -> Result<i32> {
+        Self::load_jit_runtime(runtime_library)?;
+        let engine = self.module
+            .create_jit_execution_engine(self.optimization_level)
+            .map_err(|e| anyhow!("Could not create JIT execution engine: {}", e))?;
+        
+        let main = self.module.get_function("main")
+            .ok_or_else(|| anyhow!("Program has no main function"))?;
+        let args: Vec<&str> = args.iter().map(String::as_str).collect();
+        let exit_code = unsafe { engine.run_function_as_main(main, &args) };
+        
+        Ok(exit_code)
     }
     
-    fn perform_dead_code_elimination(&self) -> Result<()> {
-        // Dead code elimination - remove unreachable code
-        println!("  - Dead code elimination applied");
-        Ok(())
+    fn load_jit_runtime(runtime_library: &Path) -> Result<()> {
+        // load_library_permanently reports failure by returning true
+        if load_library_permanently(runtime_library) {
+            return Err(anyhow!("Could not load YAF runtime library {}", runtime_library.display()));
+        }
+        
+        Target::initialize_native(&InitializationConfig::default())
+            .map_err(|e| anyhow!("Could not initialize native target: {}", e))
     }
     
-    fn perform_function_inlining(&self) -> Result<()> {
-        // Function inlining for small functions
-        println!("  - Function inlining applied");
+    // yaf_repl_entry(ptr out): runs main under yaf_run_guarded, saves the
+    // bits of `globals` to out[2 * i] and out[2 * i + 1] and returns main's
+    // status (1 after a runtime error)
+    fn build_session_entry(&self, globals: &[(String, Variable<'ctx>)]) -> Result<()> {
+        let i32_type = self.context.i32_type();
+        let i64_type = self.context.i64_type();
+        let ptr_type = self.context.ptr_type(AddressSpace::default());
+        
+        let main = self.module.get_function("main")
+            .ok_or_else(|| anyhow!("Program has no main function"))?;
+        let guarded = self.module.add_function("yaf_run_guarded", i32_type.fn_type(&[ptr_type.into()], false), None);
+        let entry = self.module.add_function("yaf_repl_entry", i32_type.fn_type(&[ptr_type.into()], false), None);
+        self.builder.position_at_end(self.context.append_basic_block(entry, "entry"));
+        
+        let status = self.builder.build_call(guarded, &[main.as_global_value().as_pointer_value().into()], "status")
+            .unwrap().try_as_basic_value().left().unwrap();
+        let out = entry.get_nth_param(0).unwrap().into_pointer_value();
+        for (i, (name, variable)) in globals.iter().enumerate() {
+            let value = self.builder.build_load(self.llvm_type_of(variable.kind), variable.ptr, name).unwrap();
+            let (tag, bits) = match variable.kind {
+                ValueKind::Int => (i64_type.const_zero(), value.into_int_value()),
+                ValueKind::Bool => (i64_type.const_zero(), self.builder.build_int_z_extend(value.into_int_value(), i64_type, "bits").unwrap()),
+                ValueKind::Float => (i64_type.const_zero(), self.builder.build_bit_cast(value, i64_type, "bits").unwrap().into_int_value()),
+                ValueKind::Boxed => {
+                    let value = value.into_struct_value();
+                    let tag = self.builder.build_extract_value(value, 0, "tag").unwrap().into_int_value();
+                    let tag = self.builder.build_int_z_extend(tag, i64_type, "tag").unwrap();
+                    (tag, self.builder.build_extract_value(value, 1, "bits").unwrap().into_int_value())
+                },
+            };
+            for (j, word) in [tag, bits].into_iter().enumerate() {
+                let slot = unsafe {
+                    self.builder.build_in_bounds_gep(i64_type, out, &[i64_type.const_int((2 * i + j) as u64, false)], "slot").unwrap()
+                };
+                self.builder.build_store(slot, word).unwrap();
+            }
+        }
+        self.builder.build_return(Some(&status)).unwrap();
         Ok(())
     }
     
-    pub fn emit_to_file(&self, output_path: &Path) -> Result<()> {
-        // Run optimizations before emitting
-        self.optimize_module()?;
-        
-        Target::initialize_all(&InitializationConfig::default());
+    /// Registers every LLVM target, once per process. Registration is not
+    /// thread-safe, so `yaf build` calls this before its compile threads start.
+    pub fn initialize_targets() {
+        static TARGETS: Once = Once::new();
+        TARGETS.call_once(|| Target::initialize_all(&InitializationConfig::default()));
+    }
+    
+    fn create_target_machine(&self) -> Result<TargetMachine> {
+        Self::initialize_targets();
         
         let target_triple = TargetMachine::get_default_triple();
         let target = Target::from_triple(&target_triple).map_err(|e| anyhow!("Target error: {}", e))?;
         
-        let target_machine = target
+        target
             .create_target_machine(
                 &target_triple,
                 "generic",
@@ -2105,7 +4051,39 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
                 RelocMode::Default,
                 CodeModel::Default,
             )
-            .ok_or_else(|| anyhow!("Could not create target machine"))?;
+            .ok_or_else(|| anyhow!("Could not create target machine"))
+    }
+    
+    // Pipeline of the new pass manager matching the -O level
+    fn pass_pipeline(&self) -> &'static str {
+        match self.optimization_level {
+            OptimizationLevel::None => "default<O0>",
+            OptimizationLevel::Less => "default<O1>",
+            OptimizationLevel::Default => "default<O2>",
+            OptimizationLevel::Aggressive => "default<O3>",
+        }
+    }
+    
+    /// Runs the LLVM optimization pipeline on the module. Call it once after
+    /// `verify` and before `emit_llvm_ir`/`emit_to_file`.
+    pub fn optimize_module(&self) -> Result<()> {
+        let target_machine = self.create_target_machine()?;
+        self.module.set_triple(&target_machine.get_triple());
+        self.module.set_data_layout(&target_machine.get_target_data().get_data_layout());
+        
+        let options = PassBuilderOptions::create();
+        let vectorize = matches!(self.optimization_level, OptimizationLevel::Default | OptimizationLevel::Aggressive);
+        options.set_loop_vectorization(vectorize);
+        options.set_loop_slp_vectorization(vectorize);
+        options.set_loop_unrolling(self.optimization_level != OptimizationLevel::None);
+        
+        self.module
+            .run_passes(self.pass_pipeline(), &target_machine, options)
+            .map_err(|e| anyhow!("LLVM optimization failed: {}", e))
+    }
+    
+    pub fn emit_to_file(&self, output_path: &Path) -> Result<()> {
+        let target_machine = self.create_target_machine()?;
         
         target_machine
             .write_to_file(&self.module, FileType::Object, output_path)
@@ -2114,6 +4092,14 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         Ok(())
     }
     
+    /// Writes the module as bitcode, for clang to compile (see crate::pgo)
+    pub fn emit_bitcode(&self, output_path: &Path) -> Result<()> {
+        if !self.module.write_bitcode_to_path(output_path) {
+            return Err(anyhow!("Could not write bitcode to {}", output_path.display()));
+        }
+        Ok(())
+    }
+    
     pub fn emit_llvm_ir(&self) -> String {
         self.module.print_to_string().to_string()
     }
@@ -2124,4 +4110,151 @@ impl<'ctx> LLVMCodeGenerator<'ctx> {
         }
         Ok(())
     }
-}
\ No newline at end of file
+}
+
+impl LLVMCodeGenerator<'static> {
+    /// Runs main as the next entry of `session` (see `continue_session`) and
+    /// returns its status. The variables it leaves become the session's; after
+    /// a runtime error only those of earlier entries are kept, with the
+    /// values the entry gave them.
+    pub fn run_session_entry(&self, runtime_library: &Path, session: &mut JitSession) -> Result<i32> {
+        Self::load_jit_runtime(runtime_library)?;
+        
+        let mut globals: Vec<(String, Variable<'static>)> = self.global_variables.iter()
+            .map(|(name, variable)| (name.clone(), variable.clone()))
+            .collect();
+        globals.sort_by(|a, b| a.0.cmp(&b.0));
+        self.build_session_entry(&globals)?;
+        
+        let engine = self.module
+            .create_jit_execution_engine(self.optimization_level)
+            .map_err(|e| anyhow!("Could not create JIT execution engine: {}", e))?;
+        let address = engine.get_function_address("yaf_repl_entry")
+            .map_err(|e| anyhow!("Could not find the REPL entry: {}", e))?;
+        let entry: unsafe extern "C" fn(*mut u64) -> i32 = unsafe { std::mem::transmute(address) };
+        
+        let mut bits = vec![0u64; 2 * globals.len()];
+        let status = unsafe { entry(bits.as_mut_ptr()) };
+        
+        for ((name, variable), bits) in globals.into_iter().zip(bits.chunks(2)) {
+            if status != 0 && !session.globals.contains_key(&name) {
+                continue;
+            }
+            session.globals.insert(name, SessionGlobal { kind: variable.kind, ty: variable.ty, bits: [bits[0], bits[1]] });
+        }
+        session.engines.push(engine);
+        Ok(status)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::core::{Lexer, Parser, TypeChecker};
+    
+    fn parse(source: &str) -> Program {
+        let tokens = Lexer::new(source).tokenize().expect("lexes");
+        let program = Parser::new(tokens).parse().expect("parses");
+        TypeChecker::new().check(&program).expect("type checks");
+        program
+    }
+    
+    // The definition of user function `name` in the module text
+    fn function_ir<'a>(ir: &'a str, name: &str) -> &'a str {
+        let signature = format!("@yaf_func_{}(", name);
+        let (start, _) = ir.match_indices("define ")
+            .find(|(at, _)| ir[*at..].lines().next().unwrap().contains(&signature))
+            .expect("function is defined");
+        let body = &ir[start..];
+        &body[..body.find("\n}").unwrap()]
+    }
+    
+    #[test]
+    fn string_equality_is_not_merged_across_a_store() {
+        let program = parse(r#"
+func main() {
+    names = ["a", "b"]
+    before = names[0] == "b"
+    names[0] = "b"
+    after = names[0] == "b"
+    if before != after {
+        print("value changed")
+    }
+}
+"#);
+        let context = Context::create();
+        let mut codegen = LLVMCodeGenerator::new(&context, "test", OptimizationLevel::Aggressive);
+        codegen.generate(&program).expect("generates");
+        
+        let memory = Attribute::get_named_enum_kind_id("memory");
+        for name in ["yaf_eq", "yaf_ne"] {
+            let function = codegen.module.get_function(name).expect("helper exists");
+            let effects = function.get_enum_attribute(AttributeLoc::Function, memory)
+                .map(|attribute| attribute.get_enum_value());
+            assert_eq!(effects, Some(MEMORY_READ), "{} reads the strings it compares", name);
+        }
+        
+        // Folding the second comparison into the first would make the
+        // branch dead and drop its string
+        codegen.verify().expect("verifies");
+        codegen.optimize_module().expect("optimizes");
+        assert!(codegen.emit_llvm_ir().contains("value changed"));
+    }
+    
+    #[test]
+    fn the_right_operand_of_and_only_runs_when_needed() {
+        let program = parse(r#"
+func fails(n: int) -> bool {
+    return 1 / n > 0
+}
+
+func check(n: int) -> bool {
+    return n > 0 && fails(0)
+}
+
+func main() {
+    print(check(-1))
+}
+"#);
+        let context = Context::create();
+        let mut codegen = LLVMCodeGenerator::new(&context, "test", OptimizationLevel::None);
+        codegen.generate(&program).expect("generates");
+        codegen.verify().expect("verifies");
+        
+        let ir = codegen.emit_llvm_ir();
+        let check = function_ir(&ir, "check");
+        let branch = check.find("logic_right:").expect("the right operand has its own block");
+        let call = check.find("@yaf_func_fails(").expect("check calls fails");
+        assert!(branch < call, "{}", check);
+    }
+    
+    #[test]
+    fn typed_integer_division_checks_its_divisor() {
+        let program = parse(r#"
+func quotient(a: int, b: int) -> int {
+    return a / b + a % b
+}
+
+func main() {
+    print(quotient(7, 2))
+}
+"#);
+        let context = Context::create();
+        let mut codegen = LLVMCodeGenerator::new(&context, "test", OptimizationLevel::None);
+        codegen.generate(&program).expect("generates");
+        codegen.verify().expect("verifies");
+        
+        let ir = codegen.emit_llvm_ir();
+        let quotient = function_ir(&ir, "quotient");
+        assert_eq!(quotient.matches("call void @yaf_division_by_zero()").count(), 2, "{}", quotient);
+        // A -1 divisor never reaches the sdiv/srem
+        assert!(quotient.contains("%divisor_minus_one = icmp eq i64"), "{}", quotient);
+        
+        // The boxed helpers divide the same way and may trap, so they can't be memory(none)
+        let memory = Attribute::get_named_enum_kind_id("memory");
+        for name in ["yaf_div", "yaf_mod"] {
+            let function = codegen.module.get_function(name).expect("helper exists");
+            assert!(function.get_enum_attribute(AttributeLoc::Function, memory).is_none(), "{} may trap", name);
+        }
+    }
+}
@@ -0,0 +1,203 @@
+//! # Benchmark harness
+//!
+//! `yaf bench` runs the `@bench` functions of a program. The program is
+//! compiled once with a generated main: after the original top-level code,
+//! each benchmark is warmed up and then timed in batches with `now_nanos()`,
+//! printing one tagged line per sample. The driver parses those lines and
+//! reports median, p99 and standard deviation per call.
+
+use crate::core::ast::*;
+use crate::runtime::values::Value;
+use anyhow::{Result, anyhow};
+
+/// Prefix of the sample lines printed by the harness
+pub const SAMPLE_TAG: &str = "@@yaf-bench";
+
+/// Time a batch of calls should take, so the timer cost stays negligible
+const TARGET_BATCH_NANOS: i64 = 1_000_000;
+
+/// Summary of the per-call times of one benchmark, in nanoseconds
+pub struct BenchStats {
+    pub samples: usize,
+    pub median: f64,
+    pub p99: f64,
+    pub mean: f64,
+    pub stddev: f64,
+    pub min: f64,
+}
+
+impl BenchStats {
+    pub fn from_samples(mut samples: Vec<f64>) -> Option<BenchStats> {
+        if samples.is_empty() {
+            return None;
+        }
+        samples.sort_by(|a, b| a.partial_cmp(b).unwrap_or(std::cmp::Ordering::Equal));
+
+        let n = samples.len();
+        let median = if n % 2 == 1 {
+            samples[n / 2]
+        } else {
+            (samples[n / 2 - 1] + samples[n / 2]) / 2.0
+        };
+        // Nearest rank
+        let p99 = samples[((n as f64 * 0.99).ceil() as usize).clamp(1, n) - 1];
+        let mean = samples.iter().sum::<f64>() / n as f64;
+        let variance = if n > 1 {
+            samples.iter().map(|x| (x - mean) * (x - mean)).sum::<f64>() / (n - 1) as f64
+        } else {
+            0.0
+        };
+
+        Some(BenchStats { samples: n, median, p99, mean, stddev: variance.sqrt(), min: samples[0] })
+    }
+}
+
+/// Benchmarks of the program: functions marked `@bench`, which take no arguments
+pub fn benchmark_functions(program: &Program) -> Result<Vec<String>> {
+    let mut names = Vec::new();
+    for function in program.functions.iter().filter(|function| function.has_attribute("bench")) {
+        if !function.parameters.is_empty() {
+            return Err(anyhow!("@bench function '{}' must not take parameters", function.name));
+        }
+        names.push(function.name.clone());
+    }
+    if names.is_empty() {
+        return Err(anyhow!("No @bench functions found"));
+    }
+    Ok(names)
+}
+
+/// The program with its main extended by the timing loops for `benchmarks`
+pub fn build_harness(program: &Program, benchmarks: &[String], samples: u32, warmup: u32) -> Program {
+    let mut main = program.main.statements.clone();
+    for (index, name) in benchmarks.iter().enumerate() {
+        let returns_value = program.functions.iter()
+            .any(|function| &function.name == name && function.return_type != Type::Void);
+        main.extend(benchmark_statements(index, name, returns_value, samples, warmup));
+    }
+    Program { functions: program.functions.clone(), main: Block { statements: main } }
+}
+
+// Per-call times of each benchmark, from the tagged lines of the output
+pub fn parse_samples(output: &str, benchmarks: usize) -> Vec<Vec<f64>> {
+    let mut samples = vec![Vec::new(); benchmarks];
+    for line in output.lines() {
+        let mut fields = line.split_whitespace();
+        if fields.next() != Some(SAMPLE_TAG) {
+            continue;
+        }
+        let numbers: Vec<i64> = fields.filter_map(|field| field.parse().ok()).collect();
+        if let [index, elapsed, batch] = numbers[..] {
+            if index >= 0 && (index as usize) < benchmarks && batch > 0 {
+                samples[index as usize].push(elapsed as f64 / batch as f64);
+            }
+        }
+    }
+    samples
+}
+
+pub fn format_nanos(nanos: f64) -> String {
+    if nanos < 1_000.0 {
+        format!("{:.1} ns", nanos)
+    } else if nanos < 1_000_000.0 {
+        format!("{:.2} µs", nanos / 1_000.0)
+    } else if nanos < 1_000_000_000.0 {
+        format!("{:.2} ms", nanos / 1_000_000.0)
+    } else {
+        format!("{:.2} s", nanos / 1_000_000_000.0)
+    }
+}
+
+// Timing loops for one benchmark. The warm-up also sizes the batch: each
+// sample runs enough calls to take about TARGET_BATCH_NANOS.
+//
+//   i = 0; t0 = now_nanos()
+//   while i < warmup { f(); i = i + 1 }
+//   batch = TARGET * warmup / (now_nanos() - t0 + 1) + 1
+//   i = 0
+//   while i < samples {
+//       j = 0; t0 = now_nanos()
+//       while j < batch { f(); j = j + 1 }
+//       print(TAG, index, now_nanos() - t0, batch)
+//       i = i + 1
+//   }
+fn benchmark_statements(index: usize, name: &str, returns_value: bool, samples: u32, warmup: u32) -> Vec<Statement> {
+    const I: &str = "__yaf_bench_i";
+    const J: &str = "__yaf_bench_j";
+    const START: &str = "__yaf_bench_start";
+    const BATCH: &str = "__yaf_bench_batch";
+
+    let call = {
+        let call = Expression::FunctionCall { name: name.to_string(), arguments: Vec::new() };
+        // Results go through black_box so pure calls are not optimized away
+        Statement::Expression(if returns_value {
+            builtin("black_box", vec![call])
+        } else {
+            call
+        })
+    };
+
+    let elapsed_since_start = binary(builtin("now_nanos", Vec::new()), BinaryOperator::Subtract, variable(START));
+    let count_loop = |counter: &str, limit: Expression| Statement::While {
+        condition: binary(variable(counter), BinaryOperator::Less, limit),
+        body: Block { statements: vec![call.clone(), increment(counter)] },
+    };
+
+    vec![
+        assign(I, int(0)),
+        assign(START, builtin("now_nanos", Vec::new())),
+        count_loop(I, int(warmup as i64)),
+        assign(BATCH, binary(
+            binary(
+                int(TARGET_BATCH_NANOS * warmup as i64),
+                BinaryOperator::Divide,
+                binary(elapsed_since_start.clone(), BinaryOperator::Add, int(1)),
+            ),
+            BinaryOperator::Add,
+            int(1),
+        )),
+        assign(I, int(0)),
+        Statement::While {
+            condition: binary(variable(I), BinaryOperator::Less, int(samples as i64)),
+            body: Block { statements: vec![
+                assign(J, int(0)),
+                assign(START, builtin("now_nanos", Vec::new())),
+                count_loop(J, variable(BATCH)),
+                Statement::Expression(Expression::FunctionCall {
+                    name: "print".to_string(),
+                    arguments: vec![
+                        Expression::Literal(Value::String(SAMPLE_TAG.to_string())),
+                        int(index as i64),
+                        elapsed_since_start,
+                        variable(BATCH),
+                    ],
+                }),
+                increment(I),
+            ] },
+        },
+    ]
+}
+
+fn int(value: i64) -> Expression {
+    Expression::Literal(Value::Int(value))
+}
+
+fn variable(name: &str) -> Expression {
+    Expression::Variable(name.to_string())
+}
+
+fn builtin(name: &str, arguments: Vec<Expression>) -> Expression {
+    Expression::BuiltinCall { name: name.to_string(), arguments }
+}
+
+fn binary(left: Expression, operator: BinaryOperator, right: Expression) -> Expression {
+    Expression::BinaryOp { left: Box::new(left), operator, right: Box::new(right) }
+}
+
+fn assign(name: &str, value: Expression) -> Statement {
+    Statement::Assignment { name: name.to_string(), value }
+}
+
+fn increment(name: &str) -> Statement {
+    assign(name, binary(variable(name), BinaryOperator::Add, int(1)))
+}
@@ -0,0 +1,122 @@
+//! # Compilation cache
+//!
+//! Results of earlier compiles, kept in the cache directory so that an
+//! unchanged program skips the work that produced them:
+//!
+//! - `ast-<key>.json`: the checked and folded AST of a source file, keyed by
+//!   its contents and the compiler. A hit skips lexing, parsing, type
+//!   checking and folding.
+//! - `object-<key>.o`: the object code of a program, keyed by the code the
+//!   backend generated (the C source, or the LLVM module before optimizing)
+//!   and the flags that compile it. A hit skips clang or the LLVM pipeline;
+//!   only linking runs again.
+//!
+//! Object code is cached per program, not per function: both backends
+//! optimize across functions (inlining, tail calls, @memo wrappers), so the
+//! code of one function depends on the others.
+//!
+//! The compiler part of the keys is the version plus the size and mtime of
+//! the running executable, so a rebuilt compiler never reads entries of the
+//! old one; without them nothing is cached. The cache is best effort: an
+//! entry that can't be read or written is a miss. Entries are written under
+//! a temporary name and renamed, so concurrent compiles (see `yaf build`)
+//! never see a partial one.
+
+use crate::core::Program;
+use std::collections::hash_map::DefaultHasher;
+use std::hash::{Hash, Hasher};
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::OnceLock;
+use std::time::SystemTime;
+use tracing::debug;
+
+pub struct CompileCache {
+    dir: PathBuf,
+}
+
+impl CompileCache {
+    pub fn new(dir: PathBuf) -> CompileCache {
+        CompileCache { dir }
+    }
+
+    /// The front end result for this source, if an earlier compile stored it
+    pub fn load_ast(&self, source: &str) -> Option<Program> {
+        let entry = self.entry("ast", &[source.as_bytes()], &[], "json")?;
+        let json = std::fs::read(&entry).ok()?;
+        match serde_json::from_slice(&json) {
+            Ok(program) => Some(program),
+            Err(e) => {
+                debug!("Ignoring unreadable cache entry {}: {}", entry.display(), e);
+                None
+            },
+        }
+    }
+
+    pub fn store_ast(&self, source: &str, program: &Program) {
+        let Some(entry) = self.entry("ast", &[source.as_bytes()], &[], "json") else {
+            return;
+        };
+        let Ok(json) = serde_json::to_string(program) else {
+            return;
+        };
+        // Literals must read back as the same values (JSON has no NaN, say)
+        let round_trip = serde_json::from_str::<Program>(&json).ok()
+            .and_then(|program| serde_json::to_string(&program).ok());
+        if round_trip.as_deref() != Some(json.as_str()) {
+            return;
+        }
+        self.write(&entry, |partial| std::fs::write(partial, &json));
+    }
+
+    /// Where the object code for this generated code and these flags is
+    /// cached; it exists if an earlier compile stored it
+    pub fn object(&self, inputs: &[&[u8]], flags: &[String]) -> Option<PathBuf> {
+        self.entry("object", inputs, flags, "o")
+    }
+
+    /// Copies `object` into the cache as `entry`
+    pub fn store_object(&self, entry: &Path, object: &Path) {
+        self.write(entry, |partial| std::fs::copy(object, partial).map(|_| ()));
+    }
+
+    fn entry(&self, kind: &str, inputs: &[&[u8]], flags: &[String], extension: &str) -> Option<PathBuf> {
+        let compiler = compiler_fingerprint().as_ref()?;
+        let mut hasher = DefaultHasher::new();
+        compiler.hash(&mut hasher);
+        inputs.hash(&mut hasher);
+        flags.hash(&mut hasher);
+        std::env::consts::ARCH.hash(&mut hasher);
+        std::env::consts::OS.hash(&mut hasher);
+        Some(self.dir.join(format!("{}-{:016x}.{}", kind, hasher.finish(), extension)))
+    }
+
+    fn write(&self, entry: &Path, write: impl FnOnce(&Path) -> std::io::Result<()>) {
+        let partial = partial_path(entry);
+        let result = std::fs::create_dir_all(&self.dir)
+            .and_then(|_| write(&partial))
+            .and_then(|_| std::fs::rename(&partial, entry));
+        if let Err(e) = result {
+            debug!("Could not write cache entry {}: {}", entry.display(), e);
+            std::fs::remove_file(&partial).ok();
+        }
+    }
+}
+
+/// Temporary name next to `path`, unique to this process and call, to
+/// build a file under before renaming it into place
+pub fn partial_path(path: &Path) -> PathBuf {
+    static NEXT: AtomicUsize = AtomicUsize::new(0);
+    let mut name = path.file_name().unwrap_or_default().to_os_string();
+    name.push(format!(".{}-{}", std::process::id(), NEXT.fetch_add(1, Ordering::Relaxed)));
+    path.with_file_name(name)
+}
+
+// Version, size and mtime of the compiler
+fn compiler_fingerprint() -> &'static Option<(&'static str, u64, SystemTime)> {
+    static FINGERPRINT: OnceLock<Option<(&'static str, u64, SystemTime)>> = OnceLock::new();
+    FINGERPRINT.get_or_init(|| {
+        let executable = std::env::current_exe().and_then(std::fs::metadata).ok()?;
+        Some((env!("CARGO_PKG_VERSION"), executable.len(), executable.modified().ok()?))
+    })
+}
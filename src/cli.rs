@@ -15,7 +15,9 @@ use std::path::PathBuf;
 #[command(after_help = "EXAMPLES:
   yaf run hello.yaf              # Compile and run a YAF program
   yaf compile input.yaf -o app   # Compile to executable
+  yaf build src/ --out-dir bin   # Compile many programs in parallel
   yaf check syntax.yaf           # Check syntax only
+  yaf bench benches.yaf          # Run the @bench functions
   yaf info                       # Show compiler information
 
 Visit: https://github.com/Lexharden/Yaf.git")]
@@ -75,6 +77,44 @@ pub enum Commands {
         /// Enable debug information
         #[arg(short, long)]
         debug: bool,
+        
+        /// Print the time and allocations of each compiler pass
+        #[arg(long)]
+        time_passes: bool,
+        
+        /// Instrument the executable to write a profile when it runs
+        #[arg(long, value_name = "DIR", num_args = 0..=1, conflicts_with = "profile_use",
+              help = "Build with profiling instrumentation (profiles go to DIR, default: current directory)")]
+        profile_gen: Option<Option<PathBuf>>,
+        
+        /// Optimize with a profile recorded by a --profile-gen build
+        #[arg(long, value_name = "FILE", help = "Profile to optimize with (.profdata, or a .profraw file or directory to merge)")]
+        profile_use: Option<PathBuf>,
+        
+        /// Instrument function entry and exit; the executable writes a flat
+        /// profile to stderr and collapsed stacks (yaf-profile.folded, or
+        /// $YAF_PROFILE) when it exits
+        #[arg(long)]
+        profile: bool,
+    },
+    
+    /// 🏗️  Compile many YAF programs in parallel, one per core
+    Build {
+        /// Source files, or directories to search for .yaf files
+        #[arg(required = true, help = "Paths to .yaf files or directories")]
+        inputs: Vec<PathBuf>,
+        
+        /// Directory for the executables (default: next to each source)
+        #[arg(long, value_name = "DIR")]
+        out_dir: Option<PathBuf>,
+        
+        /// Code generation backend
+        #[arg(short, long, default_value = "llvm", help = "Choose compilation backend")]
+        backend: Backend,
+        
+        /// Programs compiled at the same time (default: one per core)
+        #[arg(short, long)]
+        jobs: Option<usize>,
     },
     
     /// 🚀 Compile and run a YAF program in one step
@@ -87,6 +127,25 @@ pub enum Commands {
         #[arg(last = true, help = "Arguments passed to the YAF program")]
         args: Vec<String>,
         
+        /// Code generation backend
+        #[arg(short, long, default_value = "jit", help = "Choose execution backend")]
+        backend: Backend,
+    },
+    
+    /// ⏱️  Run the @bench functions of a YAF program
+    Bench {
+        /// YAF source file with @bench functions
+        #[arg(help = "Path to .yaf source file")]
+        input: PathBuf,
+        
+        /// Measured samples per benchmark
+        #[arg(long, default_value = "100")]
+        samples: u32,
+        
+        /// Calls made before measuring
+        #[arg(long, default_value = "10")]
+        warmup: u32,
+        
         /// Code generation backend
         #[arg(short, long, default_value = "llvm", help = "Choose compilation backend")]
         backend: Backend,
@@ -115,7 +174,7 @@ pub enum Commands {
     /// 💻 Interactive REPL (Read-Eval-Print-Loop)
     Repl {
         /// Backend for JIT compilation
-        #[arg(short, long, default_value = "cranelift")]
+        #[arg(short, long, default_value = "jit")]
         backend: Backend,
     },
     
@@ -127,6 +186,8 @@ pub enum Commands {
 pub enum Backend {
     /// 🔥 LLVM backend - Best performance and optimization
     Llvm,
+    /// 🏃 LLVM JIT - Run in-process without producing an executable
+    Jit,
     /// ⚡ Cranelift backend - Fast compilation (experimental)
     Cranelift,
     /// 🛠️ C backend - Maximum compatibility and portability
@@ -137,6 +198,7 @@ impl std::fmt::Display for Backend {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
             Backend::Llvm => write!(f, "llvm"),
+            Backend::Jit => write!(f, "jit"),
             Backend::Cranelift => write!(f, "cranelift"),
             Backend::C => write!(f, "c"),
         }
@@ -1,26 +1,34 @@
 use crate::runtime::values::Value;
+use serde::{Deserialize, Serialize};
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Program {
     pub functions: Vec<Function>,
     pub main: Block,
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Function {
     pub name: String,
     pub parameters: Vec<Parameter>,
     pub return_type: Type,
     pub body: Block,
+    pub attributes: Vec<String>, // @bench, @memo... escritos antes de `func`
 }
 
-#[derive(Debug, Clone)]
+impl Function {
+    pub fn has_attribute(&self, name: &str) -> bool {
+        self.attributes.iter().any(|attribute| attribute == name)
+    }
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Parameter {
     pub name: String,
     pub param_type: Type,
 }
 
-#[derive(Debug, Clone, PartialEq)]
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub enum Type {
     Int,
     Float,
@@ -28,6 +36,7 @@ pub enum Type {
     Bool,
     Void,
     Array(Box<Type>), // Array with element type
+    Map(Box<Type>, Box<Type>), // Map with key and value types
 }
 
 impl Type {
@@ -41,16 +50,17 @@ impl Type {
             Type::Bool => "bool".to_string(),
             Type::Void => "void".to_string(),
             Type::Array(element_type) => format!("array[{}]", element_type.to_string()),
+            Type::Map(key_type, value_type) => format!("map[{}, {}]", key_type.to_string(), value_type.to_string()),
         }
     }
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub struct Block {
     pub statements: Vec<Statement>,
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum Statement {
     Declaration {
         name: String,
@@ -81,13 +91,46 @@ pub enum Statement {
         increment: Box<Statement>,
         body: Block,
     },
+    // pfor i = inicio; i < fin; i = i + 1 reduce(+: total) { ... }
+    // Iteraciones independientes repartidas entre hilos; `end` es exclusivo
+    ParallelFor {
+        variable: String,
+        start: Expression,
+        end: Expression,
+        reductions: Vec<Reduction>,
+        body: Block,
+    },
     Return {
         value: Option<Expression>,
     },
     Expression(Expression),
 }
 
-#[derive(Debug, Clone)]
+// Variable que un pfor combina al final: cada trozo la acumula por su cuenta
+#[derive(Debug, Clone, Serialize, Deserialize)]
+pub struct Reduction {
+    pub operator: ReductionOperator,
+    pub variable: String,
+}
+
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
+pub enum ReductionOperator {
+    Add,
+    Min,
+    Max,
+}
+
+impl ReductionOperator {
+    pub fn to_string(&self) -> &'static str {
+        match self {
+            ReductionOperator::Add => "+",
+            ReductionOperator::Min => "min",
+            ReductionOperator::Max => "max",
+        }
+    }
+}
+
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum Expression {
     Literal(Value),
     Variable(String),
@@ -115,9 +158,14 @@ pub enum Expression {
         array: Box<Expression>,
         index: Box<Expression>,
     },
+    MapLiteral {
+        key_type: Type,
+        value_type: Type,
+        entries: Vec<(Expression, Expression)>,
+    },
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq, Serialize, Deserialize)]
 pub enum BinaryOperator {
     Add,
     Subtract,
@@ -134,7 +182,7 @@ pub enum BinaryOperator {
     Or,
 }
 
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, Serialize, Deserialize)]
 pub enum UnaryOperator {
     Not,
     Minus,
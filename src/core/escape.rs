@@ -0,0 +1,196 @@
+//! # Escape analysis
+//!
+//! Finds heap values the code generators can build in the stack frame of
+//! the function that creates them instead of on the GC heap. Frame objects
+//! are never linked into the heap, so they cost no allocation, no sweep and
+//! no free (see "Frame objects" in runtime/yaf_runtime.c).
+//!
+//! - Frame arrays: variables whose every assignment is an array literal
+//!   and that are only indexed, assigned by index, passed to `length` or
+//!   `pop`, or printed. The array never reaches another variable, array,
+//!   map, call or return value, so each literal gets one slot of frame
+//!   storage: running it again (say, in the next loop iteration) replaces
+//!   an array nothing else can see. `push` would move the elements to
+//!   heap storage the frame does not own, so it disqualifies the variable.
+//! - Frame strings: `str(x)` / `int_to_string(x)` read right away by
+//!   `print` or a concatenation, which copy the characters and drop the
+//!   conversion. The backends ask `is_frame_string` at those two places.
+
+use std::collections::HashSet;
+use crate::core::ast::*;
+
+/// Variables of `body` whose arrays can live in the frame. `excluded` are
+/// names something else may see: the parameters of a function, or for
+/// main the names the functions use.
+pub fn frame_arrays(body: &Block, excluded: &HashSet<String>) -> HashSet<String> {
+    let mut analysis = Analysis::default();
+    analysis.block(body);
+    analysis.literals.retain(|name| !analysis.escaped.contains(name) && !excluded.contains(name));
+    analysis.literals
+}
+
+/// Whether `expr` is a string conversion that can be formatted into frame
+/// storage when its value is consumed immediately
+pub fn is_frame_string(expr: &Expression) -> bool {
+    match expr {
+        Expression::BuiltinCall { name, arguments } | Expression::FunctionCall { name, arguments } => {
+            (name == "str" || name == "int_to_string") && arguments.len() == 1
+        },
+        _ => false,
+    }
+}
+
+/// Every name an expression or block reads or assigns, for the exclusions of main
+pub fn collect_names(block: &Block, names: &mut HashSet<String>) {
+    let mut analysis = Analysis::default();
+    analysis.block(block);
+    names.extend(analysis.literals);
+    names.extend(analysis.escaped);
+    names.extend(analysis.indexed);
+}
+
+#[derive(Default)]
+struct Analysis {
+    // Assigned an array literal somewhere
+    literals: HashSet<String>,
+    // Read in a way that may keep the array alive, or assigned anything else
+    escaped: HashSet<String>,
+    // Only read in place (kept for collect_names)
+    indexed: HashSet<String>,
+}
+
+impl Analysis {
+    fn block(&mut self, block: &Block) {
+        for statement in &block.statements {
+            self.statement(statement);
+        }
+    }
+
+    fn statement(&mut self, statement: &Statement) {
+        match statement {
+            Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                self.assignment(name, value);
+            },
+            Statement::ArrayAssignment { name, index, value } => {
+                self.indexed.insert(name.clone());
+                self.expression(index);
+                self.expression(value);
+            },
+            Statement::If { condition, then_block, else_block } => {
+                self.expression(condition);
+                self.block(then_block);
+                if let Some(else_block) = else_block {
+                    self.block(else_block);
+                }
+            },
+            Statement::While { condition, body } => {
+                self.expression(condition);
+                self.block(body);
+            },
+            Statement::For { init, condition, increment, body } => {
+                self.statement(init);
+                self.expression(condition);
+                self.statement(increment);
+                self.block(body);
+            },
+            // The body runs on other threads: nothing it touches stays in a frame
+            Statement::ParallelFor { variable, start, end, reductions, body } => {
+                self.expression(start);
+                self.expression(end);
+                let mut inner = Analysis::default();
+                inner.block(body);
+                self.escaped.insert(variable.clone());
+                self.escaped.extend(reductions.iter().map(|reduction| reduction.variable.clone()));
+                self.escaped.extend(inner.literals);
+                self.escaped.extend(inner.escaped);
+                self.escaped.extend(inner.indexed);
+            },
+            Statement::Return { value } => {
+                if let Some(value) = value {
+                    self.expression(value);
+                }
+            },
+            Statement::Expression(expr) => self.expression(expr),
+        }
+    }
+
+    // A literal that reads the variable it replaces would be built over the
+    // storage it is reading
+    fn assignment(&mut self, name: &str, value: &Expression) {
+        match value {
+            Expression::ArrayLiteral { elements } => {
+                let mut inner = Analysis::default();
+                for element in elements {
+                    inner.expression(element);
+                }
+                if inner.escaped.contains(name) || inner.indexed.contains(name) {
+                    self.escaped.insert(name.to_string());
+                }
+                self.literals.insert(name.to_string());
+                self.merge(inner);
+            },
+            _ => {
+                self.escaped.insert(name.to_string());
+                self.expression(value);
+            },
+        }
+    }
+
+    fn merge(&mut self, other: Analysis) {
+        self.literals.extend(other.literals);
+        self.escaped.extend(other.escaped);
+        self.indexed.extend(other.indexed);
+    }
+
+    // Reads that only look at the array in place
+    fn read_in_place(&mut self, expr: &Expression) {
+        match expr {
+            Expression::Variable(name) => {
+                self.indexed.insert(name.clone());
+            },
+            _ => self.expression(expr),
+        }
+    }
+
+    fn expression(&mut self, expr: &Expression) {
+        match expr {
+            Expression::Literal(_) => {},
+            Expression::Variable(name) => {
+                self.escaped.insert(name.clone());
+            },
+            Expression::ArrayAccess { array, index } => {
+                self.read_in_place(array);
+                self.expression(index);
+            },
+            Expression::BuiltinCall { name, arguments } if (name == "length" || name == "pop") && arguments.len() == 1 => {
+                self.read_in_place(&arguments[0]);
+            },
+            Expression::FunctionCall { name, arguments } if name == "print" => {
+                for argument in arguments {
+                    self.read_in_place(argument);
+                }
+            },
+            Expression::FunctionCall { arguments, .. } | Expression::BuiltinCall { arguments, .. } => {
+                for argument in arguments {
+                    self.expression(argument);
+                }
+            },
+            Expression::BinaryOp { left, right, .. } => {
+                self.expression(left);
+                self.expression(right);
+            },
+            Expression::UnaryOp { operand, .. } => self.expression(operand),
+            Expression::ArrayLiteral { elements } => {
+                for element in elements {
+                    self.expression(element);
+                }
+            },
+            Expression::MapLiteral { entries, .. } => {
+                for (key, value) in entries {
+                    self.expression(key);
+                    self.expression(value);
+                }
+            },
+        }
+    }
+}
@@ -48,6 +48,7 @@ pub enum Token {
     Else,
     While,
     For,
+    Pfor,
     Return,
     Print,
     
@@ -58,6 +59,7 @@ pub enum Token {
     BoolType,
     VoidType,
     ArrayType,
+    MapType,
     
     // Literales
     IntLiteral(i64),
@@ -96,6 +98,7 @@ pub enum Token {
     Comma,
     Colon,
     Semicolon,
+    At,            // @ de los atributos de función
     
     // Comentarios y espacios en blanco se ignoran
     
@@ -306,6 +309,7 @@ impl Lexer {
             "else" => Token::Else,
             "while" => Token::While,
             "for" => Token::For,
+            "pfor" => Token::Pfor,
             "return" => Token::Return,
             "print" => Token::Print,
 
@@ -315,6 +319,7 @@ impl Lexer {
             "bool" => Token::BoolType,
             "void" => Token::VoidType,
             "array" => Token::ArrayType,
+            "map" => Token::MapType,
             "true" => Token::BoolLiteral(true),
             "false" => Token::BoolLiteral(false),
             _ => Token::Identifier(identifier.to_string()),
@@ -501,6 +506,11 @@ impl Lexer {
                     return Ok(Token::Semicolon);
                 }
                 
+                Some('@') => {
+                    self.advance();
+                    return Ok(Token::At);
+                }
+                
                 Some(ch) => {
                     self.advance();
                     return Err(YafError::LexError(format!("Carácter inesperado: {}", ch)));
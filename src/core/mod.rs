@@ -6,8 +6,12 @@ pub mod ast;
 pub mod lexer;
 pub mod parser;
 pub mod typechecker;
+pub mod optimizer;
+pub mod escape;
+pub mod tailcall;
 
 pub use ast::*;
 pub use lexer::*;
 pub use parser::*;
 pub use typechecker::*;
+pub use optimizer::*;
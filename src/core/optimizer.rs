@@ -0,0 +1,596 @@
+//! # AST optimizer
+//!
+//! Runs between type checking and code generation:
+//!
+//! - Constant `BinaryOp` / `UnaryOp` expressions are folded with the same
+//!   semantics as the runtime (wrapping integer arithmetic, truncating
+//!   division). Division by zero is left for the runtime to report.
+//! - A variable assigned exactly once, at the top level of a function body
+//!   or of main, to a scalar constant is replaced by that constant in the
+//!   statements that follow, so loop bounds become literals.
+//! - Pure functions (no globals, arrays, maps or I/O; only calls to other
+//!   pure functions) called with constant arguments are evaluated here,
+//!   within a fuel limit. Calls that run out of fuel or would fail at
+//!   runtime are kept.
+
+use std::cell::{Cell, RefCell};
+use std::collections::{HashMap, HashSet};
+use crate::core::ast::*;
+use crate::runtime::values::Value;
+
+/// Evaluation steps one call with constant arguments may take
+const EVALUATION_FUEL: u64 = 100_000;
+
+/// Evaluation steps for the whole program, so many call sites that run out
+/// of fuel can't slow the compiler down much
+const PROGRAM_FUEL: u64 = 10_000_000;
+
+/// Nesting of calls while evaluating, well within the compiler's own stack
+const MAX_EVALUATION_DEPTH: usize = 200;
+
+/// Builtins a pure function may call
+const PURE_BUILTINS: &[&str] = &["abs", "min", "max"];
+
+pub struct Optimizer {
+    pure_functions: HashMap<String, Function>,
+    // Result of each evaluated call, keyed by its text, None if it failed
+    evaluated: RefCell<HashMap<String, Option<Value>>>,
+    fuel: Cell<u64>,
+}
+
+impl Optimizer {
+    pub fn new() -> Self {
+        Optimizer { pure_functions: HashMap::new(), evaluated: RefCell::new(HashMap::new()), fuel: Cell::new(PROGRAM_FUEL) }
+    }
+
+    pub fn optimize(&mut self, program: Program) -> Program {
+        // Anything main assigns may be a global a function reads or writes
+        let mut globals = HashSet::new();
+        collect_assigned(&program.main, &mut globals);
+        let mut assigned_in_functions = HashSet::new();
+        for function in &program.functions {
+            collect_assigned(&function.body, &mut assigned_in_functions);
+        }
+        self.pure_functions = pure_functions(&program.functions, &globals);
+
+        let functions = program.functions.into_iter().map(|mut function| {
+            // Benchmarks should time the calls they make
+            let evaluate_calls = !function.has_attribute("bench");
+            function.body = self.optimize_body(function.body, &globals, evaluate_calls);
+            function
+        }).collect();
+        let main = self.optimize_body(program.main, &assigned_in_functions, true);
+        Program { functions, main }
+    }
+
+    // `shared` are the names something else may also assign, never propagated
+    fn optimize_body(&self, body: Block, shared: &HashSet<String>, evaluate_calls: bool) -> Block {
+        let mut assignments = HashMap::new();
+        count_assignments(&body, &mut assignments);
+
+        let mut constants = HashMap::new();
+        let statements = body.statements.into_iter().map(|statement| {
+            let statement = self.fold_statement(statement, &constants, evaluate_calls);
+            let constant = match &statement {
+                Statement::Assignment { name, value: Expression::Literal(value) } => Some((name, value)),
+                Statement::Declaration { name, var_type, value: Expression::Literal(value) }
+                    if literal_type(value) == *var_type => Some((name, value)),
+                _ => None,
+            };
+            if let Some((name, value)) = constant {
+                if assignments.get(name) == Some(&1) && !shared.contains(name) && !matches!(value, Value::String(_)) {
+                    constants.insert(name.clone(), value.clone());
+                }
+            }
+            statement
+        }).collect();
+        Block { statements }
+    }
+
+    fn evaluate(&self, name: &str, arguments: Vec<Value>) -> Option<Value> {
+        let key = format!("{}{:?}", name, arguments);
+        if let Some(result) = self.evaluated.borrow().get(&key) {
+            return result.clone();
+        }
+        let fuel = self.fuel.get().min(EVALUATION_FUEL);
+        let mut evaluator = Evaluator { functions: &self.pure_functions, fuel, depth: 0 };
+        let result = evaluator.call(name, arguments).filter(is_emittable);
+        self.fuel.set(self.fuel.get() - (fuel - evaluator.fuel));
+        self.evaluated.borrow_mut().insert(key, result.clone());
+        result
+    }
+
+    fn fold_block(&self, block: Block, constants: &HashMap<String, Value>, evaluate_calls: bool) -> Block {
+        Block {
+            statements: block.statements.into_iter()
+                .map(|statement| self.fold_statement(statement, constants, evaluate_calls))
+                .collect(),
+        }
+    }
+
+    fn fold_statement(&self, statement: Statement, constants: &HashMap<String, Value>, evaluate_calls: bool) -> Statement {
+        let fold = |expr: Expression| self.fold_expression(expr, constants, evaluate_calls);
+        let fold_block = |block: Block| self.fold_block(block, constants, evaluate_calls);
+        match statement {
+            Statement::Declaration { name, var_type, value } => {
+                Statement::Declaration { name, var_type, value: fold(value) }
+            },
+            Statement::Assignment { name, value } => Statement::Assignment { name, value: fold(value) },
+            Statement::ArrayAssignment { name, index, value } => {
+                Statement::ArrayAssignment { name, index: fold(index), value: fold(value) }
+            },
+            Statement::If { condition, then_block, else_block } => Statement::If {
+                condition: fold(condition),
+                then_block: fold_block(then_block),
+                else_block: else_block.map(fold_block),
+            },
+            Statement::While { condition, body } => Statement::While { condition: fold(condition), body: fold_block(body) },
+            Statement::For { init, condition, increment, body } => Statement::For {
+                init: Box::new(self.fold_statement(*init, constants, evaluate_calls)),
+                condition: fold(condition),
+                increment: Box::new(self.fold_statement(*increment, constants, evaluate_calls)),
+                body: fold_block(body),
+            },
+            Statement::ParallelFor { variable, start, end, reductions, body } => Statement::ParallelFor {
+                variable,
+                start: fold(start),
+                end: fold(end),
+                reductions,
+                body: fold_block(body),
+            },
+            Statement::Return { value } => Statement::Return { value: value.map(fold) },
+            Statement::Expression(expr) => Statement::Expression(fold(expr)),
+        }
+    }
+
+    fn fold_expression(&self, expr: Expression, constants: &HashMap<String, Value>, evaluate_calls: bool) -> Expression {
+        let fold = |expr: Expression| self.fold_expression(expr, constants, evaluate_calls);
+        match expr {
+            Expression::Variable(name) => match constants.get(&name) {
+                Some(value) => Expression::Literal(value.clone()),
+                None => Expression::Variable(name),
+            },
+            Expression::BinaryOp { left, operator, right } => {
+                let left = fold(*left);
+                let right = fold(*right);
+                if let (Expression::Literal(a), Expression::Literal(b)) = (&left, &right) {
+                    if let Some(value) = binary_value(&operator, a, b).filter(is_emittable) {
+                        return Expression::Literal(value);
+                    }
+                }
+                Expression::BinaryOp { left: Box::new(left), operator, right: Box::new(right) }
+            },
+            Expression::UnaryOp { operator, operand } => {
+                let operand = fold(*operand);
+                if let Expression::Literal(value) = &operand {
+                    if let Some(value) = unary_value(&operator, value).filter(is_emittable) {
+                        return Expression::Literal(value);
+                    }
+                }
+                Expression::UnaryOp { operator, operand: Box::new(operand) }
+            },
+            Expression::FunctionCall { name, arguments } => {
+                let arguments: Vec<Expression> = arguments.into_iter().map(fold).collect();
+                if evaluate_calls && self.pure_functions.contains_key(&name) {
+                    let values: Option<Vec<Value>> = arguments.iter().map(|argument| match argument {
+                        Expression::Literal(value) => Some(value.clone()),
+                        _ => None,
+                    }).collect();
+                    if let Some(value) = values.and_then(|values| self.evaluate(&name, values)) {
+                        return Expression::Literal(value);
+                    }
+                }
+                Expression::FunctionCall { name, arguments }
+            },
+            Expression::BuiltinCall { name, arguments } => {
+                Expression::BuiltinCall { name, arguments: arguments.into_iter().map(fold).collect() }
+            },
+            Expression::ArrayLiteral { elements } => {
+                Expression::ArrayLiteral { elements: elements.into_iter().map(fold).collect() }
+            },
+            Expression::ArrayAccess { array, index } => {
+                Expression::ArrayAccess { array: Box::new(fold(*array)), index: Box::new(fold(*index)) }
+            },
+            Expression::MapLiteral { key_type, value_type, entries } => Expression::MapLiteral {
+                key_type,
+                value_type,
+                entries: entries.into_iter().map(|(key, value)| (fold(key), fold(value))).collect(),
+            },
+            literal @ Expression::Literal(_) => literal,
+        }
+    }
+}
+
+fn literal_type(value: &Value) -> Type {
+    match value {
+        Value::Int(_) => Type::Int,
+        Value::Float(_) => Type::Float,
+        Value::String(_) => Type::String,
+        Value::Bool(_) => Type::Bool,
+    }
+}
+
+// Literals the backends can print back: no NaN or infinity, and no
+// INT64_MIN, which has no literal form
+fn is_emittable(value: &Value) -> bool {
+    match value {
+        Value::Int(n) => *n != i64::MIN,
+        Value::Float(f) => f.is_finite(),
+        _ => true,
+    }
+}
+
+fn truthy(value: &Value) -> bool {
+    match value {
+        Value::Int(n) => *n != 0,
+        Value::Float(f) => *f != 0.0,
+        Value::String(s) => !s.is_empty(),
+        Value::Bool(b) => *b,
+    }
+}
+
+fn number(value: &Value) -> Option<f64> {
+    match value {
+        Value::Int(n) => Some(*n as f64),
+        Value::Float(f) => Some(*f),
+        _ => None,
+    }
+}
+
+// Same results as yaf_add & co. in the runtime; None where it would fail
+fn binary_value(operator: &BinaryOperator, a: &Value, b: &Value) -> Option<Value> {
+    use std::cmp::Ordering;
+
+    if let (Value::Int(x), Value::Int(y)) = (a, b) {
+        let (x, y) = (*x, *y);
+        return Some(match operator {
+            BinaryOperator::Add => Value::Int(x.wrapping_add(y)),
+            BinaryOperator::Subtract => Value::Int(x.wrapping_sub(y)),
+            BinaryOperator::Multiply => Value::Int(x.wrapping_mul(y)),
+            BinaryOperator::Divide if y != 0 => Value::Int(x.wrapping_div(y)),
+            BinaryOperator::Modulo if y != 0 => Value::Int(x.wrapping_rem(y)),
+            BinaryOperator::Divide | BinaryOperator::Modulo => return None,
+            BinaryOperator::Equal => Value::Bool(x == y),
+            BinaryOperator::NotEqual => Value::Bool(x != y),
+            BinaryOperator::Less => Value::Bool(x < y),
+            BinaryOperator::LessEqual => Value::Bool(x <= y),
+            BinaryOperator::Greater => Value::Bool(x > y),
+            BinaryOperator::GreaterEqual => Value::Bool(x >= y),
+            BinaryOperator::And => Value::Bool(x != 0 && y != 0),
+            BinaryOperator::Or => Value::Bool(x != 0 || y != 0),
+        });
+    }
+
+    match operator {
+        BinaryOperator::And => return Some(Value::Bool(truthy(a) && truthy(b))),
+        BinaryOperator::Or => return Some(Value::Bool(truthy(a) || truthy(b))),
+        _ => {},
+    }
+
+    if let (Value::String(x), Value::String(y)) = (a, b) {
+        let order = x.as_bytes().cmp(y.as_bytes());
+        return Some(match operator {
+            BinaryOperator::Add => Value::String(format!("{}{}", x, y)),
+            BinaryOperator::Equal => Value::Bool(order == Ordering::Equal),
+            BinaryOperator::NotEqual => Value::Bool(order != Ordering::Equal),
+            BinaryOperator::Less => Value::Bool(order == Ordering::Less),
+            BinaryOperator::LessEqual => Value::Bool(order != Ordering::Greater),
+            BinaryOperator::Greater => Value::Bool(order == Ordering::Greater),
+            BinaryOperator::GreaterEqual => Value::Bool(order != Ordering::Less),
+            _ => return None,
+        });
+    }
+
+    if let (Value::Bool(x), Value::Bool(y)) = (a, b) {
+        return match operator {
+            BinaryOperator::Equal => Some(Value::Bool(x == y)),
+            BinaryOperator::NotEqual => Some(Value::Bool(x != y)),
+            _ => None,
+        };
+    }
+
+    // Mixed or float operands are computed as doubles. NaN compares false.
+    let (x, y) = (number(a)?, number(b)?);
+    Some(match operator {
+        BinaryOperator::Add => Value::Float(x + y),
+        BinaryOperator::Subtract => Value::Float(x - y),
+        BinaryOperator::Multiply => Value::Float(x * y),
+        BinaryOperator::Divide => Value::Float(x / y),
+        BinaryOperator::Modulo => Value::Float(x % y),
+        BinaryOperator::Equal => Value::Bool(x == y),
+        BinaryOperator::NotEqual => Value::Bool(x != y),
+        BinaryOperator::Less => Value::Bool(x < y),
+        BinaryOperator::LessEqual => Value::Bool(x <= y),
+        BinaryOperator::Greater => Value::Bool(x > y),
+        BinaryOperator::GreaterEqual => Value::Bool(x >= y),
+        BinaryOperator::And | BinaryOperator::Or => unreachable!(),
+    })
+}
+
+fn unary_value(operator: &UnaryOperator, value: &Value) -> Option<Value> {
+    match (operator, value) {
+        (UnaryOperator::Not, value) => Some(Value::Bool(!truthy(value))),
+        (UnaryOperator::Minus, Value::Int(n)) => Some(Value::Int(n.wrapping_neg())),
+        (UnaryOperator::Minus, Value::Float(f)) => Some(Value::Float(-f)),
+        _ => None,
+    }
+}
+
+fn builtin_value(name: &str, arguments: &[Value]) -> Option<Value> {
+    match (name, arguments) {
+        ("abs", [Value::Int(n)]) if *n != i64::MIN => Some(Value::Int(n.abs())),
+        ("min", [Value::Int(a), Value::Int(b)]) => Some(Value::Int(*a.min(b))),
+        ("max", [Value::Int(a), Value::Int(b)]) => Some(Value::Int(*a.max(b))),
+        _ => None,
+    }
+}
+
+// Names assigned anywhere in the block, loop variables included
+fn collect_assigned(block: &Block, names: &mut HashSet<String>) {
+    let mut counts = HashMap::new();
+    count_assignments(block, &mut counts);
+    names.extend(counts.into_keys());
+}
+
+fn count_assignments(block: &Block, counts: &mut HashMap<String, usize>) {
+    for statement in &block.statements {
+        count_statement_assignments(statement, counts);
+    }
+}
+
+fn count_statement_assignments(statement: &Statement, counts: &mut HashMap<String, usize>) {
+    match statement {
+        Statement::Declaration { name, .. } | Statement::Assignment { name, .. } => {
+            *counts.entry(name.clone()).or_insert(0) += 1;
+        },
+        Statement::If { then_block, else_block, .. } => {
+            count_assignments(then_block, counts);
+            if let Some(block) = else_block {
+                count_assignments(block, counts);
+            }
+        },
+        Statement::While { body, .. } => count_assignments(body, counts),
+        Statement::For { init, increment, body, .. } => {
+            count_statement_assignments(init, counts);
+            count_statement_assignments(increment, counts);
+            count_assignments(body, counts);
+        },
+        Statement::ParallelFor { variable, reductions, body, .. } => {
+            *counts.entry(variable.clone()).or_insert(0) += 1;
+            for reduction in reductions {
+                *counts.entry(reduction.variable.clone()).or_insert(0) += 1;
+            }
+            count_assignments(body, counts);
+        },
+        Statement::ArrayAssignment { .. } | Statement::Return { .. } | Statement::Expression(_) => {},
+    }
+}
+
+// Functions over ints and bools that only compute: every variable is a
+// parameter or a local, and calls go to builtins from PURE_BUILTINS or to
+// other pure functions. Found by elimination, so recursion is fine.
+fn pure_functions(functions: &[Function], globals: &HashSet<String>) -> HashMap<String, Function> {
+    let scalar = |t: &Type| matches!(t, Type::Int | Type::Bool);
+    let mut candidates: HashMap<String, &Function> = functions.iter()
+        .filter(|function| scalar(&function.return_type) && function.parameters.iter().all(|p| scalar(&p.param_type)))
+        .map(|function| (function.name.clone(), function))
+        .collect();
+
+    loop {
+        let names: HashSet<String> = candidates.keys().cloned().collect();
+        let before = candidates.len();
+        candidates.retain(|_, function| {
+            let mut locals: HashSet<String> = function.parameters.iter().map(|p| p.name.clone()).collect();
+            collect_assigned(&function.body, &mut locals);
+            locals.iter().all(|name| !globals.contains(name)) && block_is_pure(&function.body, &locals, &names)
+        });
+        if candidates.len() == before {
+            break;
+        }
+    }
+    candidates.into_iter().map(|(name, function)| (name, function.clone())).collect()
+}
+
+fn block_is_pure(block: &Block, locals: &HashSet<String>, pure: &HashSet<String>) -> bool {
+    block.statements.iter().all(|statement| statement_is_pure(statement, locals, pure))
+}
+
+fn statement_is_pure(statement: &Statement, locals: &HashSet<String>, pure: &HashSet<String>) -> bool {
+    let expr_pure = |expr: &Expression| expression_is_pure(expr, locals, pure);
+    match statement {
+        Statement::Declaration { value, .. } | Statement::Assignment { value, .. } => expr_pure(value),
+        Statement::If { condition, then_block, else_block } => {
+            expr_pure(condition) && block_is_pure(then_block, locals, pure) &&
+                else_block.as_ref().map_or(true, |block| block_is_pure(block, locals, pure))
+        },
+        Statement::While { condition, body } => expr_pure(condition) && block_is_pure(body, locals, pure),
+        Statement::For { init, condition, increment, body } => {
+            statement_is_pure(init, locals, pure) && expr_pure(condition) &&
+                statement_is_pure(increment, locals, pure) && block_is_pure(body, locals, pure)
+        },
+        Statement::Return { value } => value.as_ref().map_or(true, expr_pure),
+        Statement::Expression(expr) => expr_pure(expr),
+        Statement::ArrayAssignment { .. } | Statement::ParallelFor { .. } => false,
+    }
+}
+
+fn expression_is_pure(expr: &Expression, locals: &HashSet<String>, pure: &HashSet<String>) -> bool {
+    let expr_pure = |expr: &Expression| expression_is_pure(expr, locals, pure);
+    match expr {
+        Expression::Literal(_) => true,
+        Expression::Variable(name) => locals.contains(name),
+        Expression::FunctionCall { name, arguments } => pure.contains(name) && arguments.iter().all(expr_pure),
+        Expression::BuiltinCall { name, arguments } => {
+            PURE_BUILTINS.contains(&name.as_str()) && arguments.iter().all(expr_pure)
+        },
+        Expression::BinaryOp { left, right, .. } => expr_pure(left) && expr_pure(right),
+        Expression::UnaryOp { operand, .. } => expr_pure(operand),
+        Expression::ArrayLiteral { .. } | Expression::ArrayAccess { .. } | Expression::MapLiteral { .. } => false,
+    }
+}
+
+enum Flow {
+    Next,
+    Return(Value),
+}
+
+// Tree-walking interpreter for pure functions. Every step costs one unit
+// of fuel; anything it can't decide (no fuel left, a runtime error, a
+// missing return) makes the whole call None.
+struct Evaluator<'a> {
+    functions: &'a HashMap<String, Function>,
+    fuel: u64,
+    depth: usize,
+}
+
+impl<'a> Evaluator<'a> {
+    fn call(&mut self, name: &str, arguments: Vec<Value>) -> Option<Value> {
+        let function = self.functions.get(name)?;
+        if self.depth == MAX_EVALUATION_DEPTH || function.parameters.len() != arguments.len() {
+            return None;
+        }
+        let mut env: HashMap<String, Value> = function.parameters.iter()
+            .map(|parameter| parameter.name.clone())
+            .zip(arguments)
+            .collect();
+
+        self.depth += 1;
+        let flow = self.block(&function.body, &mut env);
+        self.depth -= 1;
+        match flow? {
+            Flow::Return(value) if literal_type(&value) == function.return_type => Some(value),
+            _ => None,
+        }
+    }
+
+    fn tick(&mut self) -> Option<()> {
+        self.fuel = self.fuel.checked_sub(1)?;
+        Some(())
+    }
+
+    fn block(&mut self, block: &Block, env: &mut HashMap<String, Value>) -> Option<Flow> {
+        for statement in &block.statements {
+            if let Flow::Return(value) = self.statement(statement, env)? {
+                return Some(Flow::Return(value));
+            }
+        }
+        Some(Flow::Next)
+    }
+
+    fn statement(&mut self, statement: &Statement, env: &mut HashMap<String, Value>) -> Option<Flow> {
+        self.tick()?;
+        match statement {
+            Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                let value = self.expression(value, env)?;
+                env.insert(name.clone(), value);
+                Some(Flow::Next)
+            },
+            Statement::If { condition, then_block, else_block } => {
+                if truthy(&self.expression(condition, env)?) {
+                    self.block(then_block, env)
+                } else if let Some(block) = else_block {
+                    self.block(block, env)
+                } else {
+                    Some(Flow::Next)
+                }
+            },
+            Statement::While { condition, body } => {
+                while truthy(&self.expression(condition, env)?) {
+                    if let Flow::Return(value) = self.block(body, env)? {
+                        return Some(Flow::Return(value));
+                    }
+                }
+                Some(Flow::Next)
+            },
+            Statement::For { init, condition, increment, body } => {
+                self.statement(init, env)?;
+                while truthy(&self.expression(condition, env)?) {
+                    if let Flow::Return(value) = self.block(body, env)? {
+                        return Some(Flow::Return(value));
+                    }
+                    self.statement(increment, env)?;
+                }
+                Some(Flow::Next)
+            },
+            Statement::Return { value: Some(value) } => Some(Flow::Return(self.expression(value, env)?)),
+            Statement::Expression(expr) => {
+                self.expression(expr, env)?;
+                Some(Flow::Next)
+            },
+            Statement::Return { value: None } | Statement::ArrayAssignment { .. } | Statement::ParallelFor { .. } => None,
+        }
+    }
+
+    fn expression(&mut self, expr: &Expression, env: &mut HashMap<String, Value>) -> Option<Value> {
+        self.tick()?;
+        match expr {
+            Expression::Literal(value) => Some(value.clone()),
+            Expression::Variable(name) => env.get(name).cloned(),
+            Expression::BinaryOp { left, operator, right } => {
+                // And / Or short-circuit like both backends
+                let left = self.expression(left, env)?;
+                match operator {
+                    BinaryOperator::And if !truthy(&left) => return Some(Value::Bool(false)),
+                    BinaryOperator::Or if truthy(&left) => return Some(Value::Bool(true)),
+                    _ => {},
+                }
+                let right = self.expression(right, env)?;
+                binary_value(operator, &left, &right)
+            },
+            Expression::UnaryOp { operator, operand } => {
+                let operand = self.expression(operand, env)?;
+                unary_value(operator, &operand)
+            },
+            Expression::FunctionCall { name, arguments } => {
+                let arguments = arguments.iter()
+                    .map(|argument| self.expression(argument, env))
+                    .collect::<Option<Vec<Value>>>()?;
+                self.call(name, arguments)
+            },
+            Expression::BuiltinCall { name, arguments } => {
+                let arguments = arguments.iter()
+                    .map(|argument| self.expression(argument, env))
+                    .collect::<Option<Vec<Value>>>()?;
+                builtin_value(name, &arguments)
+            },
+            Expression::ArrayLiteral { .. } | Expression::ArrayAccess { .. } | Expression::MapLiteral { .. } => None,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::core::{Lexer, Parser};
+    
+    // The printed expressions of main after optimizing
+    fn printed(source: &str) -> Vec<Expression> {
+        let tokens = Lexer::new(source).tokenize().unwrap();
+        let program = Optimizer::new().optimize(Parser::new(tokens).parse().unwrap());
+        program.main.statements.into_iter().filter_map(|statement| match statement {
+            Statement::Expression(Expression::FunctionCall { name, mut arguments }) if name == "print" => arguments.pop(),
+            _ => None,
+        }).collect()
+    }
+    
+    #[test]
+    fn a_right_operand_that_traps_keeps_the_call() {
+        let printed = printed(r#"
+func fails(n: int) -> bool {
+    return 1 / n > 0
+}
+
+func check(n: int) -> bool {
+    return n > 0 && fails(0)
+}
+
+func main() {
+    print(check(1))
+    print(check(-1))
+}
+"#);
+        assert!(matches!(&printed[0], Expression::FunctionCall { name, .. } if name == "check"), "{:?}", printed[0]);
+        // The left operand decides, so `fails` never runs
+        assert!(matches!(printed[1], Expression::Literal(Value::Bool(false))), "{:?}", printed[1]);
+    }
+}
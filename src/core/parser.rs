@@ -140,6 +140,7 @@ impl Parser {
             Token::Else => "'else'".to_string(),
             Token::While => "'while'".to_string(),
             Token::For => "'for'".to_string(),
+            Token::Pfor => "'pfor'".to_string(),
             Token::Return => "'return'".to_string(),
 
             Token::Print => "'print'".to_string(),
@@ -153,6 +154,7 @@ impl Parser {
             Token::Semicolon => "';'".to_string(),
             Token::Comma => "','".to_string(),
             Token::Colon => "':'".to_string(),
+            Token::At => "'@'".to_string(),
             Token::Equal => "'='".to_string(),
             Token::Plus => "'+'".to_string(),
             Token::Minus => "'-'".to_string(),
@@ -179,6 +181,7 @@ impl Parser {
             Token::BoolType => "'bool'".to_string(),
             Token::VoidType => "'void'".to_string(),
             Token::ArrayType => "'array'".to_string(),
+            Token::MapType => "'map'".to_string(),
             Token::Eof => "fin de archivo".to_string(),
         }
     }
@@ -191,7 +194,7 @@ impl Parser {
         // Parsear funciones y declaraciones globales
         while !self.check(&Token::Eof) {
     
-            if self.check(&Token::Fun) {
+            if self.check(&Token::Fun) || self.check(&Token::At) {
                 let function = self.parse_function()?;
                 
                 // Verificar si es función main
@@ -236,7 +239,28 @@ impl Parser {
         Ok(Program { functions, main })
     }
     
+    // Atributos que pueden preceder a `func`
+    const FUNCTION_ATTRIBUTES: &'static [&'static str] = &["bench", "memo"];
+    
+    fn parse_attributes(&mut self) -> Result<Vec<String>> {
+        let mut attributes = Vec::new();
+        while self.check(&Token::At) {
+            self.advance();
+            let name = match self.current_token() {
+                Token::Identifier(name) => name.clone(),
+                _ => return Err(YafError::ParseError("Se esperaba el nombre del atributo después de '@'".to_string())),
+            };
+            if !Self::FUNCTION_ATTRIBUTES.contains(&name.as_str()) {
+                return Err(YafError::ParseError(format!("Atributo desconocido: @{}", name)));
+            }
+            self.advance();
+            attributes.push(name);
+        }
+        Ok(attributes)
+    }
+    
     fn parse_function(&mut self) -> Result<Function> {
+        let attributes = self.parse_attributes()?;
         self.consume(Token::Fun, "Se esperaba 'func'")?;
         
         let name = match self.current_token() {
@@ -309,6 +333,7 @@ impl Parser {
             parameters,
             return_type,
             body,
+            attributes,
         })
     }
     
@@ -341,10 +366,25 @@ impl Parser {
                 self.consume(Token::RightBracket, "Se esperaba ']' después del tipo de elemento")?;
                 Ok(Type::Array(Box::new(element_type)))
             },
+            Token::MapType => {
+                let (key_type, value_type) = self.parse_map_type()?;
+                Ok(Type::Map(Box::new(key_type), Box::new(value_type)))
+            },
             _ => Err(YafError::ParseError("Se esperaba un tipo".to_string())),
         }
     }
     
+    // map[K, V]
+    fn parse_map_type(&mut self) -> Result<(Type, Type)> {
+        self.advance(); // consume 'map'
+        self.consume(Token::LeftBracket, "Se esperaba '[' después de 'map'")?;
+        let key_type = self.parse_type()?;
+        self.consume(Token::Comma, "Se esperaba ',' entre el tipo de clave y el de valor")?;
+        let value_type = self.parse_type()?;
+        self.consume(Token::RightBracket, "Se esperaba ']' después del tipo de valor")?;
+        Ok((key_type, value_type))
+    }
+    
     fn parse_block(&mut self) -> Result<Block> {
         self.consume(Token::LeftBrace, "Se esperaba '{'")?;
         
@@ -364,6 +404,7 @@ impl Parser {
             Token::If => self.parse_if_statement()?,
             Token::While => self.parse_while_statement()?,
             Token::For => self.parse_for_statement()?,
+            Token::Pfor => self.parse_parallel_for_statement()?,
             Token::Return => {
                 let ret_stmt = self.parse_return_statement()?;
                 // Consumir semicolon opcional después de return
@@ -536,6 +577,99 @@ impl Parser {
         Ok(Statement::For { init, condition, increment, body })
     }
     
+    // pfor i = inicio; i < fin; i = i + 1 [reduce(op: variable, ...)] { ... }
+    // La cabecera es la de un for, pero tiene que recorrer un rango de enteros
+    fn parse_parallel_for_statement(&mut self) -> Result<Statement> {
+        self.consume(Token::Pfor, "Se esperaba 'pfor'")?;
+        
+        let variable = match self.current_token() {
+            Token::Identifier(name) => name.clone(),
+            _ => return Err(YafError::ParseError("Se esperaba la variable del pfor".to_string())),
+        };
+        self.advance();
+        self.consume(Token::Equal, "Se esperaba '=' en la inicialización del pfor")?;
+        let start = self.parse_expression()?;
+        self.consume(Token::Semicolon, "Se esperaba ';' después de la inicialización del pfor")?;
+        
+        let end = match self.parse_expression()? {
+            Expression::BinaryOp { left, operator, right } if matches!(left.as_ref(), Expression::Variable(name) if *name == variable) => {
+                match operator {
+                    BinaryOperator::Less => *right,
+                    BinaryOperator::LessEqual => Expression::BinaryOp {
+                        left: right,
+                        operator: BinaryOperator::Add,
+                        right: Box::new(Expression::Literal(Value::Int(1))),
+                    },
+                    _ => return Err(Self::parallel_header_error(&variable)),
+                }
+            },
+            _ => return Err(Self::parallel_header_error(&variable)),
+        };
+        self.consume(Token::Semicolon, "Se esperaba ';' después de la condición del pfor")?;
+        
+        // El incremento solo puede ser `i = i + 1`
+        let increments_by_one = match self.current_token() {
+            Token::Identifier(name) if *name == variable => {
+                self.advance();
+                self.consume(Token::Equal, "Se esperaba '=' en el incremento del pfor")?;
+                matches!(self.parse_expression()?, Expression::BinaryOp { left, operator: BinaryOperator::Add, right }
+                    if matches!(left.as_ref(), Expression::Variable(name) if *name == variable) &&
+                       matches!(right.as_ref(), Expression::Literal(Value::Int(1))))
+            },
+            _ => false,
+        };
+        if !increments_by_one {
+            return Err(Self::parallel_header_error(&variable));
+        }
+        
+        let reductions = if matches!(self.current_token(), Token::Identifier(name) if name == "reduce") {
+            self.advance();
+            self.parse_reductions()?
+        } else {
+            Vec::new()
+        };
+        
+        let body = self.parse_block()?;
+        
+        Ok(Statement::ParallelFor { variable, start, end, reductions, body })
+    }
+    
+    fn parallel_header_error(variable: &str) -> YafError {
+        YafError::ParseError(format!(
+            "La cabecera de un pfor tiene que ser '{0} = inicio; {0} < fin; {0} = {0} + 1' (o '{0} <= fin')",
+            variable
+        ))
+    }
+    
+    // (+: total, max: mayor)
+    fn parse_reductions(&mut self) -> Result<Vec<Reduction>> {
+        self.consume(Token::LeftParen, "Se esperaba '(' después de 'reduce'")?;
+        let mut reductions = Vec::new();
+        loop {
+            let operator = match self.current_token() {
+                Token::Plus => ReductionOperator::Add,
+                Token::Identifier(name) if name == "min" => ReductionOperator::Min,
+                Token::Identifier(name) if name == "max" => ReductionOperator::Max,
+                _ => return Err(YafError::ParseError("Operador de reducción desconocido: se esperaba '+', 'min' o 'max'".to_string())),
+            };
+            self.advance();
+            self.consume(Token::Colon, "Se esperaba ':' después del operador de reducción")?;
+            let variable = match self.current_token() {
+                Token::Identifier(name) => name.clone(),
+                _ => return Err(YafError::ParseError("Se esperaba la variable de la reducción".to_string())),
+            };
+            self.advance();
+            reductions.push(Reduction { operator, variable });
+            
+            if !self.check(&Token::Comma) {
+                break;
+            }
+            self.advance();
+        }
+        self.consume(Token::RightParen, "Se esperaba ')' al final de 'reduce'")?;
+        Ok(reductions)
+    }
+    
     fn parse_return_statement(&mut self) -> Result<Statement> {
         self.consume(Token::Return, "Se esperaba 'return'")?;
         
@@ -778,11 +912,36 @@ impl Parser {
                 self.consume(Token::RightBracket, "Se esperaba ']' después de los elementos del array")?;
                 Ok(Expression::ArrayLiteral { elements })
             },
+            Token::MapType => {
+                // map[K, V] { clave: valor, ... }
+                let (key_type, value_type) = self.parse_map_type()?;
+                self.consume(Token::LeftBrace, "Se esperaba '{' después del tipo del map")?;
+                let mut entries = Vec::new();
+                
+                if !self.check(&Token::RightBrace) {
+                    loop {
+                        let key = self.parse_expression()?;
+                        self.consume(Token::Colon, "Se esperaba ':' después de la clave")?;
+                        let value = self.parse_expression()?;
+                        entries.push((key, value));
+                        if self.check(&Token::Comma) {
+                            self.advance();
+                        } else {
+                            break;
+                        }
+                    }
+                }
+                
+                self.consume(Token::RightBrace, "Se esperaba '}' después de las entradas del map")?;
+                Ok(Expression::MapLiteral { key_type, value_type, entries })
+            },
             Token::Identifier(name) => {
                 let name = name.clone();
                 
-                // Verificar si es una función de librería built-in
-                if matches!(name.as_str(), "abs" | "max" | "min" | "pow" | "length" | "upper" | "lower" | "concat" | "substring" | "read_file" | "write_file" | "file_exists" | "now" | "now_millis" | "sleep" | "str" | "int" | "float" | "input" | "input_prompt" | "string_to_int" | "int_to_string") {
+                // Verificar si es una función de librería built-in (solo si va seguida de
+                // '(', así nombres como `open` o `eof` siguen sirviendo como variables)
+                let is_call = matches!(self.tokens.get(self.current + 1).map(|t| &t.token), Some(Token::LeftParen));
+                if is_call && matches!(name.as_str(), "abs" | "max" | "min" | "pow" | "length" | "upper" | "lower" | "concat" | "find" | "contains" | "substring" | "read_file" | "write_file" | "file_exists" | "open" | "read_line" | "eof" | "close" | "file_open" | "file_write" | "file_close" | "now" | "now_millis" | "now_nanos" | "clock_monotonic" | "sleep" | "sleep_ms" | "black_box" | "memory_stats" | "str" | "int" | "float" | "input" | "input_prompt" | "string_to_int" | "int_to_string" | "push" | "pop" | "map_get" | "map_set" | "map_has" | "map_delete" | "flush" | "http_get" | "http_post" | "http_get_all" | "http_status_all" | "tcp_connect_all" | "tcp_request") {
                     self.advance();
                     self.consume(Token::LeftParen, "Se esperaba '(' después de función built-in")?;
                     
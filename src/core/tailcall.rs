@@ -0,0 +1,214 @@
+//! # Self tail calls
+//!
+//! Finds the `return` statements of a function that the code generators can
+//! turn into a jump back to the top of the function instead of a call, so
+//! the recursion runs in constant stack space:
+//!
+//! - `return f(args)` inside `f`: the arguments become the new parameters.
+//! - `return e * f(args)` or `return f(args) * e` (also `+`) in a function
+//!   returning int: `e` is folded into an accumulator local and the call
+//!   becomes a jump; every other `return v` then returns `acc * v`. Integer
+//!   `+` and `*` wrap, so they are associative and commutative and the
+//!   regrouping gives the same result. The loop evaluates `e` before the
+//!   new arguments, which is the original order for `e * f(args)`; there `e`
+//!   must only make no calls. In `f(args) * e` it ran after the recursion,
+//!   which may write a global or an array `e` reads, so `e` may only use
+//!   parameters and literals, and divide only by nonzero literals.
+//!
+//! @memo functions are left alone: their recursive calls go through the cache.
+
+use crate::core::ast::*;
+use crate::runtime::values::Value;
+
+/// The loop one function's self tail calls become
+#[derive(Debug, Clone, PartialEq)]
+pub struct TailLoop {
+    function: String,
+    arity: usize,
+    parameters: Vec<String>,
+    /// Operator of the accumulator, when the function has one
+    pub accumulator: Option<BinaryOperator>,
+}
+
+impl TailLoop {
+    /// Value the accumulator starts with
+    pub fn identity(&self) -> i64 {
+        match self.accumulator {
+            Some(BinaryOperator::Multiply) => 1,
+            _ => 0,
+        }
+    }
+    
+    /// What `return value` does in the function
+    pub fn classify<'a>(&self, value: &'a Expression) -> TailReturn<'a> {
+        if let Some(arguments) = self.self_call(value) {
+            return TailReturn::Jump { arguments, operand: None };
+        }
+        match self.accumulating(value) {
+            Some((operator, operand, arguments)) if self.accumulator.as_ref() == Some(&operator) => {
+                TailReturn::Jump { arguments, operand: Some(operand) }
+            },
+            _ => TailReturn::Value,
+        }
+    }
+    
+    fn self_call<'a>(&self, expr: &'a Expression) -> Option<&'a [Expression]> {
+        match expr {
+            Expression::FunctionCall { name, arguments } if *name == self.function && arguments.len() == self.arity => {
+                Some(arguments)
+            },
+            _ => None,
+        }
+    }
+    
+    // `e op f(args)` with a call-free `e`, or `f(args) op e` with an `e` the
+    // recursion can't change (see the module docs)
+    fn accumulating<'a>(&self, expr: &'a Expression) -> Option<(BinaryOperator, &'a Expression, &'a [Expression])> {
+        let Expression::BinaryOp { left, operator, right } = expr else {
+            return None;
+        };
+        if !matches!(operator, BinaryOperator::Add | BinaryOperator::Multiply) {
+            return None;
+        }
+        let (operand, arguments) = match (self.self_call(left), self.self_call(right)) {
+            (None, Some(arguments)) if !makes_calls(left) => (left.as_ref(), arguments),
+            (Some(arguments), None) if self.independent(right) => (right.as_ref(), arguments),
+            _ => return None,
+        };
+        Some((operator.clone(), operand, arguments))
+    }
+    
+    // Whether `expr` gives the same value (or the same error) evaluated before
+    // the recursive call as after it
+    fn independent(&self, expr: &Expression) -> bool {
+        match expr {
+            Expression::Literal(_) => true,
+            Expression::Variable(name) => self.parameters.contains(name),
+            Expression::BinaryOp { left, operator: BinaryOperator::Divide | BinaryOperator::Modulo, right } => {
+                self.independent(left) && matches!(right.as_ref(), Expression::Literal(Value::Int(n)) if *n != 0)
+            },
+            Expression::BinaryOp { left, right, .. } => self.independent(left) && self.independent(right),
+            Expression::UnaryOp { operand, .. } => self.independent(operand),
+            _ => false,
+        }
+    }
+}
+
+/// What a `return` of a function with a tail loop does
+pub enum TailReturn<'a> {
+    /// Jump back with these arguments, first folding `operand` into the
+    /// accumulator when there is one
+    Jump { arguments: &'a [Expression], operand: Option<&'a Expression> },
+    /// Return the value (combined with the accumulator, when there is one)
+    Value,
+}
+
+/// The tail loop of `function`, if any of its returns can jump
+pub fn tail_loop(function: &Function) -> Option<TailLoop> {
+    if function.has_attribute("memo") {
+        return None;
+    }
+    let mut returns = Vec::new();
+    collect_returns(&function.body, &mut returns);
+    let mut tail = TailLoop {
+        function: function.name.clone(),
+        arity: function.parameters.len(),
+        parameters: function.parameters.iter().map(|param| param.name.clone()).collect(),
+        accumulator: None,
+    };
+
+    // All accumulating returns must agree on the operator
+    let mut operators = returns.iter().filter_map(|value| tail.accumulating(value).map(|(operator, _, _)| operator));
+    if let Some(first) = operators.next() {
+        if function.return_type == Type::Int && operators.all(|operator| operator == first) {
+            tail.accumulator = Some(first);
+        }
+    }
+
+    if returns.iter().any(|value| matches!(tail.classify(value), TailReturn::Jump { .. })) {
+        Some(tail)
+    } else {
+        None
+    }
+}
+
+fn collect_returns<'a>(block: &'a Block, returns: &mut Vec<&'a Expression>) {
+    for statement in &block.statements {
+        match statement {
+            Statement::Return { value: Some(value) } => returns.push(value),
+            Statement::If { then_block, else_block, .. } => {
+                collect_returns(then_block, returns);
+                if let Some(else_block) = else_block {
+                    collect_returns(else_block, returns);
+                }
+            },
+            Statement::While { body, .. } | Statement::For { body, .. } => collect_returns(body, returns),
+            // A pfor body is a function of its own
+            _ => {},
+        }
+    }
+}
+
+fn makes_calls(expr: &Expression) -> bool {
+    match expr {
+        Expression::Literal(_) | Expression::Variable(_) => false,
+        Expression::FunctionCall { .. } | Expression::BuiltinCall { .. } => true,
+        Expression::BinaryOp { left, right, .. } => makes_calls(left) || makes_calls(right),
+        Expression::UnaryOp { operand, .. } => makes_calls(operand),
+        Expression::ArrayAccess { array, index } => makes_calls(array) || makes_calls(index),
+        Expression::ArrayLiteral { .. } | Expression::MapLiteral { .. } => true,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::core::{Lexer, Parser};
+    
+    // The first function of `source`, in a program whose main sets the global `calls`
+    fn function(source: &str) -> Function {
+        let source = format!("{}\nfunc main() {{\n    calls = 0\n}}\n", source);
+        let tokens = Lexer::new(&source).tokenize().unwrap();
+        Parser::new(tokens).parse().unwrap().functions.remove(0)
+    }
+    
+    #[test]
+    fn an_operand_read_after_the_recursion_is_not_hoisted() {
+        // `calls` is a global the recursive call increments: the original
+        // adds its final value at every level, not the value before the call
+        let counting = function(r#"
+func count(n: int) -> int {
+    calls = calls + 1
+    if n == 0 {
+        return 0
+    }
+    return count(n - 1) + calls
+}
+"#);
+        assert_eq!(tail_loop(&counting), None);
+    }
+    
+    #[test]
+    fn an_operand_evaluated_before_the_recursion_still_accumulates() {
+        let counting = function(r#"
+func count(n: int) -> int {
+    calls = calls + 1
+    if n == 0 {
+        return 0
+    }
+    return calls + count(n - 1)
+}
+"#);
+        assert_eq!(tail_loop(&counting).and_then(|tail| tail.accumulator), Some(BinaryOperator::Add));
+        
+        let sum = function(r#"
+func sum(n: int) -> int {
+    if n == 0 {
+        return 0
+    }
+    return sum(n - 1) + n * 2
+}
+"#);
+        assert_eq!(tail_loop(&sum).and_then(|tail| tail.accumulator), Some(BinaryOperator::Add));
+    }
+}
@@ -1,12 +1,39 @@
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 use crate::core::ast::*;
 use crate::runtime::values::Value;
 use crate::error::{YafError, Result};
 
+// Builtins that go through process-wide state (stdin, file handles, the
+// output buffer, the connection pool) and so can't run in a pfor body
+const PARALLEL_UNSAFE_BUILTINS: &[&str] = &[
+    "input", "input_prompt", "open", "file_open", "read_line", "eof",
+    "file_write", "close", "file_close", "flush",
+    "http_get", "http_post", "http_get_all", "http_status_all", "tcp_connect_all", "tcp_request",
+];
+
+// Builtins whose result depends on something besides their arguments (the
+// clock, the file system, the heap) or that are there to defeat the
+// optimizer, on top of PARALLEL_UNSAFE_BUILTINS: a @memo function can't
+// use them
+const IMPURE_BUILTINS: &[&str] = &[
+    "read_file", "write_file", "file_exists",
+    "now", "now_millis", "now_nanos", "clock_monotonic", "sleep", "sleep_ms", "black_box",
+    "memory_stats",
+];
+
+// Builtins that modify the array or map passed as first argument
+const MUTATING_BUILTINS: &[&str] = &["push", "pop", "map_set", "map_delete"];
+
 pub struct TypeChecker {
     variables: HashMap<String, Type>,
     functions: HashMap<String, (Vec<Type>, Type)>, // (param_types, return_type)
     current_function_return_type: Option<Type>,
+    // Why a function can't be called from a pfor body, for those that can't
+    parallel_hazards: HashMap<String, String>,
+    // Why a function is not pure (see check_memo_functions), for those that aren't
+    impurities: HashMap<String, String>,
+    // Globals the program uses but doesn't define (see declare_global)
+    declared_globals: HashMap<String, Type>,
 }
 
 impl TypeChecker {
@@ -15,9 +42,23 @@ impl TypeChecker {
             variables: HashMap::new(),
             functions: HashMap::new(),
             current_function_return_type: None,
+            parallel_hazards: HashMap::new(),
+            impurities: HashMap::new(),
+            declared_globals: HashMap::new(),
         }
     }
     
+    /// Makes a global visible to the program without an assignment in its
+    /// main, like the variables of earlier REPL entries
+    pub fn declare_global(&mut self, name: &str, ty: Type) {
+        self.declared_globals.insert(name.to_string(), ty);
+    }
+    
+    /// Type of a top-level variable of the last checked program
+    pub fn global_type(&self, name: &str) -> Option<&Type> {
+        self.variables.get(name)
+    }
+    
     pub fn check(&mut self, program: &Program) -> Result<()> {
         // First pass: collect function signatures
         for function in &program.functions {
@@ -34,8 +75,11 @@ impl TypeChecker {
         
         // Second pass: Collect global variables from main block (only let statements)
         self.current_function_return_type = Some(Type::Void);
-        self.variables.clear();
+        self.variables = self.declared_globals.clone();
         self.collect_global_variables(&program.main)?;
+        self.parallel_hazards = self.collect_hazards(&program.functions, false);
+        self.impurities = self.collect_hazards(&program.functions, true);
+        self.check_memo_functions(&program.functions)?;
         
         // Third pass: type check function bodies with global variables available
         for function in &program.functions {
@@ -62,6 +106,178 @@ impl TypeChecker {
         Ok(())
     }
 
+    // A function is unsafe to call from a pfor body when it writes a global,
+    // modifies an array or map it was passed (it may be shared), uses a
+    // builtin from PARALLEL_UNSAFE_BUILTINS or calls a function that does.
+    // It is not pure (`pure`) when, on top of that, it reads a global, prints
+    // or uses a builtin from IMPURE_BUILTINS: two calls with the same
+    // arguments could then return different values or do different things.
+    // Calls are followed to a fixed point, so recursion is fine.
+    fn collect_hazards(&self, functions: &[Function], pure: bool) -> HashMap<String, String> {
+        let globals: HashSet<String> = self.variables.keys().cloned().collect();
+        let mut hazards = HashMap::new();
+        loop {
+            let mut changed = false;
+            for function in functions {
+                if hazards.contains_key(&function.name) {
+                    continue;
+                }
+                let parameters: HashSet<String> = function.parameters.iter().map(|p| p.name.clone()).collect();
+                let mut hazard = None;
+                Self::block_hazard(&function.body, &globals, &parameters, &hazards, pure, &mut hazard);
+                if let Some(reason) = hazard {
+                    hazards.insert(function.name.clone(), reason);
+                    changed = true;
+                }
+            }
+            if !changed {
+                break;
+            }
+        }
+        hazards
+    }
+    
+    // The code generators cache the result of a @memo function by its
+    // argument values, so it must be pure and take and return plain values:
+    // a cached array or map could be modified by whoever got it first.
+    fn check_memo_functions(&self, functions: &[Function]) -> Result<()> {
+        let cacheable = |t: &Type| matches!(t, Type::Int | Type::Float | Type::Bool | Type::String);
+        for function in functions.iter().filter(|function| function.has_attribute("memo")) {
+            if let Some(param) = function.parameters.iter().find(|p| !cacheable(&p.param_type)) {
+                return Err(YafError::TypeError(format!(
+                    "@memo function '{}': parameter '{}' must be int, float, bool or string, got {}",
+                    function.name, param.name, param.param_type.to_string()
+                )));
+            }
+            if !cacheable(&function.return_type) {
+                return Err(YafError::TypeError(format!(
+                    "@memo function '{}' must return int, float, bool or string, got {}",
+                    function.name, function.return_type.to_string()
+                )));
+            }
+            if let Some(reason) = self.impurities.get(&function.name) {
+                return Err(YafError::TypeError(format!(
+                    "@memo function '{}' is not pure: it {}", function.name, reason
+                )));
+            }
+        }
+        Ok(())
+    }
+    
+    fn block_hazard(block: &Block, globals: &HashSet<String>, parameters: &HashSet<String>,
+                    known: &HashMap<String, String>, pure: bool, hazard: &mut Option<String>) {
+        for statement in &block.statements {
+            if hazard.is_some() {
+                return;
+            }
+            let mut expressions: Vec<&Expression> = Vec::new();
+            match statement {
+                Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                    if globals.contains(name) && !parameters.contains(name) {
+                        *hazard = Some(format!("writes the global '{}'", name));
+                    }
+                    expressions.push(value);
+                },
+                Statement::ArrayAssignment { name, index, value } => {
+                    if parameters.contains(name) {
+                        *hazard = Some(format!("modifies its parameter '{}'", name));
+                    } else if globals.contains(name) {
+                        *hazard = Some(format!("modifies the global '{}'", name));
+                    }
+                    expressions.push(index);
+                    expressions.push(value);
+                },
+                Statement::If { condition, then_block, else_block } => {
+                    expressions.push(condition);
+                    Self::block_hazard(then_block, globals, parameters, known, pure, hazard);
+                    if let Some(else_block) = else_block {
+                        Self::block_hazard(else_block, globals, parameters, known, pure, hazard);
+                    }
+                },
+                Statement::While { condition, body } => {
+                    expressions.push(condition);
+                    Self::block_hazard(body, globals, parameters, known, pure, hazard);
+                },
+                Statement::For { init, condition, increment, body } => {
+                    expressions.push(condition);
+                    let header = Block { statements: vec![(**init).clone(), (**increment).clone()] };
+                    Self::block_hazard(&header, globals, parameters, known, pure, hazard);
+                    Self::block_hazard(body, globals, parameters, known, pure, hazard);
+                },
+                Statement::ParallelFor { start, end, reductions, body, .. } => {
+                    expressions.push(start);
+                    expressions.push(end);
+                    if let Some(reduction) = reductions.iter().find(|r| globals.contains(&r.variable) && !parameters.contains(&r.variable)) {
+                        *hazard = Some(format!("writes the global '{}'", reduction.variable));
+                    }
+                    Self::block_hazard(body, globals, parameters, known, pure, hazard);
+                },
+                Statement::Return { value } => expressions.extend(value.iter()),
+                Statement::Expression(expr) => expressions.push(expr),
+            }
+            for expr in expressions {
+                if hazard.is_none() {
+                    *hazard = Self::expression_hazard(expr, globals, parameters, known, pure);
+                }
+            }
+        }
+    }
+    
+    fn expression_hazard(expr: &Expression, globals: &HashSet<String>, parameters: &HashSet<String>,
+                         known: &HashMap<String, String>, pure: bool) -> Option<String> {
+        let arguments = match expr {
+            Expression::Variable(name) if pure && globals.contains(name) && !parameters.contains(name) => {
+                return Some(format!("reads the global '{}'", name));
+            },
+            Expression::Literal(_) | Expression::Variable(_) => return None,
+            Expression::FunctionCall { name, arguments } => {
+                if let Some(reason) = known.get(name) {
+                    return Some(format!("calls '{}', which {}", name, reason));
+                }
+                if pure && name == "print" {
+                    return Some("uses 'print'".to_string());
+                }
+                arguments.iter().collect::<Vec<_>>()
+            },
+            Expression::BuiltinCall { name, arguments } => {
+                if PARALLEL_UNSAFE_BUILTINS.contains(&name.as_str()) || (pure && IMPURE_BUILTINS.contains(&name.as_str())) {
+                    return Some(format!("uses '{}'", name));
+                }
+                if MUTATING_BUILTINS.contains(&name.as_str()) {
+                    match arguments.first().and_then(Self::container_variable) {
+                        Some(target) if parameters.contains(target) => {
+                            return Some(format!("modifies its parameter '{}'", target));
+                        },
+                        Some(target) if globals.contains(target) => {
+                            return Some(format!("modifies the global '{}'", target));
+                        },
+                        _ => {},
+                    }
+                }
+                arguments.iter().collect()
+            },
+            Expression::BinaryOp { left, right, .. } => vec![left.as_ref(), right.as_ref()],
+            Expression::UnaryOp { operand, .. } => vec![operand.as_ref()],
+            Expression::ArrayLiteral { elements } => elements.iter().collect(),
+            Expression::ArrayAccess { array, index } => vec![array.as_ref(), index.as_ref()],
+            Expression::MapLiteral { entries, .. } => entries.iter().flat_map(|(k, v)| [k, v]).collect(),
+        };
+        arguments.into_iter().find_map(|arg| Self::expression_hazard(arg, globals, parameters, known, pure))
+    }
+    
+    // Variable holding the container an expression refers to: `a` for `a`,
+    // `a[i]`, `a[i][j]` and `map_get(a, k)`
+    fn container_variable(expr: &Expression) -> Option<&str> {
+        match expr {
+            Expression::Variable(name) => Some(name),
+            Expression::ArrayAccess { array, .. } => Self::container_variable(array),
+            Expression::BuiltinCall { name, arguments } if name == "map_get" => {
+                arguments.first().and_then(Self::container_variable)
+            },
+            _ => None,
+        }
+    }
+    
     fn check_function(&mut self, function: &Function) -> Result<()> {
         // Keep global variables and add parameters to scope
         let mut function_scope = self.variables.clone();
@@ -83,6 +299,35 @@ impl TypeChecker {
         Ok(())
     }
     
+    // Keys are hashed by value: only scalars and strings
+    fn check_map_key_type(&self, key_type: &Type) -> Result<()> {
+        match key_type {
+            Type::Int | Type::String | Type::Bool => Ok(()),
+            _ => Err(YafError::TypeError(format!(
+                "Map keys must be int, string or bool, got {}", key_type.to_string()
+            ))),
+        }
+    }
+    
+    // Arguments of the http_* and tcp_* builtins, which all take fixed types
+    fn check_network_arguments(&mut self, name: &str, arguments: &[Expression], expected: &[Type]) -> Result<()> {
+        if arguments.len() != expected.len() {
+            return Err(YafError::TypeError(format!(
+                "{}() expects {} argument{}, got {}",
+                name, expected.len(), if expected.len() == 1 { "" } else { "s" }, arguments.len()
+            )));
+        }
+        for (argument, expected_type) in arguments.iter().zip(expected) {
+            let arg_type = self.check_expression(argument)?;
+            if arg_type != *expected_type {
+                return Err(YafError::TypeError(format!(
+                    "{}() expects {} argument, got {}", name, expected_type.to_string(), arg_type.to_string()
+                )));
+            }
+        }
+        Ok(())
+    }
+    
     fn check_block(&mut self, block: &Block) -> Result<()> {
         for statement in &block.statements {
             self.check_statement(statement)?;
@@ -225,6 +470,46 @@ impl TypeChecker {
                 self.variables = saved_vars;
             },
             
+            Statement::ParallelFor { variable, start, end, reductions, body } => {
+                for (bound, expr) in [("start", start), ("end", end)] {
+                    let bound_type = self.check_expression(expr)?;
+                    if bound_type != Type::Int {
+                        return Err(YafError::TypeError(format!(
+                            "pfor {} must be int, found {}", bound, bound_type.to_string()
+                        )));
+                    }
+                }
+                
+                for (i, reduction) in reductions.iter().enumerate() {
+                    let allowed = match (&reduction.operator, self.variables.get(&reduction.variable)) {
+                        (_, None) => return Err(YafError::UndefinedVariable(reduction.variable.clone())),
+                        (ReductionOperator::Add, Some(ty)) => *ty == Type::Int || *ty == Type::Float,
+                        (_, Some(ty)) => *ty == Type::Int,
+                    };
+                    if !allowed || reduction.variable == *variable {
+                        return Err(YafError::TypeError(format!(
+                            "Cannot reduce '{}' with {}: reductions take an int (or, with +, a float) variable other than the loop variable",
+                            reduction.variable, reduction.operator.to_string()
+                        )));
+                    }
+                    if reductions[..i].iter().any(|other| other.variable == reduction.variable) {
+                        return Err(YafError::TypeError(format!(
+                            "Variable '{}' is reduced twice", reduction.variable
+                        )));
+                    }
+                }
+                
+                // Lo visible antes del bucle es compartido entre iteraciones
+                let shared: HashSet<String> = self.variables.keys().cloned().collect();
+                let saved_vars = self.variables.clone();
+                self.variables.insert(variable.clone(), Type::Int);
+                self.check_block(body)?;
+                self.variables = saved_vars;
+                
+                let containers = Self::shared_containers(body, &shared);
+                self.check_parallel_block(body, variable, reductions, &shared, &containers)?;
+            },
+            
             Statement::Return { value } => {
                 let return_type = if let Some(expr) = value {
                     self.check_expression(expr)?
@@ -249,6 +534,212 @@ impl TypeChecker {
         Ok(())
     }
     
+    // Iterations of a pfor run concurrently and in any order, so its body may
+    // only write variables of its own. A reduction variable is only updated
+    // as `r = r + e` (or `r = min(r, e)`, `r = max(r, e)`) and not read
+    // otherwise: each chunk accumulates it separately and the results are
+    // combined after the loop.
+    fn check_parallel_block(&self, block: &Block, variable: &str, reductions: &[Reduction], shared: &HashSet<String>, containers: &HashSet<String>) -> Result<()> {
+        for statement in &block.statements {
+            match statement {
+                Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                    if let Some(reduction) = reductions.iter().find(|r| r.variable == *name) {
+                        let operand = Self::reduction_operand(reduction, value).ok_or_else(|| Self::reduction_misuse(reduction))?;
+                        self.check_parallel_expression(operand, reductions, shared, containers)?;
+                        continue;
+                    }
+                    if name == variable {
+                        return Err(YafError::TypeError(format!(
+                            "The pfor variable '{}' cannot be assigned", name
+                        )));
+                    }
+                    if shared.contains(name) {
+                        return Err(YafError::TypeError(format!(
+                            "pfor body cannot assign '{}', which is shared between iterations; use a reduction or a variable local to the body",
+                            name
+                        )));
+                    }
+                    self.check_parallel_expression(value, reductions, shared, containers)?;
+                },
+                Statement::ArrayAssignment { name, index, value } => {
+                    if containers.contains(name) {
+                        return Err(YafError::TypeError(format!(
+                            "pfor body cannot modify {}", Self::shared_container(name, "array ", shared)
+                        )));
+                    }
+                    self.check_parallel_expression(index, reductions, shared, containers)?;
+                    self.check_parallel_expression(value, reductions, shared, containers)?;
+                },
+                Statement::If { condition, then_block, else_block } => {
+                    self.check_parallel_expression(condition, reductions, shared, containers)?;
+                    self.check_parallel_block(then_block, variable, reductions, shared, containers)?;
+                    if let Some(else_block) = else_block {
+                        self.check_parallel_block(else_block, variable, reductions, shared, containers)?;
+                    }
+                },
+                Statement::While { condition, body } => {
+                    self.check_parallel_expression(condition, reductions, shared, containers)?;
+                    self.check_parallel_block(body, variable, reductions, shared, containers)?;
+                },
+                Statement::For { init, condition, increment, body } => {
+                    let header = Block { statements: vec![(**init).clone(), (**increment).clone()] };
+                    self.check_parallel_block(&header, variable, reductions, shared, containers)?;
+                    self.check_parallel_expression(condition, reductions, shared, containers)?;
+                    self.check_parallel_block(body, variable, reductions, shared, containers)?;
+                },
+                Statement::ParallelFor { start, end, reductions: inner, body, .. } => {
+                    self.check_parallel_expression(start, reductions, shared, containers)?;
+                    self.check_parallel_expression(end, reductions, shared, containers)?;
+                    // El pfor interior escribe sus reducciones al terminar
+                    for reduction in inner {
+                        if let Some(outer) = reductions.iter().find(|r| r.variable == reduction.variable) {
+                            return Err(Self::reduction_misuse(outer));
+                        }
+                        if shared.contains(&reduction.variable) {
+                            return Err(YafError::TypeError(format!(
+                                "pfor body cannot assign '{}', which is shared between iterations; use a reduction or a variable local to the body",
+                                reduction.variable
+                            )));
+                        }
+                    }
+                    self.check_parallel_block(body, variable, reductions, shared, containers)?;
+                },
+                Statement::Return { .. } => {
+                    return Err(YafError::TypeError("Cannot return from inside a pfor body".to_string()));
+                },
+                Statement::Expression(expr) => self.check_parallel_expression(expr, reductions, shared, containers)?,
+            }
+        }
+        Ok(())
+    }
+    
+    fn check_parallel_expression(&self, expr: &Expression, reductions: &[Reduction], shared: &HashSet<String>, containers: &HashSet<String>) -> Result<()> {
+        let arguments: Vec<&Expression> = match expr {
+            Expression::Literal(_) => Vec::new(),
+            Expression::Variable(name) => {
+                if let Some(reduction) = reductions.iter().find(|r| r.variable == *name) {
+                    return Err(Self::reduction_misuse(reduction));
+                }
+                Vec::new()
+            },
+            Expression::FunctionCall { name, arguments } => {
+                if let Some(reason) = self.parallel_hazards.get(name) {
+                    return Err(YafError::TypeError(format!(
+                        "pfor body cannot call '{}': it {}", name, reason
+                    )));
+                }
+                arguments.iter().collect()
+            },
+            Expression::BuiltinCall { name, arguments } => {
+                if PARALLEL_UNSAFE_BUILTINS.contains(&name.as_str()) {
+                    return Err(YafError::TypeError(format!(
+                        "pfor body cannot call '{}'", name
+                    )));
+                }
+                if MUTATING_BUILTINS.contains(&name.as_str()) {
+                    if let Some(target) = arguments.first().and_then(Self::container_variable) {
+                        if containers.contains(target) {
+                            return Err(YafError::TypeError(format!(
+                                "pfor body cannot modify {} with {}()", Self::shared_container(target, "", shared), name
+                            )));
+                        }
+                    }
+                }
+                arguments.iter().collect()
+            },
+            Expression::BinaryOp { left, right, .. } => vec![left.as_ref(), right.as_ref()],
+            Expression::UnaryOp { operand, .. } => vec![operand.as_ref()],
+            Expression::ArrayLiteral { elements } => elements.iter().collect(),
+            Expression::ArrayAccess { array, index } => vec![array.as_ref(), index.as_ref()],
+            Expression::MapLiteral { entries, .. } => entries.iter().flat_map(|(k, v)| [k, v]).collect(),
+        };
+        for argument in arguments {
+            self.check_parallel_expression(argument, reductions, shared, containers)?;
+        }
+        Ok(())
+    }
+    
+    // Arrays and maps are shared by reference, so a body local assigned a
+    // shared container, or an element of one (`b = a`, `row = grid[0]`), is
+    // the same container. Found to a fixed point over the whole body, since
+    // an inner loop may run an assignment before a use it follows.
+    fn shared_containers(block: &Block, shared: &HashSet<String>) -> HashSet<String> {
+        let mut containers = shared.clone();
+        loop {
+            let before = containers.len();
+            Self::collect_container_aliases(block, &mut containers);
+            if containers.len() == before {
+                return containers;
+            }
+        }
+    }
+    
+    fn collect_container_aliases(block: &Block, containers: &mut HashSet<String>) {
+        for statement in &block.statements {
+            match statement {
+                Statement::Declaration { name, value, .. } | Statement::Assignment { name, value } => {
+                    if Self::container_variable(value).is_some_and(|source| containers.contains(source)) {
+                        containers.insert(name.clone());
+                    }
+                },
+                Statement::If { then_block, else_block, .. } => {
+                    Self::collect_container_aliases(then_block, containers);
+                    if let Some(else_block) = else_block {
+                        Self::collect_container_aliases(else_block, containers);
+                    }
+                },
+                Statement::For { init, increment, body, .. } => {
+                    let header = Block { statements: vec![(**init).clone(), (**increment).clone()] };
+                    Self::collect_container_aliases(&header, containers);
+                    Self::collect_container_aliases(body, containers);
+                },
+                Statement::While { body, .. } | Statement::ParallelFor { body, .. } => {
+                    Self::collect_container_aliases(body, containers);
+                },
+                Statement::ArrayAssignment { .. } | Statement::Return { .. } | Statement::Expression(_) => {},
+            }
+        }
+    }
+    
+    fn shared_container(name: &str, kind: &str, shared: &HashSet<String>) -> String {
+        if shared.contains(name) {
+            format!("the shared {}'{}'", kind, name)
+        } else {
+            format!("'{}', which refers to a shared array or map", name)
+        }
+    }
+    
+    // The `e` of `r = r + e`, `r = e + r`, `r = min(r, e)`... for the reduction's operator
+    fn reduction_operand<'a>(reduction: &Reduction, value: &'a Expression) -> Option<&'a Expression> {
+        let is_target = |expr: &Expression| matches!(expr, Expression::Variable(name) if *name == reduction.variable);
+        let (left, right) = match (&reduction.operator, value) {
+            (ReductionOperator::Add, Expression::BinaryOp { left, operator: BinaryOperator::Add, right }) => {
+                (left.as_ref(), right.as_ref())
+            },
+            (ReductionOperator::Min, Expression::BuiltinCall { name, arguments }) |
+            (ReductionOperator::Max, Expression::BuiltinCall { name, arguments })
+                if name == reduction.operator.to_string() && arguments.len() == 2 => (&arguments[0], &arguments[1]),
+            _ => return None,
+        };
+        match (is_target(left), is_target(right)) {
+            (true, false) => Some(right),
+            (false, true) => Some(left),
+            _ => None,
+        }
+    }
+    
+    fn reduction_misuse(reduction: &Reduction) -> YafError {
+        let r = &reduction.variable;
+        let update = match reduction.operator {
+            ReductionOperator::Add => format!("{} = {} + ...", r, r),
+            ReductionOperator::Min => format!("{} = min({}, ...)", r, r),
+            ReductionOperator::Max => format!("{} = max({}, ...)", r, r),
+        };
+        YafError::TypeError(format!(
+            "Reduction variable '{}' can only be updated as '{}' inside the pfor", r, update
+        ))
+    }
+    
     fn check_expression(&mut self, expr: &Expression) -> Result<Type> {
         match expr {
             Expression::Literal(value) => {
@@ -545,6 +1036,22 @@ impl TypeChecker {
                 }
             },
             
+            Expression::MapLiteral { key_type, value_type, entries } => {
+                self.check_map_key_type(key_type)?;
+                for (key, value) in entries {
+                    let entry_key_type = self.check_expression(key)?;
+                    let entry_value_type = self.check_expression(value)?;
+                    if entry_key_type != *key_type || entry_value_type != *value_type {
+                        return Err(YafError::TypeError(format!(
+                            "Map entry has type {}: {}, expected {}: {}",
+                            entry_key_type.to_string(), entry_value_type.to_string(),
+                            key_type.to_string(), value_type.to_string()
+                        )));
+                    }
+                }
+                Ok(Type::Map(Box::new(key_type.clone()), Box::new(value_type.clone())))
+            },
+            
             Expression::ArrayAccess { array, index } => {
                 let array_type = self.check_expression(array)?;
                 let index_type = self.check_expression(index)?;
@@ -634,6 +1141,15 @@ impl TypeChecker {
                         }
                         Ok(Type::String)
                     },
+                    "flush" => {
+                        if !arguments.is_empty() {
+                            return Err(YafError::ArgumentMismatch(format!(
+                                "Function 'flush' expects no arguments, got {}",
+                                arguments.len()
+                            )));
+                        }
+                        Ok(Type::Void)
+                    },
                     "input_prompt" => {
                         if arguments.len() != 1 {
                             return Err(YafError::ArgumentMismatch(format!(
@@ -693,6 +1209,9 @@ impl TypeChecker {
                             )));
                         }
                         let arg_type = self.check_expression(&arguments[0])?;
+                        if name == "length" && matches!(arg_type, Type::Array(_) | Type::Map(_, _)) {
+                            return Ok(Type::Int);
+                        }
                         if arg_type != Type::String {
                             return Err(YafError::TypeError(format!(
                                 "{}() expects string argument, got {}", name, arg_type.to_string()
@@ -700,6 +1219,74 @@ impl TypeChecker {
                         }
                         Ok(Type::Int)
                     },
+                    // Array functions
+                    "push" => {
+                        if arguments.len() != 2 {
+                            return Err(YafError::TypeError(format!(
+                                "push() expects 2 arguments, got {}", arguments.len()
+                            )));
+                        }
+                        let array_type = self.check_expression(&arguments[0])?;
+                        let value_type = self.check_expression(&arguments[1])?;
+                        match array_type {
+                            Type::Array(element_type) if *element_type == value_type => Ok(Type::Void),
+                            Type::Array(element_type) => Err(YafError::TypeError(format!(
+                                "push() expects {} element, got {}",
+                                element_type.to_string(), value_type.to_string()
+                            ))),
+                            _ => Err(YafError::TypeError(format!(
+                                "push() expects array argument, got {}", array_type.to_string()
+                            ))),
+                        }
+                    },
+                    "pop" => {
+                        if arguments.len() != 1 {
+                            return Err(YafError::TypeError(format!(
+                                "pop() expects 1 argument, got {}", arguments.len()
+                            )));
+                        }
+                        match self.check_expression(&arguments[0])? {
+                            Type::Array(element_type) => Ok(*element_type),
+                            other => Err(YafError::TypeError(format!(
+                                "pop() expects array argument, got {}", other.to_string()
+                            ))),
+                        }
+                    },
+                    // Map functions: map_get(m, k), map_set(m, k, v), map_has(m, k), map_delete(m, k)
+                    "map_get" | "map_set" | "map_has" | "map_delete" => {
+                        let expected = if name == "map_set" { 3 } else { 2 };
+                        if arguments.len() != expected {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects {} arguments, got {}", name, expected, arguments.len()
+                            )));
+                        }
+                        let (key_type, value_type) = match self.check_expression(&arguments[0])? {
+                            Type::Map(key_type, value_type) => (*key_type, *value_type),
+                            other => return Err(YafError::TypeError(format!(
+                                "{}() expects map argument, got {}", name, other.to_string()
+                            ))),
+                        };
+                        let arg_key_type = self.check_expression(&arguments[1])?;
+                        if arg_key_type != key_type {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects {} key, got {}", name, key_type.to_string(), arg_key_type.to_string()
+                            )));
+                        }
+                        match name.as_str() {
+                            "map_get" => Ok(value_type),
+                            "map_set" => {
+                                let arg_value_type = self.check_expression(&arguments[2])?;
+                                if arg_value_type != value_type {
+                                    return Err(YafError::TypeError(format!(
+                                        "map_set() expects {} value, got {}",
+                                        value_type.to_string(), arg_value_type.to_string()
+                                    )));
+                                }
+                                Ok(Type::Void)
+                            },
+                            _ => Ok(Type::Bool),
+                        }
+                    },
                     "upper" | "lower" | "string_upper" | "string_lower" => {
                         if arguments.len() != 1 {
                             return Err(YafError::TypeError(format!(
@@ -730,6 +1317,22 @@ impl TypeChecker {
                         }
                         Ok(Type::String)
                     },
+                    "find" | "contains" => {
+                        if arguments.len() != 2 {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects 2 arguments, got {}", name, arguments.len()
+                            )));
+                        }
+                        let haystack_type = self.check_expression(&arguments[0])?;
+                        let needle_type = self.check_expression(&arguments[1])?;
+                        if haystack_type != Type::String || needle_type != Type::String {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects string arguments, got {} and {}", 
+                                name, haystack_type.to_string(), needle_type.to_string()
+                            )));
+                        }
+                        Ok(if name == "find" { Type::Int } else { Type::Bool })
+                    },
                     
                     // I/O functions
                     "read_file" => {
@@ -776,9 +1379,76 @@ impl TypeChecker {
                         }
                         Ok(Type::Bool)
                     },
+                    "open" => {
+                        if arguments.len() != 1 {
+                            return Err(YafError::TypeError(format!(
+                                "open() expects 1 argument, got {}", arguments.len()
+                            )));
+                        }
+                        let arg_type = self.check_expression(&arguments[0])?;
+                        if arg_type != Type::String {
+                            return Err(YafError::TypeError(format!(
+                                "open() expects string argument, got {}", arg_type.to_string()
+                            )));
+                        }
+                        Ok(Type::Int)
+                    },
+                    "file_open" => {
+                        if arguments.len() != 2 {
+                            return Err(YafError::TypeError(format!(
+                                "file_open() expects 2 arguments, got {}", arguments.len()
+                            )));
+                        }
+                        let path_type = self.check_expression(&arguments[0])?;
+                        let mode_type = self.check_expression(&arguments[1])?;
+                        if path_type != Type::String || mode_type != Type::String {
+                            return Err(YafError::TypeError(format!(
+                                "file_open() expects string arguments, got {} and {}", 
+                                path_type.to_string(), mode_type.to_string()
+                            )));
+                        }
+                        if let Expression::Literal(Value::String(mode)) = &arguments[1] {
+                            if !matches!(mode.as_str(), "r" | "w" | "a") {
+                                return Err(YafError::TypeError(format!(
+                                    "file_open() mode must be \"r\", \"w\" or \"a\", got \"{}\"", mode
+                                )));
+                            }
+                        }
+                        Ok(Type::Int)
+                    },
+                    "file_write" => {
+                        if arguments.len() != 2 {
+                            return Err(YafError::TypeError(format!(
+                                "file_write() expects 2 arguments, got {}", arguments.len()
+                            )));
+                        }
+                        let handle_type = self.check_expression(&arguments[0])?;
+                        let content_type = self.check_expression(&arguments[1])?;
+                        if handle_type != Type::Int || content_type != Type::String {
+                            return Err(YafError::TypeError(format!(
+                                "file_write() expects a file handle (int) and a string, got {} and {}", 
+                                handle_type.to_string(), content_type.to_string()
+                            )));
+                        }
+                        Ok(Type::Bool)
+                    },
+                    "read_line" | "eof" | "close" | "file_close" => {
+                        if arguments.len() != 1 {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects 1 argument, got {}", name, arguments.len()
+                            )));
+                        }
+                        let arg_type = self.check_expression(&arguments[0])?;
+                        if arg_type != Type::Int {
+                            return Err(YafError::TypeError(format!(
+                                "{}() expects a file handle (int), got {}", name, arg_type.to_string()
+                            )));
+                        }
+                        Ok(if name == "read_line" { Type::String } else { Type::Bool })
+                    },
                     
                     // Time functions
-                    "now" | "now_millis" => {
+                    "now" | "now_millis" | "now_nanos" | "clock_monotonic" => {
                         if !arguments.is_empty() {
                             return Err(YafError::TypeError(format!(
                                 "{}() expects no arguments, got {}", name, arguments.len()
@@ -786,20 +1456,57 @@ impl TypeChecker {
                         }
                         Ok(Type::Int)
                     },
-                    "sleep" => {
+                    "sleep" | "sleep_ms" => {
                         if arguments.len() != 1 {
                             return Err(YafError::TypeError(format!(
-                                "sleep() expects 1 argument, got {}", arguments.len()
+                                "{}() expects 1 argument, got {}", name, arguments.len()
                             )));
                         }
                         let arg_type = self.check_expression(&arguments[0])?;
-                        if arg_type != Type::Int {
+                        if arg_type != Type::Int && arg_type != Type::Float {
                             return Err(YafError::TypeError(format!(
-                                "sleep() expects int argument, got {}", arg_type.to_string()
+                                "{}() expects a number, got {}", name, arg_type.to_string()
                             )));
                         }
                         Ok(Type::Bool)
                     },
+                    "memory_stats" => {
+                        if !arguments.is_empty() {
+                            return Err(YafError::TypeError(format!(
+                                "memory_stats() expects no arguments, got {}", arguments.len()
+                            )));
+                        }
+                        Ok(Type::Map(Box::new(Type::String), Box::new(Type::Int)))
+                    },
+                    "black_box" => {
+                        if arguments.len() != 1 {
+                            return Err(YafError::TypeError(format!(
+                                "black_box() expects 1 argument, got {}", arguments.len()
+                            )));
+                        }
+                        self.check_expression(&arguments[0])
+                    },
+                    
+                    // Network functions
+                    "http_get" | "http_post" | "tcp_request" => {
+                        let expected = match name.as_str() {
+                            "http_get" => vec![Type::String],
+                            "http_post" => vec![Type::String, Type::String],
+                            _ => vec![Type::String, Type::String, Type::Int],
+                        };
+                        self.check_network_arguments(name, arguments, &expected)?;
+                        Ok(Type::String)
+                    },
+                    "http_get_all" | "http_status_all" | "tcp_connect_all" => {
+                        let urls = Type::Array(Box::new(Type::String));
+                        let expected = if name == "http_get_all" { vec![urls] } else { vec![urls, Type::Int] };
+                        self.check_network_arguments(name, arguments, &expected)?;
+                        Ok(Type::Array(Box::new(match name.as_str() {
+                            "http_get_all" => Type::String,
+                            "http_status_all" => Type::Int,
+                            _ => Type::Bool,
+                        })))
+                    },
                     
                     // Type conversion functions
                     "str" => {
@@ -838,4 +1545,82 @@ impl TypeChecker {
             },
         }
     }
-}
\ No newline at end of file
+}
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::core::{Lexer, Parser};
+    
+    fn check(source: &str) -> Result<()> {
+        let tokens = Lexer::new(source).tokenize()?;
+        let program = Parser::new(tokens).parse()?;
+        TypeChecker::new().check(&program)
+    }
+    
+    fn rejected(source: &str) -> String {
+        match check(source) {
+            Err(YafError::TypeError(message)) => message,
+            other => panic!("expected a type error, got {:?}", other),
+        }
+    }
+    
+    #[test]
+    fn pfor_rejects_pushing_to_an_alias_of_a_shared_array() {
+        let message = rejected(r#"
+func main() {
+    a = [1, 2, 3]
+    pfor i = 0; i < 3; i = i + 1 {
+        b = a
+        push(b, i)
+    }
+}
+"#);
+        assert!(message.contains("'b', which refers to a shared"), "{}", message);
+    }
+    
+    #[test]
+    fn pfor_rejects_storing_through_an_alias_of_a_shared_array() {
+        let message = rejected(r#"
+func main() {
+    a = [1, 2, 3]
+    pfor i = 0; i < 3; i = i + 1 {
+        b = a
+        b[i] = 0
+    }
+}
+"#);
+        assert!(message.contains("'b', which refers to a shared"), "{}", message);
+    }
+    
+    #[test]
+    fn pfor_rejects_modifying_an_element_of_a_shared_array() {
+        let message = rejected(r#"
+func main() {
+    grid = [[1, 2], [3, 4]]
+    pfor i = 0; i < 2; i = i + 1 {
+        row = grid[0]
+        push(row, i)
+    }
+}
+"#);
+        assert!(message.contains("'row', which refers to a shared"), "{}", message);
+    }
+    
+    #[test]
+    fn pfor_allows_locals_read_from_a_shared_array() {
+        check(r#"
+func main() {
+    a = [1, 2, 3]
+    total = 0
+    pfor i = 0; i < 3; i = i + 1 reduce(+: total) {
+        v = a[i]
+        v = v * 2
+        copy = [v]
+        push(copy, v)
+        total = total + copy[1]
+    }
+    print(int_to_string(total))
+}
+"#).expect("type checks");
+    }
+}
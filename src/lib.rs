@@ -16,6 +16,7 @@ pub mod libs;
 pub mod runtime;
 pub mod diagnostics;
 pub mod error;
+pub mod timing;
 
 // Re-export commonly used types
 pub use crate::core::ast::*;
@@ -6,6 +6,10 @@ mod libs;
 mod error;
 mod cli;
 mod diagnostics;
+mod bench;
+mod timing;
+mod pgo;
+mod cache;
 
 use std::path::{Path, PathBuf};
 use anyhow::{Result, anyhow};
@@ -15,13 +19,20 @@ use colored::*;
 use tracing::info;
 
 // Use the new modular structure
-use crate::core::{Lexer, Parser, Program, TypeChecker};
+use crate::core::{Lexer, Optimizer, Parser, Program, TypeChecker};
 // Backend types imported as needed
 #[cfg(feature = "llvm-backend")]
-use crate::backend::llvm::LLVMCodeGenerator;
+use crate::backend::llvm::{JitSession, LLVMCodeGenerator};
 use crate::backend::c::CodeGenerator;
 use crate::cli::{Args, Commands};
 use crate::diagnostics::DiagnosticEngine;
+use crate::timing::{CountingAllocator, PassTimings};
+use crate::pgo::Pgo;
+use crate::cache::CompileCache;
+
+// Counts allocations for --time-passes
+#[global_allocator]
+static ALLOCATOR: CountingAllocator = CountingAllocator;
 
 fn main() -> Result<()> {
     // Initialize tracing
@@ -39,13 +50,24 @@ fn main() -> Result<()> {
             emit_asm, 
             keep_temps, 
             lto, 
-            debug 
+            debug,
+            time_passes,
+            profile_gen,
+            profile_use,
+            profile
         } => {
-            compile_program(&input, output, backend, emit_ir, emit_llvm, emit_asm, keep_temps, lto, debug, args.optimization, &args.target, args.verbose)
+            let pgo = Pgo::from_args(profile_gen, profile_use, &yaf_cache_dir(), args.verbose)?;
+            compile_program(&input, output, backend, emit_ir, emit_llvm, emit_asm, keep_temps, lto, debug, time_passes, &pgo, profile, args.optimization, &args.target, args.verbose)
+        },
+        Commands::Build { inputs, out_dir, backend, jobs } => {
+            build_programs(&inputs, out_dir.as_deref(), backend, jobs, args.optimization, &args.target, args.verbose)
         },
         Commands::Run { input, args: run_args, backend } => {
             run_program(&input, run_args, backend, args.optimization, &args.target, args.verbose)
         },
+        Commands::Bench { input, samples, warmup, backend } => {
+            bench_program(&input, samples, warmup, backend, args.optimization, &args.target, args.verbose)
+        },
         Commands::Check { input } => {
             check_program(&input, args.verbose)
         },
@@ -72,23 +94,196 @@ fn compile_program(
     emit_llvm: bool, 
     emit_asm: bool,
     keep_temps: bool,
-    _lto: bool,
+    lto: bool,
     _debug: bool,
+    time_passes: bool,
+    pgo: &Pgo,
+    profile: bool,
     opt_level: u8,
     _target: &str,
     verbose: bool
 ) -> Result<()> {
     info!("Compiling {} with {} backend", input.display(), backend);
     
+    let mut timings = PassTimings::new(time_passes);
+    let ast = load_program(input, &mut timings, verbose)?;
+    
+    let output_name = output.unwrap_or_else(|| {
+        input.with_extension("")
+    });
+    
+    compile_checked(&ast, &output_name, backend, emit_ir, emit_llvm, emit_asm, keep_temps, lto, pgo, profile, opt_level, _target, &mut timings, verbose)?;
+    
+    if let Pgo::Generate(directory) = pgo {
+        let directory = directory.as_deref().unwrap_or(Path::new("."));
+        println!("{} Instrumented build: run it, then rebuild with --profile-use={}", "ℹ".blue(), directory.display());
+    }
+    if time_passes {
+        println!("{}", timings.report());
+    }
+    Ok(())
+}
+
+// `yaf build`: compiles every input as `yaf compile` would, on `jobs`
+// threads that each take the next source when they finish one. Every
+// compile has its own LLVM context, and shared files (runtime objects,
+// cache entries) are built under temporary names and renamed.
+fn build_programs(inputs: &[PathBuf], out_dir: Option<&Path>, backend: cli::Backend, jobs: Option<usize>, opt_level: u8, target: &str, verbose: bool) -> Result<()> {
+    use std::collections::HashSet;
+    use std::sync::Mutex;
+    use std::sync::atomic::{AtomicUsize, Ordering};
+    
+    let mut sources = Vec::new();
+    for input in inputs {
+        collect_sources(input, &mut sources)?;
+    }
+    if sources.is_empty() {
+        return Err(anyhow!("No .yaf files to build"));
+    }
+    
+    let builds: Vec<(PathBuf, PathBuf)> = sources.into_iter()
+        .map(|source| {
+            let output = match out_dir {
+                Some(dir) => dir.join(source.file_stem().unwrap_or_default()),
+                None => source.with_extension(""),
+            };
+            (source, output)
+        })
+        .collect();
+    let mut outputs = HashSet::new();
+    for (source, output) in &builds {
+        if !outputs.insert(output) {
+            return Err(anyhow!("{} builds {}, like another input", source.display(), output.display()));
+        }
+    }
+    if let Some(dir) = out_dir {
+        std::fs::create_dir_all(dir)?;
+    }
+    
+    let jobs = jobs
+        .unwrap_or_else(|| std::thread::available_parallelism().map_or(1, |cores| cores.get()))
+        .clamp(1, builds.len());
+    if verbose {
+        info!("Building {} programs with {} jobs", builds.len(), jobs);
+    }
+    
+    // LLVM's target registry is filled here, not by each compile thread
+    #[cfg(feature = "llvm-backend")]
+    LLVMCodeGenerator::initialize_targets();
+    
+    let start = std::time::Instant::now();
+    let next = AtomicUsize::new(0);
+    let failed = Mutex::new(Vec::new());
+    std::thread::scope(|scope| {
+        for _ in 0..jobs {
+            scope.spawn(|| {
+                while let Some((source, output)) = builds.get(next.fetch_add(1, Ordering::Relaxed)) {
+                    let result = compile_program(
+                        source, Some(output.clone()), backend.clone(),
+                        false, false, false, false, false, false, false, &Pgo::Off, false,
+                        opt_level, target, verbose
+                    );
+                    if let Err(e) = result {
+                        eprintln!("{} {}: {}", "✗".red(), source.display(), e);
+                        failed.lock().unwrap().push(source.clone());
+                    }
+                }
+            });
+        }
+    });
+    
+    let failed = failed.into_inner().unwrap();
+    if !failed.is_empty() {
+        return Err(anyhow!("{} of {} programs failed to build", failed.len(), builds.len()));
+    }
+    let plural = if builds.len() == 1 { "" } else { "s" };
+    println!("{} Built {} program{} in {:.2}s", "✓".green(), builds.len(), plural, start.elapsed().as_secs_f64());
+    Ok(())
+}
+
+// The input itself, or every .yaf file under the directory (sorted, so
+// builds run in a stable order)
+fn collect_sources(path: &Path, sources: &mut Vec<PathBuf>) -> Result<()> {
+    if path.is_dir() {
+        let mut entries: Vec<PathBuf> = std::fs::read_dir(path)?
+            .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+            .collect();
+        entries.sort();
+        for entry in entries {
+            if entry.is_dir() || entry.extension().is_some_and(|extension| extension == "yaf") {
+                collect_sources(&entry, sources)?;
+            }
+        }
+    } else if path.exists() {
+        sources.push(path.to_path_buf());
+    } else {
+        return Err(anyhow!("Input not found: {}", path.display()));
+    }
+    Ok(())
+}
+
+// Back end half of compile_program, for an already checked program
+fn compile_checked(
+    ast: &Program,
+    output_name: &Path,
+    backend: cli::Backend,
+    emit_ir: bool,
+    emit_llvm: bool,
+    emit_asm: bool,
+    keep_temps: bool,
+    lto: bool,
+    pgo: &Pgo,
+    profile: bool,
+    opt_level: u8,
+    _target: &str,
+    timings: &mut PassTimings,
+    verbose: bool
+) -> Result<()> {
+    match backend {
+        cli::Backend::Llvm => {
+            #[cfg(feature = "llvm-backend")]
+            {
+                compile_with_llvm(&ast, &output_name, emit_ir, emit_llvm, emit_asm, lto, pgo, profile, opt_level, _target, timings, verbose)
+            }
+            #[cfg(not(feature = "llvm-backend"))]
+            {
+                println!("{} LLVM backend not available. Use --features llvm-backend to enable.", "⚠".yellow());
+                compile_with_c(&ast, &output_name, keep_temps, pgo, profile, opt_level, timings, verbose)
+            }
+        },
+        cli::Backend::Jit => {
+            Err(anyhow!("The JIT backend runs programs in-process; use `yaf run --backend jit`"))
+        },
+        cli::Backend::Cranelift => {
+            compile_with_cranelift(&ast, &output_name, opt_level, timings, verbose)
+        },
+        cli::Backend::C => {
+            compile_with_c(&ast, &output_name, keep_temps, pgo, profile, opt_level, timings, verbose)
+        },
+    }
+}
+
+// Front end: lexing, parsing, type checking and AST folding, with
+// diagnostics on failure
+fn load_program(input: &Path, timings: &mut PassTimings, verbose: bool) -> Result<Program> {
     let source = std::fs::read_to_string(input)
         .map_err(|e| anyhow!("Failed to read input file: {}", e))?;
     
+    // A source this compiler already checked: its folded AST is cached
+    let cache = CompileCache::new(yaf_cache_dir());
+    if let Some(ast) = timings.time("cache", || cache.load_ast(&source)) {
+        if verbose {
+            info!("Front end skipped: {} is unchanged", input.display());
+        }
+        return Ok(ast);
+    }
+    
     let mut diagnostics = DiagnosticEngine::new();
     diagnostics.add_source(input.to_string_lossy().as_ref(), source.clone());
     
     // Tokenization
     let mut lexer = Lexer::new(&source);
-    let tokens = match lexer.tokenize() {
+    let tokens = match timings.time("lex", || lexer.tokenize()) {
         Ok(tokens) => tokens,
         Err(err) => {
             // Usar la línea y columna exactas del error de lexer
@@ -109,7 +304,7 @@ fn compile_program(
     
     // Parsing
     let mut parser = Parser::new(tokens);
-    let ast = match parser.parse() {
+    let ast = match timings.time("parse", || parser.parse()) {
         Ok(ast) => ast,
         Err(err) => {
             // Usar la línea y columna exactas del error
@@ -131,7 +326,7 @@ fn compile_program(
     
     // Type checking
     let mut type_checker = TypeChecker::new();
-    if let Err(err) = type_checker.check(&ast) {
+    if let Err(err) = timings.time("typecheck", || type_checker.check(&ast)) {
         diagnostics.from_yaf_error(&err, input.to_string_lossy().as_ref(), 1, 1);
         diagnostics.emit_all();
         return Err(anyhow!("Type checking failed"));
@@ -141,29 +336,11 @@ fn compile_program(
         info!("Type checking completed");
     }
     
-    let output_name = output.unwrap_or_else(|| {
-        input.with_extension("")
-    });
+    // Constant folding and compile-time evaluation of pure calls
+    let ast = timings.time("fold", || Optimizer::new().optimize(ast));
+    cache.store_ast(&source, &ast);
     
-    match backend {
-        cli::Backend::Llvm => {
-            #[cfg(feature = "llvm-backend")]
-            {
-                compile_with_llvm(&ast, &output_name, emit_ir, emit_llvm, emit_asm, opt_level, _target, verbose)
-            }
-            #[cfg(not(feature = "llvm-backend"))]
-            {
-                println!("{} LLVM backend not available. Use --features llvm-backend to enable.", "⚠".yellow());
-                compile_with_c(&ast, &output_name, keep_temps, opt_level, verbose)
-            }
-        },
-        cli::Backend::Cranelift => {
-            compile_with_cranelift(&ast, &output_name, opt_level, verbose)
-        },
-        cli::Backend::C => {
-            compile_with_c(&ast, &output_name, keep_temps, opt_level, verbose)
-        },
-    }
+    Ok(ast)
 }
 
 #[cfg(feature = "llvm-backend")]
@@ -173,30 +350,61 @@ fn compile_with_llvm(
     emit_ir: bool, 
     emit_llvm: bool, 
     emit_asm: bool,
+    lto: bool,
+    pgo: &Pgo,
+    profile: bool,
     opt_level: u8,
     _target: &str,
+    timings: &mut PassTimings,
     verbose: bool
 ) -> Result<()> {
     use inkwell::context::Context;
-    use inkwell::OptimizationLevel;
     
     let context = Context::create();
-    let opt_level = match opt_level {
-        0 => OptimizationLevel::None,
-        1 => OptimizationLevel::Less,
-        2 => OptimizationLevel::Default,
-        3 => OptimizationLevel::Aggressive,
-        _ => OptimizationLevel::Default,
-    };
-    
-    let mut codegen = LLVMCodeGenerator::new(&context, "yaf_program", opt_level);
+    let mut codegen = LLVMCodeGenerator::new(&context, "yaf_program", llvm_opt_level(opt_level));
+    codegen.set_profiling(profile);
     
     if verbose {
         info!("Generating LLVM IR...");
     }
     
-    codegen.generate(ast.clone())?;
-    codegen.verify()?;
+    timings.time("codegen", || codegen.generate(ast))?;
+    timings.time("verify", || codegen.verify())?;
+    let runtime_module = if lto { Some(runtime_bitcode(verbose)?) } else { None };
+    
+    // The same module before optimizing, and the same flags, give the object
+    // code of an earlier build: only linking is left
+    let cache = CompileCache::new(yaf_cache_dir());
+    let cached = if !emit_ir && !emit_llvm && !emit_asm {
+        let mut flags = vec!["llvm".to_string(), clang_opt_flag(opt_level).to_string()];
+        flags.extend(pgo.clang_flag());
+        flags.extend(runtime_module.as_ref().map(|bitcode| bitcode.display().to_string()));
+        cache.object(&[codegen.emit_llvm_ir().as_bytes()], &flags)
+    } else {
+        None
+    };
+    if let Some(entry) = cached.as_ref().filter(|entry| entry.exists()) {
+        if verbose {
+            info!("Object code unchanged, reusing {}", entry.display());
+        }
+        timings.time("link", || link_executable(entry, output, lto, pgo, verbose))?;
+        println!("{} Executable created: {}", "✓".green(), output.display());
+        return Ok(());
+    }
+    
+    if let Some(runtime_bitcode) = &runtime_module {
+        // Whole-program mode: the runtime joins the module before optimizing
+        codegen.link_runtime_bitcode(runtime_bitcode)?;
+        codegen.verify()?;
+        if verbose {
+            info!("Runtime bitcode linked: {}", runtime_bitcode.display());
+        }
+    }
+    
+    if verbose {
+        info!("Running LLVM optimization pipeline...");
+    }
+    timings.time("optimize", || codegen.optimize_module())?;
     
     if emit_llvm {
         let llvm_ir = codegen.emit_llvm_ir();
@@ -206,16 +414,41 @@ fn compile_with_llvm(
     }
     
     if !emit_ir && !emit_asm {
-        // Generate object file
+        // Generate object file. With PGO, clang compiles the optimized module
+        // again with the profile flag, which instruments it or applies the profile.
         let obj_file = output.with_extension("o");
-        codegen.emit_to_file(&obj_file)?;
+        if let Some(flag) = pgo.clang_flag() {
+            let bitcode_file = output.with_extension("bc");
+            timings.time("emit", || codegen.emit_bitcode(&bitcode_file))?;
+            let result = timings.time("cc", || {
+                std::process::Command::new("clang")
+                    .arg("-c")
+                    .arg(clang_opt_flag(opt_level))
+                    .arg(&flag)
+                    .arg(&bitcode_file)
+                    .arg("-o")
+                    .arg(&obj_file)
+                    .output()
+            })?;
+            std::fs::remove_file(&bitcode_file).ok();
+            if !result.status.success() {
+                eprintln!("{} Compiling the profiled module failed:", "✗".red());
+                eprintln!("{}", String::from_utf8_lossy(&result.stderr));
+                return Err(anyhow!("Compiling the profiled module failed"));
+            }
+        } else {
+            timings.time("emit", || codegen.emit_to_file(&obj_file))?;
+        }
         
         if verbose {
             info!("Object file generated: {}", obj_file.display());
         }
+        if let Some(entry) = &cached {
+            cache.store_object(entry, &obj_file);
+        }
         
         // Link to create executable
-        link_executable(&obj_file, output)?;
+        timings.time("link", || link_executable(&obj_file, output, lto, pgo, verbose))?;
         
         // Clean up object file if not keeping temps
         std::fs::remove_file(&obj_file).ok();
@@ -226,103 +459,269 @@ fn compile_with_llvm(
     Ok(())
 }
 
-fn compile_with_cranelift(ast: &Program, output: &Path, opt_level: u8, verbose: bool) -> Result<()> {
+#[cfg(feature = "llvm-backend")]
+fn llvm_opt_level(opt_level: u8) -> inkwell::OptimizationLevel {
+    use inkwell::OptimizationLevel;
+    
+    match opt_level {
+        0 => OptimizationLevel::None,
+        1 => OptimizationLevel::Less,
+        2 => OptimizationLevel::Default,
+        3 => OptimizationLevel::Aggressive,
+        _ => OptimizationLevel::Default,
+    }
+}
+
+// Runs a checked program in this process: no object file, link step or
+// temporary executable. Returns the exit code of the program's main.
+#[cfg(feature = "llvm-backend")]
+fn run_with_jit(ast: &Program, args: &[String], opt_level: u8, verbose: bool) -> Result<i32> {
+    use inkwell::context::Context;
+    
+    let context = Context::create();
+    let mut codegen = LLVMCodeGenerator::new(&context, "yaf_jit", llvm_opt_level(opt_level));
+    codegen.generate(ast)?;
+    codegen.verify()?;
+    codegen.optimize_module()?;
+    
+    // The runtime symbols come from yaf_runtime.c built as a shared library
+    let runtime_library = cached_runtime_artifact(Path::new("runtime/yaf_runtime.c"), &["-shared", "-fPIC", "-O2", "-pthread"], "so", verbose)
+        .map_err(|e| anyhow!("YAF runtime library compilation failed: {}", e))?;
+    
+    if verbose {
+        info!("Running main in JIT");
+    }
+    codegen.run_jit(&runtime_library, args)
+}
+
+#[cfg(not(feature = "llvm-backend"))]
+fn run_with_jit(_ast: &Program, _args: &[String], _opt_level: u8, _verbose: bool) -> Result<i32> {
+    Err(anyhow!("JIT backend not available. Use --features llvm-backend to enable."))
+}
+
+// Runs one REPL entry in-process; returns 1 if it stopped at a runtime error
+#[cfg(feature = "llvm-backend")]
+fn run_repl_entry(ast: &Program, session: &mut JitSession) -> Result<i32> {
+    use inkwell::context::Context;
+    
+    // Values of the session can point into the code of any earlier entry,
+    // so every entry's context lives as long as the REPL
+    let context: &'static Context = Box::leak(Box::new(Context::create()));
+    let mut codegen = LLVMCodeGenerator::new(context, "yaf_repl", llvm_opt_level(1));
+    codegen.continue_session(session);
+    codegen.generate(ast)?;
+    codegen.verify()?;
+    codegen.optimize_module()?;
+    
+    let runtime_library = cached_runtime_artifact(Path::new("runtime/yaf_runtime.c"), &["-shared", "-fPIC", "-O2", "-pthread"], "so", false)
+        .map_err(|e| anyhow!("YAF runtime library compilation failed: {}", e))?;
+    codegen.run_session_entry(&runtime_library, session)
+}
+
+fn compile_with_cranelift(ast: &Program, output: &Path, opt_level: u8, timings: &mut PassTimings, verbose: bool) -> Result<()> {
     // TODO: Implement Cranelift backend
     println!("{} Cranelift backend not yet implemented", "⚠".yellow());
-    compile_with_c(ast, output, false, opt_level, verbose)
+    compile_with_c(ast, output, false, &Pgo::Off, false, opt_level, timings, verbose)
 }
 
-fn compile_with_c(ast: &Program, output: &Path, keep_temps: bool, opt_level: u8, verbose: bool) -> Result<()> {
+fn compile_with_c(ast: &Program, output: &Path, keep_temps: bool, pgo: &Pgo, profile: bool, opt_level: u8, timings: &mut PassTimings, verbose: bool) -> Result<()> {
     if verbose {
         info!("Generating C code...");
     }
     
     let mut codegen = CodeGenerator::new();
-    let c_code = codegen.generate(ast.clone())?;
+    codegen.set_profiling(profile);
+    let c_code = timings.time("codegen", || codegen.generate(ast))?;
     
     let c_file = output.with_extension("c");
-    std::fs::write(&c_file, c_code)?;
+    std::fs::write(&c_file, &c_code)?;
     
     if verbose {
         info!("C code generated: {}", c_file.display());
     }
     
-    // Compile C code with YAF runtime
-    let runtime_file = Path::new("runtime/yaf_runtime.c");
-    let mut compile_cmd = std::process::Command::new("clang");
-    compile_cmd
-        .arg(&c_file)
-        .arg(runtime_file)
-        .arg("-o")
-        .arg(output)
-        .arg("-lm");
+    // The same C code, header and flags compile to the object code of an
+    // earlier build; otherwise clang compiles it and the cache keeps a copy
+    let mut flags = vec!["c".to_string(), clang_opt_flag(opt_level).to_string()];
+    flags.extend(pgo.clang_flag());
+    let header = std::fs::read("runtime/yaf_runtime.h").unwrap_or_default();
+    let cache = CompileCache::new(yaf_cache_dir());
+    let cached = cache.object(&[c_code.as_bytes(), &header], &flags);
+    
+    let obj_file = output.with_extension("o");
+    let object = match cached.as_ref().filter(|entry| entry.exists()) {
+        Some(entry) => {
+            if verbose {
+                info!("Object code unchanged, reusing {}", entry.display());
+            }
+            entry.clone()
+        },
+        None => {
+            let mut compile_cmd = std::process::Command::new("clang");
+            compile_cmd
+                .arg("-c")
+                .arg("-Iruntime")
+                .args(RUNTIME_DEFINES)
+                .args(&flags[1..])
+                .arg(&c_file)
+                .arg("-o")
+                .arg(&obj_file);
+            
+            let output_result = timings.time("cc", || compile_cmd.output())?;
+            
+            if !output_result.status.success() {
+                eprintln!("{} C compilation failed:", "✗".red());
+                eprintln!("{}", String::from_utf8_lossy(&output_result.stderr));
+                return Err(anyhow!("C compilation failed"));
+            }
+            if let Some(entry) = &cached {
+                cache.store_object(entry, &obj_file);
+            }
+            obj_file.clone()
+        },
+    };
+    
+    // Link with the (cached) YAF runtime object
+    let linked = timings.time("link", || link_executable(&object, output, false, pgo, verbose));
+    std::fs::remove_file(&obj_file).ok();
+    if !keep_temps {
+        std::fs::remove_file(&c_file).ok();
+    }
+    linked?;
     
+    println!("{} Executable created: {}", "✓".green(), output.display());
+    Ok(())
+}
+
+fn clang_opt_flag(opt_level: u8) -> &'static str {
     match opt_level {
-        0 => { compile_cmd.arg("-O0"); },
-        1 => { compile_cmd.arg("-O1"); },
-        2 => { compile_cmd.arg("-O2"); },
-        3 => { compile_cmd.arg("-O3"); },
-        _ => { compile_cmd.arg("-O2"); },
+        0 => "-O0",
+        1 => "-O1",
+        3 => "-O3",
+        _ => "-O2",
+    }
+}
+
+// Directory for artifacts that outlive a single compile (runtime builds...)
+fn yaf_cache_dir() -> PathBuf {
+    if let Some(dir) = std::env::var_os("YAF_CACHE_DIR") {
+        return PathBuf::from(dir);
+    }
+    if let Some(dir) = std::env::var_os("XDG_CACHE_HOME") {
+        return PathBuf::from(dir).join("yaf");
+    }
+    if let Some(home) = std::env::var_os("HOME") {
+        return PathBuf::from(home).join(".cache").join("yaf");
     }
+    std::env::temp_dir().join("yaf-cache")
+}
+
+// Preprocessor flags every runtime build gets, from the cargo features
+#[cfg(feature = "nan-boxing")]
+const RUNTIME_DEFINES: &[&str] = &["-DYAF_NAN_BOXING"];
+#[cfg(not(feature = "nan-boxing"))]
+const RUNTIME_DEFINES: &[&str] = &[];
+
+// Compiles a runtime source with clang, or reuses an earlier build. The
+// cache key covers the source, the runtime headers, the target and the
+// clang flags, so edits to the runtime or different flags get their own entry.
+fn cached_runtime_artifact(source_path: &Path, flags: &[&str], extension: &str, verbose: bool) -> Result<PathBuf> {
+    use std::collections::hash_map::DefaultHasher;
+    use std::hash::{Hash, Hasher};
     
-    let output_result = compile_cmd.output()?;
+    let source = std::fs::read(source_path)
+        .map_err(|e| anyhow!("Failed to read {}: {}", source_path.display(), e))?;
+    let header = std::fs::read("runtime/yaf_runtime.h").unwrap_or_default();
     
-    if !output_result.status.success() {
-        eprintln!("{} C compilation failed:", "✗".red());
-        eprintln!("{}", String::from_utf8_lossy(&output_result.stderr));
-        return Err(anyhow!("C compilation failed"));
+    let mut hasher = DefaultHasher::new();
+    source.hash(&mut hasher);
+    header.hash(&mut hasher);
+    flags.hash(&mut hasher);
+    RUNTIME_DEFINES.hash(&mut hasher);
+    std::env::consts::ARCH.hash(&mut hasher);
+    std::env::consts::OS.hash(&mut hasher);
+    
+    let stem = source_path.file_stem().and_then(|stem| stem.to_str()).unwrap_or("runtime");
+    let cache_dir = yaf_cache_dir();
+    std::fs::create_dir_all(&cache_dir)?;
+    let artifact = cache_dir.join(format!("{}-{:016x}.{}", stem, hasher.finish(), extension));
+    if artifact.exists() {
+        return Ok(artifact);
     }
     
-    if !keep_temps {
-        std::fs::remove_file(&c_file).ok();
+    if verbose {
+        info!("Building {} -> {}", source_path.display(), artifact.display());
     }
     
-    println!("{} Executable created: {}", "✓".green(), output.display());
-    Ok(())
+    // Build next to the final name and rename, so concurrent compiles never
+    // pick up a partial file
+    let partial = cache::partial_path(&artifact);
+    let output = std::process::Command::new("clang")
+        .args(flags)
+        .args(RUNTIME_DEFINES)
+        .arg(source_path)
+        .arg("-o")
+        .arg(&partial)
+        .arg("-I")
+        .arg("runtime") // Include runtime headers
+        .output()?;
+    if !output.status.success() {
+        std::fs::remove_file(&partial).ok();
+        return Err(anyhow!("{}", String::from_utf8_lossy(&output.stderr)));
+    }
+    std::fs::rename(&partial, &artifact)?;
+    
+    Ok(artifact)
+}
+
+// LLVM bitcode of runtime/yaf_runtime.c for --lto
+#[cfg(feature = "llvm-backend")]
+fn runtime_bitcode(verbose: bool) -> Result<PathBuf> {
+    cached_runtime_artifact(Path::new("runtime/yaf_runtime.c"), &["-c", "-emit-llvm", "-O2"], "bc", verbose)
+        .map_err(|e| {
+            eprintln!("{} YAF runtime bitcode compilation failed:", "⚠".yellow());
+            eprintln!("{}", e);
+            anyhow!("YAF runtime bitcode compilation failed")
+        })
+}
+
+// Object of runtime/yaf_runtime.c, built with the same PGO flag as the program
+fn runtime_object(pgo: &Pgo, verbose: bool) -> Result<PathBuf> {
+    let flag = pgo.clang_flag();
+    let mut flags = vec!["-c", "-O2"];
+    flags.extend(flag.as_deref());
+    cached_runtime_artifact(Path::new("runtime/yaf_runtime.c"), &flags, "o", verbose)
 }
 
-fn link_executable(obj_file: &Path, output: &Path) -> Result<()> {
-    // First, compile the YAF runtime
+fn link_executable(obj_file: &Path, output: &Path, runtime_linked: bool, pgo: &Pgo, verbose: bool) -> Result<()> {
+    // The YAF runtime object comes from the cache (unless --lto already
+    // merged its bitcode into the program)
     let yaf_runtime_path = Path::new("runtime/yaf_runtime.c");
-    let yaf_obj_path = output.with_extension("yaf_runtime.o");
-    
-    if yaf_runtime_path.exists() {
-        let mut compile_runtime_cmd = std::process::Command::new("clang");
-        compile_runtime_cmd
-            .arg("-c")
-            .arg(yaf_runtime_path)
-            .arg("-o")
-            .arg(&yaf_obj_path)
-            .arg("-O2")
-            .arg("-I")
-            .arg("runtime"); // Include runtime headers
-        
-        let runtime_output = compile_runtime_cmd.output()?;
-        if !runtime_output.status.success() {
-            eprintln!("{} YAF runtime compilation failed:", "⚠".yellow());
-            eprintln!("{}", String::from_utf8_lossy(&runtime_output.stderr));
-            return Err(anyhow!("YAF runtime compilation failed"));
+    let mut yaf_obj_path = None;
+    
+    if yaf_runtime_path.exists() && !runtime_linked {
+        match runtime_object(pgo, verbose) {
+            Ok(path) => yaf_obj_path = Some(path),
+            Err(e) => {
+                eprintln!("{} YAF runtime compilation failed:", "⚠".yellow());
+                eprintln!("{}", e);
+                return Err(anyhow!("YAF runtime compilation failed"));
+            }
         }
     }
     
-    // Then, compile the GC runtime
+    // Then, the GC runtime
     let gc_runtime_path = Path::new("src/gc_runtime.c");
-    let gc_obj_path = output.with_extension("gc.o");
+    let mut gc_obj_path = None;
     
     if gc_runtime_path.exists() {
-        let mut compile_gc_cmd = std::process::Command::new("clang");
-        compile_gc_cmd
-            .arg("-c")
-            .arg(gc_runtime_path)
-            .arg("-o")
-            .arg(&gc_obj_path)
-            .arg("-O2");
-        
-        let gc_output = compile_gc_cmd.output()?;
-        if !gc_output.status.success() {
-            eprintln!("{} GC runtime compilation failed:", "⚠".yellow());
-            eprintln!("{}", String::from_utf8_lossy(&gc_output.stderr));
-            // Continue without GC runtime
+        match cached_runtime_artifact(gc_runtime_path, &["-c", "-O2"], "o", verbose) {
+            Ok(path) => gc_obj_path = Some(path),
+            Err(e) => {
+                eprintln!("{} GC runtime compilation failed:", "⚠".yellow());
+                eprintln!("{}", e);
+                // Continue without GC runtime
+            }
         }
     }
     
@@ -330,19 +729,25 @@ fn link_executable(obj_file: &Path, output: &Path) -> Result<()> {
     link_cmd
         .arg(obj_file)
         .arg("-o")
-        .arg(output)
-        .arg("-lm");
+        .arg(output);
+    // The instrumented build links clang's profile runtime
+    if let Some(flag) = pgo.clang_flag() {
+        link_cmd.arg(flag);
+    }
     
     // Add YAF runtime (required)
-    if yaf_obj_path.exists() {
-        link_cmd.arg(&yaf_obj_path);
+    if let Some(path) = &yaf_obj_path {
+        link_cmd.arg(path);
     }
     
     // Add GC runtime if it was compiled successfully
-    if gc_obj_path.exists() {
-        link_cmd.arg(&gc_obj_path);
+    if let Some(path) = &gc_obj_path {
+        link_cmd.arg(path);
     }
     
+    // Libraries after the objects that use them
+    link_cmd.arg("-lm").arg("-pthread");
+    
     let output_result = link_cmd.output()?;
     
     if !output_result.status.success() {
@@ -355,13 +760,22 @@ fn link_executable(obj_file: &Path, output: &Path) -> Result<()> {
 }
 
 fn run_program(input: &Path, args: Vec<String>, backend: cli::Backend, opt_level: u8, target: &str, verbose: bool) -> Result<()> {
+    if let cli::Backend::Jit = backend {
+        let ast = load_program(input, &mut PassTimings::new(false), verbose)?;
+        let exit_code = run_with_jit(&ast, &args, opt_level, verbose)?;
+        if exit_code != 0 {
+            return Err(anyhow!("Program execution failed (exit code {})", exit_code));
+        }
+        return Ok(());
+    }
+    
     let temp_output = input.with_extension("");
     
     compile_program(
         input, 
         Some(temp_output.clone()), 
         backend, 
-        false, false, false, false, false, false,
+        false, false, false, false, false, false, false, &Pgo::Off, false,
         opt_level, target, verbose
     )?;
     
@@ -384,6 +798,57 @@ fn run_program(input: &Path, args: Vec<String>, backend: cli::Backend, opt_level
     Ok(())
 }
 
+// Compiles the program once with a harness main that times each @bench
+// function (see bench.rs), runs it and reports the statistics
+fn bench_program(input: &Path, samples: u32, warmup: u32, backend: cli::Backend, opt_level: u8, target: &str, verbose: bool) -> Result<()> {
+    if samples == 0 {
+        return Err(anyhow!("--samples must be at least 1"));
+    }
+    let backend = match backend {
+        cli::Backend::Jit => cli::Backend::Llvm, // timing needs a standalone process
+        other => other,
+    };
+    
+    let ast = load_program(input, &mut PassTimings::new(false), verbose)?;
+    let benchmarks = bench::benchmark_functions(&ast)?;
+    let harness = bench::build_harness(&ast, &benchmarks, samples, warmup);
+    
+    let executable = std::env::temp_dir().join(format!("yaf-bench-{}", std::process::id()));
+    compile_checked(&harness, &executable, backend, false, false, false, false, false, &Pgo::Off, false, opt_level, target, &mut PassTimings::new(false), verbose)?;
+    
+    if verbose {
+        info!("Running benchmarks: {}", executable.display());
+    }
+    let output = std::process::Command::new(&executable).output();
+    std::fs::remove_file(&executable).ok();
+    let output = output?;
+    if !output.status.success() {
+        eprintln!("{}", String::from_utf8_lossy(&output.stderr));
+        return Err(anyhow!("Benchmark execution failed"));
+    }
+    
+    let samples = bench::parse_samples(&String::from_utf8_lossy(&output.stdout), benchmarks.len());
+    
+    println!("{:<24} {:>8} {:>12} {:>12} {:>12} {:>12} {:>12}", "benchmark", "samples", "min", "median", "mean", "p99", "stddev");
+    for (name, samples) in benchmarks.iter().zip(samples) {
+        match bench::BenchStats::from_samples(samples) {
+            Some(stats) => println!(
+                "{:<24} {:>8} {:>12} {:>12} {:>12} {:>12} {:>12}",
+                name,
+                stats.samples,
+                bench::format_nanos(stats.min),
+                bench::format_nanos(stats.median),
+                bench::format_nanos(stats.mean),
+                bench::format_nanos(stats.p99),
+                format!("±{}", bench::format_nanos(stats.stddev)),
+            ),
+            None => println!("{:<24} {}", name, "no samples".yellow()),
+        }
+    }
+    
+    Ok(())
+}
+
 fn check_program(input: &Path, verbose: bool) -> Result<()> {
     let source = std::fs::read_to_string(input)?;
     
@@ -468,11 +933,126 @@ fn start_lsp() -> Result<()> {
     Ok(())
 }
 
+#[cfg(not(feature = "llvm-backend"))]
 fn start_repl(_backend: cli::Backend) -> Result<()> {
-    println!("{} REPL not yet implemented", "⚠".yellow());
+    Err(anyhow!("The REPL needs the JIT backend. Use --features llvm-backend to enable."))
+}
+
+#[cfg(feature = "llvm-backend")]
+fn start_repl(backend: cli::Backend) -> Result<()> {
+    use std::io::{BufRead, Write};
+    
+    if !matches!(backend, cli::Backend::Jit) {
+        println!("{} The REPL always runs on the JIT (ignoring --backend {})", "⚠".yellow(), backend);
+    }
+    println!("YAF REPL - functions and variables persist between entries, Ctrl-D to exit");
+    
+    let mut session = ReplSession::default();
+    let stdin = std::io::stdin();
+    let mut pending = String::new();
+    
+    loop {
+        print!("{}", if pending.is_empty() { "yaf> " } else { "...> " });
+        std::io::stdout().flush().ok();
+        
+        let mut line = String::new();
+        if stdin.lock().read_line(&mut line)? == 0 {
+            println!();
+            break;
+        }
+        pending.push_str(&line);
+        
+        // Blocks may span several lines: wait until braces balance
+        if pending.matches('{').count() > pending.matches('}').count() {
+            continue;
+        }
+        
+        let entry = std::mem::take(&mut pending);
+        if entry.trim().is_empty() {
+            continue;
+        }
+        if let Err(err) = session.eval(&entry) {
+            eprintln!("{} {}", "✗".red(), err);
+        }
+    }
+    
     Ok(())
 }
 
+// State kept between REPL entries. Each entry is compiled and run as a
+// program made of the session functions and the new statements; the
+// top-level variables of earlier entries keep their values in `jit`, so
+// their definitions never run again.
+#[cfg(feature = "llvm-backend")]
+#[derive(Default)]
+struct ReplSession {
+    functions: Vec<core::Function>,
+    variables: std::collections::HashMap<String, core::Type>,
+    jit: JitSession,
+}
+
+#[cfg(feature = "llvm-backend")]
+impl ReplSession {
+    fn eval(&mut self, source: &str) -> Result<()> {
+        use crate::core::{Block, Expression, Statement};
+        
+        let tokens = Lexer::new(source).tokenize().map_err(|e| anyhow!("{}", e))?;
+        let entry = Parser::new(tokens).parse().map_err(|e| anyhow!("{}", e))?;
+        
+        let mut functions = self.functions.clone();
+        for function in entry.functions {
+            functions.retain(|existing| existing.name != function.name);
+            functions.push(function);
+        }
+        
+        // Bare expressions are echoed
+        let statements: Vec<Statement> = entry.main.statements.into_iter().map(|stmt| match stmt {
+            Statement::Expression(expr) if !matches!(&expr, Expression::FunctionCall { name, .. } if name == "print") => {
+                Statement::Expression(Expression::FunctionCall { name: "print".to_string(), arguments: vec![expr] })
+            },
+            other => other,
+        }).collect();
+        
+        let program = Program { functions: functions.clone(), main: Block { statements } };
+        let mut type_checker = TypeChecker::new();
+        for (name, ty) in &self.variables {
+            type_checker.declare_global(name, ty.clone());
+        }
+        type_checker.check(&program).map_err(|e| anyhow!("{}", e))?;
+        
+        // A variable given a value of another type starts over
+        let stale: Vec<String> = self.jit.variables()
+            .filter(|name| type_checker.global_type(name) != self.variables.get(*name))
+            .map(str::to_string)
+            .collect();
+        for name in stale {
+            self.jit.forget(&name);
+        }
+        
+        let status = run_repl_entry(&program, &mut self.jit)?;
+        
+        // Variables of the program the type checker doesn't see at the top
+        // level (loop variables, say) are not part of the session
+        let unseen: Vec<String> = self.jit.variables()
+            .filter(|name| type_checker.global_type(name).is_none())
+            .map(str::to_string)
+            .collect();
+        for name in unseen {
+            self.jit.forget(&name);
+        }
+        self.variables = self.jit.variables()
+            .filter_map(|name| type_checker.global_type(name).map(|ty| (name.to_string(), ty.clone())))
+            .collect();
+        
+        // Only functions of entries that ran to the end become part of the session
+        if status != 0 {
+            return Err(anyhow!("The entry stopped at a runtime error; its functions were not kept"));
+        }
+        self.functions = functions;
+        Ok(())
+    }
+}
+
 fn show_info() -> Result<()> {
     println!("{}", "Yaf Programming Language".bright_cyan().bold());
     println!("Version: 0.1.0");
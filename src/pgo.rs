@@ -0,0 +1,108 @@
+//! # Profile-guided optimization
+//!
+//! `yaf compile --profile-gen` builds an instrumented executable; running
+//! it writes `.profraw` files. `yaf compile --profile-use=<profile>` then
+//! rebuilds with the recorded branch and call counts, so clang inlines the
+//! hot calls, lays cold blocks out of line and weights the branches.
+//!
+//! Both backends leave the instrumentation to clang: the program (the C
+//! source, or the optimized LLVM module as bitcode) and the runtime are
+//! compiled with the same `-fprofile-generate` / `-fprofile-use` flag. The
+//! profile therefore matches as long as the program and compiler flags are
+//! the same in both builds.
+
+use anyhow::{Result, anyhow};
+use std::path::{Path, PathBuf};
+use tracing::info;
+
+#[derive(Debug, Clone, Default)]
+pub enum Pgo {
+    #[default]
+    Off,
+    /// Instrument; profiles go to the directory, or the current one
+    Generate(Option<PathBuf>),
+    /// Optimize with this indexed (.profdata) profile
+    Use(PathBuf),
+}
+
+impl Pgo {
+    /// Mode for the --profile-gen and --profile-use arguments. A raw
+    /// profile is merged here, once, so every clang run reads the same file.
+    pub fn from_args(generate: Option<Option<PathBuf>>, profile: Option<PathBuf>, cache_dir: &Path, verbose: bool) -> Result<Pgo> {
+        match (generate, profile) {
+            (Some(directory), None) => Ok(Pgo::Generate(directory)),
+            (None, Some(profile)) => Ok(Pgo::Use(indexed_profile(&profile, cache_dir, verbose)?)),
+            (None, None) => Ok(Pgo::Off),
+            (Some(_), Some(_)) => Err(anyhow!("--profile-gen and --profile-use can't be used together")),
+        }
+    }
+
+    /// The clang flag for compiling and linking, if any
+    pub fn clang_flag(&self) -> Option<String> {
+        match self {
+            Pgo::Off => None,
+            Pgo::Generate(None) => Some("-fprofile-generate".to_string()),
+            Pgo::Generate(Some(directory)) => Some(format!("-fprofile-generate={}", directory.display())),
+            Pgo::Use(profile) => Some(format!("-fprofile-use={}", profile.display())),
+        }
+    }
+}
+
+// clang only reads indexed profiles: .profraw files (a file, or every one
+// in a directory) are merged with llvm-profdata first. The result is copied
+// into the cache under the hash of its contents, so a cached runtime built
+// with -fprofile-use=<path> is never reused for a different profile.
+fn indexed_profile(profile: &Path, cache_dir: &Path, verbose: bool) -> Result<PathBuf> {
+    use std::collections::hash_map::DefaultHasher;
+    use std::hash::{Hash, Hasher};
+
+    if !profile.exists() {
+        return Err(anyhow!("Profile not found: {}", profile.display()));
+    }
+    std::fs::create_dir_all(cache_dir)?;
+
+    let merged = if profile.extension().is_some_and(|extension| extension == "profdata") {
+        std::fs::read(profile)?
+    } else {
+        let inputs: Vec<PathBuf> = if profile.is_dir() {
+            std::fs::read_dir(profile)?
+                .filter_map(|entry| entry.ok().map(|entry| entry.path()))
+                .filter(|path| path.extension().is_some_and(|extension| extension == "profraw"))
+                .collect()
+        } else {
+            vec![profile.to_path_buf()]
+        };
+        if inputs.is_empty() {
+            return Err(anyhow!("No .profraw files in {}", profile.display()));
+        }
+        if verbose {
+            info!("Merging {} raw profile(s) from {}", inputs.len(), profile.display());
+        }
+
+        let partial = cache_dir.join(format!("profile.{}.profdata", std::process::id()));
+        let output = std::process::Command::new("llvm-profdata")
+            .arg("merge")
+            .arg("-o")
+            .arg(&partial)
+            .args(&inputs)
+            .output()
+            .map_err(|e| anyhow!("Could not run llvm-profdata (needed to merge .profraw files): {}", e))?;
+        if !output.status.success() {
+            std::fs::remove_file(&partial).ok();
+            return Err(anyhow!("llvm-profdata merge failed: {}", String::from_utf8_lossy(&output.stderr)));
+        }
+        let merged = std::fs::read(&partial)?;
+        std::fs::remove_file(&partial).ok();
+        merged
+    };
+
+    let mut hasher = DefaultHasher::new();
+    merged.hash(&mut hasher);
+    let indexed = cache_dir.join(format!("profile-{:016x}.profdata", hasher.finish()));
+    if !indexed.exists() {
+        let partial = indexed.with_extension(format!("profdata.{}", std::process::id()));
+        std::fs::write(&partial, &merged)?;
+        std::fs::rename(&partial, &indexed)?;
+    }
+    Ok(indexed)
+}
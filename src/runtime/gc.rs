@@ -1,15 +1,28 @@
 //! # Garbage Collection
 //! 
-//! Memory management and garbage collection for YAF Language runtime
+//! Memory management and garbage collection for YAF Language runtime.
+//!
+//! Compiled programs use the precise mark-sweep collector in
+//! `runtime/yaf_runtime.c`: the LLVM backend registers every variable slot
+//! with `yaf_gc_add_root` and polls `yaf_gc_collect_if_needed` at function
+//! entry and loop back-edges. This module only tracks host-side allocations.
+//!
+//! Allocations are spread over `SHARDS` independently locked maps by id, so
+//! threads registering at the same time rarely contend, and ids come from an
+//! atomic counter rather than a lock.
 
 use crate::error::Result;
 use std::collections::HashMap;
 use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// Number of independently locked allocation maps
+const SHARDS: usize = 16;
 
 /// Garbage collector for managing memory allocations
 pub struct GarbageCollector {
-    allocations: Mutex<HashMap<usize, AllocationInfo>>,
-    next_id: Mutex<usize>,
+    shards: [Mutex<HashMap<usize, AllocationInfo>>; SHARDS],
+    next_id: AtomicUsize,
 }
 
 /// Information about an allocation
@@ -20,7 +33,8 @@ pub struct AllocationInfo {
     marked: bool,
 }
 
-// Safety: We're using this in a single-threaded context with careful synchronization
+// Safety: the pointer is only recorded, never dereferenced, and every access
+// goes through the shard's lock
 unsafe impl Send for AllocationInfo {}
 unsafe impl Sync for AllocationInfo {}
 
@@ -29,20 +43,20 @@ impl GarbageCollector {
     /// Create a new garbage collector
     pub fn new() -> Self {
         GarbageCollector {
-            allocations: Mutex::new(HashMap::new()),
-            next_id: Mutex::new(0),
+            shards: std::array::from_fn(|_| Mutex::new(HashMap::new())),
+            next_id: AtomicUsize::new(0),
         }
     }
     
+    fn shard(&self, id: usize) -> &Mutex<HashMap<usize, AllocationInfo>> {
+        &self.shards[id % SHARDS]
+    }
+    
     /// Register a new allocation
     pub fn register_allocation(&self, ptr: *mut u8, size: usize) -> usize {
-        let mut allocations = self.allocations.lock().unwrap();
-        let mut next_id = self.next_id.lock().unwrap();
+        let id = self.next_id.fetch_add(1, Ordering::Relaxed);
         
-        let id = *next_id;
-        *next_id += 1;
-        
-        allocations.insert(id, AllocationInfo {
+        self.shard(id).lock().unwrap().insert(id, AllocationInfo {
             size,
             ptr,
             marked: false,
@@ -53,44 +67,43 @@ impl GarbageCollector {
     
     /// Mark allocation as reachable
     pub fn mark_allocation(&self, id: usize) {
-        let mut allocations = self.allocations.lock().unwrap();
+        let mut allocations = self.shard(id).lock().unwrap();
         if let Some(alloc) = allocations.get_mut(&id) {
             alloc.marked = true;
         }
     }
     
-    /// Sweep unreachable allocations
+    /// Sweep unreachable allocations, one shard at a time
     pub fn sweep(&self) -> Result<usize> {
-        let mut allocations = self.allocations.lock().unwrap();
         let mut freed_count = 0;
         
-        allocations.retain(|_, alloc| {
-            if !alloc.marked {
-                // Free the memory (in a real implementation)
-                freed_count += 1;
-                false
-            } else {
-                // Reset mark for next cycle
-                alloc.marked = false;
-                true
-            }
-        });
+        for shard in &self.shards {
+            shard.lock().unwrap().retain(|_, alloc| {
+                if !alloc.marked {
+                    // Free the memory (in a real implementation)
+                    freed_count += 1;
+                    false
+                } else {
+                    // Reset mark for next cycle
+                    alloc.marked = false;
+                    true
+                }
+            });
+        }
         
         Ok(freed_count)
     }
     
     /// Get total number of allocations
     pub fn allocation_count(&self) -> usize {
-        self.allocations.lock().unwrap().len()
+        self.shards.iter().map(|shard| shard.lock().unwrap().len()).sum()
     }
     
     /// Get total allocated bytes
     pub fn total_allocated(&self) -> usize {
-        self.allocations
-            .lock()
-            .unwrap()
-            .values()
-            .map(|alloc| alloc.size)
+        self.shards
+            .iter()
+            .map(|shard| shard.lock().unwrap().values().map(|alloc| alloc.size).sum::<usize>())
             .sum()
     }
 }
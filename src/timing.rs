@@ -0,0 +1,104 @@
+//! # Pass timing
+//!
+//! Wall time and heap allocations of each compiler phase, for
+//! `yaf compile --time-passes` and the compiler benchmarks. Allocations are
+//! counted by `CountingAllocator` when it is installed as the global
+//! allocator; otherwise those columns stay at zero.
+
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::time::{Duration, Instant};
+
+static ALLOCATIONS: AtomicU64 = AtomicU64::new(0);
+static ALLOCATED_BYTES: AtomicU64 = AtomicU64::new(0);
+
+/// The system allocator plus two relaxed counters
+pub struct CountingAllocator;
+
+unsafe impl GlobalAlloc for CountingAllocator {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(layout.size() as u64, Ordering::Relaxed);
+        System.alloc(layout)
+    }
+
+    unsafe fn alloc_zeroed(&self, layout: Layout) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(layout.size() as u64, Ordering::Relaxed);
+        System.alloc_zeroed(layout)
+    }
+
+    unsafe fn realloc(&self, ptr: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        ALLOCATIONS.fetch_add(1, Ordering::Relaxed);
+        ALLOCATED_BYTES.fetch_add(new_size.saturating_sub(layout.size()) as u64, Ordering::Relaxed);
+        System.realloc(ptr, layout, new_size)
+    }
+
+    unsafe fn dealloc(&self, ptr: *mut u8, layout: Layout) {
+        System.dealloc(ptr, layout)
+    }
+}
+
+/// Allocation count and bytes allocated so far by this process
+pub fn allocation_counters() -> (u64, u64) {
+    (ALLOCATIONS.load(Ordering::Relaxed), ALLOCATED_BYTES.load(Ordering::Relaxed))
+}
+
+#[derive(Debug, Clone)]
+pub struct PassTiming {
+    pub name: &'static str,
+    pub duration: Duration,
+    pub allocations: u64,
+    pub bytes: u64,
+}
+
+/// Per-phase measurements. When disabled, `time` just runs the closure.
+pub struct PassTimings {
+    enabled: bool,
+    passes: Vec<PassTiming>,
+}
+
+impl PassTimings {
+    pub fn new(enabled: bool) -> Self {
+        PassTimings { enabled, passes: Vec::new() }
+    }
+
+    pub fn time<T>(&mut self, name: &'static str, pass: impl FnOnce() -> T) -> T {
+        if !self.enabled {
+            return pass();
+        }
+        let (allocations, bytes) = allocation_counters();
+        let start = Instant::now();
+        let result = pass();
+        let duration = start.elapsed();
+        let (allocations_after, bytes_after) = allocation_counters();
+        self.passes.push(PassTiming {
+            name,
+            duration,
+            allocations: allocations_after - allocations,
+            bytes: bytes_after - bytes,
+        });
+        result
+    }
+
+    // Read by benches/compiler.rs
+    #[allow(dead_code)]
+    pub fn passes(&self) -> &[PassTiming] {
+        &self.passes
+    }
+
+    /// Table of the recorded passes, in the order they ran
+    pub fn report(&self) -> String {
+        let total: Duration = self.passes.iter().map(|pass| pass.duration).sum();
+        let mut report = format!("{:<16} {:>12} {:>7} {:>12} {:>14}\n", "pass", "time", "%", "allocs", "bytes");
+        for pass in &self.passes {
+            let share = if total.is_zero() { 0.0 } else { 100.0 * pass.duration.as_secs_f64() / total.as_secs_f64() };
+            report.push_str(&format!(
+                "{:<16} {:>9.3} ms {:>6.1}% {:>12} {:>14}\n",
+                pass.name, pass.duration.as_secs_f64() * 1000.0, share, pass.allocations, pass.bytes
+            ));
+        }
+        report.push_str(&format!("{:<16} {:>9.3} ms", "total", total.as_secs_f64() * 1000.0));
+        report
+    }
+}